@@ -0,0 +1,438 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analytics.h"
+#include "parallel.h"
+#include "simd_kernels.h"
+
+#define PAGE_RANK_BLOCK_BIT_WIDTH 16
+
+#if (1 << PAGE_RANK_BLOCK_BIT_WIDTH) != PAGE_RANK_BLOCK_VERTEX_COUNT
+#error "PAGE_RANK_BLOCK_VERTEX_COUNT must be 1 << PAGE_RANK_BLOCK_BIT_WIDTH"
+#endif
+
+static inline EntityId pairKey(EntityPair pair) {
+  return (EntityId)(pair >> ENTITY_PAIR_HALF_BIT_COUNT);
+}
+
+static inline EntityId pairValue(EntityPair pair) {
+  return (EntityId)(pair & ENTITY_PAIR_HALF_MASK);
+}
+
+// the first position of sorted pairs whose key is >= key
+static inline unsigned long keyPosition(EntityPair *pairs, unsigned long count, unsigned long long key) {
+  return lowerBoundEntityPairs(pairs, 0, count, (EntityPair)key << ENTITY_PAIR_HALF_BIT_COUNT);
+}
+
+// leaves the entry as one sorted run in each order and returns its vertex count
+unsigned long prepareAnalyticsEntry(PredicateEntry *entry) {
+  assert(!isCompressedPredicateEntry(entry));
+  if (predicateEntryUnsortedCount(entry) > 0 || entry->deltaSortedCount > 0 || entry->tombstoneCount > 0) {
+    compactPredicateEntry(entry);
+  }
+  if (entry->entryCount == 0) {
+    return 0;
+  }
+  unsigned long long subjects = (unsigned long long)pairKey(entry->soEntries[entry->entryCount - 1]) + 1;
+  unsigned long long objects = (unsigned long long)pairKey(entry->osEntries[entry->entryCount - 1]) + 1;
+  return (subjects > objects) ? subjects : objects;
+}
+
+/*
+  PageRank
+*/
+
+void initPageRankOptions(PageRankOptions *options) {
+  options->threadCount = 0;
+  options->damping = PAGE_RANK_DEFAULT_DAMPING;
+  options->maxIterations = PAGE_RANK_DEFAULT_MAX_ITERATIONS;
+  options->tolerance = PAGE_RANK_DEFAULT_TOLERANCE;
+}
+
+/*
+  Past one block of vertices the in-edges are also laid out segmented (CSR segmenting, Zhang et al.):
+  segment s holds the edges whose source is in block s, grouped by destination, so summing a segment
+  reads only that block's contributions. Segments follow each other, and within one the destinations
+  ascend, each with the end of its sources; a thread owns the same destination range in every segment.
+*/
+typedef struct {
+  unsigned long segmentCount;
+  // the edges' sources, segment by segment
+  EntityId *sources;
+  // one per destination of each segment, in the same order
+  EntityId *destinations;
+  unsigned long *sourceEnds;
+  // segmentCount * threadCount + 1 starts in destinations: segment s, thread t at [s * threadCount + t]
+  unsigned long *starts;
+} PageRankSegments;
+
+typedef struct {
+  EntityPair *soPairs;
+  EntityPair *osPairs;
+  unsigned long pairCount;
+  unsigned long vertexCount;
+  int threadCount;
+  // threadCount + 1 vertex bounds, placed so each thread pulls about as many edges
+  unsigned long *bounds;
+
+  unsigned long *outDegrees;
+  double *ranks;
+  double *contributions;
+  double *next;
+  PageRankSegments *segments;
+
+  double damping;
+  // what every vertex gets before its in-edges: the teleport and the dangling vertices' share
+  double base;
+  // per thread
+  double *danglingRanks;
+  double *changes;
+  // per thread and segment while building the segments: edges and destinations, then their starts
+  unsigned long *segmentEdges;
+  unsigned long *segmentDestinations;
+  BOOL placing;
+} PageRankRun;
+
+void pageRankDegreesTask(int threadIndex, int threadCount, void *context) {
+  PageRankRun *run = (PageRankRun *)context;
+  (void)threadCount;
+  unsigned long begin = run->bounds[threadIndex];
+  unsigned long end = run->bounds[threadIndex + 1];
+  unsigned long position = keyPosition(run->soPairs, run->pairCount, begin);
+  for (unsigned long v = begin; v < end; v++) {
+    unsigned long runStart = position;
+    while (position < run->pairCount && pairKey(run->soPairs[position]) == v) {
+      position++;
+    }
+    run->outDegrees[v] = position - runStart;
+  }
+}
+
+// counting fills the thread's row of segmentEdges and segmentDestinations; placing writes from their starts
+void pageRankSegmentsTask(int threadIndex, int threadCount, void *context) {
+  PageRankRun *run = (PageRankRun *)context;
+  PageRankSegments *segments = run->segments;
+  unsigned long *edges = run->segmentEdges + threadIndex * segments->segmentCount;
+  unsigned long *destinations = run->segmentDestinations + threadIndex * segments->segmentCount;
+  (void)threadCount;
+  unsigned long position = keyPosition(run->osPairs, run->pairCount, run->bounds[threadIndex]);
+  unsigned long end = keyPosition(run->osPairs, run->pairCount, run->bounds[threadIndex + 1]);
+  EntityId lastDestination = 0;
+  unsigned long lastSegment = segments->segmentCount;
+  for (; position < end; position++) {
+    EntityId destination = pairKey(run->osPairs[position]);
+    EntityId source = pairValue(run->osPairs[position]);
+    unsigned long segment = (unsigned long)source >> PAGE_RANK_BLOCK_BIT_WIDTH;
+    // a destination's sources ascend, so its edges from one segment are adjacent
+    BOOL opens = destination != lastDestination || segment != lastSegment;
+    lastDestination = destination;
+    lastSegment = segment;
+    if (!run->placing) {
+      edges[segment]++;
+      destinations[segment] += opens;
+      continue;
+    }
+    if (opens) {
+      segments->destinations[destinations[segment]++] = destination;
+    }
+    segments->sources[edges[segment]] = source;
+    segments->sourceEnds[destinations[segment] - 1] = ++edges[segment];
+  }
+}
+
+PageRankSegments *createPageRankSegments(PageRankRun *run) {
+  int threadCount = run->threadCount;
+  PageRankSegments *segments = malloc(sizeof(PageRankSegments));
+  segments->segmentCount = ((run->vertexCount - 1) >> PAGE_RANK_BLOCK_BIT_WIDTH) + 1;
+  unsigned long cellCount = segments->segmentCount * threadCount;
+  run->segments = segments;
+  run->segmentEdges = calloc(cellCount, sizeof(unsigned long));
+  run->segmentDestinations = calloc(cellCount, sizeof(unsigned long));
+  run->placing = 0;
+  runParallel(threadCount, &pageRankSegmentsTask, run);
+
+  // segment-major starts, so each thread's part of a segment follows the previous thread's
+  segments->starts = malloc(sizeof(unsigned long) * (cellCount + 1));
+  unsigned long edgeCount = 0;
+  unsigned long destinationCount = 0;
+  for (unsigned long s = 0; s < segments->segmentCount; s++) {
+    for (int t = 0; t < threadCount; t++) {
+      unsigned long cell = t * segments->segmentCount + s;
+      unsigned long edges = run->segmentEdges[cell];
+      unsigned long destinations = run->segmentDestinations[cell];
+      segments->starts[s * threadCount + t] = destinationCount;
+      run->segmentEdges[cell] = edgeCount;
+      run->segmentDestinations[cell] = destinationCount;
+      edgeCount += edges;
+      destinationCount += destinations;
+    }
+  }
+  segments->starts[cellCount] = destinationCount;
+  segments->sources = malloc(sizeof(EntityId) * (edgeCount + 1));
+  segments->destinations = malloc(sizeof(EntityId) * (destinationCount + 1));
+  segments->sourceEnds = malloc(sizeof(unsigned long) * (destinationCount + 1));
+  run->placing = 1;
+  runParallel(threadCount, &pageRankSegmentsTask, run);
+  free(run->segmentEdges);
+  free(run->segmentDestinations);
+  return segments;
+}
+
+void freePageRankSegments(PageRankSegments *segments) {
+  free(segments->sources);
+  free(segments->destinations);
+  free(segments->sourceEnds);
+  free(segments->starts);
+  free(segments);
+}
+
+void pageRankContributionsTask(int threadIndex, int threadCount, void *context) {
+  PageRankRun *run = (PageRankRun *)context;
+  (void)threadCount;
+  double dangling = 0;
+  for (unsigned long v = run->bounds[threadIndex]; v < run->bounds[threadIndex + 1]; v++) {
+    if (run->outDegrees[v] == 0) {
+      dangling += run->ranks[v];
+      run->contributions[v] = 0;
+    } else {
+      run->contributions[v] = run->ranks[v] / run->outDegrees[v];
+    }
+  }
+  run->danglingRanks[threadIndex] = dangling;
+}
+
+void pageRankPullTask(int threadIndex, int threadCount, void *context) {
+  PageRankRun *run = (PageRankRun *)context;
+  unsigned long begin = run->bounds[threadIndex];
+  unsigned long end = run->bounds[threadIndex + 1];
+  double *contributions = run->contributions;
+  double *next = run->next;
+  if (run->segments == NULL) {
+    unsigned long position = keyPosition(run->osPairs, run->pairCount, begin);
+    for (unsigned long v = begin; v < end; v++) {
+      double sum = 0;
+      for (; position < run->pairCount && pairKey(run->osPairs[position]) == v; position++) {
+        sum += contributions[pairValue(run->osPairs[position])];
+      }
+      next[v] = sum;
+    }
+  } else {
+    PageRankSegments *segments = run->segments;
+    memset(next + begin, 0, sizeof(double) * (end - begin));
+    for (unsigned long s = 0; s < segments->segmentCount; s++) {
+      unsigned long cell = s * threadCount + threadIndex;
+      unsigned long k = segments->starts[cell];
+      unsigned long source = (k == 0) ? 0 : segments->sourceEnds[k - 1];
+      for (; k < segments->starts[cell + 1]; k++) {
+        double sum = 0;
+        for (; source < segments->sourceEnds[k]; source++) {
+          sum += contributions[segments->sources[source]];
+        }
+        next[segments->destinations[k]] += sum;
+      }
+    }
+  }
+  double change = 0;
+  for (unsigned long v = begin; v < end; v++) {
+    next[v] = run->base + run->damping * next[v];
+    change += (next[v] > run->ranks[v]) ? next[v] - run->ranks[v] : run->ranks[v] - next[v];
+  }
+  run->changes[threadIndex] = change;
+}
+
+// vertex bounds at evenly spaced positions of osEntries, so every thread pulls about as many edges
+void placePageRankBounds(PageRankRun *run) {
+  run->bounds[0] = 0;
+  for (int t = 1; t < run->threadCount; t++) {
+    unsigned long position = run->pairCount / run->threadCount * t;
+    unsigned long bound = (position < run->pairCount) ? pairKey(run->osPairs[position]) : run->vertexCount;
+    run->bounds[t] = (bound > run->bounds[t - 1]) ? bound : run->bounds[t - 1];
+  }
+  run->bounds[run->threadCount] = run->vertexCount;
+}
+
+PageRankResult *computePageRank(PredicateEntry *entry, PageRankOptions *options) {
+  assert(options->damping >= 0 && options->damping <= 1);
+  PageRankResult *result = malloc(sizeof(PageRankResult));
+  result->vertexCount = prepareAnalyticsEntry(entry);
+  result->ranks = malloc(sizeof(double) * (result->vertexCount + 1));
+  result->iterations = 0;
+  result->change = 0;
+  if (result->vertexCount == 0) {
+    return result;
+  }
+
+  PageRankRun run;
+  run.soPairs = entry->soEntries;
+  run.osPairs = entry->osEntries;
+  run.pairCount = entry->entryCount;
+  run.vertexCount = result->vertexCount;
+  run.threadCount = (options->threadCount < 1) ? availableThreadCount() : options->threadCount;
+  run.bounds = malloc(sizeof(unsigned long) * (run.threadCount + 1));
+  placePageRankBounds(&run);
+  run.outDegrees = malloc(sizeof(unsigned long) * run.vertexCount);
+  run.ranks = result->ranks;
+  run.contributions = malloc(sizeof(double) * run.vertexCount);
+  run.next = malloc(sizeof(double) * run.vertexCount);
+  run.damping = options->damping;
+  run.danglingRanks = malloc(sizeof(double) * run.threadCount);
+  run.changes = malloc(sizeof(double) * run.threadCount);
+  run.segments = NULL;
+  runParallel(run.threadCount, &pageRankDegreesTask, &run);
+  if (run.vertexCount > PAGE_RANK_BLOCK_VERTEX_COUNT) {
+    createPageRankSegments(&run);
+  }
+
+  for (unsigned long v = 0; v < run.vertexCount; v++) {
+    run.ranks[v] = 1.0 / run.vertexCount;
+  }
+  while (result->iterations < options->maxIterations) {
+    runParallel(run.threadCount, &pageRankContributionsTask, &run);
+    double dangling = 0;
+    for (int t = 0; t < run.threadCount; t++) {
+      dangling += run.danglingRanks[t];
+    }
+    run.base = (1 - run.damping) / run.vertexCount + run.damping * dangling / run.vertexCount;
+    runParallel(run.threadCount, &pageRankPullTask, &run);
+    result->change = 0;
+    for (int t = 0; t < run.threadCount; t++) {
+      result->change += run.changes[t];
+    }
+    double *ranks = run.ranks;
+    run.ranks = run.next;
+    run.next = ranks;
+    result->iterations++;
+    if (result->change < options->tolerance) {
+      break;
+    }
+  }
+  // the ranks may have ended up in the scratch array
+  if (run.ranks != result->ranks) {
+    memcpy(result->ranks, run.ranks, sizeof(double) * run.vertexCount);
+    run.next = run.ranks;
+  }
+
+  if (run.segments != NULL) {
+    freePageRankSegments(run.segments);
+  }
+  free(run.bounds);
+  free(run.outDegrees);
+  free(run.contributions);
+  free(run.next);
+  free(run.danglingRanks);
+  free(run.changes);
+  return result;
+}
+
+void freePageRankResult(PageRankResult *result) {
+  free(result->ranks);
+  free(result);
+}
+
+/*
+  Weakly connected components
+*/
+
+typedef struct {
+  EntityPair *pairs;
+  unsigned long pairCount;
+  unsigned long vertexCount;
+  EntityId *parents;
+  unsigned long *roots;
+} ComponentsRun;
+
+// hooks the root of one side under the root of the other, the larger under the smaller, so the
+// root of every tree is its smallest vertex; a failed swap means another thread moved a root first
+static inline void linkComponents(EntityId *parents, EntityId u, EntityId v) {
+  EntityId a = __atomic_load_n(&parents[u], __ATOMIC_RELAXED);
+  EntityId b = __atomic_load_n(&parents[v], __ATOMIC_RELAXED);
+  while (a != b) {
+    EntityId high = (a > b) ? a : b;
+    EntityId low = (a > b) ? b : a;
+    EntityId highParent = __atomic_load_n(&parents[high], __ATOMIC_RELAXED);
+    if (highParent == low) {
+      return;
+    }
+    if (highParent == high) {
+      EntityId expected = high;
+      if (__atomic_compare_exchange_n(&parents[high], &expected, low, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+      }
+    }
+    a = __atomic_load_n(&parents[__atomic_load_n(&parents[high], __ATOMIC_RELAXED)], __ATOMIC_RELAXED);
+    b = __atomic_load_n(&parents[low], __ATOMIC_RELAXED);
+  }
+}
+
+void initComponentsTask(int threadIndex, int threadCount, void *context) {
+  ComponentsRun *run = (ComponentsRun *)context;
+  unsigned long begin;
+  unsigned long end;
+  parallelChunk(run->vertexCount, threadIndex, threadCount, &begin, &end);
+  for (unsigned long v = begin; v < end; v++) {
+    run->parents[v] = (EntityId)v;
+  }
+}
+
+void linkComponentsTask(int threadIndex, int threadCount, void *context) {
+  ComponentsRun *run = (ComponentsRun *)context;
+  unsigned long begin;
+  unsigned long end;
+  parallelChunk(run->pairCount, threadIndex, threadCount, &begin, &end);
+  for (unsigned long i = begin; i < end; i++) {
+    linkComponents(run->parents, pairKey(run->pairs[i]), pairValue(run->pairs[i]));
+  }
+}
+
+// once every edge is linked the trees only get shallower, so threads can shortcut them concurrently
+void compressComponentsTask(int threadIndex, int threadCount, void *context) {
+  ComponentsRun *run = (ComponentsRun *)context;
+  EntityId *parents = run->parents;
+  unsigned long begin;
+  unsigned long end;
+  parallelChunk(run->vertexCount, threadIndex, threadCount, &begin, &end);
+  unsigned long roots = 0;
+  for (unsigned long v = begin; v < end; v++) {
+    EntityId parent = __atomic_load_n(&parents[v], __ATOMIC_RELAXED);
+    EntityId grandparent = __atomic_load_n(&parents[parent], __ATOMIC_RELAXED);
+    while (parent != grandparent) {
+      parent = grandparent;
+      grandparent = __atomic_load_n(&parents[parent], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&parents[v], parent, __ATOMIC_RELAXED);
+    roots += parent == v;
+  }
+  run->roots[threadIndex] = roots;
+}
+
+ComponentsResult *computeConnectedComponents(PredicateEntry *entry, int threadCount) {
+  if (threadCount < 1) {
+    threadCount = availableThreadCount();
+  }
+  ComponentsResult *result = malloc(sizeof(ComponentsResult));
+  result->vertexCount = prepareAnalyticsEntry(entry);
+  result->labels = malloc(sizeof(EntityId) * (result->vertexCount + 1));
+  result->componentCount = 0;
+
+  ComponentsRun run;
+  run.pairs = entry->soEntries;
+  run.pairCount = entry->entryCount;
+  run.vertexCount = result->vertexCount;
+  run.parents = result->labels;
+  run.roots = malloc(sizeof(unsigned long) * threadCount);
+  runParallel(threadCount, &initComponentsTask, &run);
+  runParallel(threadCount, &linkComponentsTask, &run);
+  runParallel(threadCount, &compressComponentsTask, &run);
+  for (int t = 0; t < threadCount; t++) {
+    result->componentCount += run.roots[t];
+  }
+  free(run.roots);
+  return result;
+}
+
+void freeComponentsResult(ComponentsResult *result) {
+  free(result->labels);
+  free(result);
+}
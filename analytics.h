@@ -0,0 +1,65 @@
+#ifndef ANALYTICS_H_INCLUDED
+#define ANALYTICS_H_INCLUDED
+
+#include "triple.h"
+#include "predicate_entry.h"
+
+/*
+  Whole-graph kernels over one predicate's edges, subject to object, read straight from the
+  entry's sorted pair arrays: the only allocations are a few arrays of one value per vertex.
+  Vertices are the ids 0 .. vertexCount - 1, subjects and objects alike, as for traversals.
+
+  The entry must be optimized and not compressed. Pairs added since the last optimize or
+  removed since the last compaction are compacted in first, so run the kernels between
+  queries, as for compactSegment.
+*/
+
+/* PageRank */
+
+#define PAGE_RANK_DEFAULT_DAMPING 0.85
+#define PAGE_RANK_DEFAULT_MAX_ITERATIONS 20
+#define PAGE_RANK_DEFAULT_TOLERANCE 1e-6
+
+// pulling sums each vertex's in-edges from osEntries, which hold them contiguously; the contributions
+// they read are spread over the whole vertex range, so past this many vertices the pull is done one
+// block of sources at a time, keeping the block's contributions in cache
+#define PAGE_RANK_BLOCK_VERTEX_COUNT 65536
+
+typedef struct {
+  // < 1 uses availableThreadCount()
+  int threadCount;
+  double damping;
+  int maxIterations;
+  // stops once the ranks move less than this in total (L1) in one iteration
+  double tolerance;
+} PageRankOptions;
+
+typedef struct {
+  unsigned long vertexCount;
+  // sum to 1; the rank of vertices without out-edges is spread over all vertices
+  double *ranks;
+  int iterations;
+  // of the last iteration
+  double change;
+} PageRankResult;
+
+void initPageRankOptions(PageRankOptions *options);
+PageRankResult *computePageRank(PredicateEntry *entry, PageRankOptions *options);
+void freePageRankResult(PageRankResult *result);
+
+/* Weakly connected components */
+
+typedef struct {
+  unsigned long vertexCount;
+  // the smallest vertex of each vertex's component; ids without edges are components of their own
+  EntityId *labels;
+  unsigned long componentCount;
+} ComponentsResult;
+
+// concurrent union-find: every thread links the edges of its share of soEntries, always hooking the
+// larger root under the smaller with one compare and swap, so no edge needs a lock
+// threadCount < 1 uses availableThreadCount()
+ComponentsResult *computeConnectedComponents(PredicateEntry *entry, int threadCount);
+void freeComponentsResult(ComponentsResult *result);
+
+#endif
@@ -0,0 +1,135 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+/* Arena */
+
+struct ArenaChunk_t {
+  ArenaChunk *next;
+  unsigned long length;
+  // two words ahead of it keep data aligned to ARENA_ALIGNMENT on 64-bit targets
+  unsigned char data[];
+};
+
+static inline unsigned long alignArenaSize(unsigned long size) {
+  return ARENA_ALIGN(size);
+}
+
+ArenaChunk *createArenaChunk(unsigned long length) {
+  ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + length);
+  chunk->next = NULL;
+  chunk->length = length;
+  return chunk;
+}
+
+Arena *createArena(unsigned long chunkLength) {
+  Arena *arena = malloc(sizeof(Arena));
+  arena->chunkLength = alignArenaSize(chunkLength > 0 ? chunkLength : ARENA_DEFAULT_CHUNK_LENGTH);
+  arena->first = createArenaChunk(arena->chunkLength);
+  arena->current = arena->first;
+  arena->used = 0;
+  return arena;
+}
+
+void freeArenaChunks(ArenaChunk *chunk) {
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+}
+
+void freeArena(Arena *arena) {
+  freeArenaChunks(arena->first);
+  free(arena);
+}
+
+void resetArena(Arena *arena) {
+  // a query that outgrew the first chunk once will likely do so again, but bounding
+  // the retained memory matters more than the occasional malloc
+  freeArenaChunks(arena->first->next);
+  arena->first->next = NULL;
+  arena->current = arena->first;
+  arena->used = 0;
+}
+
+void *arenaAllocate(Arena *arena, unsigned long size) {
+  size = alignArenaSize(size);
+  if (arena->used + size > arena->current->length) {
+    // oversized requests get a chunk of their own
+    ArenaChunk *chunk = createArenaChunk(size > arena->chunkLength ? size : arena->chunkLength);
+    arena->current->next = chunk;
+    arena->current = chunk;
+    arena->used = 0;
+  }
+  void *allocation = arena->current->data + arena->used;
+  arena->used += size;
+  return allocation;
+}
+
+unsigned long arenaMemoryUsage(Arena *arena) {
+  unsigned long usage = sizeof(Arena);
+  for (ArenaChunk *chunk = arena->first; chunk != NULL; chunk = chunk->next) {
+    usage += sizeof(ArenaChunk) + chunk->length;
+  }
+  return usage;
+}
+
+/* Slab pool */
+
+void initSlabPool(SlabPool *pool, unsigned long itemSize, unsigned long itemsPerSlab) {
+  assert(itemsPerSlab > 0);
+  pool->itemSize = SLAB_POOL_ITEM_SIZE(itemSize);
+  pool->itemsPerSlab = itemsPerSlab;
+  pool->freeList = NULL;
+  pool->slabs = NULL;
+  pool->slabCount = 0;
+  pool->currentSlabsLength = 0;
+  pthread_mutex_init(&pool->lock, NULL);
+}
+
+void destroySlabPool(SlabPool *pool) {
+  for (unsigned long i = 0; i < pool->slabCount; i++) {
+    free(pool->slabs[i]);
+  }
+  free(pool->slabs);
+  pool->slabs = NULL;
+  pool->slabCount = 0;
+  pool->currentSlabsLength = 0;
+  pool->freeList = NULL;
+  pthread_mutex_destroy(&pool->lock);
+}
+
+void addSlab(SlabPool *pool) {
+  if (pool->slabCount == pool->currentSlabsLength) {
+    pool->currentSlabsLength = (pool->currentSlabsLength > 0) ? pool->currentSlabsLength * 2 : 16;
+    pool->slabs = realloc(pool->slabs, sizeof(void *) * pool->currentSlabsLength);
+  }
+  unsigned char *slab = malloc(pool->itemSize * pool->itemsPerSlab);
+  pool->slabs[pool->slabCount++] = slab;
+  // thread the new items onto the free list in address order
+  for (unsigned long i = pool->itemsPerSlab; i > 0; i--) {
+    void **item = (void **)(slab + pool->itemSize * (i - 1));
+    *item = pool->freeList;
+    pool->freeList = item;
+  }
+}
+
+void *slabAllocate(SlabPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->freeList == NULL) {
+    addSlab(pool);
+  }
+  void **item = pool->freeList;
+  pool->freeList = *item;
+  pthread_mutex_unlock(&pool->lock);
+  return item;
+}
+
+void slabFree(SlabPool *pool, void *item) {
+  pthread_mutex_lock(&pool->lock);
+  *(void **)item = pool->freeList;
+  pool->freeList = item;
+  pthread_mutex_unlock(&pool->lock);
+}
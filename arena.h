@@ -0,0 +1,61 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <pthread.h>
+
+/*
+  Arena: a bump allocator for short-lived objects that die together, e.g. the iterator
+  tree of one query. Allocations are carved consecutively out of chunks, so a tree built
+  in one go sits in a few adjacent cache lines, and resetArena releases everything at once.
+  Single-threaded; use one arena per query or per worker.
+*/
+
+// enough for EntityPair and every other type stored in arenas
+#define ARENA_ALIGNMENT 16
+#define ARENA_DEFAULT_CHUNK_LENGTH 4096
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~((unsigned long)ARENA_ALIGNMENT - 1))
+
+struct ArenaChunk_t;
+typedef struct ArenaChunk_t ArenaChunk;
+
+typedef struct {
+  ArenaChunk *first;
+  ArenaChunk *current;
+  unsigned long used;
+  unsigned long chunkLength;
+} Arena;
+
+Arena *createArena(unsigned long chunkLength);
+void freeArena(Arena *arena);
+// frees everything allocated so far; keeps the first chunk, so a reused arena stops calling malloc
+void resetArena(Arena *arena);
+void *arenaAllocate(Arena *arena, unsigned long size);
+unsigned long arenaMemoryUsage(Arena *arena);
+
+/*
+  Slab pool: fixed-size items handed out from slabs of itemsPerSlab items, with freed
+  items kept on a free list for reuse. Slabs are only released by destroySlabPool.
+  The pool is locked, so it can back allocations made from several threads.
+*/
+typedef struct {
+  unsigned long itemSize;
+  unsigned long itemsPerSlab;
+  void *freeList;
+  void **slabs;
+  unsigned long slabCount;
+  unsigned long currentSlabsLength;
+  pthread_mutex_t lock;
+} SlabPool;
+
+// freed items hold the free list link, and items stay aligned like arena allocations
+#define SLAB_POOL_ITEM_SIZE(itemSize) ARENA_ALIGN((itemSize) > sizeof(void *) ? (itemSize) : sizeof(void *))
+// for pools with static storage, which need no initSlabPool
+#define SLAB_POOL_INITIALIZER(itemSize, itemsPerSlab) \
+  {SLAB_POOL_ITEM_SIZE(itemSize), (itemsPerSlab), NULL, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER}
+
+void initSlabPool(SlabPool *pool, unsigned long itemSize, unsigned long itemsPerSlab);
+void destroySlabPool(SlabPool *pool);
+void *slabAllocate(SlabPool *pool);
+void slabFree(SlabPool *pool, void *item);
+
+#endif
@@ -0,0 +1,596 @@
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "graph.h"
+#include "traversal.h"
+#include "analytics.h"
+
+/*
+  Benchmarks the predicate entry paths on synthetic graphs and prints one record per
+  measurement, as JSON (default) or CSV, so runs from different commits can be diffed.
+
+  Graphs have 2^scale vertices and edgeFactor * 2^scale edges:
+    uniform  endpoints drawn uniformly
+    zipf     endpoints drawn from a Zipf distribution over the vertices
+    rmat     recursive matrix (R-MAT) edges with the usual a, b, c, d = .57, .19, .19, .05
+  Vertex ids are scrambled by a bijection so hubs do not all sit at low ids. Each edge gets
+  predicate p with probability 2^-(p + 1), so entries range from half the graph to a sliver.
+
+  Every measurement runs repeats times; nsPerOp is the median, stddevPercent the spread.
+*/
+
+#define BENCH_DEFAULT_SCALE 18
+#define BENCH_DEFAULT_EDGE_FACTOR 8
+#define BENCH_DEFAULT_REPEATS 5
+#define BENCH_DEFAULT_PREDICATE_COUNT 4
+#define BENCH_DEFAULT_ZIPF_EXPONENT 1.0
+#define BENCH_MAX_LOOKUPS 1000000
+
+#define RMAT_A 0.57
+#define RMAT_B 0.19
+#define RMAT_C 0.19
+
+typedef enum {
+  UNIFORM_GRAPH,
+  ZIPF_GRAPH,
+  RMAT_GRAPH,
+  GRAPH_KIND_COUNT
+} GraphKind;
+
+static const char *graphKindNames[GRAPH_KIND_COUNT] = {"uniform", "zipf", "rmat"};
+
+typedef struct {
+  int scale;
+  int edgeFactor;
+  int repeats;
+  int predicateCount;
+  double zipfExponent;
+  unsigned long long seed;
+  BOOL csv;
+  // -1 runs every kind
+  int graphKind;
+} BenchOptions;
+
+typedef struct {
+  SubjectId subject;
+  PredicateId predicate;
+  ObjectId object;
+} BenchEdge;
+
+typedef struct {
+  GraphKind kind;
+  BenchEdge *edges;
+  unsigned long edgeCount;
+  unsigned long vertexCount;
+} BenchGraph;
+
+/* Random numbers */
+
+static unsigned long long benchRandomState;
+
+// splitmix64: fast, and good enough for graph shapes
+static unsigned long long benchRandom() {
+  unsigned long long z = (benchRandomState += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static double benchRandomUnit() {
+  return (double)(benchRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double benchNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+/* Generators */
+
+// vertexCount is a power of two, so multiplying by an odd constant permutes the ids
+static inline EntityId scrambleVertex(unsigned long long vertex, unsigned long vertexCount) {
+  return (EntityId)((vertex * 0x9E3779B97F4A7C15ULL) & (vertexCount - 1));
+}
+
+// predicate p with probability 2^-(p + 1), the last one taking the remainder
+static PredicateId randomPredicate(int predicateCount) {
+  int predicate = __builtin_ctzll(benchRandom() | (1ULL << 63));
+  return (PredicateId)((predicate < predicateCount) ? predicate : predicateCount - 1);
+}
+
+// cumulative probabilities of the vertex ranks, searched by inverse transform
+static double *createZipfTable(unsigned long vertexCount, double exponent) {
+  double *cdf = malloc(sizeof(double) * vertexCount);
+  double total = 0;
+  for (unsigned long rank = 0; rank < vertexCount; rank++) {
+    total += 1.0 / pow((double)(rank + 1), exponent);
+    cdf[rank] = total;
+  }
+  for (unsigned long rank = 0; rank < vertexCount; rank++) {
+    cdf[rank] /= total;
+  }
+  return cdf;
+}
+
+static unsigned long sampleZipf(const double *cdf, unsigned long vertexCount) {
+  double u = benchRandomUnit();
+  unsigned long low = 0;
+  unsigned long high = vertexCount - 1;
+  while (low < high) {
+    unsigned long middle = low + (high - low) / 2;
+    if (cdf[middle] < u) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+static void sampleRMAT(int scale, unsigned long long *source, unsigned long long *target) {
+  unsigned long long s = 0;
+  unsigned long long t = 0;
+  for (int bit = 0; bit < scale; bit++) {
+    double u = benchRandomUnit();
+    s <<= 1;
+    t <<= 1;
+    if (u < RMAT_A) {
+      // top left quadrant
+    } else if (u < RMAT_A + RMAT_B) {
+      t |= 1;
+    } else if (u < RMAT_A + RMAT_B + RMAT_C) {
+      s |= 1;
+    } else {
+      s |= 1;
+      t |= 1;
+    }
+  }
+  *source = s;
+  *target = t;
+}
+
+static BenchGraph generateGraph(GraphKind kind, BenchOptions *options) {
+  BenchGraph graph;
+  graph.kind = kind;
+  graph.vertexCount = 1UL << options->scale;
+  graph.edgeCount = graph.vertexCount * options->edgeFactor;
+  graph.edges = malloc(sizeof(BenchEdge) * graph.edgeCount);
+  double *zipf = (kind == ZIPF_GRAPH) ? createZipfTable(graph.vertexCount, options->zipfExponent) : NULL;
+
+  benchRandomState = options->seed;
+  for (unsigned long e = 0; e < graph.edgeCount; e++) {
+    unsigned long long source;
+    unsigned long long target;
+    if (kind == UNIFORM_GRAPH) {
+      source = benchRandom() & (graph.vertexCount - 1);
+      target = benchRandom() & (graph.vertexCount - 1);
+    } else if (kind == ZIPF_GRAPH) {
+      source = sampleZipf(zipf, graph.vertexCount);
+      target = sampleZipf(zipf, graph.vertexCount);
+    } else {
+      sampleRMAT(options->scale, &source, &target);
+    }
+    graph.edges[e].subject = scrambleVertex(source, graph.vertexCount);
+    graph.edges[e].predicate = randomPredicate(options->predicateCount);
+    graph.edges[e].object = scrambleVertex(target, graph.vertexCount);
+  }
+  free(zipf);
+  return graph;
+}
+
+/* Measurements */
+
+typedef struct {
+  BenchOptions *options;
+  BenchGraph *graph;
+  BOOL first;
+  // one timing per repeat, in ns
+  double *samples;
+} BenchRun;
+
+static int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// ops is what one repeat did, e.g. triples scanned or lookups made; bytesPerTriple < 0 is not reported
+static void reportMeasurement(BenchRun *run, const char *name, unsigned long ops, unsigned long results, double bytesPerTriple) {
+  int repeats = run->options->repeats;
+  double mean = 0;
+  for (int r = 0; r < repeats; r++) {
+    mean += run->samples[r];
+  }
+  mean /= repeats;
+  double variance = 0;
+  for (int r = 0; r < repeats; r++) {
+    variance += (run->samples[r] - mean) * (run->samples[r] - mean);
+  }
+  double stddevPercent = (repeats > 1 && mean > 0) ? 100.0 * sqrt(variance / (repeats - 1)) / mean : 0;
+  qsort(run->samples, repeats, sizeof(double), compareDoubles);
+  double median = run->samples[repeats / 2];
+  double nsPerOp = (ops > 0) ? median / ops : 0;
+  double triplesPerSecond = (median > 0) ? ops * 1e9 / median : 0;
+  double minNsPerOp = (ops > 0) ? run->samples[0] / ops : 0;
+  const char *graphName = graphKindNames[run->graph->kind];
+
+  if (run->options->csv) {
+    printf("%s,%d,%d,%lu,%s,%lu,%lu,%.3f,%.3f,%.0f,", graphName, run->options->scale, run->options->edgeFactor,
+           run->graph->edgeCount, name, ops, results, nsPerOp, minNsPerOp, triplesPerSecond);
+    if (bytesPerTriple >= 0) {
+      printf("%.2f", bytesPerTriple);
+    }
+    printf(",%.2f\n", stddevPercent);
+    return;
+  }
+  printf("%s    {\"graph\": \"%s\", \"scale\": %d, \"edgeFactor\": %d, \"triples\": %lu, \"benchmark\": \"%s\", "
+         "\"ops\": %lu, \"results\": %lu, \"nsPerOp\": %.3f, \"minNsPerOp\": %.3f, \"triplesPerSecond\": %.0f, ",
+         run->first ? "" : ",\n", graphName, run->options->scale, run->options->edgeFactor, run->graph->edgeCount, name,
+         ops, results, nsPerOp, minNsPerOp, triplesPerSecond);
+  if (bytesPerTriple >= 0) {
+    printf("\"bytesPerTriple\": %.2f, ", bytesPerTriple);
+  } else {
+    printf("\"bytesPerTriple\": null, ");
+  }
+  printf("\"repeats\": %d, \"stddevPercent\": %.2f}", repeats, stddevPercent);
+  run->first = FALSE;
+}
+
+static PredicateEntry **ingestGraph(BenchGraph *graph, int predicateCount) {
+  PredicateEntry **entries = malloc(sizeof(PredicateEntry *) * predicateCount);
+  for (int p = 0; p < predicateCount; p++) {
+    entries[p] = createPredicateEntry((PredicateId)p);
+  }
+  for (unsigned long e = 0; e < graph->edgeCount; e++) {
+    BenchEdge *edge = &graph->edges[e];
+    addToPredicateEntry(entries[edge->predicate], edge->subject, edge->object);
+  }
+  return entries;
+}
+
+static void freeEntries(PredicateEntry **entries, int predicateCount) {
+  for (int p = 0; p < predicateCount; p++) {
+    freePredicateEntry(entries[p]);
+  }
+  free(entries);
+}
+
+static double entriesBytesPerTriple(PredicateEntry **entries, int predicateCount, unsigned long tripleCount) {
+  unsigned long bytes = 0;
+  for (int p = 0; p < predicateCount; p++) {
+    bytes += predicateEntryMemoryUsage(entries[p]);
+  }
+  return (double)bytes / (double)tripleCount;
+}
+
+static unsigned long drainIterator(Iterator *iterator, Triple *batch) {
+  unsigned long count = 0;
+  iterator->init(iterator);
+  for (;;) {
+    unsigned long found = nextBatch(iterator, batch, ITERATOR_BATCH_LENGTH);
+    if (found == 0) {
+      return count;
+    }
+    count += found;
+  }
+}
+
+static void benchIngestAndOptimize(BenchRun *run) {
+  int predicateCount = run->options->predicateCount;
+  double *optimizeSamples = malloc(sizeof(double) * run->options->repeats);
+  double ingestBytes = 0;
+  double optimizeBytes = 0;
+  for (int r = 0; r < run->options->repeats; r++) {
+    double start = benchNow();
+    PredicateEntry **entries = ingestGraph(run->graph, predicateCount);
+    double ingested = benchNow();
+    ingestBytes = entriesBytesPerTriple(entries, predicateCount, run->graph->edgeCount);
+    for (int p = 0; p < predicateCount; p++) {
+      optimizePredicateEntry(entries[p]);
+    }
+    double optimized = benchNow();
+    optimizeBytes = entriesBytesPerTriple(entries, predicateCount, run->graph->edgeCount);
+    run->samples[r] = ingested - start;
+    optimizeSamples[r] = optimized - ingested;
+    freeEntries(entries, predicateCount);
+  }
+  reportMeasurement(run, "ingest", run->graph->edgeCount, run->graph->edgeCount, ingestBytes);
+  memcpy(run->samples, optimizeSamples, sizeof(double) * run->options->repeats);
+  reportMeasurement(run, "optimize", run->graph->edgeCount, run->graph->edgeCount, optimizeBytes);
+  free(optimizeSamples);
+}
+
+static void benchScans(BenchRun *run, PredicateEntry **entries, const char *name, unsigned char order) {
+  Triple *batch = malloc(sizeof(Triple) * ITERATOR_BATCH_LENGTH);
+  unsigned long count = 0;
+  for (int r = 0; r < run->options->repeats; r++) {
+    double start = benchNow();
+    count = 0;
+    for (int p = 0; p < run->options->predicateCount; p++) {
+      Iterator *iterator = createPredicateEntryOrderedIterator(entries[p], order);
+      count += drainIterator(iterator, batch);
+      iterator->free(iterator);
+    }
+    run->samples[r] = benchNow() - start;
+  }
+  reportMeasurement(run, name, count, count, entriesBytesPerTriple(entries, run->options->predicateCount, run->graph->edgeCount));
+  free(batch);
+}
+
+// b holds a fraction of the graph's edges, so the joins with the largest entry range from
+// a handful of matches to most of it
+static void benchJoins(BenchRun *run, PredicateEntry *a) {
+  static const double selectivities[] = {0.001, 0.01, 0.1, 1.0};
+  Triple *batch = malloc(sizeof(Triple) * ITERATOR_BATCH_LENGTH);
+  char name[64];
+  for (unsigned long s = 0; s < sizeof(selectivities) / sizeof(selectivities[0]); s++) {
+    unsigned long bCount = (unsigned long)(selectivities[s] * a->entryCount);
+    PredicateEntry *b = createPredicateEntryWithCapacity(a->predicate, bCount);
+    for (unsigned long i = 0; i < bCount; i++) {
+      BenchEdge *edge = &run->graph->edges[benchRandom() % run->graph->edgeCount];
+      addToPredicateEntry(b, edge->subject, edge->object);
+    }
+    optimizePredicateEntry(b);
+
+    for (int join = 0; join < 2; join++) {
+      unsigned long results = 0;
+      for (int r = 0; r < run->options->repeats; r++) {
+        double start = benchNow();
+        Iterator *aIterator = createPredicateEntryIterator(a);
+        Iterator *bIterator = createPredicateEntryIterator(b);
+        Iterator *iterator = (join == 0) ? createPredicateEntryANDIterator(aIterator, bIterator) : createPredicateEntryORIterator(aIterator, bIterator);
+        results = drainIterator(iterator, batch);
+        iterator->free(iterator);
+        run->samples[r] = benchNow() - start;
+      }
+      snprintf(name, sizeof(name), "%s_%g", (join == 0) ? "and" : "or", selectivities[s]);
+      reportMeasurement(run, name, a->entryCount + b->entryCount, results, -1);
+    }
+    freePredicateEntry(b);
+  }
+  free(batch);
+}
+
+// membership probes for pairs present and absent, without and then with a Bloom filter, and neighbor lookups
+static void benchLookups(BenchRun *run, PredicateEntry *entry) {
+  unsigned long lookupCount = (entry->entryCount < BENCH_MAX_LOOKUPS) ? entry->entryCount : BENCH_MAX_LOOKUPS;
+  EntityPair *hits = malloc(sizeof(EntityPair) * lookupCount);
+  EntityPair *misses = malloc(sizeof(EntityPair) * lookupCount);
+  for (unsigned long i = 0; i < lookupCount; i++) {
+    hits[i] = entry->soEntries[benchRandom() % entry->entryCount];
+    // ids past the vertex range are never present
+    misses[i] = toSOEntry((SubjectId)(benchRandom() % run->graph->vertexCount), (ObjectId)(run->graph->vertexCount + benchRandom() % run->graph->vertexCount));
+  }
+
+  ObjectId *objects = malloc(sizeof(ObjectId) * ITERATOR_BATCH_LENGTH);
+  unsigned long neighbors = 0;
+  for (int r = 0; r < run->options->repeats; r++) {
+    double start = benchNow();
+    neighbors = 0;
+    for (unsigned long i = 0; i < lookupCount; i++) {
+      neighbors += lookupPredicateEntrySubject(entry, subjectIdFromSOEntry(hits[i]), objects, ITERATOR_BATCH_LENGTH);
+    }
+    run->samples[r] = benchNow() - start;
+  }
+  reportMeasurement(run, "lookup_subject", lookupCount, neighbors, (double)predicateEntryMemoryUsage(entry) / (double)entry->entryCount);
+  free(objects);
+
+  static const char *names[2][2] = {{"lookup_hit", "lookup_miss"}, {"lookup_hit_bloom", "lookup_miss_bloom"}};
+  for (int bloom = 0; bloom < 2; bloom++) {
+    if (bloom) {
+      buildPredicateEntryBloomFilter(entry, BLOOM_FILTER_DEFAULT_BITS_PER_KEY);
+    }
+    double bytesPerTriple = (double)predicateEntryMemoryUsage(entry) / (double)entry->entryCount;
+    for (int kind = 0; kind < 2; kind++) {
+      EntityPair *pairs = (kind == 0) ? hits : misses;
+      unsigned long found = 0;
+      for (int r = 0; r < run->options->repeats; r++) {
+        double start = benchNow();
+        found = 0;
+        for (unsigned long i = 0; i < lookupCount; i++) {
+          found += predicateEntryHasPair(entry, subjectIdFromSOEntry(pairs[i]), objectIdFromSOEntry(pairs[i]));
+        }
+        run->samples[r] = benchNow() - start;
+      }
+      reportMeasurement(run, names[bloom][kind], lookupCount, found, bytesPerTriple);
+    }
+  }
+  free(hits);
+  free(misses);
+}
+
+// breadth-first traversals over all the predicates from the subject of a random edge, top-down only and
+// direction-optimizing; ops are the index's edges, so triplesPerSecond reads as traversed edges per second
+static void benchTraversals(BenchRun *run, PredicateEntry **entries) {
+  TraversalIndex *index = NULL;
+  for (int r = 0; r < run->options->repeats; r++) {
+    if (index != NULL) {
+      freeTraversalIndex(index);
+    }
+    double start = benchNow();
+    index = createTraversalIndex(entries, run->options->predicateCount, TRAVERSE_FORWARD, 0);
+    run->samples[r] = benchNow() - start;
+  }
+  reportMeasurement(run, "traversal_index", index->edgeCount, index->edgeCount, (double)traversalIndexMemoryUsage(index) / (double)index->edgeCount);
+
+  EntityId source = run->graph->edges[benchRandom() % run->graph->edgeCount].subject;
+  static const char *names[2] = {"bfs_top_down", "bfs"};
+  static const unsigned char strategies[2] = {TRAVERSAL_TOP_DOWN, TRAVERSAL_AUTOMATIC};
+  for (int s = 0; s < 2; s++) {
+    TraversalOptions options;
+    initTraversalOptions(&options);
+    options.strategy = strategies[s];
+    unsigned long reached = 0;
+    for (int r = 0; r < run->options->repeats; r++) {
+      double start = benchNow();
+      TraversalResult *result = traverseBreadthFirst(index, &source, 1, &options);
+      run->samples[r] = benchNow() - start;
+      reached = result->reachedCount;
+      freeTraversalResult(result);
+    }
+    reportMeasurement(run, names[s], index->edgeCount, reached, -1);
+  }
+  freeTraversalIndex(index);
+}
+
+// PageRank for its default iterations and components over one entry; ops are the edges times the passes over them
+static void benchAnalytics(BenchRun *run, PredicateEntry *entry) {
+  PageRankOptions options;
+  initPageRankOptions(&options);
+  options.tolerance = 0;
+  unsigned long vertexCount = 0;
+  for (int r = 0; r < run->options->repeats; r++) {
+    double start = benchNow();
+    PageRankResult *result = computePageRank(entry, &options);
+    run->samples[r] = benchNow() - start;
+    vertexCount = result->vertexCount;
+    freePageRankResult(result);
+  }
+  reportMeasurement(run, "pagerank", entry->entryCount * options.maxIterations, vertexCount, -1);
+
+  unsigned long componentCount = 0;
+  for (int r = 0; r < run->options->repeats; r++) {
+    double start = benchNow();
+    ComponentsResult *result = computeConnectedComponents(entry, 0);
+    run->samples[r] = benchNow() - start;
+    componentCount = result->componentCount;
+    freeComponentsResult(result);
+  }
+  reportMeasurement(run, "components", entry->entryCount, componentCount, -1);
+}
+
+static void benchGraph(BenchRun *run) {
+  benchIngestAndOptimize(run);
+
+  int predicateCount = run->options->predicateCount;
+  PredicateEntry **entries = ingestGraph(run->graph, predicateCount);
+  for (int p = 0; p < predicateCount; p++) {
+    optimizePredicateEntry(entries[p]);
+  }
+  benchScans(run, entries, "scan_subject", SUBJECT_ORDER);
+  benchScans(run, entries, "scan_object", OBJECT_ORDER);
+  // predicate 0 holds about half the edges
+  benchJoins(run, entries[0]);
+  benchLookups(run, entries[0]);
+  benchTraversals(run, entries);
+  benchAnalytics(run, entries[0]);
+  freeEntries(entries, predicateCount);
+}
+
+/* Command line */
+
+static void printUsage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--graph uniform|zipf|rmat|all] [--scale N] [--edge-factor N] [--repeats N]\n"
+          "          [--predicates N] [--zipf-exponent X] [--seed N] [--csv]\n",
+          program);
+}
+
+static BOOL parseOptions(int argc, char **argv, BenchOptions *options) {
+  static struct option longOptions[] = {
+    {"graph", required_argument, NULL, 'g'},
+    {"scale", required_argument, NULL, 's'},
+    {"edge-factor", required_argument, NULL, 'e'},
+    {"repeats", required_argument, NULL, 'r'},
+    {"predicates", required_argument, NULL, 'p'},
+    {"zipf-exponent", required_argument, NULL, 'z'},
+    {"seed", required_argument, NULL, 'S'},
+    {"csv", no_argument, NULL, 'c'},
+    {NULL, 0, NULL, 0}
+  };
+  options->scale = BENCH_DEFAULT_SCALE;
+  options->edgeFactor = BENCH_DEFAULT_EDGE_FACTOR;
+  options->repeats = BENCH_DEFAULT_REPEATS;
+  options->predicateCount = BENCH_DEFAULT_PREDICATE_COUNT;
+  options->zipfExponent = BENCH_DEFAULT_ZIPF_EXPONENT;
+  options->seed = 1;
+  options->csv = FALSE;
+  options->graphKind = -1;
+
+  int option;
+  while ((option = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+    switch (option) {
+      case 'g':
+        options->graphKind = -2;
+        for (int kind = 0; kind < GRAPH_KIND_COUNT; kind++) {
+          if (strcmp(optarg, graphKindNames[kind]) == 0) {
+            options->graphKind = kind;
+          }
+        }
+        if (strcmp(optarg, "all") == 0) {
+          options->graphKind = -1;
+        }
+        if (options->graphKind == -2) {
+          return FALSE;
+        }
+        break;
+      case 's':
+        options->scale = atoi(optarg);
+        break;
+      case 'e':
+        options->edgeFactor = atoi(optarg);
+        break;
+      case 'r':
+        options->repeats = atoi(optarg);
+        break;
+      case 'p':
+        options->predicateCount = atoi(optarg);
+        break;
+      case 'z':
+        options->zipfExponent = atof(optarg);
+        break;
+      case 'S':
+        options->seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'c':
+        options->csv = TRUE;
+        break;
+      default:
+        return FALSE;
+    }
+  }
+  // vertex ids have to fit both halves of a pair, and the joins need a predicate to themselves
+  int maxScale = (SUBJECT_BIT_WIDTH < OBJECT_BIT_WIDTH ? SUBJECT_BIT_WIDTH : OBJECT_BIT_WIDTH) - 1;
+  return optind == argc && options->scale >= 4 && options->scale <= maxScale && options->edgeFactor >= 1 &&
+    options->repeats >= 1 && options->predicateCount >= 1 && options->predicateCount <= 64 &&
+    (PredicateId)(options->predicateCount - 1) <= PREDICATE_ID_MAX && options->zipfExponent > 0;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, &options)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  BenchRun run;
+  run.options = &options;
+  run.first = TRUE;
+  run.samples = malloc(sizeof(double) * options.repeats);
+
+  if (options.csv) {
+    printf("graph,scale,edge_factor,triples,benchmark,ops,results,ns_per_op,min_ns_per_op,triples_per_second,bytes_per_triple,stddev_percent\n");
+  } else {
+    printf("[\n");
+  }
+  for (int kind = 0; kind < GRAPH_KIND_COUNT; kind++) {
+    if (options.graphKind >= 0 && options.graphKind != kind) {
+      continue;
+    }
+    BenchGraph graph = generateGraph((GraphKind)kind, &options);
+    run.graph = &graph;
+    benchGraph(&run);
+    free(graph.edges);
+    fflush(stdout);
+  }
+  if (!options.csv) {
+    printf("\n]\n");
+  }
+  free(run.samples);
+  return 0;
+}
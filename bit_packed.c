@@ -0,0 +1,52 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bit_packed.h"
+
+unsigned int bitWidthForValue(unsigned long long value) {
+  unsigned int width = 0;
+  while (value != 0) {
+    width++;
+    value >>= 1;
+  }
+  return width;
+}
+
+unsigned long bitPackedWordCount(unsigned long length, unsigned int bitWidth) {
+  return (length * bitWidth + BIT_PACKED_WORD_BIT_COUNT - 1) / BIT_PACKED_WORD_BIT_COUNT + 1;
+}
+
+void initBitPackedArray(BitPackedArray *array, unsigned long length, unsigned int bitWidth) {
+  assert(bitWidth <= BIT_PACKED_WORD_BIT_COUNT);
+  array->length = length;
+  array->bitWidth = bitWidth;
+  array->mask = (bitWidth == BIT_PACKED_WORD_BIT_COUNT) ? ~0ULL : ((1ULL << bitWidth) - 1);
+  array->words = calloc(bitPackedWordCount(length, bitWidth), sizeof(unsigned long long));
+}
+
+void destroyBitPackedArray(BitPackedArray *array) {
+  free(array->words);
+  array->words = NULL;
+  array->length = 0;
+}
+
+unsigned long bitPackedArrayMemoryUsage(const BitPackedArray *array) {
+  return bitPackedWordCount(array->length, array->bitWidth) * sizeof(unsigned long long);
+}
+
+void setBitPackedValue(BitPackedArray *array, unsigned long index, unsigned long long value) {
+  assert(index < array->length);
+  assert((value & ~array->mask) == 0);
+  if (array->bitWidth == 0) {
+    return;
+  }
+  unsigned long bit = index * array->bitWidth;
+  unsigned long word = bit / BIT_PACKED_WORD_BIT_COUNT;
+  unsigned int shift = bit % BIT_PACKED_WORD_BIT_COUNT;
+  array->words[word] = (array->words[word] & ~(array->mask << shift)) | (value << shift);
+  if (shift + array->bitWidth > BIT_PACKED_WORD_BIT_COUNT) {
+    unsigned int spill = BIT_PACKED_WORD_BIT_COUNT - shift;
+    array->words[word + 1] = (array->words[word + 1] & ~(array->mask >> spill)) | (value >> spill);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef BIT_PACKED_H_INCLUDED
+#define BIT_PACKED_H_INCLUDED
+
+// fixed-width unsigned values packed back to back into 64-bit words
+typedef struct {
+  unsigned long long *words;
+  unsigned long length;
+  unsigned int bitWidth;
+  unsigned long long mask;
+} BitPackedArray;
+
+#define BIT_PACKED_WORD_BIT_COUNT 64
+
+unsigned int bitWidthForValue(unsigned long long value);
+
+void initBitPackedArray(BitPackedArray *array, unsigned long length, unsigned int bitWidth);
+void destroyBitPackedArray(BitPackedArray *array);
+unsigned long bitPackedArrayMemoryUsage(const BitPackedArray *array);
+
+void setBitPackedValue(BitPackedArray *array, unsigned long index, unsigned long long value);
+
+// inline because iterators decode one value per triple
+static inline unsigned long long getBitPackedValue(const BitPackedArray *array, unsigned long index) {
+  unsigned long bit = index * array->bitWidth;
+  unsigned long word = bit / BIT_PACKED_WORD_BIT_COUNT;
+  unsigned int shift = bit % BIT_PACKED_WORD_BIT_COUNT;
+  unsigned long long value = array->words[word] >> shift;
+  // the words array carries one word of padding, so reading past a value's word is always safe
+  if (shift + array->bitWidth > BIT_PACKED_WORD_BIT_COUNT) {
+    value |= array->words[word + 1] << (BIT_PACKED_WORD_BIT_COUNT - shift);
+  }
+  return value & array->mask;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom_filter.h"
+
+// odd multipliers that spread the low half of the hash into one bit position per word
+static const unsigned long long bloomFilterSalts[BLOOM_FILTER_BLOCK_WORD_COUNT] = {
+  0x47B6137B44974D91ULL, 0x8824AD5BA2B7289DULL, 0x705495C72DF1424BULL, 0x9EFC49475C6BFB31ULL,
+  0x2DF1424B9EFC4947ULL, 0x5C6BFB3147B6137BULL, 0x44974D918824AD5BULL, 0xA2B7289D705495C7ULL};
+
+BloomFilter *createBloomFilter(unsigned long keyCount, unsigned int bitsPerKey) {
+  BloomFilter *filter = malloc(sizeof(BloomFilter));
+  unsigned long long bitCount = (unsigned long long)keyCount * bitsPerKey;
+  filter->blockCount = (bitCount + BLOOM_FILTER_BLOCK_BIT_COUNT - 1) / BLOOM_FILTER_BLOCK_BIT_COUNT;
+  if (filter->blockCount == 0) {
+    filter->blockCount = 1;
+  }
+  unsigned long length = sizeof(unsigned long long) * BLOOM_FILTER_BLOCK_WORD_COUNT * filter->blockCount;
+  void *words = NULL;
+  if (posix_memalign(&words, sizeof(unsigned long long) * BLOOM_FILTER_BLOCK_WORD_COUNT, length) != 0) {
+    free(filter);
+    return NULL;
+  }
+  memset(words, 0, length);
+  filter->words = words;
+  return filter;
+}
+
+void freeBloomFilter(BloomFilter *filter) {
+  free(filter->words);
+  free(filter);
+}
+
+unsigned long bloomFilterMemoryUsage(BloomFilter *filter) {
+  return sizeof(BloomFilter) + sizeof(unsigned long long) * BLOOM_FILTER_BLOCK_WORD_COUNT * filter->blockCount;
+}
+
+static inline unsigned long long *bloomFilterBlock(BloomFilter *filter, unsigned long long hash) {
+  // the high half picks the block, without a division
+  unsigned long long block = ((hash >> 32) * filter->blockCount) >> 32;
+  return filter->words + block * BLOOM_FILTER_BLOCK_WORD_COUNT;
+}
+
+static inline unsigned long long bloomFilterBit(unsigned long long hash, int word) {
+  return 1ULL << (((unsigned int)hash * bloomFilterSalts[word]) >> 58);
+}
+
+void addBloomFilterHash(BloomFilter *filter, unsigned long long hash) {
+  unsigned long long *block = bloomFilterBlock(filter, hash);
+  for (int i = 0; i < BLOOM_FILTER_BLOCK_WORD_COUNT; i++) {
+    block[i] |= bloomFilterBit(hash, i);
+  }
+}
+
+BOOL bloomFilterMayContainHash(BloomFilter *filter, unsigned long long hash) {
+  unsigned long long *block = bloomFilterBlock(filter, hash);
+  unsigned long long missing = 0;
+  // no early exit: the block is one cache line and the loop vectorizes
+  for (int i = 0; i < BLOOM_FILTER_BLOCK_WORD_COUNT; i++) {
+    missing |= bloomFilterBit(hash, i) & ~block[i];
+  }
+  return missing == 0;
+}
@@ -0,0 +1,41 @@
+#ifndef BLOOM_FILTER_H_INCLUDED
+#define BLOOM_FILTER_H_INCLUDED
+
+#include "triple.h"
+
+/*
+  Split-block Bloom filter. A key's hash picks one 64-byte block and sets one bit in each of
+  its BLOOM_FILTER_BLOCK_WORD_COUNT words, so a lookup reads a single cache line. At 10 bits
+  per key the false positive rate is about 1%.
+*/
+
+#define BLOOM_FILTER_BLOCK_WORD_COUNT 8
+#define BLOOM_FILTER_BLOCK_BIT_COUNT (BLOOM_FILTER_BLOCK_WORD_COUNT * 64)
+#define BLOOM_FILTER_DEFAULT_BITS_PER_KEY 10
+
+typedef struct {
+  // blockCount * BLOOM_FILTER_BLOCK_WORD_COUNT words, aligned to the block size
+  unsigned long long *words;
+  unsigned long blockCount;
+} BloomFilter;
+
+BloomFilter *createBloomFilter(unsigned long keyCount, unsigned int bitsPerKey);
+void freeBloomFilter(BloomFilter *filter);
+unsigned long bloomFilterMemoryUsage(BloomFilter *filter);
+
+void addBloomFilterHash(BloomFilter *filter, unsigned long long hash);
+// FALSE means definitely absent
+BOOL bloomFilterMayContainHash(BloomFilter *filter, unsigned long long hash);
+
+// hash of a two-part key such as a (subject, object) pair
+static inline unsigned long long bloomFilterHashPair(unsigned long long a, unsigned long long b) {
+  unsigned long long hash = a * 0x9E3779B97F4A7C15ULL ^ (b + 0x632BE59BD9B4E019ULL + (a << 6) + (a >> 2));
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+#endif
@@ -0,0 +1,284 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bulk_loader.h"
+#include "parallel.h"
+
+// below this many input units (triples or bytes) per thread, extra threads cost more than they save
+#define BULK_LOAD_MIN_CHUNK_LENGTH ((unsigned long)1 << 16)
+
+#define BULK_LOAD_COUNT_PASS ((unsigned char)0)
+#define BULK_LOAD_SCATTER_PASS ((unsigned char)1)
+
+typedef struct {
+  unsigned char format;
+  const Triple *triples;
+  const char *bytes;
+  // triples for binary input, bytes for text
+  unsigned long length;
+
+  unsigned char pass;
+  // per thread, paged like the segment's predicate table: counts in the first pass, write positions in the second
+  // a thread only allocates the pages of predicates it actually sees
+  unsigned long ***cursorPages;
+  Segment *segment;
+  BOOL *failed;
+} BulkLoadContext;
+
+static inline void bulkLoadTriple(BulkLoadContext *context, unsigned long **cursorPages, Triple triple) {
+  PredicateId predicate = predicateIdFromTriple(triple);
+  unsigned long pageIndex = predicate >> SEGMENT_PREDICATE_PAGE_BIT_WIDTH;
+  PredicateId slot = predicate & SEGMENT_PREDICATE_PAGE_MASK;
+  if (context->pass == BULK_LOAD_COUNT_PASS) {
+    if (cursorPages[pageIndex] == NULL) {
+      cursorPages[pageIndex] = calloc(SEGMENT_PREDICATE_PAGE_LENGTH, sizeof(unsigned long));
+    }
+    cursorPages[pageIndex][slot]++;
+  } else {
+    // every predicate counted in the first pass has its entry by now
+    PredicateEntry *entry = context->segment->predicatePages[pageIndex][slot];
+    unsigned long position = cursorPages[pageIndex][slot]++;
+    entry->soEntries[position] = tripleToSOEntry(triple);
+    entry->osEntries[position] = tripleToOSEntry(triple);
+  }
+}
+
+static inline BOOL isNTriplesSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// reads one id, optionally wrapped in <>, and fails if it is missing or wider than bitWidth
+static inline BOOL parseNTriplesId(const char **cursor, const char *end, unsigned int bitWidth, unsigned long long *id) {
+  const char *c = *cursor;
+  while (c < end && isNTriplesSpace(*c)) {
+    c++;
+  }
+  BOOL bracketed = (c < end && *c == '<');
+  if (bracketed) {
+    c++;
+  }
+  const char *digits = c;
+  unsigned long long value = 0;
+  while (c < end && *c >= '0' && *c <= '9') {
+    value = value * 10 + (unsigned long long)(*c - '0');
+    if (value >= ((unsigned long long)1 << bitWidth)) {
+      return FALSE;
+    }
+    c++;
+  }
+  if (c == digits) {
+    return FALSE;
+  }
+  if (bracketed) {
+    if (c >= end || *c != '>') {
+      return FALSE;
+    }
+    c++;
+  }
+  *id = value;
+  *cursor = c;
+  return TRUE;
+}
+
+BOOL bulkLoadNTriples(BulkLoadContext *context, unsigned long **cursorPages, const char *c, const char *end) {
+  while (c < end) {
+    while (c < end && isNTriplesSpace(*c)) {
+      c++;
+    }
+    if (c < end && *c == '#') {
+      while (c < end && *c != '\n') {
+        c++;
+      }
+    }
+    if (c < end && *c == '\n') {
+      c++;
+      continue;
+    }
+    if (c >= end) {
+      break;
+    }
+
+    unsigned long long subject;
+    unsigned long long predicate;
+    unsigned long long object;
+    if (!parseNTriplesId(&c, end, SUBJECT_BIT_WIDTH, &subject) ||
+        !parseNTriplesId(&c, end, PREDICATE_BIT_WIDTH, &predicate) ||
+        !parseNTriplesId(&c, end, OBJECT_BIT_WIDTH, &object)) {
+      return FALSE;
+    }
+    // only the terminating dot may follow the object
+    while (c < end && (isNTriplesSpace(*c) || *c == '.')) {
+      c++;
+    }
+    if (c < end && *c != '\n') {
+      return FALSE;
+    }
+    bulkLoadTriple(context, cursorPages, toTriple((SubjectId)subject, (PredicateId)predicate, (ObjectId)object));
+  }
+  return TRUE;
+}
+
+// moves a byte offset forward to the start of the next line, so neighbouring chunks split on the same line
+unsigned long alignToNTriplesLine(const char *bytes, unsigned long length, unsigned long offset) {
+  while (offset > 0 && offset < length && bytes[offset - 1] != '\n') {
+    offset++;
+  }
+  return offset;
+}
+
+void bulkLoadTask(int threadIndex, int threadCount, void *arg) {
+  BulkLoadContext *context = (BulkLoadContext *)arg;
+  unsigned long **cursorPages = context->cursorPages[threadIndex];
+  unsigned long begin;
+  unsigned long end;
+  parallelChunk(context->length, threadIndex, threadCount, &begin, &end);
+
+  if (context->format == BULK_LOAD_BINARY) {
+    for (unsigned long i = begin; i < end; i++) {
+      bulkLoadTriple(context, cursorPages, context->triples[i]);
+    }
+  } else {
+    begin = alignToNTriplesLine(context->bytes, context->length, begin);
+    end = alignToNTriplesLine(context->bytes, context->length, end);
+    if (!bulkLoadNTriples(context, cursorPages, context->bytes + begin, context->bytes + end)) {
+      context->failed[threadIndex] = TRUE;
+    }
+  }
+}
+
+Segment *bulkLoad(BulkLoadContext *context, int threadCount) {
+  if (threadCount < 1) {
+    threadCount = availableThreadCount();
+  }
+  unsigned long maxThreadCount = context->length / BULK_LOAD_MIN_CHUNK_LENGTH;
+  if ((unsigned long)threadCount > maxThreadCount) {
+    threadCount = maxThreadCount > 0 ? (int)maxThreadCount : 1;
+  }
+
+  context->cursorPages = malloc(sizeof(unsigned long **) * threadCount);
+  context->failed = calloc(threadCount, sizeof(BOOL));
+  for (int t = 0; t < threadCount; t++) {
+    context->cursorPages[t] = calloc(SEGMENT_PREDICATE_PAGE_COUNT, sizeof(unsigned long *));
+  }
+
+  context->pass = BULK_LOAD_COUNT_PASS;
+  runParallel(threadCount, &bulkLoadTask, context);
+
+  BOOL failed = FALSE;
+  for (int t = 0; t < threadCount; t++) {
+    failed = failed || context->failed[t];
+  }
+
+  Segment *segment = NULL;
+  if (!failed) {
+    // size every entry exactly once, and turn each thread's counts into its first write position
+    segment = createSegment();
+    for (unsigned long pageIndex = 0; pageIndex < SEGMENT_PREDICATE_PAGE_COUNT; pageIndex++) {
+      BOOL seen = FALSE;
+      for (int t = 0; t < threadCount; t++) {
+        seen = seen || context->cursorPages[t][pageIndex] != NULL;
+      }
+      if (!seen) {
+        continue;
+      }
+      for (unsigned long slot = 0; slot < SEGMENT_PREDICATE_PAGE_LENGTH; slot++) {
+        unsigned long total = 0;
+        for (int t = 0; t < threadCount; t++) {
+          unsigned long *page = context->cursorPages[t][pageIndex];
+          if (page != NULL && page[slot] > 0) {
+            unsigned long count = page[slot];
+            page[slot] = total;
+            total += count;
+          }
+        }
+        if (total > 0) {
+          PredicateId predicate = (PredicateId)((pageIndex << SEGMENT_PREDICATE_PAGE_BIT_WIDTH) | slot);
+          PredicateEntry *entry = createPredicateEntryWithCapacity(predicate, total);
+          entry->entryCount = total;
+          addPredicateEntryToSegment(segment, entry);
+          segment->tripleCount += total;
+        }
+      }
+    }
+
+    if (segment->predicateCount > 0) {
+      context->segment = segment;
+      context->pass = BULK_LOAD_SCATTER_PASS;
+      runParallel(threadCount, &bulkLoadTask, context);
+      optimizeSegmentWithThreads(segment, threadCount);
+    }
+  }
+
+  for (int t = 0; t < threadCount; t++) {
+    for (unsigned long pageIndex = 0; pageIndex < SEGMENT_PREDICATE_PAGE_COUNT; pageIndex++) {
+      free(context->cursorPages[t][pageIndex]);
+    }
+    free(context->cursorPages[t]);
+  }
+  free(context->cursorPages);
+  free(context->failed);
+
+  if (failed) {
+    errno = EINVAL;
+  }
+  return segment;
+}
+
+Segment *bulkLoadTriples(const Triple *triples, unsigned long count, int threadCount) {
+  BulkLoadContext context;
+  context.format = BULK_LOAD_BINARY;
+  context.triples = triples;
+  context.bytes = NULL;
+  context.length = count;
+  context.segment = NULL;
+  return bulkLoad(&context, threadCount);
+}
+
+Segment *bulkLoadSegment(const char *path, unsigned char format, int threadCount) {
+  int descriptor = open(path, O_RDONLY);
+  if (descriptor < 0) {
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    return NULL;
+  }
+  unsigned long fileLength = status.st_size;
+  if (fileLength == 0) {
+    close(descriptor);
+    return createSegment();
+  }
+  if (format == BULK_LOAD_BINARY && fileLength % sizeof(Triple) != 0) {
+    close(descriptor);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  // the input is only streamed through twice, so map it rather than buffering it in the heap
+  void *mapping = mmap(NULL, fileLength, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  close(descriptor);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(mapping, fileLength, MADV_SEQUENTIAL);
+
+  BulkLoadContext context;
+  context.format = format;
+  context.triples = (const Triple *)mapping;
+  context.bytes = (const char *)mapping;
+  context.length = (format == BULK_LOAD_BINARY) ? fileLength / sizeof(Triple) : fileLength;
+  context.segment = NULL;
+  Segment *segment = bulkLoad(&context, threadCount);
+
+  int savedErrno = errno;
+  munmap(mapping, fileLength);
+  errno = savedErrno;
+  return segment;
+}
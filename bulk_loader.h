@@ -0,0 +1,22 @@
+#ifndef BULK_LOADER_H_INCLUDED
+#define BULK_LOADER_H_INCLUDED
+
+#include "segment.h"
+
+// raw packed Triple values, native byte order, no header
+#define BULK_LOAD_BINARY ((unsigned char)0)
+// one "subject predicate object ." per line with integer ids, optionally wrapped in <>
+// blank lines and lines starting with # are skipped
+#define BULK_LOAD_NTRIPLES ((unsigned char)1)
+
+/*
+  Loads in two passes over the input, each split across threadCount threads:
+  the first counts triples per predicate, the second scatters them into entries
+  allocated at their exact size. The entries are then optimized concurrently.
+*/
+
+// returns NULL with errno set if the file cannot be read, is malformed, or holds ids too wide for the id layout
+Segment *bulkLoadSegment(const char *path, unsigned char format, int threadCount);
+Segment *bulkLoadTriples(const Triple *triples, unsigned long count, int threadCount);
+
+#endif
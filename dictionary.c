@@ -0,0 +1,493 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dictionary.h"
+#include "segment_file.h"
+
+#define DICTIONARY_BUILDER_INITIAL_LENGTH 4096
+// how many lookups ahead the bulk forms prefetch
+#define DICTIONARY_PREFETCH_DISTANCE 8
+
+typedef struct {
+  char magic[8];
+  unsigned int version;
+  unsigned int byteOrder;
+
+  unsigned long long termCount;
+  unsigned long long maxTermLength;
+  unsigned long long blockCount;
+  unsigned long long dataLength;
+  unsigned long long hashCapacity;
+
+  // each section starts on a SEGMENT_FILE_ALIGNMENT boundary
+  unsigned long long blockOffsetsOffset;
+  unsigned long long dataOffset;
+  unsigned long long hashOffset;
+  unsigned long long fileLength;
+
+  // computed with this field zeroed
+  unsigned long long headerChecksum;
+} DictionaryFileHeader;
+
+/*
+  Builder
+*/
+
+DictionaryBuilder *createDictionaryBuilder() {
+  DictionaryBuilder *builder = malloc(sizeof(DictionaryBuilder));
+  builder->currentTermsLength = DICTIONARY_BUILDER_INITIAL_LENGTH;
+  builder->terms = malloc(builder->currentTermsLength);
+  builder->termsLength = 0;
+  builder->termCount = 0;
+  return builder;
+}
+
+void freeDictionaryBuilder(DictionaryBuilder *builder) {
+  free(builder->terms);
+  free(builder);
+}
+
+void addDictionaryBuilderTerm(DictionaryBuilder *builder, const char *term, unsigned long length) {
+  assert(length <= (unsigned int)~0U);
+  unsigned long needed = builder->termsLength + sizeof(unsigned int) + length;
+  if (needed > builder->currentTermsLength) {
+    while (needed > builder->currentTermsLength) {
+      builder->currentTermsLength *= 2;
+    }
+    builder->terms = realloc(builder->terms, builder->currentTermsLength);
+  }
+  unsigned int termLength = (unsigned int)length;
+  memcpy(builder->terms + builder->termsLength, &termLength, sizeof(unsigned int));
+  memcpy(builder->terms + builder->termsLength + sizeof(unsigned int), term, length);
+  builder->termsLength = needed;
+  builder->termCount++;
+}
+
+static inline unsigned int builderTermLength(const unsigned char *entry) {
+  unsigned int length;
+  memcpy(&length, entry, sizeof(unsigned int));
+  return length;
+}
+
+int compareBuilderTerms(const void *a, const void *b) {
+  const unsigned char *x = *(const unsigned char * const *)a;
+  const unsigned char *y = *(const unsigned char * const *)b;
+  unsigned int xLength = builderTermLength(x);
+  unsigned int yLength = builderTermLength(y);
+  int order = memcmp(x + sizeof(unsigned int), y + sizeof(unsigned int), xLength < yLength ? xLength : yLength);
+  if (order != 0) {
+    return order;
+  }
+  return (xLength > yLength) - (xLength < yLength);
+}
+
+/*
+  Encoding helpers
+*/
+
+static inline unsigned long writeVarint(unsigned char *out, unsigned long value) {
+  unsigned long length = 0;
+  while (value >= 0x80) {
+    out[length++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  out[length++] = (unsigned char)value;
+  return length;
+}
+
+static inline unsigned long readVarint(const unsigned char **cursor) {
+  const unsigned char *c = *cursor;
+  unsigned long value = 0;
+  unsigned int shift = 0;
+  while (*c & 0x80) {
+    value |= (unsigned long)(*c++ & 0x7F) << shift;
+    shift += 7;
+  }
+  value |= (unsigned long)(*c++) << shift;
+  *cursor = c;
+  return value;
+}
+
+unsigned long long hashDictionaryTerm(const unsigned char *bytes, unsigned long length) {
+  // word at a time, so long IRIs hash at memory speed
+  unsigned long long hash = 0x9E3779B97F4A7C15ULL ^ (length * 0xC2B2AE3D27D4EB4FULL);
+  unsigned long i = 0;
+  for (; i + sizeof(unsigned long long) <= length; i += sizeof(unsigned long long)) {
+    unsigned long long word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 29;
+  }
+  if (i < length) {
+    unsigned long long word = 0;
+    memcpy(&word, bytes + i, length - i);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static inline unsigned long long dictionaryFingerprint(unsigned long long hash) {
+  return hash >> 32;
+}
+
+unsigned long dictionaryHashCapacity(unsigned long termCount) {
+  // at most 3/4 full, and always at least one empty slot to end a probe
+  unsigned long capacity = 2;
+  while (capacity < termCount + termCount / 3 + 1) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+void insertDictionaryHashSlot(Dictionary *dictionary, unsigned long long hash, unsigned int id) {
+  unsigned long slot = hash & dictionary->hashMask;
+  while (dictionary->hashSlots[slot] != 0) {
+    slot = (slot + 1) & dictionary->hashMask;
+  }
+  dictionary->hashSlots[slot] = (dictionaryFingerprint(hash) << 32) | ((unsigned long long)id + 1);
+}
+
+/*
+  Dictionary
+*/
+
+Dictionary *buildDictionary(DictionaryBuilder *builder) {
+  const unsigned char **sorted = malloc(sizeof(unsigned char *) * (builder->termCount > 0 ? builder->termCount : 1));
+  unsigned long offset = 0;
+  for (unsigned long i = 0; i < builder->termCount; i++) {
+    sorted[i] = builder->terms + offset;
+    offset += sizeof(unsigned int) + builderTermLength(sorted[i]);
+  }
+  qsort(sorted, builder->termCount, sizeof(unsigned char *), compareBuilderTerms);
+
+  unsigned long termCount = 0;
+  for (unsigned long i = 0; i < builder->termCount; i++) {
+    if (termCount == 0 || compareBuilderTerms(&sorted[termCount - 1], &sorted[i]) != 0) {
+      sorted[termCount++] = sorted[i];
+    }
+  }
+  assert(termCount < DICTIONARY_MISSING_ID);
+
+  Dictionary *dictionary = malloc(sizeof(Dictionary));
+  dictionary->termCount = termCount;
+  dictionary->maxTermLength = 0;
+  dictionary->blockCount = (termCount + DICTIONARY_BLOCK_LENGTH - 1) / DICTIONARY_BLOCK_LENGTH;
+  dictionary->blockOffsets = malloc(sizeof(unsigned long long) * (dictionary->blockCount + 1));
+  dictionary->mapping = NULL;
+  dictionary->mappingLength = 0;
+
+  // front coding never grows a term, so the raw bytes plus two varints per term bound the data
+  unsigned long dataBound = 1;
+  for (unsigned long i = 0; i < termCount; i++) {
+    dataBound += builderTermLength(sorted[i]) + 20;
+  }
+  dictionary->data = malloc(dataBound);
+
+  unsigned char *out = dictionary->data;
+  for (unsigned long i = 0; i < termCount; i++) {
+    const unsigned char *term = sorted[i] + sizeof(unsigned int);
+    unsigned int length = builderTermLength(sorted[i]);
+    if (length > dictionary->maxTermLength) {
+      dictionary->maxTermLength = length;
+    }
+    if (i % DICTIONARY_BLOCK_LENGTH == 0) {
+      dictionary->blockOffsets[i / DICTIONARY_BLOCK_LENGTH] = out - dictionary->data;
+      out += writeVarint(out, length);
+      memcpy(out, term, length);
+      out += length;
+    } else {
+      const unsigned char *previous = sorted[i - 1] + sizeof(unsigned int);
+      unsigned int previousLength = builderTermLength(sorted[i - 1]);
+      unsigned int shared = 0;
+      while (shared < length && shared < previousLength && term[shared] == previous[shared]) {
+        shared++;
+      }
+      out += writeVarint(out, shared);
+      out += writeVarint(out, length - shared);
+      memcpy(out, term + shared, length - shared);
+      out += length - shared;
+    }
+  }
+  dictionary->dataLength = out - dictionary->data;
+  dictionary->blockOffsets[dictionary->blockCount] = dictionary->dataLength;
+  dictionary->data = realloc(dictionary->data, dictionary->dataLength > 0 ? dictionary->dataLength : 1);
+
+  unsigned long capacity = dictionaryHashCapacity(termCount);
+  dictionary->hashSlots = calloc(capacity, sizeof(unsigned long long));
+  dictionary->hashMask = capacity - 1;
+  for (unsigned long i = 0; i < termCount; i++) {
+    insertDictionaryHashSlot(dictionary, hashDictionaryTerm(sorted[i] + sizeof(unsigned int), builderTermLength(sorted[i])), (unsigned int)i);
+  }
+
+  free(sorted);
+  return dictionary;
+}
+
+void freeDictionary(Dictionary *dictionary) {
+  if (dictionary->mapping != NULL) {
+    munmap(dictionary->mapping, dictionary->mappingLength);
+  } else {
+    free(dictionary->blockOffsets);
+    free(dictionary->data);
+    free(dictionary->hashSlots);
+  }
+  free(dictionary);
+}
+
+unsigned long dictionaryMemoryUsage(Dictionary *dictionary) {
+  return sizeof(Dictionary) +
+    sizeof(unsigned long long) * (dictionary->blockCount + 1) +
+    dictionary->dataLength +
+    sizeof(unsigned long long) * (dictionary->hashMask + 1);
+}
+
+/*
+  Lookup
+*/
+
+// checks whether term id equals the given bytes without materializing it, by tracking how much
+// of the target each decoded term in the block shares
+BOOL matchDictionaryTerm(Dictionary *dictionary, unsigned int id, const unsigned char *term, unsigned long length) {
+  unsigned long block = id / DICTIONARY_BLOCK_LENGTH;
+  unsigned long index = id % DICTIONARY_BLOCK_LENGTH;
+  const unsigned char *cursor = dictionary->data + dictionary->blockOffsets[block];
+
+  unsigned long currentLength = readVarint(&cursor);
+  unsigned long matched = 0;
+  while (matched < currentLength && matched < length && cursor[matched] == term[matched]) {
+    matched++;
+  }
+  cursor += currentLength;
+
+  for (unsigned long i = 1; i <= index; i++) {
+    unsigned long shared = readVarint(&cursor);
+    unsigned long suffixLength = readVarint(&cursor);
+    // past the match, the shared prefix carries the same mismatch forward
+    if (shared <= matched) {
+      matched = shared;
+      while (matched < shared + suffixLength && matched < length && cursor[matched - shared] == term[matched]) {
+        matched++;
+      }
+    }
+    currentLength = shared + suffixLength;
+    cursor += suffixLength;
+  }
+  return matched == length && currentLength == length;
+}
+
+static inline unsigned int probeDictionary(Dictionary *dictionary, unsigned long long hash, const unsigned char *term, unsigned long length) {
+  unsigned long long fingerprint = dictionaryFingerprint(hash);
+  unsigned long slot = hash & dictionary->hashMask;
+  for (;;) {
+    unsigned long long value = dictionary->hashSlots[slot];
+    if (value == 0) {
+      return DICTIONARY_MISSING_ID;
+    }
+    if ((value >> 32) == fingerprint) {
+      unsigned int id = (unsigned int)(value & 0xFFFFFFFFULL) - 1;
+      if (matchDictionaryTerm(dictionary, id, term, length)) {
+        return id;
+      }
+    }
+    slot = (slot + 1) & dictionary->hashMask;
+  }
+}
+
+unsigned int encodeDictionaryTerm(Dictionary *dictionary, const char *term, unsigned long length) {
+  const unsigned char *bytes = (const unsigned char *)term;
+  return probeDictionary(dictionary, hashDictionaryTerm(bytes, length), bytes, length);
+}
+
+unsigned long decodeDictionaryTerm(Dictionary *dictionary, unsigned int id, char *buffer, unsigned long capacity) {
+  assert(id < dictionary->termCount);
+  unsigned long block = id / DICTIONARY_BLOCK_LENGTH;
+  unsigned long index = id % DICTIONARY_BLOCK_LENGTH;
+  const unsigned char *cursor = dictionary->data + dictionary->blockOffsets[block];
+
+  // bytes past capacity are dropped; a shared prefix only ever reads bytes below it, so the rest stays consistent
+  unsigned long length = readVarint(&cursor);
+  memcpy(buffer, cursor, length < capacity ? length : capacity);
+  cursor += length;
+  for (unsigned long i = 1; i <= index; i++) {
+    unsigned long shared = readVarint(&cursor);
+    unsigned long suffixLength = readVarint(&cursor);
+    if (shared < capacity) {
+      unsigned long copied = (shared + suffixLength < capacity) ? suffixLength : capacity - shared;
+      memcpy(buffer + shared, cursor, copied);
+    }
+    length = shared + suffixLength;
+    cursor += suffixLength;
+  }
+  return length;
+}
+
+void encodeDictionaryTerms(Dictionary *dictionary, const char **terms, const unsigned long *lengths, unsigned long count, unsigned int *ids) {
+  unsigned long long hashes[DICTIONARY_PREFETCH_DISTANCE];
+  for (unsigned long i = 0; i < count && i < DICTIONARY_PREFETCH_DISTANCE; i++) {
+    hashes[i] = hashDictionaryTerm((const unsigned char *)terms[i], lengths[i]);
+    __builtin_prefetch(&dictionary->hashSlots[hashes[i] & dictionary->hashMask]);
+  }
+  for (unsigned long i = 0; i < count; i++) {
+    unsigned long long hash = hashes[i % DICTIONARY_PREFETCH_DISTANCE];
+    unsigned long ahead = i + DICTIONARY_PREFETCH_DISTANCE;
+    if (ahead < count) {
+      unsigned long long aheadHash = hashDictionaryTerm((const unsigned char *)terms[ahead], lengths[ahead]);
+      hashes[ahead % DICTIONARY_PREFETCH_DISTANCE] = aheadHash;
+      __builtin_prefetch(&dictionary->hashSlots[aheadHash & dictionary->hashMask]);
+    }
+    ids[i] = probeDictionary(dictionary, hash, (const unsigned char *)terms[i], lengths[i]);
+  }
+}
+
+unsigned long decodeDictionaryTerms(Dictionary *dictionary, const unsigned int *ids, unsigned long count, char *buffer, unsigned long capacity, unsigned long *offsets) {
+  unsigned long position = 0;
+  for (unsigned long i = 0; i < count; i++) {
+    if (i + DICTIONARY_PREFETCH_DISTANCE < count) {
+      unsigned int ahead = ids[i + DICTIONARY_PREFETCH_DISTANCE];
+      __builtin_prefetch(dictionary->data + dictionary->blockOffsets[ahead / DICTIONARY_BLOCK_LENGTH]);
+    }
+    offsets[i] = position;
+    unsigned long remaining = (position < capacity) ? capacity - position : 0;
+    position += decodeDictionaryTerm(dictionary, ids[i], buffer + (remaining > 0 ? position : 0), remaining);
+  }
+  offsets[count] = position;
+  return position;
+}
+
+/*
+  Persistence
+*/
+
+unsigned long long alignDictionaryFileOffset(unsigned long long offset) {
+  return (offset + SEGMENT_FILE_ALIGNMENT - 1) & ~((unsigned long long)SEGMENT_FILE_ALIGNMENT - 1);
+}
+
+unsigned long long dictionaryFileHeaderChecksum(const DictionaryFileHeader *header) {
+  DictionaryFileHeader copy = *header;
+  copy.headerChecksum = 0;
+  return segmentFileChecksum((const unsigned long long *)&copy, sizeof(copy) / sizeof(unsigned long long));
+}
+
+BOOL writeDictionarySection(FILE *file, unsigned long long offset, const void *bytes, unsigned long long length) {
+  if (fseek(file, (long)offset, SEEK_SET) != 0) {
+    return FALSE;
+  }
+  return length == 0 || fwrite(bytes, 1, length, file) == length;
+}
+
+BOOL saveDictionary(Dictionary *dictionary, const char *path) {
+  DictionaryFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, DICTIONARY_FILE_MAGIC, sizeof(header.magic));
+  header.version = DICTIONARY_FILE_VERSION;
+  header.byteOrder = SEGMENT_FILE_BYTE_ORDER;
+  header.termCount = dictionary->termCount;
+  header.maxTermLength = dictionary->maxTermLength;
+  header.blockCount = dictionary->blockCount;
+  header.dataLength = dictionary->dataLength;
+  header.hashCapacity = dictionary->hashMask + 1;
+  header.blockOffsetsOffset = SEGMENT_FILE_ALIGNMENT;
+  header.dataOffset = alignDictionaryFileOffset(header.blockOffsetsOffset + sizeof(unsigned long long) * (header.blockCount + 1));
+  header.hashOffset = alignDictionaryFileOffset(header.dataOffset + header.dataLength);
+  header.fileLength = header.hashOffset + sizeof(unsigned long long) * header.hashCapacity;
+  header.headerChecksum = dictionaryFileHeaderChecksum(&header);
+
+  unsigned long pathLength = strlen(path);
+  char *temporaryPath = malloc(pathLength + sizeof(".tmp"));
+  memcpy(temporaryPath, path, pathLength);
+  memcpy(temporaryPath + pathLength, ".tmp", sizeof(".tmp"));
+
+  // seeking past the end leaves the alignment gaps as holes, which read back as zeros
+  FILE *file = fopen(temporaryPath, "wb");
+  BOOL written = file != NULL;
+  written = written && writeDictionarySection(file, 0, &header, sizeof(header));
+  written = written && writeDictionarySection(file, header.blockOffsetsOffset, dictionary->blockOffsets, sizeof(unsigned long long) * (header.blockCount + 1));
+  written = written && writeDictionarySection(file, header.dataOffset, dictionary->data, header.dataLength);
+  written = written && writeDictionarySection(file, header.hashOffset, dictionary->hashSlots, sizeof(unsigned long long) * header.hashCapacity);
+  written = written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+  if (file != NULL && fclose(file) != 0) {
+    written = FALSE;
+  }
+  if (written && rename(temporaryPath, path) != 0) {
+    written = FALSE;
+  }
+  if (!written) {
+    int savedErrno = errno;
+    unlink(temporaryPath);
+    errno = savedErrno;
+  }
+  free(temporaryPath);
+  return written;
+}
+
+BOOL isValidDictionaryFileHeader(const DictionaryFileHeader *header, unsigned long long fileLength) {
+  unsigned long long capacity = header->hashCapacity;
+  return memcmp(header->magic, DICTIONARY_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+    header->version == DICTIONARY_FILE_VERSION &&
+    header->byteOrder == SEGMENT_FILE_BYTE_ORDER &&
+    header->headerChecksum == dictionaryFileHeaderChecksum(header) &&
+    header->fileLength == fileLength &&
+    header->termCount < DICTIONARY_MISSING_ID &&
+    header->blockCount == (header->termCount + DICTIONARY_BLOCK_LENGTH - 1) / DICTIONARY_BLOCK_LENGTH &&
+    capacity > header->termCount && (capacity & (capacity - 1)) == 0 &&
+    header->blockOffsetsOffset % sizeof(unsigned long long) == 0 &&
+    header->hashOffset % sizeof(unsigned long long) == 0 &&
+    header->blockOffsetsOffset + sizeof(unsigned long long) * (header->blockCount + 1) <= header->dataOffset &&
+    header->dataOffset + header->dataLength <= header->hashOffset &&
+    header->hashOffset + sizeof(unsigned long long) * capacity <= fileLength;
+}
+
+Dictionary *openDictionaryMapped(const char *path) {
+  int descriptor = open(path, O_RDONLY);
+  if (descriptor < 0) {
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    return NULL;
+  }
+  unsigned long long fileLength = status.st_size;
+  if (fileLength < sizeof(DictionaryFileHeader)) {
+    close(descriptor);
+    errno = EINVAL;
+    return NULL;
+  }
+  void *mapping = mmap(NULL, fileLength, PROT_READ, MAP_SHARED, descriptor, 0);
+  close(descriptor);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  char *base = mapping;
+  const DictionaryFileHeader *header = mapping;
+  if (!isValidDictionaryFileHeader(header, fileLength)) {
+    munmap(mapping, fileLength);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  Dictionary *dictionary = malloc(sizeof(Dictionary));
+  dictionary->termCount = header->termCount;
+  dictionary->maxTermLength = header->maxTermLength;
+  dictionary->blockCount = header->blockCount;
+  dictionary->blockOffsets = (unsigned long long *)(base + header->blockOffsetsOffset);
+  dictionary->data = (unsigned char *)(base + header->dataOffset);
+  dictionary->dataLength = header->dataLength;
+  dictionary->hashSlots = (unsigned long long *)(base + header->hashOffset);
+  dictionary->hashMask = header->hashCapacity - 1;
+  dictionary->mapping = mapping;
+  dictionary->mappingLength = fileLength;
+  return dictionary;
+}
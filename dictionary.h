@@ -0,0 +1,76 @@
+#ifndef DICTIONARY_H_INCLUDED
+#define DICTIONARY_H_INCLUDED
+
+#include "triple.h"
+
+/*
+  Immutable map between terms (IRIs, literals, any byte strings) and dense ids.
+
+  Ids are the terms' ranks in byte order, so id order is term order. Decode walks a
+  front-coded string array: terms are grouped in blocks of DICTIONARY_BLOCK_LENGTH, each
+  block stores its first term whole and the rest as (shared prefix length, suffix).
+  Encode probes an open-addressing table of (fingerprint, id) slots and confirms a
+  fingerprint match by decoding the candidate.
+
+  Use one dictionary per id space, e.g. one for entities and one for predicates.
+*/
+
+#define DICTIONARY_BLOCK_LENGTH 16
+#define DICTIONARY_MISSING_ID ((unsigned int)~0U)
+
+#define DICTIONARY_FILE_MAGIC "CGRAPHDC"
+#define DICTIONARY_FILE_VERSION 1
+
+typedef struct {
+  // each term is stored as its unsigned int length followed by its bytes
+  unsigned char *terms;
+  unsigned long termsLength;
+  unsigned long currentTermsLength;
+  unsigned long termCount;
+} DictionaryBuilder;
+
+typedef struct {
+  unsigned long termCount;
+  unsigned long maxTermLength;
+
+  // blockCount + 1 byte offsets into data
+  unsigned long blockCount;
+  unsigned long long *blockOffsets;
+  unsigned char *data;
+  unsigned long dataLength;
+
+  // each slot is fingerprint << 32 | (id + 1), 0 when empty
+  unsigned long long *hashSlots;
+  unsigned long hashMask;
+
+  // set when the arrays point into a mapped dictionary file
+  void *mapping;
+  unsigned long mappingLength;
+} Dictionary;
+
+DictionaryBuilder *createDictionaryBuilder();
+void freeDictionaryBuilder(DictionaryBuilder *builder);
+// duplicates are fine, they share an id
+void addDictionaryBuilderTerm(DictionaryBuilder *builder, const char *term, unsigned long length);
+
+// sorts and deduplicates the builder's terms; the builder can be freed afterwards
+Dictionary *buildDictionary(DictionaryBuilder *builder);
+void freeDictionary(Dictionary *dictionary);
+unsigned long dictionaryMemoryUsage(Dictionary *dictionary);
+
+// DICTIONARY_MISSING_ID when the term is not in the dictionary
+unsigned int encodeDictionaryTerm(Dictionary *dictionary, const char *term, unsigned long length);
+// writes up to capacity bytes of the term and returns its full length, which is at most maxTermLength
+unsigned long decodeDictionaryTerm(Dictionary *dictionary, unsigned int id, char *buffer, unsigned long capacity);
+
+// bulk forms prefetch ahead, so independent lookups overlap their cache misses
+void encodeDictionaryTerms(Dictionary *dictionary, const char **terms, const unsigned long *lengths, unsigned long count, unsigned int *ids);
+// writes the terms back to back into buffer, term i at [offsets[i], offsets[i + 1])
+// returns the bytes needed; when that exceeds capacity nothing past capacity is written and offsets are still filled
+unsigned long decodeDictionaryTerms(Dictionary *dictionary, const unsigned int *ids, unsigned long count, char *buffer, unsigned long capacity, unsigned long *offsets);
+
+// same write-then-rename and errno conventions as writeSegmentFile
+BOOL saveDictionary(Dictionary *dictionary, const char *path);
+Dictionary *openDictionaryMapped(const char *path);
+
+#endif
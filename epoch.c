@@ -0,0 +1,93 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "epoch.h"
+
+#define EPOCH_INITIAL_RETIRED_LENGTH 16
+
+EpochDomain *createEpochDomain() {
+  EpochDomain *domain = aligned_alloc(64, (sizeof(EpochDomain) + 63) & ~63UL);
+  domain->globalEpoch = 1;
+  for (int i = 0; i < EPOCH_DOMAIN_MAX_READERS; i++) {
+    domain->slots[i].epoch = EPOCH_QUIESCENT;
+    domain->slots[i].registered = 0;
+  }
+  domain->retiredCount = 0;
+  domain->currentRetiredLength = EPOCH_INITIAL_RETIRED_LENGTH;
+  domain->retired = malloc(sizeof(RetiredObject) * domain->currentRetiredLength);
+  return domain;
+}
+
+void freeEpochDomain(EpochDomain *domain) {
+  for (int i = 0; i < EPOCH_DOMAIN_MAX_READERS; i++) {
+    assert(domain->slots[i].epoch == EPOCH_QUIESCENT);
+  }
+  for (unsigned long i = 0; i < domain->retiredCount; i++) {
+    domain->retired[i].free(domain->retired[i].object);
+  }
+  free(domain->retired);
+  free(domain);
+}
+
+int registerEpochReader(EpochDomain *domain) {
+  for (int i = 0; i < EPOCH_DOMAIN_MAX_READERS; i++) {
+    unsigned long unclaimed = 0;
+    if (__atomic_load_n(&domain->slots[i].registered, __ATOMIC_RELAXED) == 0 &&
+        __atomic_compare_exchange_n(&domain->slots[i].registered, &unclaimed, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void unregisterEpochReader(EpochDomain *domain, int reader) {
+  assert(reader >= 0 && reader < EPOCH_DOMAIN_MAX_READERS);
+  assert(domain->slots[reader].epoch == EPOCH_QUIESCENT);
+  __atomic_store_n(&domain->slots[reader].registered, 0, __ATOMIC_RELEASE);
+}
+
+// the announcement and the writer's unlink are both sequentially consistent, so either the writer's
+// scan sees the announcement or the reader's later loads see the unlink
+void enterEpoch(EpochDomain *domain, int reader) {
+  assert(reader >= 0 && reader < EPOCH_DOMAIN_MAX_READERS);
+  assert(domain->slots[reader].epoch == EPOCH_QUIESCENT);
+  __atomic_store_n(&domain->slots[reader].epoch, __atomic_load_n(&domain->globalEpoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+}
+
+void exitEpoch(EpochDomain *domain, int reader) {
+  assert(reader >= 0 && reader < EPOCH_DOMAIN_MAX_READERS);
+  __atomic_store_n(&domain->slots[reader].epoch, EPOCH_QUIESCENT, __ATOMIC_RELEASE);
+}
+
+void retireEpochObject(EpochDomain *domain, void *object, EpochFreeFn freeObject) {
+  if (domain->retiredCount == domain->currentRetiredLength) {
+    domain->currentRetiredLength *= 2;
+    domain->retired = realloc(domain->retired, sizeof(RetiredObject) * domain->currentRetiredLength);
+  }
+  RetiredObject *retired = &domain->retired[domain->retiredCount++];
+  retired->object = object;
+  retired->free = freeObject;
+  retired->epoch = __atomic_add_fetch(&domain->globalEpoch, 1, __ATOMIC_SEQ_CST);
+}
+
+unsigned long reclaimEpochObjects(EpochDomain *domain) {
+  unsigned long oldest = ~0UL;
+  for (int i = 0; i < EPOCH_DOMAIN_MAX_READERS; i++) {
+    unsigned long epoch = __atomic_load_n(&domain->slots[i].epoch, __ATOMIC_SEQ_CST);
+    if (epoch != EPOCH_QUIESCENT && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+  // retired epochs ascend, so the freeable objects are a prefix
+  unsigned long count = 0;
+  while (count < domain->retiredCount && domain->retired[count].epoch <= oldest) {
+    domain->retired[count].free(domain->retired[count].object);
+    count++;
+  }
+  for (unsigned long i = count; i < domain->retiredCount; i++) {
+    domain->retired[i - count] = domain->retired[i];
+  }
+  domain->retiredCount -= count;
+  return count;
+}
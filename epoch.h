@@ -0,0 +1,57 @@
+#ifndef EPOCH_H_INCLUDED
+#define EPOCH_H_INCLUDED
+
+/*
+  Epoch-based reclamation for one writer and any number of readers. A reader announces the
+  global epoch in its slot while it holds pointers to shared objects, and clears the slot when it
+  is done; neither step waits for anything. The writer unlinks an object, bumps the epoch and
+  retires the object at the new epoch. Every reader that announced that epoch or a later one
+  started after the unlink and cannot hold the object, so it is freed once no reader is left
+  in an older epoch.
+*/
+
+#define EPOCH_DOMAIN_MAX_READERS 128
+// an announcement of 0 means the reader holds nothing
+#define EPOCH_QUIESCENT 0
+
+// one cache line per reader, so announcing does not invalidate the other readers' slots
+typedef struct {
+  unsigned long epoch;
+  unsigned long registered;
+  char padding[64 - 2 * sizeof(unsigned long)];
+} EpochSlot;
+
+typedef void (*EpochFreeFn)(void *object);
+
+typedef struct {
+  void *object;
+  EpochFreeFn free;
+  unsigned long epoch;
+} RetiredObject;
+
+typedef struct {
+  unsigned long globalEpoch;
+  EpochSlot slots[EPOCH_DOMAIN_MAX_READERS];
+  // the writer's, oldest first
+  RetiredObject *retired;
+  unsigned long retiredCount;
+  unsigned long currentRetiredLength;
+} EpochDomain;
+
+EpochDomain *createEpochDomain();
+// frees whatever is still retired; no reader may be inside the domain
+void freeEpochDomain(EpochDomain *domain);
+
+// claims a free slot for a reader thread and returns it, or -1 when all EPOCH_DOMAIN_MAX_READERS are taken
+int registerEpochReader(EpochDomain *domain);
+void unregisterEpochReader(EpochDomain *domain, int reader);
+// shared objects read between enter and exit stay allocated until the exit; not reentrant
+void enterEpoch(EpochDomain *domain, int reader);
+void exitEpoch(EpochDomain *domain, int reader);
+
+// writer only: object must already be unreachable for readers entering from now on
+void retireEpochObject(EpochDomain *domain, void *object, EpochFreeFn freeObject);
+// writer only: frees the retired objects no reader can hold any more and returns how many
+unsigned long reclaimEpochObjects(EpochDomain *domain);
+
+#endif
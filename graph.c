@@ -3,6 +3,21 @@
 #include <stdlib.h>
 
 #include "segment.h"
+#include "graph.h"
+
+static Segment *segment = NULL;
 
 void initialize() {
+  assert(segment == NULL);
+  segment = createSegment();
+}
+
+void finalize() {
+  assert(segment != NULL);
+  freeSegment(segment);
+  segment = NULL;
+}
+
+Segment *getGraphSegment() {
+  return segment;
 }
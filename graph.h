@@ -4,5 +4,8 @@
 #include "segment.h"
 
 void initialize();
+void finalize();
+
+Segment *getGraphSegment();
 
 #endif
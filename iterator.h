@@ -1,31 +1,139 @@
 #ifndef ITERATOR_H_INCLUDED
 #define ITERATOR_H_INCLUDED
 
+#include <stdio.h>
+
 #include "triple.h"
 
+// per-node counters, see IteratorStats; 0 compiles them out, 1 (make ITERATOR_STATS=1) compiles them in
+#ifndef CGRAPH_ITERATOR_STATS
+#define CGRAPH_ITERATOR_STATS 0
+#endif
+
+#if CGRAPH_ITERATOR_STATS && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif CGRAPH_ITERATOR_STATS
+#include <time.h>
+#endif
+
 struct Iterator_t;
 typedef struct Iterator_t Iterator;
 
 typedef void (*advanceFn)(Iterator *iterator);
 typedef void (*nextOperandFn)(Iterator *iterator);
 typedef Triple (*peekFn)(Iterator *iterator);
+// the component of the current triple the iterator is sorted by, e.g. the subject for soEntries
+typedef EntityId (*peekKeyFn)(Iterator *iterator);
 typedef BOOL (*doneFn)(Iterator *iterator);
 typedef void (*initFn)(Iterator *iterator);
 typedef void (*freeFn)(Iterator *iterator);
+// moves forward to the first triple whose key is >= target; never moves backwards
+typedef void (*seekFn)(Iterator *iterator, EntityId target);
+// writes up to capacity triples in iteration order, returning how many; 0 once done
+typedef unsigned long (*nextBatchFn)(Iterator *iterator, Triple *triples, unsigned long capacity);
+// a fresh, uninitialized copy of the whole iterator tree over the same entries, e.g. one per worker thread
+typedef Iterator *(*cloneFn)(Iterator *iterator);
+// writes a one line label for the node, e.g. "AND", for explainIterator
+typedef void (*describeFn)(Iterator *iterator, char *label, unsigned long length);
+// the node's index-th input, NULL past the last one
+typedef Iterator *(*inputFn)(Iterator *iterator, int index);
 
 #define ENTRY_ITERATOR  ((unsigned char)1)
 #define JOIN_ITERATOR   ((unsigned char)2)
+#define LEAPFROG_ITERATOR ((unsigned char)3)
+// an entry's sorted base and delta read as one sorted run
+#define MERGED_ENTRY_ITERATOR ((unsigned char)4)
+// k-way union, see union_iterator.h
+#define UNION_ITERATOR ((unsigned char)5)
+
+// a batch size that keeps the output buffer in L1/L2
+#define ITERATOR_BATCH_LENGTH 1024
 
 BOOL iterate(Iterator *iterator, Triple *triple);
+unsigned long nextBatch(Iterator *iterator, Triple *triples, unsigned long capacity);
+// the free of iterators allocated in an arena, which releases them all at once
+void freeArenaIterator(Iterator *iterator);
+// nextBatch built from done/peek/advance, for iterators without a native one
+unsigned long nextBatchByIterating(Iterator *iterator, Triple *triples, unsigned long capacity);
+// input for iterators without inputs
+Iterator *noIteratorInput(Iterator *iterator, int index);
+
+/*
+  Iterator statistics. With CGRAPH_ITERATOR_STATS every node counts its own work: the init
+  functions put counting wrappers in front of advance, nextOperand, peek, peekKey, seek and
+  nextBatch, and only the outermost call on a node counts, so an advance that goes on into the
+  node's own nextOperand is charged once. Cycles include the node's inputs; explainIterator
+  subtracts them to show what the node spent itself. Batch loops that read an entry's pairs
+  directly are charged to the join running them rather than to the entry's iterator.
+  Clones start from zero, so morsel workers each count for their own tree.
+*/
+#if CGRAPH_ITERATOR_STATS
+typedef struct {
+  // triples handed out by advance and nextBatch
+  unsigned long long rows;
+  unsigned long long advances;
+  unsigned long long batches;
+  // peek and peekKey
+  unsigned long long peeks;
+  unsigned long long seeks;
+  // key comparisons between inputs in the triple at a time paths
+  unsigned long long comparisons;
+  // pairs passed over without being emitted, by seeks, tombstones or a join's batch loops
+  unsigned long long skipped;
+  // time stamp counter ticks, or nanoseconds where there is none
+  unsigned long long cycles;
+
+  unsigned int depth;
+  advanceFn advance;
+  nextOperandFn nextOperand;
+  peekFn peek;
+  peekKeyFn peekKey;
+  seekFn seek;
+  nextBatchFn nextBatch;
+} IteratorStats;
+
+static inline unsigned long long iteratorStatsCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+void installIteratorStats(Iterator *iterator);
+#define ITERATOR_STATS_INSTALL(iterator) installIteratorStats((Iterator *)(iterator))
+#define ITERATOR_STATS_ADD(iterator, counter, n) (((Iterator *)(iterator))->stats.counter += (n))
+#else
+#define ITERATOR_STATS_INSTALL(iterator) ((void)(iterator))
+#define ITERATOR_STATS_ADD(iterator, counter, n) ((void)(iterator), (void)(n))
+#endif
+
+// zeroes the counters of the whole tree; a no-op without CGRAPH_ITERATOR_STATS
+void resetIteratorStats(Iterator *iterator);
+// prints the tree one node per line, inputs indented under their node, with each node's counters
+// when they are compiled in; explainIterator prints to stdout
+void explainIterator(Iterator *iterator);
+void explainIteratorToFile(Iterator *iterator, FILE *file);
 
 struct Iterator_t {
   unsigned char TYPE;
   advanceFn advance;
   nextOperandFn nextOperand;
   peekFn peek;
+  peekKeyFn peekKey;
   doneFn done;
   initFn init;
   freeFn free;
+  seekFn seek;
+  nextBatchFn nextBatch;
+  cloneFn clone;
+  describeFn describe;
+  inputFn input;
+#if CGRAPH_ITERATOR_STATS
+  IteratorStats stats;
+#endif
 };
 
 #endif
@@ -0,0 +1,412 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "leapfrog_join.h"
+
+/*
+  Leapfrog Join
+*/
+
+void nextOperandLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  Iterator *first = p->inputs[0];
+
+  if (first->done(first)) {
+    p->currentIterator = NULL;
+    return;
+  }
+
+  EntityId target = first->peekKey(first);
+  // further triples of an already matched key need no trip around the inputs
+  if (p->matched && target == p->matchedKey) {
+    p->currentIterator = first;
+    return;
+  }
+
+  // every input in turn seeks to the largest key seen so far until all of them agree
+  int agreed = 1;
+  int i = 1 % p->inputCount;
+  while (agreed < p->inputCount) {
+    Iterator *input = p->inputs[i];
+    input->seek(input, target);
+    if (input->done(input)) {
+      p->matched = FALSE;
+      p->currentIterator = NULL;
+      return;
+    }
+    EntityId key = input->peekKey(input);
+    ITERATOR_STATS_ADD(iterator, comparisons, 1);
+    if (key == target) {
+      agreed++;
+    } else {
+      target = key;
+      agreed = 1;
+    }
+    i = (i + 1) % p->inputCount;
+  }
+
+  p->matched = TRUE;
+  p->matchedKey = target;
+  p->currentIterator = first;
+}
+
+void advanceLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  assert(!iterator->done(iterator));
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  p->currentIterator->advance(p->currentIterator);
+  iterator->nextOperand(iterator);
+}
+
+BOOL doneLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  return p->currentIterator == NULL;
+}
+
+Triple peekLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  assert(!iterator->done(iterator));
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  return p->currentIterator->peek(p->currentIterator);
+}
+
+EntityId peekKeyLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  assert(!iterator->done(iterator));
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  return p->matchedKey;
+}
+
+void initLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  for (int i = 0; i < p->inputCount; i++) {
+    p->inputs[i]->init(p->inputs[i]);
+  }
+  iterator->nextOperand(iterator);
+}
+
+void seekLeapfrog(Iterator *iterator, EntityId target) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  // the other inputs catch up inside nextOperand
+  p->inputs[0]->seek(p->inputs[0], target);
+  iterator->nextOperand(iterator);
+}
+
+unsigned long nextBatchLeapfrog(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  unsigned long count = 0;
+  while (count < capacity && p->currentIterator != NULL) {
+    triples[count++] = p->currentIterator->peek(p->currentIterator);
+    p->currentIterator->advance(p->currentIterator);
+    nextOperandLeapfrog(iterator);
+  }
+  return count;
+}
+
+void freeLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  for (int i = 0; i < p->inputCount; i++) {
+    p->inputs[i]->free(p->inputs[i]);
+  }
+  free(p->inputs);
+  free(iterator);
+}
+
+void describeLeapfrog(Iterator *iterator, char *label, unsigned long length) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  snprintf(label, length, "LEAPFROG inputs=%d", p->inputCount);
+}
+
+Iterator *inputLeapfrog(Iterator *iterator, int index) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  return (index < p->inputCount) ? p->inputs[index] : NULL;
+}
+
+Iterator *cloneLeapfrog(Iterator *iterator) {
+  assert(iterator->TYPE == LEAPFROG_ITERATOR);
+  LeapfrogJoinIterator *p = (LeapfrogJoinIterator *)iterator;
+  Iterator **inputs = malloc(sizeof(Iterator *) * p->inputCount);
+  for (int i = 0; i < p->inputCount; i++) {
+    inputs[i] = p->inputs[i]->clone(p->inputs[i]);
+  }
+  Iterator *clone = createLeapfrogJoinIterator(inputs, p->inputCount);
+  free(inputs);
+  return clone;
+}
+
+void initLeapfrogJoinIterator(LeapfrogJoinIterator *iterator, Iterator **inputs, Iterator **ownInputs, int inputCount) {
+  assert(inputCount > 0);
+  iterator->fn.TYPE = LEAPFROG_ITERATOR;
+  iterator->fn.advance = &advanceLeapfrog;
+  iterator->fn.nextOperand = &nextOperandLeapfrog;
+  iterator->fn.peek = &peekLeapfrog;
+  iterator->fn.peekKey = &peekKeyLeapfrog;
+  iterator->fn.done = &doneLeapfrog;
+  iterator->fn.init = &initLeapfrog;
+  iterator->fn.free = &freeLeapfrog;
+  iterator->fn.seek = &seekLeapfrog;
+  iterator->fn.nextBatch = &nextBatchLeapfrog;
+  iterator->fn.clone = &cloneLeapfrog;
+  iterator->fn.describe = &describeLeapfrog;
+  iterator->fn.input = &inputLeapfrog;
+  iterator->inputs = ownInputs;
+  for (int i = 0; i < inputCount; i++) {
+    iterator->inputs[i] = inputs[i];
+  }
+  iterator->inputCount = inputCount;
+  iterator->currentIterator = NULL;
+  iterator->matched = FALSE;
+  iterator->matchedKey = 0;
+  ITERATOR_STATS_INSTALL(iterator);
+}
+
+Iterator *createLeapfrogJoinIterator(Iterator **inputs, int inputCount) {
+  LeapfrogJoinIterator *iterator = malloc(sizeof(LeapfrogJoinIterator));
+  initLeapfrogJoinIterator(iterator, inputs, malloc(sizeof(Iterator *) * inputCount), inputCount);
+  return (Iterator*)iterator;
+}
+
+Iterator *createLeapfrogJoinIteratorInArena(Arena *arena, Iterator **inputs, int inputCount) {
+  LeapfrogJoinIterator *iterator = arenaAllocate(arena, sizeof(LeapfrogJoinIterator));
+  initLeapfrogJoinIterator(iterator, inputs, arenaAllocate(arena, sizeof(Iterator *) * inputCount), inputCount);
+  iterator->fn.free = &freeArenaIterator;
+  return (Iterator*)iterator;
+}
+
+/*
+  Leapfrog Triejoin
+*/
+
+// a two level trie over a sorted pair array: level 0 walks the distinct high halves,
+// level 1 the low halves sharing the high half bound at level 0
+typedef struct {
+  EntityPair *pairs;
+  unsigned long count;
+  int depth;
+  int variables[2];
+
+  unsigned long position;
+  unsigned long end;
+  EntityPair prefix;
+  // where the level 0 key owning the open level 1 run starts
+  unsigned long parentPosition;
+} TrieCursor;
+
+typedef struct {
+  TrieCursor *cursors;
+  int variableCount;
+  // participants[v] lists the cursors that mention variable v, participantCounts[v] of them
+  TrieCursor ***participants;
+  int *participantCounts;
+  EntityId *bindings;
+  TriejoinCallback callback;
+  void *context;
+  unsigned long resultCount;
+} Triejoin;
+
+EntityId trieCursorKey(TrieCursor *cursor) {
+  EntityPair pair = cursor->pairs[cursor->position];
+  return (cursor->depth == 0) ? (EntityId)(pair >> ENTITY_PAIR_HALF_BIT_COUNT) : (EntityId)(pair & ENTITY_PAIR_HALF_MASK);
+}
+
+BOOL trieCursorAtEnd(TrieCursor *cursor) {
+  return cursor->position >= cursor->end;
+}
+
+void trieCursorSeek(TrieCursor *cursor, EntityId target) {
+  cursor->position = gallopEntityPairs(cursor->pairs, cursor->position, cursor->end, cursor->prefix | (EntityPair)target);
+}
+
+void trieCursorSeekHigh(TrieCursor *cursor, EntityId target) {
+  cursor->position = gallopEntityPairs(cursor->pairs, cursor->position, cursor->end, (EntityPair)target << ENTITY_PAIR_HALF_BIT_COUNT);
+}
+
+void trieCursorNext(TrieCursor *cursor) {
+  EntityId key = trieCursorKey(cursor);
+  // skip the rest of the run sharing this key
+  if (cursor->depth == 0) {
+    if (key == (EntityId)ENTITY_PAIR_HALF_MASK) {
+      cursor->position = cursor->end;
+    } else {
+      trieCursorSeekHigh(cursor, key + 1);
+    }
+  } else {
+    if (key == (EntityId)ENTITY_PAIR_HALF_MASK) {
+      cursor->position = cursor->end;
+    } else {
+      trieCursorSeek(cursor, key + 1);
+    }
+  }
+}
+
+void trieCursorOpen(TrieCursor *cursor) {
+  if (cursor->depth < 0) {
+    cursor->depth = 0;
+    cursor->position = 0;
+    cursor->end = cursor->count;
+    return;
+  }
+  assert(cursor->depth == 0);
+  EntityId key = trieCursorKey(cursor);
+  cursor->depth = 1;
+  cursor->parentPosition = cursor->position;
+  cursor->prefix = (EntityPair)key << ENTITY_PAIR_HALF_BIT_COUNT;
+  if (key == (EntityId)ENTITY_PAIR_HALF_MASK) {
+    cursor->end = cursor->count;
+  } else {
+    cursor->end = gallopEntityPairs(cursor->pairs, cursor->position, cursor->count, (EntityPair)(key + 1) << ENTITY_PAIR_HALF_BIT_COUNT);
+  }
+}
+
+void trieCursorUp(TrieCursor *cursor) {
+  if (cursor->depth == 1) {
+    // back on the level 0 key the run belongs to
+    cursor->depth = 0;
+    cursor->end = cursor->count;
+    cursor->position = cursor->parentPosition;
+    cursor->prefix = 0;
+  } else {
+    cursor->depth = -1;
+  }
+}
+
+void triejoinSearch(Triejoin *join, int variable);
+
+void triejoinLeapfrog(Triejoin *join, int variable) {
+  TrieCursor **cursors = join->participants[variable];
+  int count = join->participantCounts[variable];
+
+  for (int i = 0; i < count; i++) {
+    if (trieCursorAtEnd(cursors[i])) {
+      return;
+    }
+  }
+
+  EntityId target = trieCursorKey(cursors[0]);
+  for (int i = 1; i < count; i++) {
+    EntityId key = trieCursorKey(cursors[i]);
+    target = (key > target) ? key : target;
+  }
+
+  int agreed = 0;
+  int i = 0;
+  for (;;) {
+    TrieCursor *cursor = cursors[i];
+    if (cursor->depth == 0) {
+      trieCursorSeekHigh(cursor, target);
+    } else {
+      trieCursorSeek(cursor, target);
+    }
+    if (trieCursorAtEnd(cursor)) {
+      return;
+    }
+    EntityId key = trieCursorKey(cursor);
+    if (key == target) {
+      agreed++;
+    } else {
+      target = key;
+      agreed = 1;
+    }
+
+    if (agreed == count) {
+      join->bindings[variable] = target;
+      triejoinSearch(join, variable + 1);
+      // restart the round from this cursor on its next key
+      trieCursorNext(cursor);
+      if (trieCursorAtEnd(cursor)) {
+        return;
+      }
+      target = trieCursorKey(cursor);
+      agreed = 0;
+      continue;
+    }
+    i = (i + 1) % count;
+  }
+}
+
+void triejoinSearch(Triejoin *join, int variable) {
+  if (variable == join->variableCount) {
+    if (join->callback != NULL) {
+      join->callback(join->bindings, join->context);
+    }
+    join->resultCount++;
+    return;
+  }
+
+  TrieCursor **cursors = join->participants[variable];
+  int count = join->participantCounts[variable];
+  for (int i = 0; i < count; i++) {
+    trieCursorOpen(cursors[i]);
+  }
+  triejoinLeapfrog(join, variable);
+  for (int i = 0; i < count; i++) {
+    trieCursorUp(cursors[i]);
+  }
+}
+
+unsigned long leapfrogTriejoin(TriejoinAtom *atoms, int atomCount, int variableCount, TriejoinCallback callback, void *context) {
+  Triejoin join;
+  join.cursors = malloc(sizeof(TrieCursor) * atomCount);
+  join.variableCount = variableCount;
+  join.participants = malloc(sizeof(TrieCursor **) * variableCount);
+  join.participantCounts = calloc(variableCount, sizeof(int));
+  join.bindings = calloc(variableCount, sizeof(EntityId));
+  join.callback = callback;
+  join.context = context;
+  join.resultCount = 0;
+
+  for (int v = 0; v < variableCount; v++) {
+    join.participants[v] = malloc(sizeof(TrieCursor *) * atomCount);
+  }
+
+  for (int a = 0; a < atomCount; a++) {
+    TriejoinAtom *atom = &atoms[a];
+    assert(atom->subjectVariable != atom->objectVariable);
+    assert(atom->subjectVariable >= 0 && atom->subjectVariable < variableCount);
+    assert(atom->objectVariable >= 0 && atom->objectVariable < variableCount);
+    assert(!isCompressedPredicateEntry(atom->entry));
+    // the cursors seek the whole array as one sorted run, so merge in any delta, tail and tombstones
+    compactPredicateEntry(atom->entry);
+
+    TrieCursor *cursor = &join.cursors[a];
+    // the trie is keyed by whichever variable is bound first
+    BOOL subjectFirst = atom->subjectVariable < atom->objectVariable;
+    cursor->pairs = subjectFirst ? atom->entry->soEntries : atom->entry->osEntries;
+    cursor->count = atom->entry->entryCount;
+    cursor->depth = -1;
+    cursor->variables[0] = subjectFirst ? atom->subjectVariable : atom->objectVariable;
+    cursor->variables[1] = subjectFirst ? atom->objectVariable : atom->subjectVariable;
+    cursor->position = 0;
+    cursor->end = 0;
+    cursor->prefix = 0;
+    cursor->parentPosition = 0;
+
+    join.participants[cursor->variables[0]][join.participantCounts[cursor->variables[0]]++] = cursor;
+    join.participants[cursor->variables[1]][join.participantCounts[cursor->variables[1]]++] = cursor;
+  }
+
+  for (int v = 0; v < variableCount; v++) {
+    // every variable has to be constrained by at least one atom
+    assert(join.participantCounts[v] > 0);
+  }
+
+  triejoinSearch(&join, 0);
+
+  for (int v = 0; v < variableCount; v++) {
+    free(join.participants[v]);
+  }
+  free(join.bindings);
+  free(join.participantCounts);
+  free(join.participants);
+  free(join.cursors);
+  return join.resultCount;
+}
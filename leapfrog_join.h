@@ -0,0 +1,44 @@
+#ifndef LEAPFROG_JOIN_H_INCLUDED
+#define LEAPFROG_JOIN_H_INCLUDED
+
+#include "triple.h"
+#include "iterator.h"
+#include "predicate_entry.h"
+
+/*
+  N-ary leapfrog join over inputs sorted by key (see peekKey). It emits every triple of inputs[0] whose
+  key occurs in all the other inputs, the same result as a tree of AND iterators with
+  inputs[0] leftmost, without the per-level peeks. The join takes ownership of the inputs.
+*/
+typedef struct {
+  Iterator fn;
+  Iterator **inputs;
+  int inputCount;
+  Iterator *currentIterator;
+  BOOL matched;
+  EntityId matchedKey;
+} LeapfrogJoinIterator;
+
+Iterator *createLeapfrogJoinIterator(Iterator **inputs, int inputCount);
+// see the InArena iterators in predicate_entry.h; inputs is copied into the arena
+Iterator *createLeapfrogJoinIteratorInArena(Arena *arena, Iterator **inputs, int inputCount);
+
+/*
+  Leapfrog triejoin: worst-case optimal evaluation of a conjunction of binary atoms.
+  Variables are numbered 0 .. variableCount - 1 and bound in that order. Each atom reads
+  soEntries when its subject variable comes first and osEntries otherwise, so the entries must
+  not be compressed; they are compacted first, which writes to them like iterating does. The
+  callback sees one complete binding per result.
+*/
+typedef struct {
+  PredicateEntry *entry;
+  int subjectVariable;
+  int objectVariable;
+} TriejoinAtom;
+
+typedef void (*TriejoinCallback)(const EntityId *bindings, void *context);
+
+// returns the number of results passed to callback; callback may be NULL to only count
+unsigned long leapfrogTriejoin(TriejoinAtom *atoms, int atomCount, int variableCount, TriejoinCallback callback, void *context);
+
+#endif
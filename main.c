@@ -16,4 +16,5 @@ int main(void)
   //   printf("Hello, %s.\n", buffer);
   // }
   initialize();
+  finalize();
 }
@@ -0,0 +1,310 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "morsel_executor.h"
+#include "parallel.h"
+
+// one worker's remaining run of morsels, [head, tail); the owner takes from the head, thieves from the tail
+typedef struct {
+  unsigned long head;
+  unsigned long tail;
+  pthread_mutex_t lock;
+} MorselQueue;
+
+// results of one morsel, held until every earlier morsel has been passed on
+typedef struct {
+  Triple *triples;
+  unsigned long count;
+  unsigned long currentLength;
+  BOOL complete;
+} MorselResult;
+
+typedef struct {
+  Iterator *prototype;
+  MorselOptions *options;
+  MorselCallback callback;
+  void *context;
+
+  // morselCount + 1 ascending bounds; morsel m covers keys [bounds[m], bounds[m + 1])
+  unsigned long long *bounds;
+  unsigned long morselCount;
+  MorselQueue *queues;
+  unsigned long *counts;
+
+  // ordered mode only
+  MorselResult *results;
+  unsigned long nextResult;
+  pthread_mutex_t resultLock;
+} MorselExecution;
+
+void initMorselOptions(MorselOptions *options) {
+  options->threadCount = 0;
+  options->morselCount = 0;
+  options->ordered = FALSE;
+  options->order = SUBJECT_ORDER;
+  options->partitionEntry = NULL;
+}
+
+static inline unsigned long long morselKey(Triple triple, unsigned char order) {
+  return (order == SUBJECT_ORDER) ? subjectIdFromTriple(triple) : objectIdFromTriple(triple);
+}
+
+// key at the given triple position of the entry's pairs in the given order
+unsigned long long partitionKeyAt(PredicateEntry *entry, unsigned char order, unsigned long position) {
+  if (isCompressedPredicateEntry(entry)) {
+    CompressedAdjacency *adjacency = (order == SUBJECT_ORDER) ? entry->soCompressed : entry->osCompressed;
+    // the last key whose run starts at or before position
+    unsigned long low = 0;
+    unsigned long high = adjacency->keyCount;
+    while (high - low > 1) {
+      unsigned long middle = low + (high - low) / 2;
+      if (getBitPackedValue(&adjacency->offsets, middle) <= position) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+    return getBitPackedValue(&adjacency->keys, low);
+  }
+  EntityPair *pairs = (order == SUBJECT_ORDER) ? entry->soEntries : entry->osEntries;
+  return (unsigned long long)(pairs[position] >> ENTITY_PAIR_HALF_BIT_COUNT);
+}
+
+// how many of the entry's leading pairs form one sorted run to sample bounds from; a prepared
+// entry keeps a delta only while it is under 1/PREDICATE_ENTRY_DELTA_MERGE_RATIO of the base,
+// so the base alone places the bounds closely enough
+unsigned long preparePartitionEntry(PredicateEntry *entry) {
+  if (isCompressedPredicateEntry(entry)) {
+    return entry->entryCount;
+  }
+  if (entry->sortedCount == 0) {
+    optimizePredicateEntry(entry);
+  }
+  preparePredicateEntryForReading(entry);
+  return entry->sortedCount;
+}
+
+// fills bounds with up to morselCount + 1 strictly ascending keys and returns the resulting morsel count
+unsigned long computeMorselBounds(MorselOptions *options, unsigned long morselCount, unsigned long long *bounds) {
+  unsigned long long keyLimit = (unsigned long long)((options->order == SUBJECT_ORDER) ? SUBJECT_ID_MAX : OBJECT_ID_MAX) + 1;
+  PredicateEntry *entry = options->partitionEntry;
+  unsigned long sampledCount = (entry != NULL) ? preparePartitionEntry(entry) : 0;
+  unsigned long count = 0;
+  bounds[count++] = 0;
+  for (unsigned long m = 1; m < morselCount; m++) {
+    unsigned long long bound;
+    if (entry != NULL) {
+      if (sampledCount == 0) {
+        break;
+      }
+      bound = partitionKeyAt(entry, options->order, (unsigned long)((unsigned long long)sampledCount * m / morselCount));
+    } else {
+      bound = keyLimit / morselCount * m;
+    }
+    // a key heavier than a morsel repeats; it stays in the one morsel that starts at it
+    if (bound > bounds[count - 1] && bound < keyLimit) {
+      bounds[count++] = bound;
+    }
+  }
+  bounds[count] = keyLimit;
+  return count;
+}
+
+BOOL claimMorsel(MorselExecution *execution, int threadIndex, int threadCount, unsigned long *morsel) {
+  MorselQueue *own = &execution->queues[threadIndex];
+  pthread_mutex_lock(&own->lock);
+  BOOL claimed = own->head < own->tail;
+  if (claimed) {
+    *morsel = own->head++;
+  }
+  pthread_mutex_unlock(&own->lock);
+  if (claimed) {
+    return TRUE;
+  }
+
+  for (int i = 1; i < threadCount; i++) {
+    MorselQueue *victim = &execution->queues[(threadIndex + i) % threadCount];
+    pthread_mutex_lock(&victim->lock);
+    claimed = victim->head < victim->tail;
+    if (claimed) {
+      *morsel = --victim->tail;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    if (claimed) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+void appendMorselResult(MorselResult *result, const Triple *triples, unsigned long count) {
+  if (result->count + count > result->currentLength) {
+    while (result->count + count > result->currentLength) {
+      result->currentLength = (result->currentLength > 0) ? result->currentLength * 2 : ITERATOR_BATCH_LENGTH;
+    }
+    result->triples = realloc(result->triples, sizeof(Triple) * result->currentLength);
+  }
+  memcpy(result->triples + result->count, triples, sizeof(Triple) * count);
+  result->count += count;
+}
+
+void emitMorselTriples(MorselExecution *execution, int threadIndex, MorselResult *result, const Triple *triples, unsigned long count) {
+  if (count == 0) {
+    return;
+  }
+  execution->counts[threadIndex] += count;
+  if (execution->callback == NULL) {
+    return;
+  }
+  if (execution->options->ordered) {
+    appendMorselResult(result, triples, count);
+  } else {
+    execution->callback(threadIndex, triples, count, execution->context);
+  }
+}
+
+void completeMorsel(MorselExecution *execution, int threadIndex, unsigned long morsel) {
+  pthread_mutex_lock(&execution->resultLock);
+  execution->results[morsel].complete = TRUE;
+  // whoever completes the oldest pending morsel passes on every finished one after it
+  while (execution->nextResult < execution->morselCount && execution->results[execution->nextResult].complete) {
+    MorselResult *result = &execution->results[execution->nextResult];
+    if (result->count > 0) {
+      execution->callback(threadIndex, result->triples, result->count, execution->context);
+    }
+    free(result->triples);
+    result->triples = NULL;
+    execution->nextResult++;
+  }
+  pthread_mutex_unlock(&execution->resultLock);
+}
+
+// emits the triples of [triples, triples + count) that fall in [low, high), all of them ascending by key
+// returns how many leading triples were consumed, i.e. have keys below high
+unsigned long emitMorselRange(MorselExecution *execution, int threadIndex, MorselResult *result,
+                              const Triple *triples, unsigned long count, unsigned long long low, unsigned long long high) {
+  unsigned char order = execution->options->order;
+  unsigned long begin = 0;
+  while (begin < count && morselKey(triples[begin], order) < low) {
+    begin++;
+  }
+  unsigned long end = begin;
+  while (end < count && morselKey(triples[end], order) < high) {
+    end++;
+  }
+  emitMorselTriples(execution, threadIndex, result, triples + begin, end - begin);
+  return end;
+}
+
+void morselTask(int threadIndex, int threadCount, void *arg) {
+  MorselExecution *execution = (MorselExecution *)arg;
+  Triple *batch = malloc(sizeof(Triple) * ITERATOR_BATCH_LENGTH);
+  // a batch can run past a morsel's high key; the overshoot is kept for the next morsel
+  Triple *carry = malloc(sizeof(Triple) * ITERATOR_BATCH_LENGTH);
+  unsigned long carryCount = 0;
+  Iterator *iterator = NULL;
+  unsigned long long position = 0;
+  MorselResult unorderedResult;
+  memset(&unorderedResult, 0, sizeof(unorderedResult));
+
+  unsigned long morsel;
+  while (claimMorsel(execution, threadIndex, threadCount, &morsel)) {
+    unsigned long long low = execution->bounds[morsel];
+    unsigned long long high = execution->bounds[morsel + 1];
+    MorselResult *result = execution->options->ordered ? &execution->results[morsel] : &unorderedResult;
+
+    // iterators never move backwards, so a stolen morsel behind this worker's clone needs a fresh one
+    if (iterator == NULL || low < position) {
+      if (iterator != NULL) {
+        iterator->free(iterator);
+      }
+      iterator = execution->prototype->clone(execution->prototype);
+      iterator->init(iterator);
+      carryCount = 0;
+    }
+    position = high;
+
+    unsigned long consumed = emitMorselRange(execution, threadIndex, result, carry, carryCount, low, high);
+    memmove(carry, carry + consumed, sizeof(Triple) * (carryCount - consumed));
+    carryCount -= consumed;
+
+    if (carryCount == 0) {
+      iterator->seek(iterator, (EntityId)low);
+      for (;;) {
+        unsigned long count = nextBatch(iterator, batch, ITERATOR_BATCH_LENGTH);
+        if (count == 0) {
+          break;
+        }
+        consumed = emitMorselRange(execution, threadIndex, result, batch, count, low, high);
+        if (consumed < count) {
+          memcpy(carry, batch + consumed, sizeof(Triple) * (count - consumed));
+          carryCount = count - consumed;
+          break;
+        }
+      }
+    }
+
+    if (execution->options->ordered && execution->callback != NULL) {
+      completeMorsel(execution, threadIndex, morsel);
+    }
+  }
+
+  if (iterator != NULL) {
+    iterator->free(iterator);
+  }
+  free(carry);
+  free(batch);
+}
+
+unsigned long executeMorsels(Iterator *iterator, MorselOptions *options, MorselCallback callback, void *context) {
+  assert(options->order == SUBJECT_ORDER || options->order == OBJECT_ORDER);
+  int threadCount = (options->threadCount > 0) ? options->threadCount : availableThreadCount();
+  unsigned long morselCount = (options->morselCount > 0) ? options->morselCount : (unsigned long)threadCount * MORSELS_PER_THREAD;
+
+  MorselExecution execution;
+  execution.prototype = iterator;
+  execution.options = options;
+  execution.callback = callback;
+  execution.context = context;
+  execution.bounds = malloc(sizeof(unsigned long long) * (morselCount + 1));
+  execution.morselCount = computeMorselBounds(options, morselCount, execution.bounds);
+  if ((unsigned long)threadCount > execution.morselCount) {
+    threadCount = (int)execution.morselCount;
+  }
+
+  execution.queues = malloc(sizeof(MorselQueue) * threadCount);
+  execution.counts = calloc(threadCount, sizeof(unsigned long));
+  for (int t = 0; t < threadCount; t++) {
+    unsigned long begin;
+    unsigned long end;
+    parallelChunk(execution.morselCount, t, threadCount, &begin, &end);
+    execution.queues[t].head = begin;
+    execution.queues[t].tail = end;
+    pthread_mutex_init(&execution.queues[t].lock, NULL);
+  }
+  execution.results = NULL;
+  execution.nextResult = 0;
+  if (options->ordered) {
+    execution.results = calloc(execution.morselCount, sizeof(MorselResult));
+    pthread_mutex_init(&execution.resultLock, NULL);
+  }
+
+  runParallel(threadCount, &morselTask, &execution);
+
+  unsigned long total = 0;
+  for (int t = 0; t < threadCount; t++) {
+    total += execution.counts[t];
+    pthread_mutex_destroy(&execution.queues[t].lock);
+  }
+  if (options->ordered) {
+    pthread_mutex_destroy(&execution.resultLock);
+    free(execution.results);
+  }
+  free(execution.counts);
+  free(execution.queues);
+  free(execution.bounds);
+  return total;
+}
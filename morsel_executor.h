@@ -0,0 +1,41 @@
+#ifndef MORSEL_EXECUTOR_H_INCLUDED
+#define MORSEL_EXECUTOR_H_INCLUDED
+
+#include "iterator.h"
+#include "predicate_entry.h"
+
+/*
+  Runs an iterator tree on several threads by splitting its key space into morsels,
+  contiguous key ranges [low, high). Each worker clones the tree (see Iterator.clone),
+  seeks it to a morsel's low key and drains it up to the high key. Morsels are dealt out
+  in contiguous runs, one per worker, and idle workers steal from the back of the others'
+  runs. Every input of the tree must be keyed on the same component, as for the joins.
+*/
+
+#define MORSELS_PER_THREAD 16
+
+// called with consecutive results; in ordered mode calls are serialized and follow the tree's order,
+// otherwise workers call it concurrently and threadIndex identifies the calling worker
+typedef void (*MorselCallback)(int threadIndex, const Triple *triples, unsigned long count, void *context);
+
+typedef struct {
+  // < 1 uses availableThreadCount()
+  int threadCount;
+  // 0 uses MORSELS_PER_THREAD per thread
+  unsigned long morselCount;
+  BOOL ordered;
+  // the component the tree is keyed on, SUBJECT_ORDER or OBJECT_ORDER
+  unsigned char order;
+  // when set, morsel bounds are placed at evenly spaced positions of this entry's pairs
+  // (in the tree's order) so morsels hold similar numbers of triples; otherwise the id range is split evenly
+  // the entry is optimized or prepared for reading first, so it must not be shared with running readers
+  PredicateEntry *partitionEntry;
+} MorselOptions;
+
+void initMorselOptions(MorselOptions *options);
+
+// the iterator is only used as a prototype to clone and is left untouched
+// returns the number of triples produced; callback may be NULL to only count
+unsigned long executeMorsels(Iterator *iterator, MorselOptions *options, MorselCallback callback, void *context);
+
+#endif
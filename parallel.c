@@ -0,0 +1,65 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "parallel.h"
+
+typedef struct {
+  ParallelTaskFn task;
+  void *context;
+  int threadIndex;
+  int threadCount;
+} ParallelTaskArgs;
+
+int availableThreadCount() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return (count > 0) ? (int)count : 1;
+}
+
+void *runParallelTask(void *arg) {
+  ParallelTaskArgs *args = (ParallelTaskArgs *)arg;
+  args->task(args->threadIndex, args->threadCount, args->context);
+  return NULL;
+}
+
+void runParallel(int threadCount, ParallelTaskFn task, void *context) {
+  assert(threadCount > 0);
+  if (threadCount == 1) {
+    task(0, 1, context);
+    return;
+  }
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * threadCount);
+  ParallelTaskArgs *args = malloc(sizeof(ParallelTaskArgs) * threadCount);
+
+  for (int i = 0; i < threadCount; i++) {
+    args[i].task = task;
+    args[i].context = context;
+    args[i].threadIndex = i;
+    args[i].threadCount = threadCount;
+  }
+  for (int i = 1; i < threadCount; i++) {
+    int result = pthread_create(&threads[i], NULL, &runParallelTask, &args[i]);
+    assert(result == 0);
+    (void)result;
+  }
+
+  runParallelTask(&args[0]);
+
+  for (int i = 1; i < threadCount; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  free(args);
+  free(threads);
+}
+
+void parallelChunk(unsigned long length, int threadIndex, int threadCount, unsigned long *begin, unsigned long *end) {
+  unsigned long chunk = length / threadCount;
+  unsigned long remainder = length % threadCount;
+  unsigned long index = (unsigned long)threadIndex;
+  *begin = index * chunk + ((index < remainder) ? index : remainder);
+  *end = *begin + chunk + ((index < remainder) ? 1 : 0);
+}
@@ -0,0 +1,15 @@
+#ifndef PARALLEL_H_INCLUDED
+#define PARALLEL_H_INCLUDED
+
+// called once per thread; threadIndex is in [0, threadCount)
+typedef void (*ParallelTaskFn)(int threadIndex, int threadCount, void *context);
+
+int availableThreadCount();
+
+// runs task on threadCount threads (the caller's thread is index 0) and waits for all of them
+void runParallel(int threadCount, ParallelTaskFn task, void *context);
+
+// splits [0, length) into threadCount contiguous chunks and returns the bounds of chunk threadIndex
+void parallelChunk(unsigned long length, int threadIndex, int threadCount, unsigned long *begin, unsigned long *end);
+
+#endif
@@ -1,8 +1,11 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "segment.h"
+#include "radix_sort.h"
+#include "simd_kernels.h"
 
 EntityPair toSOEntry(SubjectId subject, ObjectId object) {
   return ((EntityPair)subject << ENTITY_PAIR_HALF_BIT_COUNT) | (EntityPair)object;
@@ -44,36 +47,394 @@ Triple toTripleFromOSEntry(EntityPair osPair, PredicateId predicate) {
   return toTriple(subjectIdFromOSEntry(osPair), predicate, objectIdFromOSEntry(osPair));
 }
 
+// headers are small and segments hold thousands of them, so they come from slabs rather than one malloc each
+#define PREDICATE_ENTRY_SLAB_LENGTH 256
+static SlabPool predicateEntryPool = SLAB_POOL_INITIALIZER(sizeof(PredicateEntry), PREDICATE_ENTRY_SLAB_LENGTH);
+
 PredicateEntry* createPredicateEntry(PredicateId predicate) {
-  PredicateEntry *entry = malloc(sizeof(PredicateEntry));
+  return createPredicateEntryWithCapacity(predicate, PREDICATE_ENTRY_INITIAL_ALLOCATION_LENGTH);
+}
+
+PredicateEntry* createPredicateEntryWithCapacity(PredicateId predicate, unsigned long capacity) {
+  PredicateEntry *entry = slabAllocate(&predicateEntryPool);
   entry->predicate = predicate;
   entry->entryCount = 0;
-  entry->currentEntriesLength = PREDICATE_ENTRY_INITIAL_ALLOCATION_LENGTH;
+  // addToPredicateEntry grows one slot early, so a bulk load that fills the entry exactly never adds
+  entry->currentEntriesLength = capacity > 0 ? capacity : 1;
   entry->soEntries = malloc(sizeof(EntityPair) * entry->currentEntriesLength);
   entry->osEntries = malloc(sizeof(EntityPair) * entry->currentEntriesLength);
+  entry->sortedCount = 0;
+  entry->deltaSortedCount = 0;
+  entry->soTombstones = NULL;
+  entry->osTombstones = NULL;
+  entry->tombstoneCount = 0;
+  entry->sortedTombstoneCount = 0;
+  entry->currentTombstonesLength = 0;
+  entry->soCompressed = NULL;
+  entry->osCompressed = NULL;
+  entry->borrowed = FALSE;
+  entry->subjectBitmap = NULL;
+  entry->bloomFilter = NULL;
+  entry->statistics = NULL;
   return entry;
 }
 
+PredicateEntry *createBorrowedPredicateEntry(PredicateId predicate, EntityPair *soEntries, EntityPair *osEntries, unsigned long entryCount) {
+  PredicateEntry *entry = slabAllocate(&predicateEntryPool);
+  entry->predicate = predicate;
+  entry->entryCount = entryCount;
+  entry->currentEntriesLength = entryCount;
+  entry->soEntries = soEntries;
+  entry->osEntries = osEntries;
+  entry->sortedCount = entryCount;
+  entry->deltaSortedCount = 0;
+  entry->soTombstones = NULL;
+  entry->osTombstones = NULL;
+  entry->tombstoneCount = 0;
+  entry->sortedTombstoneCount = 0;
+  entry->currentTombstonesLength = 0;
+  entry->soCompressed = NULL;
+  entry->osCompressed = NULL;
+  entry->borrowed = TRUE;
+  entry->subjectBitmap = NULL;
+  entry->bloomFilter = NULL;
+  entry->statistics = NULL;
+  return entry;
+}
+
+// the tombstones and statistics, which copies and views keep privately
+void copyPredicateEntryRemovals(PredicateEntry *copy, PredicateEntry *entry) {
+  if (entry->tombstoneCount > 0) {
+    copy->currentTombstonesLength = entry->currentTombstonesLength;
+    copy->soTombstones = malloc(sizeof(EntityPair) * copy->currentTombstonesLength);
+    copy->osTombstones = malloc(sizeof(EntityPair) * copy->currentTombstonesLength);
+    memcpy(copy->soTombstones, entry->soTombstones, sizeof(EntityPair) * entry->tombstoneCount);
+    memcpy(copy->osTombstones, entry->osTombstones, sizeof(EntityPair) * entry->tombstoneCount);
+    copy->tombstoneCount = entry->tombstoneCount;
+    copy->sortedTombstoneCount = entry->sortedTombstoneCount;
+  }
+  if (entry->statistics != NULL) {
+    copy->statistics = malloc(sizeof(PredicateEntryStatistics));
+    memcpy(copy->statistics, entry->statistics, sizeof(PredicateEntryStatistics));
+  }
+}
+
+PredicateEntry *copyPredicateEntry(PredicateEntry *entry, unsigned long extraCapacity) {
+  assert(entry->soCompressed == NULL);
+  // addToPredicateEntry grows one slot early, so the last of extraCapacity adds needs one more
+  PredicateEntry *copy = createPredicateEntryWithCapacity(entry->predicate, entry->entryCount + extraCapacity + 1);
+  memcpy(copy->soEntries, entry->soEntries, sizeof(EntityPair) * entry->entryCount);
+  memcpy(copy->osEntries, entry->osEntries, sizeof(EntityPair) * entry->entryCount);
+  copy->entryCount = entry->entryCount;
+  copy->sortedCount = entry->sortedCount;
+  copy->deltaSortedCount = entry->deltaSortedCount;
+  copyPredicateEntryRemovals(copy, entry);
+  return copy;
+}
+
+PredicateEntry *createPredicateEntryView(PredicateEntry *entry) {
+  assert(entry->soCompressed == NULL && entry->deltaSortedCount == 0 && predicateEntryUnsortedCount(entry) == 0);
+  PredicateEntry *view = createBorrowedPredicateEntry(entry->predicate, entry->soEntries, entry->osEntries, entry->entryCount);
+  copyPredicateEntryRemovals(view, entry);
+  return view;
+}
+
+void freeCompressedAdjacency(CompressedAdjacency *adjacency) {
+  destroyBitPackedArray(&adjacency->keys);
+  destroyBitPackedArray(&adjacency->offsets);
+  destroyBitPackedArray(&adjacency->values);
+  free(adjacency);
+}
+
 void freePredicateEntry(PredicateEntry *entry) {
-  free(entry->soEntries);
-  free(entry->osEntries);
-  free(entry);
+  if (!entry->borrowed) {
+    free(entry->soEntries);
+    free(entry->osEntries);
+  }
+  free(entry->soTombstones);
+  free(entry->osTombstones);
+  if (entry->soCompressed != NULL) {
+    freeCompressedAdjacency(entry->soCompressed);
+    freeCompressedAdjacency(entry->osCompressed);
+  }
+  if (entry->subjectBitmap != NULL) {
+    freeSubjectBitmap(entry->subjectBitmap);
+  }
+  if (entry->bloomFilter != NULL) {
+    freeBloomFilter(entry->bloomFilter);
+  }
+  free(entry->statistics);
+  slabFree(&predicateEntryPool, entry);
+}
+
+unsigned long predicateEntryUnsortedCount(PredicateEntry *entry) {
+  // compressed and borrowed entries are sorted already
+  if (entry->soCompressed != NULL || entry->borrowed) {
+    return 0;
+  }
+  return entry->entryCount - entry->sortedCount;
+}
+
+void sortEntityPairs(EntityPair *pairs, EntityPair *scratch, unsigned long count, int threadCount) {
+  if (threadCount > 0) {
+    radixSortEntityPairsWithThreads(pairs, scratch, count, threadCount);
+  } else {
+    radixSortEntityPairs(pairs, scratch, count);
+  }
+}
+
+// merges the sorted runs [0, middle) and [middle, count) in place; scratch holds count - middle pairs
+// it works from the back, so only the pairs of the first run that sort after the second run's first pair move
+void mergeEntityPairRuns(EntityPair *pairs, unsigned long middle, unsigned long count, EntityPair *scratch) {
+  if (middle == 0 || middle == count || pairs[middle - 1] <= pairs[middle]) {
+    return;
+  }
+  unsigned long j = count - middle;
+  memcpy(scratch, pairs + middle, sizeof(EntityPair) * j);
+  unsigned long i = middle;
+  unsigned long k = count;
+  while (j > 0) {
+    if (i > 0 && pairs[i - 1] > scratch[j - 1]) {
+      pairs[--k] = pairs[--i];
+    } else {
+      pairs[--k] = scratch[--j];
+    }
+  }
+}
+
+// sorts the tail and merges it into the delta
+void sortPredicateEntryTail(PredicateEntry *entry, EntityPair *scratch, int threadCount) {
+  unsigned long deltaBegin = entry->sortedCount;
+  unsigned long tailBegin = deltaBegin + entry->deltaSortedCount;
+  unsigned long tailCount = entry->entryCount - tailBegin;
+  EntityPair *sides[] = {entry->soEntries, entry->osEntries};
+  for (int side = 0; side < 2; side++) {
+    sortEntityPairs(sides[side] + tailBegin, scratch, tailCount, threadCount);
+    mergeEntityPairRuns(sides[side] + deltaBegin, entry->deltaSortedCount, entry->entryCount - deltaBegin, scratch);
+  }
+  entry->deltaSortedCount = entry->entryCount - deltaBegin;
+}
+
+static inline unsigned int degreeBucket(unsigned long degree) {
+  unsigned int bucket = 63 - __builtin_clzll(degree);
+  return (bucket < PREDICATE_ENTRY_DEGREE_BUCKET_COUNT) ? bucket : PREDICATE_ENTRY_DEGREE_BUCKET_COUNT - 1;
+}
+
+// distinct keys, key range and degree histogram of one sorted side, from its pairs or its CSR form
+void recordSideStatistics(EntityPair *pairs, CompressedAdjacency *adjacency, unsigned long count,
+                          unsigned long *distinct, EntityId *min, EntityId *max, unsigned long *maxDegree, unsigned long *degrees) {
+  memset(degrees, 0, sizeof(unsigned long) * PREDICATE_ENTRY_DEGREE_BUCKET_COUNT);
+  *distinct = 0;
+  *min = 0;
+  *max = 0;
+  *maxDegree = 0;
+  if (count == 0) {
+    return;
+  }
+  if (adjacency != NULL) {
+    *distinct = adjacency->keyCount;
+    *min = getBitPackedValue(&adjacency->keys, 0);
+    *max = getBitPackedValue(&adjacency->keys, adjacency->keyCount - 1);
+    for (unsigned long k = 0; k < adjacency->keyCount; k++) {
+      unsigned long degree = getBitPackedValue(&adjacency->offsets, k + 1) - getBitPackedValue(&adjacency->offsets, k);
+      degrees[degreeBucket(degree)]++;
+      *maxDegree = (degree > *maxDegree) ? degree : *maxDegree;
+    }
+    return;
+  }
+  *min = pairs[0] >> ENTITY_PAIR_HALF_BIT_COUNT;
+  *max = pairs[count - 1] >> ENTITY_PAIR_HALF_BIT_COUNT;
+  unsigned long runBegin = 0;
+  for (unsigned long i = 1; i <= count; i++) {
+    if (i == count || (pairs[i] >> ENTITY_PAIR_HALF_BIT_COUNT) != (pairs[runBegin] >> ENTITY_PAIR_HALF_BIT_COUNT)) {
+      unsigned long degree = i - runBegin;
+      (*distinct)++;
+      degrees[degreeBucket(degree)]++;
+      *maxDegree = (degree > *maxDegree) ? degree : *maxDegree;
+      runBegin = i;
+    }
+  }
 }
 
-int predicateEntryCompareSubjectAscFunc (const void * a, const void * b) {
-   return ( subjectIdFromSOEntry(*(EntityPair *)a) - subjectIdFromSOEntry(*(EntityPair *)b) );
+void recordPredicateEntryStatistics(PredicateEntry *entry) {
+  if (entry->statistics == NULL) {
+    entry->statistics = malloc(sizeof(PredicateEntryStatistics));
+  }
+  PredicateEntryStatistics *statistics = entry->statistics;
+  statistics->entryCount = entry->entryCount;
+  EntityId min;
+  EntityId max;
+  recordSideStatistics(entry->soEntries, entry->soCompressed, entry->entryCount, &statistics->distinctSubjects,
+                       &min, &max, &statistics->maxSubjectDegree, statistics->subjectDegrees);
+  statistics->minSubject = min;
+  statistics->maxSubject = max;
+  recordSideStatistics(entry->osEntries, entry->osCompressed, entry->entryCount, &statistics->distinctObjects,
+                       &min, &max, &statistics->maxObjectDegree, statistics->objectDegrees);
+  statistics->minObject = min;
+  statistics->maxObject = max;
 }
 
-int predicateEntryCompareObjectAscFunc (const void * a, const void * b) {
-   return ( objectIdFromOSEntry(*(EntityPair *)a) - objectIdFromOSEntry(*(EntityPair *)b) );
+void refreshPredicateEntryStatistics(PredicateEntry *entry) {
+  if (entry->statistics != NULL) {
+    unsigned long recorded = entry->statistics->entryCount;
+    unsigned long drift = (entry->entryCount > recorded) ? entry->entryCount - recorded : recorded - entry->entryCount;
+    if (drift * PREDICATE_ENTRY_STATISTICS_DRIFT_RATIO <= recorded) {
+      return;
+    }
+  }
+  recordPredicateEntryStatistics(entry);
+}
+
+PredicateEntryStatistics *predicateEntryStatistics(PredicateEntry *entry) {
+  if (entry->statistics == NULL) {
+    recordPredicateEntryStatistics(entry);
+  }
+  return entry->statistics;
+}
+
+void optimizePredicateEntryWithThreads(PredicateEntry *entry, EntityPair *scratch, int threadCount) {
+  if (predicateEntryUnsortedCount(entry) == 0) {
+    return;
+  }
+  sortPredicateEntryTail(entry, scratch, threadCount);
+  mergeEntityPairRuns(entry->soEntries, entry->sortedCount, entry->entryCount, scratch);
+  mergeEntityPairRuns(entry->osEntries, entry->sortedCount, entry->entryCount, scratch);
+  entry->sortedCount = entry->entryCount;
+  entry->deltaSortedCount = 0;
+  refreshPredicateEntryStatistics(entry);
+}
+
+void optimizePredicateEntryWithScratch(PredicateEntry *entry, EntityPair *scratch) {
+  optimizePredicateEntryWithThreads(entry, scratch, 0);
 }
 
 void optimizePredicateEntry(PredicateEntry *entry) {
-  // only sort the entries which are present
-  if (entry->entryCount > 0) {
-    qsort(entry->soEntries,  entry->entryCount, sizeof(EntityPair), predicateEntryCompareSubjectAscFunc);
-    qsort(entry->osEntries,  entry->entryCount, sizeof(EntityPair), predicateEntryCompareObjectAscFunc);
+  unsigned long unsortedCount = predicateEntryUnsortedCount(entry);
+  if (unsortedCount > 0) {
+    EntityPair *scratch = malloc(sizeof(EntityPair) * unsortedCount);
+    optimizePredicateEntryWithScratch(entry, scratch);
+    free(scratch);
+  }
+}
+
+// the sorted base a reader sees, with the delta after it; a never optimized entry is all base, in insertion order
+static inline unsigned long predicateEntryBaseCount(PredicateEntry *entry) {
+  return (entry->sortedCount > 0) ? entry->sortedCount : entry->entryCount;
+}
+
+// the pairs half of preparePredicateEntryForReading, leaving pending tombstones buffered
+void preparePredicateEntryPairs(PredicateEntry *entry) {
+  // never optimized entries keep iterating in insertion order
+  unsigned long unsortedCount = predicateEntryUnsortedCount(entry);
+  if (entry->sortedCount == 0 || unsortedCount == 0) {
+    return;
+  }
+  if (unsortedCount * PREDICATE_ENTRY_DELTA_MERGE_RATIO > entry->sortedCount) {
+    optimizePredicateEntry(entry);
+    return;
+  }
+  if (entry->deltaSortedCount < unsortedCount) {
+    EntityPair *scratch = malloc(sizeof(EntityPair) * unsortedCount);
+    sortPredicateEntryTail(entry, scratch, 0);
+    free(scratch);
+  }
+}
+
+void sortPredicateEntryTombstones(PredicateEntry *entry);
+
+void preparePredicateEntryForReading(PredicateEntry *entry) {
+  if (entry->tombstoneCount > entry->sortedTombstoneCount) {
+    sortPredicateEntryTombstones(entry);
+  }
+  preparePredicateEntryPairs(entry);
+}
+
+void initOptimizeOptions(OptimizeOptions *options) {
+  options->threadCount = 0;
+  options->buildSubjectBitmaps = TRUE;
+  options->subjectBitmapDensity = OPTIMIZE_DEFAULT_SUBJECT_BITMAP_DENSITY;
+  options->buildBloomFilters = FALSE;
+  options->bloomFilterBitsPerKey = BLOOM_FILTER_DEFAULT_BITS_PER_KEY;
+}
+
+void optimizePredicateEntryWithOptions(PredicateEntry *entry, OptimizeOptions *options) {
+  optimizePredicateEntry(entry);
+  if (options->buildSubjectBitmaps) {
+    buildPredicateEntrySubjectBitmap(entry, options->subjectBitmapDensity);
+  }
+  if (options->buildBloomFilters) {
+    buildPredicateEntryBloomFilter(entry, options->bloomFilterBitsPerKey);
+  }
+}
+
+// the i-th of a compressed entry's keyCount distinct subjects
+static inline EntityId compressedSubjectAt(PredicateEntry *entry, unsigned long i) {
+  return getBitPackedValue(&entry->soCompressed->keys, i);
+}
+
+BOOL buildPredicateEntrySubjectBitmap(PredicateEntry *entry, double minDensity) {
+  if (entry->subjectBitmap != NULL) {
+    return TRUE;
+  }
+  // the bitmap has to be exact, and a subject whose pairs are all removed would still show up
+  if (entry->entryCount == 0 || entry->tombstoneCount > 0) {
+    return FALSE;
+  }
+
+  unsigned long subjectCount;
+  EntityId first;
+  EntityId last;
+  if (isCompressedPredicateEntry(entry)) {
+    subjectCount = entry->soCompressed->keyCount;
+    first = compressedSubjectAt(entry, 0);
+    last = compressedSubjectAt(entry, subjectCount - 1);
+  } else {
+    subjectCount = 1;
+    for (unsigned long i = 1; i < entry->entryCount; i++) {
+      subjectCount += subjectIdFromSOEntry(entry->soEntries[i]) != subjectIdFromSOEntry(entry->soEntries[i - 1]);
+    }
+    first = subjectIdFromSOEntry(entry->soEntries[0]);
+    last = subjectIdFromSOEntry(entry->soEntries[entry->entryCount - 1]);
   }
+  if ((double)subjectCount < minDensity * ((double)(last - first) + 1)) {
+    return FALSE;
+  }
+
+  SubjectBitmap *bitmap = createSubjectBitmap();
+  if (isCompressedPredicateEntry(entry)) {
+    for (unsigned long i = 0; i < subjectCount; i++) {
+      appendSubjectBitmap(bitmap, compressedSubjectAt(entry, i));
+    }
+  } else {
+    for (unsigned long i = 0; i < entry->entryCount; i++) {
+      appendSubjectBitmap(bitmap, subjectIdFromSOEntry(entry->soEntries[i]));
+    }
+  }
+  entry->subjectBitmap = bitmap;
+  return TRUE;
+}
+
+void buildPredicateEntryBloomFilter(PredicateEntry *entry, unsigned int bitsPerKey) {
+  if (entry->bloomFilter != NULL) {
+    return;
+  }
+  BloomFilter *filter = createBloomFilter(entry->entryCount, bitsPerKey);
+  if (isCompressedPredicateEntry(entry)) {
+    CompressedAdjacency *adjacency = entry->soCompressed;
+    for (unsigned long k = 0; k < adjacency->keyCount; k++) {
+      EntityId subject = getBitPackedValue(&adjacency->keys, k);
+      unsigned long end = getBitPackedValue(&adjacency->offsets, k + 1);
+      for (unsigned long i = getBitPackedValue(&adjacency->offsets, k); i < end; i++) {
+        addBloomFilterHash(filter, bloomFilterHashPair(subject, getBitPackedValue(&adjacency->values, i)));
+      }
+    }
+  } else {
+    for (unsigned long i = 0; i < entry->entryCount; i++) {
+      EntityPair pair = entry->soEntries[i];
+      addBloomFilterHash(filter, bloomFilterHashPair(subjectIdFromSOEntry(pair), objectIdFromSOEntry(pair)));
+    }
+  }
+  entry->bloomFilter = filter;
 }
 
 void growPredicateEntry(PredicateEntry *entry) {
@@ -82,7 +443,23 @@ void growPredicateEntry(PredicateEntry *entry) {
   entry->osEntries = realloc(entry->osEntries, sizeof(EntityPair) * entry->currentEntriesLength);
 }
 
+BOOL dropPredicateEntryTombstone(PredicateEntry *entry, SubjectId subject, ObjectId object);
+
 void addToPredicateEntry(PredicateEntry *entry, SubjectId subject, ObjectId object) {
+  assert(entry->soCompressed == NULL);
+  assert(!entry->borrowed);
+  if (entry->subjectBitmap != NULL) {
+    freeSubjectBitmap(entry->subjectBitmap);
+    entry->subjectBitmap = NULL;
+  }
+  if (entry->bloomFilter != NULL) {
+    freeBloomFilter(entry->bloomFilter);
+    entry->bloomFilter = NULL;
+  }
+  // a removed pair is still in the arrays until compaction, so adding it back only drops its tombstone
+  if (entry->tombstoneCount > 0 && dropPredicateEntryTombstone(entry, subject, object)) {
+    return;
+  }
   if ((entry->entryCount + 1) >= entry->currentEntriesLength) {
     growPredicateEntry(entry);
   }
@@ -91,49 +468,818 @@ void addToPredicateEntry(PredicateEntry *entry, SubjectId subject, ObjectId obje
   entry->entryCount++;
 }
 
+/*
+  Removal
+*/
+
+// index of pair among count tombstones, or count when it is not one
+// the sorted prefix is searched and the short unsorted buffer after it scanned
+unsigned long findTombstone(EntityPair *tombstones, unsigned long sortedCount, unsigned long count, EntityPair pair) {
+  unsigned long i = lowerBoundEntityPairs(tombstones, 0, sortedCount, pair);
+  if (i < sortedCount && tombstones[i] == pair) {
+    return i;
+  }
+  for (i = sortedCount; i < count; i++) {
+    if (tombstones[i] == pair) {
+      return i;
+    }
+  }
+  return count;
+}
+
+static inline BOOL isTombstonedPair(PredicateEntry *entry, EntityPair soPair) {
+  return entry->tombstoneCount > 0
+    && findTombstone(entry->soTombstones, entry->sortedTombstoneCount, entry->tombstoneCount, soPair) < entry->tombstoneCount;
+}
+
+void sortPredicateEntryTombstones(PredicateEntry *entry) {
+  unsigned long sortedCount = entry->sortedTombstoneCount;
+  unsigned long pending = entry->tombstoneCount - sortedCount;
+  EntityPair *scratch = malloc(sizeof(EntityPair) * pending);
+  EntityPair *sides[] = {entry->soTombstones, entry->osTombstones};
+  for (int side = 0; side < 2; side++) {
+    radixSortEntityPairs(sides[side] + sortedCount, scratch, pending);
+    mergeEntityPairRuns(sides[side], sortedCount, entry->tombstoneCount, scratch);
+  }
+  free(scratch);
+  entry->sortedTombstoneCount = entry->tombstoneCount;
+}
+
+void removeTombstoneAt(EntityPair *tombstones, unsigned long i, unsigned long count) {
+  memmove(tombstones + i, tombstones + i + 1, sizeof(EntityPair) * (count - i - 1));
+}
+
+BOOL dropPredicateEntryTombstone(PredicateEntry *entry, SubjectId subject, ObjectId object) {
+  unsigned long so = findTombstone(entry->soTombstones, entry->sortedTombstoneCount, entry->tombstoneCount, toSOEntry(subject, object));
+  if (so == entry->tombstoneCount) {
+    return FALSE;
+  }
+  unsigned long os = findTombstone(entry->osTombstones, entry->sortedTombstoneCount, entry->tombstoneCount, toOSEntry(object, subject));
+  assert(os < entry->tombstoneCount);
+  // both sides keep their sorted prefix the same length, so one is only shortened when both are
+  assert((so < entry->sortedTombstoneCount) == (os < entry->sortedTombstoneCount));
+  removeTombstoneAt(entry->soTombstones, so, entry->tombstoneCount);
+  removeTombstoneAt(entry->osTombstones, os, entry->tombstoneCount);
+  if (so < entry->sortedTombstoneCount) {
+    entry->sortedTombstoneCount--;
+  }
+  entry->tombstoneCount--;
+  return TRUE;
+}
+
+// whether the pair is in the entry's arrays, tombstoned or not; the entry must be prepared for reading
+BOOL predicateEntryStoresPair(PredicateEntry *entry, EntityPair soPair) {
+  unsigned long baseCount = predicateEntryBaseCount(entry);
+  unsigned long i = interpolationSearchEntityPairs(entry->soEntries, baseCount, soPair);
+  if (i < baseCount && entry->soEntries[i] == soPair) {
+    return TRUE;
+  }
+  EntityPair *delta = entry->soEntries + baseCount;
+  i = gallopEntityPairs(delta, 0, entry->deltaSortedCount, soPair);
+  return i < entry->deltaSortedCount && delta[i] == soPair;
+}
+
+BOOL removeFromPredicateEntry(PredicateEntry *entry, SubjectId subject, ObjectId object) {
+  assert(entry->soCompressed == NULL);
+  if (entry->sortedCount == 0) {
+    optimizePredicateEntry(entry);
+  }
+  preparePredicateEntryPairs(entry);
+  EntityPair soPair = toSOEntry(subject, object);
+  if (!predicateEntryStoresPair(entry, soPair) || isTombstonedPair(entry, soPair)) {
+    return FALSE;
+  }
+  // the bloom filter may keep the pair, false positives are allowed; the bitmap has to be exact
+  if (entry->subjectBitmap != NULL) {
+    freeSubjectBitmap(entry->subjectBitmap);
+    entry->subjectBitmap = NULL;
+  }
+  if (entry->tombstoneCount >= entry->currentTombstonesLength) {
+    entry->currentTombstonesLength = (entry->currentTombstonesLength > 0) ? entry->currentTombstonesLength * 2 : PREDICATE_ENTRY_TOMBSTONE_BUFFER_LENGTH;
+    entry->soTombstones = realloc(entry->soTombstones, sizeof(EntityPair) * entry->currentTombstonesLength);
+    entry->osTombstones = realloc(entry->osTombstones, sizeof(EntityPair) * entry->currentTombstonesLength);
+  }
+  entry->soTombstones[entry->tombstoneCount] = soPair;
+  entry->osTombstones[entry->tombstoneCount] = toOSEntry(object, subject);
+  entry->tombstoneCount++;
+  if (entry->tombstoneCount - entry->sortedTombstoneCount >= PREDICATE_ENTRY_TOMBSTONE_BUFFER_LENGTH) {
+    sortPredicateEntryTombstones(entry);
+  }
+  return TRUE;
+}
+
+BOOL predicateEntryNeedsCompaction(PredicateEntry *entry) {
+  return entry->tombstoneCount * PREDICATE_ENTRY_COMPACTION_RATIO > entry->entryCount;
+}
+
+// copies the pairs of [pairs, pairs + count) that are not tombstones to kept and returns how many it kept
+// both are sorted, so it is one merge-like pass; kept may be pairs itself
+unsigned long dropTombstonedPairs(EntityPair *pairs, unsigned long count, EntityPair *tombstones, unsigned long tombstoneCount, EntityPair *kept) {
+  unsigned long keptCount = 0;
+  unsigned long t = 0;
+  for (unsigned long i = 0; i < count; i++) {
+    EntityPair pair = pairs[i];
+    while (t < tombstoneCount && tombstones[t] < pair) {
+      t++;
+    }
+    if (t < tombstoneCount && tombstones[t] == pair) {
+      continue;
+    }
+    kept[keptCount++] = pair;
+  }
+  return keptCount;
+}
+
+void compactPredicateEntry(PredicateEntry *entry) {
+  optimizePredicateEntry(entry);
+  if (entry->tombstoneCount == 0) {
+    return;
+  }
+  preparePredicateEntryForReading(entry);
+  EntityPair *soKept = entry->soEntries;
+  EntityPair *osKept = entry->osEntries;
+  if (entry->borrowed) {
+    entry->currentEntriesLength = entry->entryCount;
+    soKept = malloc(sizeof(EntityPair) * entry->currentEntriesLength);
+    osKept = malloc(sizeof(EntityPair) * entry->currentEntriesLength);
+    entry->borrowed = FALSE;
+  }
+  unsigned long count = dropTombstonedPairs(entry->soEntries, entry->entryCount, entry->soTombstones, entry->tombstoneCount, soKept);
+  dropTombstonedPairs(entry->osEntries, entry->entryCount, entry->osTombstones, entry->tombstoneCount, osKept);
+  entry->soEntries = soKept;
+  entry->osEntries = osKept;
+  entry->entryCount = count;
+  entry->sortedCount = count;
+  entry->tombstoneCount = 0;
+  entry->sortedTombstoneCount = 0;
+  refreshPredicateEntryStatistics(entry);
+}
+
+/*
+  Compression
+*/
+
+// pairs must be sorted; the high half of each pair is the key, the low half its neighbor
+CompressedAdjacency *createCompressedAdjacency(EntityPair *pairs, unsigned long count) {
+  CompressedAdjacency *adjacency = malloc(sizeof(CompressedAdjacency));
+
+  unsigned long keyCount = 0;
+  EntityPair maxKey = 0;
+  EntityPair maxValue = 0;
+  for (unsigned long i = 0; i < count; i++) {
+    EntityPair key = pairs[i] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    EntityPair value = pairs[i] & ENTITY_PAIR_HALF_MASK;
+    if (i == 0 || key != (pairs[i - 1] >> ENTITY_PAIR_HALF_BIT_COUNT)) {
+      keyCount++;
+    }
+    maxKey = key;
+    maxValue = (value > maxValue) ? value : maxValue;
+  }
+
+  adjacency->keyCount = keyCount;
+  initBitPackedArray(&adjacency->keys, keyCount, bitWidthForValue(maxKey));
+  initBitPackedArray(&adjacency->offsets, keyCount + 1, bitWidthForValue(count));
+  initBitPackedArray(&adjacency->values, count, bitWidthForValue(maxValue));
+
+  unsigned long keyIndex = 0;
+  for (unsigned long i = 0; i < count; i++) {
+    EntityPair key = pairs[i] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    if (i == 0 || key != (pairs[i - 1] >> ENTITY_PAIR_HALF_BIT_COUNT)) {
+      setBitPackedValue(&adjacency->keys, keyIndex, key);
+      setBitPackedValue(&adjacency->offsets, keyIndex, i);
+      keyIndex++;
+    }
+    setBitPackedValue(&adjacency->values, i, pairs[i] & ENTITY_PAIR_HALF_MASK);
+  }
+  setBitPackedValue(&adjacency->offsets, keyCount, count);
+
+  return adjacency;
+}
+
+void compressPredicateEntry(PredicateEntry *entry) {
+  if (entry->soCompressed != NULL) {
+    return;
+  }
+  // the CSR form is built from fully sorted arrays, so a delta, a tail or tombstones are merged in or dropped first
+  if (entry->deltaSortedCount != 0 || predicateEntryUnsortedCount(entry) != 0 || entry->tombstoneCount != 0) {
+    compactPredicateEntry(entry);
+  }
+  entry->soCompressed = createCompressedAdjacency(entry->soEntries, entry->entryCount);
+  entry->osCompressed = createCompressedAdjacency(entry->osEntries, entry->entryCount);
+  entry->sortedCount = entry->entryCount;
+  entry->deltaSortedCount = 0;
+
+  if (!entry->borrowed) {
+    free(entry->soEntries);
+    free(entry->osEntries);
+  }
+  entry->borrowed = FALSE;
+  entry->soEntries = NULL;
+  entry->osEntries = NULL;
+  entry->currentEntriesLength = entry->entryCount;
+}
+
+BOOL isCompressedPredicateEntry(PredicateEntry *entry) {
+  return entry->soCompressed != NULL;
+}
+
+unsigned long compressedAdjacencyMemoryUsage(CompressedAdjacency *adjacency) {
+  return sizeof(CompressedAdjacency)
+    + bitPackedArrayMemoryUsage(&adjacency->keys)
+    + bitPackedArrayMemoryUsage(&adjacency->offsets)
+    + bitPackedArrayMemoryUsage(&adjacency->values);
+}
+
+unsigned long predicateEntryMemoryUsage(PredicateEntry *entry) {
+  unsigned long usage = sizeof(PredicateEntry);
+  if (entry->subjectBitmap != NULL) {
+    usage += subjectBitmapMemoryUsage(entry->subjectBitmap);
+  }
+  if (entry->bloomFilter != NULL) {
+    usage += bloomFilterMemoryUsage(entry->bloomFilter);
+  }
+  if (entry->soCompressed != NULL) {
+    return usage
+      + compressedAdjacencyMemoryUsage(entry->soCompressed)
+      + compressedAdjacencyMemoryUsage(entry->osCompressed);
+  }
+  return usage + 2 * sizeof(EntityPair) * (entry->currentEntriesLength + entry->currentTombstonesLength);
+}
+
+/*
+  Point lookups
+*/
+
+// below this a plain binary search is as quick
+#define INTERPOLATION_SEARCH_MIN_LENGTH 64
+
+unsigned long interpolationSearchEntityPairs(EntityPair *pairs, unsigned long count, EntityPair bound) {
+  if (count < INTERPOLATION_SEARCH_MIN_LENGTH) {
+    return gallopEntityPairs(pairs, 0, count, bound);
+  }
+  EntityPair first = pairs[0];
+  EntityPair last = pairs[count - 1];
+  if (bound <= first) {
+    return 0;
+  }
+  if (bound > last) {
+    return count;
+  }
+  // one probe at the estimated position, then gallop outwards from it: evenly spread pairs put
+  // the answer within a few pages of the guess, and skewed ones cost only a log factor more
+  unsigned long guess = (unsigned long)((long double)(bound - first) / (long double)(last - first) * (count - 1));
+  if (pairs[guess] < bound) {
+    return gallopEntityPairs(pairs, guess + 1, count, bound);
+  }
+  // pairs[guess] >= bound: find some low < guess below the bound, doubling the distance
+  unsigned long step = 1;
+  unsigned long high = guess;
+  while (step <= high && pairs[high - step] >= bound) {
+    high -= step;
+    step <<= 1;
+  }
+  unsigned long low = (step <= high) ? high - step + 1 : 0;
+  while (low < high) {
+    unsigned long middle = low + ((high - low) >> 1);
+    if (pairs[middle] < bound) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// the index of key in a compressed side's ascending keys, or keyCount when it is absent
+unsigned long findCompressedKey(CompressedAdjacency *adjacency, EntityId key) {
+  unsigned long low = 0;
+  unsigned long high = adjacency->keyCount;
+  while (low < high) {
+    unsigned long middle = low + (high - low) / 2;
+    if (getBitPackedValue(&adjacency->keys, middle) < key) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return (low < adjacency->keyCount && getBitPackedValue(&adjacency->keys, low) == key) ? low : adjacency->keyCount;
+}
+
+// lookups search the sorted base and delta, so a never optimized entry is sorted first and a tail sorted into the delta
+static inline void preparePredicateEntryForLookup(PredicateEntry *entry) {
+  if (entry->sortedCount == 0) {
+    optimizePredicateEntry(entry);
+  }
+  preparePredicateEntryForReading(entry);
+}
+
+BOOL predicateEntryHasPair(PredicateEntry *entry, SubjectId subject, ObjectId object) {
+  if (entry->bloomFilter != NULL && !bloomFilterMayContainHash(entry->bloomFilter, bloomFilterHashPair(subject, object))) {
+    return FALSE;
+  }
+  if (isCompressedPredicateEntry(entry)) {
+    CompressedAdjacency *adjacency = entry->soCompressed;
+    unsigned long k = findCompressedKey(adjacency, subject);
+    if (k == adjacency->keyCount) {
+      return FALSE;
+    }
+    unsigned long low = getBitPackedValue(&adjacency->offsets, k);
+    unsigned long high = getBitPackedValue(&adjacency->offsets, k + 1);
+    while (low < high) {
+      unsigned long middle = low + (high - low) / 2;
+      if (getBitPackedValue(&adjacency->values, middle) < object) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low < getBitPackedValue(&adjacency->offsets, k + 1) && getBitPackedValue(&adjacency->values, low) == object;
+  }
+  preparePredicateEntryForLookup(entry);
+  EntityPair pair = toSOEntry(subject, object);
+  return predicateEntryStoresPair(entry, pair) && !isTombstonedPair(entry, pair);
+}
+
+unsigned long lookupPredicateEntryKey(PredicateEntry *entry, unsigned char order, EntityId key, EntityId *neighbors, unsigned long capacity) {
+  if (isCompressedPredicateEntry(entry)) {
+    CompressedAdjacency *adjacency = (order == SUBJECT_ORDER) ? entry->soCompressed : entry->osCompressed;
+    unsigned long k = findCompressedKey(adjacency, key);
+    if (k == adjacency->keyCount) {
+      return 0;
+    }
+    unsigned long begin = getBitPackedValue(&adjacency->offsets, k);
+    unsigned long count = getBitPackedValue(&adjacency->offsets, k + 1) - begin;
+    for (unsigned long i = 0; i < count && i < capacity; i++) {
+      neighbors[i] = getBitPackedValue(&adjacency->values, begin + i);
+    }
+    return count;
+  }
+  preparePredicateEntryForLookup(entry);
+  EntityPair *pairs = (order == SUBJECT_ORDER) ? entry->soEntries : entry->osEntries;
+  EntityPair bound = (EntityPair)key << ENTITY_PAIR_HALF_BIT_COUNT;
+  unsigned long baseCount = predicateEntryBaseCount(entry);
+  unsigned long deltaEnd = baseCount + entry->deltaSortedCount;
+  unsigned long i = interpolationSearchEntityPairs(pairs, baseCount, bound);
+  unsigned long j = gallopEntityPairs(pairs, baseCount, deltaEnd, bound);
+  // the key's run in the base and its run in the delta, merged so the neighbors come out ascending
+  BOOL baseHasKey = i < baseCount && (EntityId)(pairs[i] >> ENTITY_PAIR_HALF_BIT_COUNT) == key;
+  BOOL deltaHasKey = j < deltaEnd && (EntityId)(pairs[j] >> ENTITY_PAIR_HALF_BIT_COUNT) == key;
+  EntityPair *tombstones = (order == SUBJECT_ORDER) ? entry->soTombstones : entry->osTombstones;
+  unsigned long t = gallopEntityPairs(tombstones, 0, entry->tombstoneCount, bound);
+  unsigned long count = 0;
+  while (baseHasKey || deltaHasKey) {
+    EntityPair pair;
+    if (baseHasKey && (!deltaHasKey || pairs[i] <= pairs[j])) {
+      pair = pairs[i++];
+      baseHasKey = i < baseCount && (EntityId)(pairs[i] >> ENTITY_PAIR_HALF_BIT_COUNT) == key;
+    } else {
+      pair = pairs[j++];
+      deltaHasKey = j < deltaEnd && (EntityId)(pairs[j] >> ENTITY_PAIR_HALF_BIT_COUNT) == key;
+    }
+    while (t < entry->tombstoneCount && tombstones[t] < pair) {
+      t++;
+    }
+    if (t < entry->tombstoneCount && tombstones[t] == pair) {
+      continue;
+    }
+    if (count < capacity) {
+      neighbors[count] = (EntityId)(pair & ENTITY_PAIR_HALF_MASK);
+    }
+    count++;
+  }
+  return count;
+}
+
+unsigned long lookupPredicateEntrySubject(PredicateEntry *entry, SubjectId subject, ObjectId *objects, unsigned long capacity) {
+  return lookupPredicateEntryKey(entry, SUBJECT_ORDER, subject, objects, capacity);
+}
+
+unsigned long lookupPredicateEntryObject(PredicateEntry *entry, ObjectId object, SubjectId *subjects, unsigned long capacity) {
+  return lookupPredicateEntryKey(entry, OBJECT_ORDER, object, subjects, capacity);
+}
+
 /*
   Predicate Entry Iterator
 */
 BOOL iterate(Iterator *iterator, Triple *triple) {
-  // printf("iterate %p\n", iterator);
   BOOL isDone = iterator->done(iterator);
-  // printf("iterate isDone=%d\n", isDone);
   if (!isDone) {
     *triple = iterator->peek(iterator);
     iterator->advance(iterator);
   }
-  return !isDone;
+  return !isDone;
+}
+
+unsigned long nextBatch(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  return iterator->nextBatch(iterator, triples, capacity);
+}
+
+void freeArenaIterator(Iterator *iterator) {
+  // the node, and its inputs, go when the arena is reset or freed
+  (void)iterator;
+}
+
+unsigned long nextBatchByIterating(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  unsigned long count = 0;
+  while (count < capacity && !iterator->done(iterator)) {
+    triples[count++] = iterator->peek(iterator);
+    iterator->advance(iterator);
+  }
+  return count;
+}
+
+Iterator *noIteratorInput(Iterator *iterator, int index) {
+  (void)iterator;
+  (void)index;
+  return NULL;
+}
+
+/*
+  Iterator statistics and explain
+*/
+#if CGRAPH_ITERATOR_STATS
+// only the outermost call on a node is timed and counted; returns whether this is it
+static inline BOOL enterIteratorStats(IteratorStats *stats, unsigned long long *start) {
+  if (stats->depth++ > 0) {
+    return 0;
+  }
+  *start = iteratorStatsCycles();
+  return 1;
+}
+
+static inline void leaveIteratorStats(IteratorStats *stats, BOOL outermost, unsigned long long start) {
+  if (outermost) {
+    stats->cycles += iteratorStatsCycles() - start;
+  }
+  stats->depth--;
+}
+
+void advanceWithStats(Iterator *iterator) {
+  IteratorStats *stats = &iterator->stats;
+  unsigned long long start;
+  BOOL outermost = enterIteratorStats(stats, &start);
+  stats->advance(iterator);
+  if (outermost) {
+    stats->advances++;
+    stats->rows++;
+  }
+  leaveIteratorStats(stats, outermost, start);
+}
+
+void nextOperandWithStats(Iterator *iterator) {
+  IteratorStats *stats = &iterator->stats;
+  unsigned long long start;
+  BOOL outermost = enterIteratorStats(stats, &start);
+  stats->nextOperand(iterator);
+  leaveIteratorStats(stats, outermost, start);
+}
+
+// peeks are too cheap to time, so they are only counted
+Triple peekWithStats(Iterator *iterator) {
+  IteratorStats *stats = &iterator->stats;
+  stats->peeks += (stats->depth == 0);
+  return stats->peek(iterator);
+}
+
+EntityId peekKeyWithStats(Iterator *iterator) {
+  IteratorStats *stats = &iterator->stats;
+  stats->peeks += (stats->depth == 0);
+  return stats->peekKey(iterator);
+}
+
+void seekWithStats(Iterator *iterator, EntityId target) {
+  IteratorStats *stats = &iterator->stats;
+  unsigned long long start;
+  BOOL outermost = enterIteratorStats(stats, &start);
+  stats->seek(iterator, target);
+  stats->seeks += outermost;
+  leaveIteratorStats(stats, outermost, start);
+}
+
+unsigned long nextBatchWithStats(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  IteratorStats *stats = &iterator->stats;
+  unsigned long long start;
+  BOOL outermost = enterIteratorStats(stats, &start);
+  unsigned long count = stats->nextBatch(iterator, triples, capacity);
+  if (outermost) {
+    stats->batches++;
+    stats->rows += count;
+  }
+  leaveIteratorStats(stats, outermost, start);
+  return count;
+}
+
+void installIteratorStats(Iterator *iterator) {
+  assert(iterator->advance != &advanceWithStats);
+  IteratorStats *stats = &iterator->stats;
+  memset(stats, 0, sizeof(IteratorStats));
+  stats->advance = iterator->advance;
+  stats->nextOperand = iterator->nextOperand;
+  stats->peek = iterator->peek;
+  stats->peekKey = iterator->peekKey;
+  stats->seek = iterator->seek;
+  stats->nextBatch = iterator->nextBatch;
+  iterator->advance = &advanceWithStats;
+  iterator->nextOperand = &nextOperandWithStats;
+  iterator->peek = &peekWithStats;
+  iterator->peekKey = &peekKeyWithStats;
+  iterator->seek = &seekWithStats;
+  iterator->nextBatch = &nextBatchWithStats;
+}
+#endif
+
+void resetIteratorStats(Iterator *iterator) {
+#if CGRAPH_ITERATOR_STATS
+  IteratorStats *stats = &iterator->stats;
+  stats->rows = 0;
+  stats->advances = 0;
+  stats->batches = 0;
+  stats->peeks = 0;
+  stats->seeks = 0;
+  stats->comparisons = 0;
+  stats->skipped = 0;
+  stats->cycles = 0;
+#endif
+  Iterator *input;
+  for (int i = 0; (input = iterator->input(iterator, i)) != NULL; i++) {
+    resetIteratorStats(input);
+  }
+}
+
+void explainIteratorNode(Iterator *iterator, FILE *file, int depth) {
+  char label[128];
+  iterator->describe(iterator, label, sizeof(label));
+  fprintf(file, "%*s%s", depth * 2, "", label);
+#if CGRAPH_ITERATOR_STATS
+  IteratorStats *stats = &iterator->stats;
+  unsigned long long inputCycles = 0;
+  Iterator *input;
+  for (int i = 0; (input = iterator->input(iterator, i)) != NULL; i++) {
+    inputCycles += input->stats.cycles;
+  }
+  // inputs driven from outside the node's own calls, e.g. by mergeJoin, can leave it short
+  unsigned long long selfCycles = (stats->cycles > inputCycles) ? stats->cycles - inputCycles : 0;
+  fprintf(file, "  rows=%llu advances=%llu batches=%llu peeks=%llu seeks=%llu comparisons=%llu skipped=%llu cycles=%llu self=%llu",
+          stats->rows, stats->advances, stats->batches, stats->peeks, stats->seeks,
+          stats->comparisons, stats->skipped, stats->cycles, selfCycles);
+#endif
+  fputc('\n', file);
+  Iterator *child;
+  for (int i = 0; (child = iterator->input(iterator, i)) != NULL; i++) {
+    explainIteratorNode(child, file, depth + 1);
+  }
+}
+
+void explainIteratorToFile(Iterator *iterator, FILE *file) {
+  explainIteratorNode(iterator, file, 0);
+}
+
+void explainIterator(Iterator *iterator) {
+  explainIteratorToFile(iterator, stdout);
+}
+
+// toTripleFromSOEntry/toTripleFromOSEntry with the predicate bits hoisted, inlined into the batch loops
+static inline Triple soEntryToTriple(EntityPair pair, Triple predicateBits) {
+  return ((Triple)(pair >> ENTITY_PAIR_HALF_BIT_COUNT) << (PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH))
+        | predicateBits
+        | (Triple)(pair & ENTITY_PAIR_HALF_MASK);
+}
+
+static inline Triple osEntryToTriple(EntityPair pair, Triple predicateBits) {
+  return ((Triple)(pair & ENTITY_PAIR_HALF_MASK) << (PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH))
+        | predicateBits
+        | (Triple)(pair >> ENTITY_PAIR_HALF_BIT_COUNT);
+}
+
+static inline Triple pairToTriple(EntityPair pair, Triple predicateBits, unsigned char order) {
+  return (order == SUBJECT_ORDER) ? soEntryToTriple(pair, predicateBits) : osEntryToTriple(pair, predicateBits);
+}
+
+static inline Triple predicateBitsForTriple(PredicateId predicate) {
+  return (Triple)predicate << OBJECT_BIT_WIDTH;
+}
+
+static inline EntityPair *entryIteratorPairs(PredicateEntryIterator *p) {
+  return (p->order == SUBJECT_ORDER) ? p->entry->soEntries : p->entry->osEntries;
+}
+
+static inline CompressedAdjacency *entryIteratorAdjacency(PredicateEntryIterator *p) {
+  return (p->order == SUBJECT_ORDER) ? p->entry->soCompressed : p->entry->osCompressed;
+}
+
+void advanceEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  p->position++;
+}
+
+void nextOperandEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+}
+
+Triple peekEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  return toTripleFromSOEntry(p->entry->soEntries[p->position], p->entry->predicate);
+}
+
+Triple peekObjectEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  return toTripleFromOSEntry(p->entry->osEntries[p->position], p->entry->predicate);
+}
+
+EntityId peekKeyEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  // both sides keep their key in the high half
+  return entryIteratorPairs(p)[p->position] >> ENTITY_PAIR_HALF_BIT_COUNT;
+}
+
+BOOL doneEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  return (p->position >= p->entry->entryCount);
+}
+
+void initEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+}
+
+// compressed entries walk the CSR form; keyEnd marks where the current key's neighbors stop
+void loadCompressedKey(PredicateEntryIterator *p) {
+  CompressedAdjacency *adjacency = entryIteratorAdjacency(p);
+  if (p->keyIndex < adjacency->keyCount) {
+    p->key = getBitPackedValue(&adjacency->keys, p->keyIndex);
+    p->keyEnd = getBitPackedValue(&adjacency->offsets, p->keyIndex + 1);
+  }
+}
+
+void advanceCompressedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  p->position++;
+  if (p->position >= p->keyEnd) {
+    p->keyIndex++;
+    loadCompressedKey(p);
+  }
+}
+
+void seekCompressedEntryIterator(Iterator *iterator, EntityId target) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  CompressedAdjacency *adjacency = entryIteratorAdjacency(p);
+  if (p->keyIndex >= adjacency->keyCount || p->key >= target) {
+    return;
+  }
+
+  // gallop over the distinct keys, then land on the first neighbor of the key found
+  unsigned long low = p->keyIndex + 1;
+  unsigned long high = low;
+  unsigned long step = 1;
+  while (high < adjacency->keyCount && getBitPackedValue(&adjacency->keys, high) < target) {
+    low = high + 1;
+    high = p->keyIndex + 1 + step;
+    step <<= 1;
+  }
+  if (high > adjacency->keyCount) {
+    high = adjacency->keyCount;
+  }
+  while (low < high) {
+    unsigned long middle = low + ((high - low) >> 1);
+    if (getBitPackedValue(&adjacency->keys, middle) < target) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  unsigned long position = getBitPackedValue(&adjacency->offsets, low);
+  ITERATOR_STATS_ADD(iterator, skipped, position - p->position);
+  p->keyIndex = low;
+  p->position = position;
+  loadCompressedKey(p);
+}
+
+unsigned long nextBatchCompressedEntryIterator(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  CompressedAdjacency *adjacency = entryIteratorAdjacency(p);
+  Triple predicateBits = predicateBitsForTriple(p->entry->predicate);
+  // the key is the subject in subject order and the object in object order
+  unsigned int keyShift = (p->order == SUBJECT_ORDER) ? PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH : 0;
+  unsigned int valueShift = (p->order == SUBJECT_ORDER) ? 0 : PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH;
+  unsigned long count = 0;
+  while (count < capacity && p->position < p->entry->entryCount) {
+    // emit the rest of the current key's run, or as much of it as fits
+    unsigned long runEnd = p->keyEnd;
+    if (runEnd - p->position > capacity - count) {
+      runEnd = p->position + (capacity - count);
+    }
+    Triple keyBits = ((Triple)p->key << keyShift) | predicateBits;
+    for (; p->position < runEnd; p->position++) {
+      triples[count++] = keyBits | ((Triple)getBitPackedValue(&adjacency->values, p->position) << valueShift);
+    }
+    if (p->position >= p->keyEnd) {
+      p->keyIndex++;
+      loadCompressedKey(p);
+    }
+  }
+  return count;
 }
 
-void advanceEntryIterator(Iterator *iterator) {
+Triple peekCompressedEntryIterator(Iterator *iterator) {
   assert(iterator->TYPE == ENTRY_ITERATOR);
   assert(!iterator->done(iterator));
   PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
-  p->position++;
+  ObjectId object = getBitPackedValue(&p->entry->soCompressed->values, p->position);
+  return toTriple(p->key, p->entry->predicate, object);
 }
 
-void nextOperandEntryIterator(Iterator *iterator) {
-  // printf("nextOperandEntryIterator %p\n", iterator);
+Triple peekCompressedObjectEntryIterator(Iterator *iterator) {
   assert(iterator->TYPE == ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  SubjectId subject = getBitPackedValue(&p->entry->osCompressed->values, p->position);
+  return toTriple(subject, p->entry->predicate, p->key);
 }
 
-Triple peekEntryIterator(Iterator *iterator) {
+EntityId peekKeyCompressedEntryIterator(Iterator *iterator) {
   assert(iterator->TYPE == ENTRY_ITERATOR);
   assert(!iterator->done(iterator));
   PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
-  return toTripleFromSOEntry(p->entry->soEntries[p->position], p->entry->predicate);
+  return p->key;
 }
 
-BOOL doneEntryIterator(Iterator *iterator) {
-  // printf("doneEntryIterator %p\n", iterator);
+// first index in [begin, count) whose pair is >= bound, galloping out from begin
+// so that short hops stay cheap and long ones cost O(log distance)
+unsigned long gallopEntityPairs(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound) {
+  unsigned long low = begin;
+  unsigned long high = begin;
+  unsigned long step = 1;
+  while (high < count && pairs[high] < bound) {
+    low = high + 1;
+    high = begin + step;
+    step <<= 1;
+  }
+  if (high > count) {
+    high = count;
+  }
+  while (low < high) {
+    unsigned long middle = low + ((high - low) >> 1);
+    if (pairs[middle] < bound) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+void seekEntryIterator(Iterator *iterator, EntityId target) {
   assert(iterator->TYPE == ENTRY_ITERATOR);
   PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
-  // printf("doneEntryIterator %ld %ld\n", p->position, p->entry->entryCount);
-  return (p->position >= p->entry->entryCount);
+  unsigned long position = lowerBoundEntityPairs(entryIteratorPairs(p), p->position, p->entry->entryCount, (EntityPair)target << ENTITY_PAIR_HALF_BIT_COUNT);
+  ITERATOR_STATS_ADD(iterator, skipped, position - p->position);
+  p->position = position;
 }
 
-void initEntryIterator(Iterator *iterator) {
+unsigned long nextBatchEntryIterator(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  unsigned long remaining = (p->position < p->entry->entryCount) ? p->entry->entryCount - p->position : 0;
+  unsigned long count = (remaining < capacity) ? remaining : capacity;
+  EntityPair *pairs = entryIteratorPairs(p) + p->position;
+  Triple predicateBits = predicateBitsForTriple(p->entry->predicate);
+  if (p->order == SUBJECT_ORDER) {
+    for (unsigned long i = 0; i < count; i++) {
+      triples[i] = soEntryToTriple(pairs[i], predicateBits);
+    }
+  } else {
+    for (unsigned long i = 0; i < count; i++) {
+      triples[i] = osEntryToTriple(pairs[i], predicateBits);
+    }
+  }
+  p->position += count;
+  return count;
+}
+
+void describeEntryIterator(Iterator *iterator, char *label, unsigned long length) {
   assert(iterator->TYPE == ENTRY_ITERATOR);
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  snprintf(label, length, "ENTRY predicate=%llu order=%s pairs=%llu%s%s", (unsigned long long)p->entry->predicate,
+           (p->order == SUBJECT_ORDER) ? "subject" : "object", (unsigned long long)p->entry->entryCount,
+           (p->entry->soCompressed != NULL) ? " compressed" : "",
+           (p->order == SUBJECT_ORDER && p->entry->subjectBitmap != NULL) ? " bitmap" : "");
+}
+
+BOOL isPlainEntryIterator(Iterator *iterator) {
+  return iterator->TYPE == ENTRY_ITERATOR && ((PredicateEntryIterator *)iterator)->entry->soCompressed == NULL;
 }
 
 void freeEntryIterator(Iterator *iterator) {
@@ -141,27 +1287,295 @@ void freeEntryIterator(Iterator *iterator) {
   free(iterator);
 }
 
-Iterator* createPredicateEntryIterator(PredicateEntry *entry) {
-  // printf("createPredicateEntryIterator %p\n", entry);
-  PredicateEntryIterator *iterator = malloc(sizeof(PredicateEntryIterator));
+Iterator* cloneEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  PredicateEntryIterator *p = (PredicateEntryIterator *)iterator;
+  return createPredicateEntryOrderedIterator(p->entry, p->order);
+}
+
+void initPredicateEntryIterator(PredicateEntryIterator *iterator, PredicateEntry *entry, unsigned char order) {
+  assert(order == SUBJECT_ORDER || order == OBJECT_ORDER);
   iterator->fn.TYPE = ENTRY_ITERATOR;
   iterator->fn.advance = &advanceEntryIterator;
   iterator->fn.nextOperand = &nextOperandEntryIterator;
-  iterator->fn.peek = &peekEntryIterator;
+  iterator->fn.peek = (order == SUBJECT_ORDER) ? &peekEntryIterator : &peekObjectEntryIterator;
+  iterator->fn.peekKey = &peekKeyEntryIterator;
   iterator->fn.done = &doneEntryIterator;
   iterator->fn.init = &initEntryIterator;
   iterator->fn.free = &freeEntryIterator;
+  iterator->fn.seek = &seekEntryIterator;
+  iterator->fn.nextBatch = &nextBatchEntryIterator;
+  iterator->fn.clone = &cloneEntryIterator;
+  iterator->fn.describe = &describeEntryIterator;
+  iterator->fn.input = &noIteratorInput;
   iterator->entry = entry;
+  iterator->order = order;
   iterator->position = 0;
+  iterator->keyIndex = 0;
+  iterator->keyEnd = 0;
+  iterator->key = 0;
+  if (entry->soCompressed != NULL) {
+    iterator->fn.advance = &advanceCompressedEntryIterator;
+    iterator->fn.peek = (order == SUBJECT_ORDER) ? &peekCompressedEntryIterator : &peekCompressedObjectEntryIterator;
+    iterator->fn.peekKey = &peekKeyCompressedEntryIterator;
+    iterator->fn.seek = &seekCompressedEntryIterator;
+    iterator->fn.nextBatch = &nextBatchCompressedEntryIterator;
+    loadCompressedKey(iterator);
+  }
+  ITERATOR_STATS_INSTALL(iterator);
+}
+
+/*
+  Merged entry iterator
+*/
+
+// the pair under the iterator comes from the base unless the delta's is smaller
+static inline BOOL mergedIteratorTakesBase(PredicateEntryMergedIterator *p, EntityPair *pairs) {
+  return p->deltaPosition >= p->deltaEnd || (p->basePosition < p->baseEnd && pairs[p->basePosition] <= pairs[p->deltaPosition]);
+}
+
+static inline EntityPair *mergedIteratorPairs(PredicateEntryMergedIterator *p) {
+  return (p->order == SUBJECT_ORDER) ? p->entry->soEntries : p->entry->osEntries;
+}
+
+static inline EntityPair *mergedIteratorTombstones(PredicateEntryMergedIterator *p) {
+  return (p->order == SUBJECT_ORDER) ? p->entry->soTombstones : p->entry->osTombstones;
+}
+
+static inline EntityPair mergedIteratorPair(PredicateEntryMergedIterator *p) {
+  EntityPair *pairs = mergedIteratorPairs(p);
+  return mergedIteratorTakesBase(p, pairs) ? pairs[p->basePosition] : pairs[p->deltaPosition];
+}
+
+BOOL doneMergedEntryIterator(Iterator *iterator);
+
+// steps past tombstoned pairs, so the iterator always rests on a live one
+// tombstones and pairs ascend together, so the tombstone cursor only moves forward
+void skipMergedTombstones(PredicateEntryMergedIterator *p) {
+  EntityPair *pairs = mergedIteratorPairs(p);
+  EntityPair *tombstones = mergedIteratorTombstones(p);
+  while (p->tombstonePosition < p->tombstoneEnd && !doneMergedEntryIterator((Iterator *)p)) {
+    BOOL fromBase = mergedIteratorTakesBase(p, pairs);
+    EntityPair pair = fromBase ? pairs[p->basePosition] : pairs[p->deltaPosition];
+    while (p->tombstonePosition < p->tombstoneEnd && tombstones[p->tombstonePosition] < pair) {
+      p->tombstonePosition++;
+    }
+    if (p->tombstonePosition >= p->tombstoneEnd || tombstones[p->tombstonePosition] != pair) {
+      return;
+    }
+    if (fromBase) {
+      p->basePosition++;
+    } else {
+      p->deltaPosition++;
+    }
+    ITERATOR_STATS_ADD(p, skipped, 1);
+  }
+}
+
+void advanceMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  if (mergedIteratorTakesBase(p, mergedIteratorPairs(p))) {
+    p->basePosition++;
+  } else {
+    p->deltaPosition++;
+  }
+  skipMergedTombstones(p);
+}
+
+void nextOperandMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+}
+
+Triple peekMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  return pairToTriple(mergedIteratorPair(p), predicateBitsForTriple(p->entry->predicate), p->order);
+}
+
+EntityId peekKeyMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  return mergedIteratorPair(p) >> ENTITY_PAIR_HALF_BIT_COUNT;
+}
+
+BOOL doneMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  return p->basePosition >= p->baseEnd && p->deltaPosition >= p->deltaEnd;
+}
+
+void initMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+}
+
+void seekMergedEntryIterator(Iterator *iterator, EntityId target) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  EntityPair *pairs = mergedIteratorPairs(p);
+  EntityPair bound = (EntityPair)target << ENTITY_PAIR_HALF_BIT_COUNT;
+  unsigned long passed = p->basePosition + p->deltaPosition;
+  p->basePosition = lowerBoundEntityPairs(pairs, p->basePosition, p->baseEnd, bound);
+  // the delta is small, so gallop rather than pay for the vector search's setup
+  p->deltaPosition = gallopEntityPairs(pairs, p->deltaPosition, p->deltaEnd, bound);
+  ITERATOR_STATS_ADD(iterator, skipped, p->basePosition + p->deltaPosition - passed);
+  p->tombstonePosition = gallopEntityPairs(mergedIteratorTombstones(p), p->tombstonePosition, p->tombstoneEnd, bound);
+  skipMergedTombstones(p);
+}
+
+unsigned long nextBatchMergedEntryIterator(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  EntityPair *pairs = mergedIteratorPairs(p);
+  Triple predicateBits = predicateBitsForTriple(p->entry->predicate);
+  if (p->tombstonePosition < p->tombstoneEnd) {
+    // with tombstones still ahead every pair is checked against the next one; past the last
+    // tombstone the merge loops below take over
+    EntityPair *tombstones = mergedIteratorTombstones(p);
+    unsigned long count = 0;
+    while (count < capacity && !doneMergedEntryIterator(iterator)) {
+      EntityPair pair;
+      if (mergedIteratorTakesBase(p, pairs)) {
+        pair = pairs[p->basePosition++];
+      } else {
+        pair = pairs[p->deltaPosition++];
+      }
+      while (p->tombstonePosition < p->tombstoneEnd && tombstones[p->tombstonePosition] < pair) {
+        p->tombstonePosition++;
+      }
+      if (p->tombstonePosition >= p->tombstoneEnd || tombstones[p->tombstonePosition] != pair) {
+        triples[count++] = pairToTriple(pair, predicateBits, p->order);
+      } else {
+        ITERATOR_STATS_ADD(iterator, skipped, 1);
+      }
+    }
+    skipMergedTombstones(p);
+    return count;
+  }
+  unsigned long basePosition = p->basePosition;
+  unsigned long deltaPosition = p->deltaPosition;
+  unsigned long count = 0;
+  while (count < capacity && basePosition < p->baseEnd && deltaPosition < p->deltaEnd) {
+    EntityPair base = pairs[basePosition];
+    EntityPair delta = pairs[deltaPosition];
+    if (base <= delta) {
+      triples[count++] = pairToTriple(base, predicateBits, p->order);
+      basePosition++;
+    } else {
+      triples[count++] = pairToTriple(delta, predicateBits, p->order);
+      deltaPosition++;
+    }
+  }
+  // once one run is drained the other is copied straight through
+  for (; count < capacity && basePosition < p->baseEnd; basePosition++) {
+    triples[count++] = pairToTriple(pairs[basePosition], predicateBits, p->order);
+  }
+  for (; count < capacity && deltaPosition < p->deltaEnd; deltaPosition++) {
+    triples[count++] = pairToTriple(pairs[deltaPosition], predicateBits, p->order);
+  }
+  p->basePosition = basePosition;
+  p->deltaPosition = deltaPosition;
+  return count;
+}
+
+void freeMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  free(iterator);
+}
+
+Iterator* cloneMergedEntryIterator(Iterator *iterator);
+
+void describeMergedEntryIterator(Iterator *iterator, char *label, unsigned long length) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  snprintf(label, length, "MERGED ENTRY predicate=%llu order=%s base=%lu delta=%lu tombstones=%lu",
+           (unsigned long long)p->entry->predicate, (p->order == SUBJECT_ORDER) ? "subject" : "object",
+           p->baseEnd, p->deltaEnd - p->baseEnd, p->tombstoneEnd);
+}
+
+void initPredicateEntryMergedIterator(PredicateEntryMergedIterator *iterator, PredicateEntry *entry, unsigned char order,
+                                      unsigned long baseEnd, unsigned long deltaEnd, unsigned long tombstoneEnd) {
+  assert(order == SUBJECT_ORDER || order == OBJECT_ORDER);
+  iterator->fn.TYPE = MERGED_ENTRY_ITERATOR;
+  iterator->fn.advance = &advanceMergedEntryIterator;
+  iterator->fn.nextOperand = &nextOperandMergedEntryIterator;
+  iterator->fn.peek = &peekMergedEntryIterator;
+  iterator->fn.peekKey = &peekKeyMergedEntryIterator;
+  iterator->fn.done = &doneMergedEntryIterator;
+  iterator->fn.init = &initMergedEntryIterator;
+  iterator->fn.free = &freeMergedEntryIterator;
+  iterator->fn.seek = &seekMergedEntryIterator;
+  iterator->fn.nextBatch = &nextBatchMergedEntryIterator;
+  iterator->fn.clone = &cloneMergedEntryIterator;
+  iterator->fn.describe = &describeMergedEntryIterator;
+  iterator->fn.input = &noIteratorInput;
+  iterator->entry = entry;
+  iterator->order = order;
+  iterator->basePosition = 0;
+  iterator->baseEnd = baseEnd;
+  iterator->deltaPosition = baseEnd;
+  iterator->deltaEnd = deltaEnd;
+  iterator->tombstonePosition = 0;
+  iterator->tombstoneEnd = tombstoneEnd;
+  ITERATOR_STATS_INSTALL(iterator);
+  skipMergedTombstones(iterator);
+}
+
+// clones keep the runs they were given rather than preparing the entry again, which is not thread safe
+Iterator* cloneMergedEntryIterator(Iterator *iterator) {
+  assert(iterator->TYPE == MERGED_ENTRY_ITERATOR);
+  PredicateEntryMergedIterator *p = (PredicateEntryMergedIterator *)iterator;
+  PredicateEntryMergedIterator *clone = malloc(sizeof(PredicateEntryMergedIterator));
+  initPredicateEntryMergedIterator(clone, p->entry, p->order, p->baseEnd, p->deltaEnd, p->tombstoneEnd);
+  return (Iterator*)clone;
+}
+
+Iterator* createPredicateEntryOrderedIterator(PredicateEntry *entry, unsigned char order) {
+  preparePredicateEntryForReading(entry);
+  if (entry->deltaSortedCount > 0 || entry->tombstoneCount > 0) {
+    PredicateEntryMergedIterator *iterator = malloc(sizeof(PredicateEntryMergedIterator));
+    initPredicateEntryMergedIterator(iterator, entry, order, entry->sortedCount, entry->sortedCount + entry->deltaSortedCount, entry->tombstoneCount);
+    return (Iterator*)iterator;
+  }
+  PredicateEntryIterator *iterator = malloc(sizeof(PredicateEntryIterator));
+  initPredicateEntryIterator(iterator, entry, order);
+  return (Iterator*)iterator;
+}
+
+Iterator* createPredicateEntryOrderedIteratorInArena(Arena *arena, PredicateEntry *entry, unsigned char order) {
+  preparePredicateEntryForReading(entry);
+  if (entry->deltaSortedCount > 0 || entry->tombstoneCount > 0) {
+    PredicateEntryMergedIterator *iterator = arenaAllocate(arena, sizeof(PredicateEntryMergedIterator));
+    initPredicateEntryMergedIterator(iterator, entry, order, entry->sortedCount, entry->sortedCount + entry->deltaSortedCount, entry->tombstoneCount);
+    iterator->fn.free = &freeArenaIterator;
+    return (Iterator*)iterator;
+  }
+  PredicateEntryIterator *iterator = arenaAllocate(arena, sizeof(PredicateEntryIterator));
+  initPredicateEntryIterator(iterator, entry, order);
+  iterator->fn.free = &freeArenaIterator;
   return (Iterator*)iterator;
 }
 
+Iterator* createPredicateEntryIterator(PredicateEntry *entry) {
+  return createPredicateEntryOrderedIterator(entry, SUBJECT_ORDER);
+}
+
+Iterator* createPredicateEntryObjectIterator(PredicateEntry *entry) {
+  return createPredicateEntryOrderedIterator(entry, OBJECT_ORDER);
+}
+
+Iterator* createPredicateEntryIteratorInArena(Arena *arena, PredicateEntry *entry) {
+  return createPredicateEntryOrderedIteratorInArena(arena, entry, SUBJECT_ORDER);
+}
+
 /*
 Join
 */
 
 void advanceJoin(Iterator *iterator) {
-  // printf("advanceJoin %p\n", iterator);
   assert(iterator->TYPE == JOIN_ITERATOR);
   assert(!iterator->done(iterator));
   PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
@@ -170,14 +1584,19 @@ void advanceJoin(Iterator *iterator) {
 }
 
 BOOL doneJoin(Iterator *iterator) {
-  // printf("doneJoin %p\n", iterator);
   assert(iterator->TYPE == JOIN_ITERATOR);
   PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
   return p->currentIterator == NULL;
 }
 
+EntityId peekKeyJoin(Iterator *iterator) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  assert(!iterator->done(iterator));
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  return p->currentIterator->peekKey(p->currentIterator);
+}
+
 Triple peekJoin(Iterator *iterator) {
-  // printf("peekJoin %p\n", iterator);
   assert(iterator->TYPE == JOIN_ITERATOR);
   assert(!iterator->done(iterator));
   PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
@@ -186,7 +1605,6 @@ Triple peekJoin(Iterator *iterator) {
 
 void initJoin(Iterator *iterator) {
   assert(iterator->TYPE == JOIN_ITERATOR);
-  // printf("initJoin %p\n", iterator);
   PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
   assert(p->currentIterator == NULL);
   p->aIterator->init(p->aIterator);
@@ -196,13 +1614,26 @@ void initJoin(Iterator *iterator) {
 
 void freeJoin(Iterator *iterator) {
   assert(iterator->TYPE == JOIN_ITERATOR);
-  // printf("freeJoin %p\n", iterator);
   PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
   p->aIterator->free(p->aIterator);
   p->bIterator->free(p->bIterator);
   free(iterator);
 }
 
+void seekJoin(Iterator *iterator, EntityId target) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  p->aIterator->seek(p->aIterator, target);
+  p->bIterator->seek(p->bIterator, target);
+  iterator->nextOperand(iterator);
+}
+
+Iterator *inputJoin(Iterator *iterator, int index) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  return (index == 0) ? p->aIterator : (index == 1) ? p->bIterator : NULL;
+}
+
 // EntityId tripleComponentFromOperand(OperandSPOMode: mode, Iterator *iterator) {
 //   if mode == OperandSPOModeSubject then return op.getValue().subject;
 //   if mode == OperandSPOModeObject then return op.getValue().object;
@@ -215,51 +1646,133 @@ OR
 
 void nextOperandOR(Iterator *iterator) {
   assert(iterator->TYPE == JOIN_ITERATOR);
-  // printf("nextOperandOR:S %p\n", iterator);
   PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
   Iterator *aIterator = p->aIterator;
   Iterator *bIterator = p->bIterator;
-  // printf("nextOperandOR:1 %p %p\n", aIterator, bIterator);
 
   BOOL aDone = aIterator->done(aIterator);
   BOOL bDone = bIterator->done(bIterator);
 
   if (aDone) {
-    // printf("nextOperandOR:2 %p\n", iterator);
     if (bDone) {
-      // printf("a done b done\n");
       p->currentIterator = NULL;
     } else {
-      // printf("a done b !done\n");
       p->currentIterator = p->bIterator;
     }
   } else {
-    // printf("nextOperandOR:3 %p\n", bIterator);
     if (bDone) {
-      // printf("a !done b done\n");
       p->currentIterator = p->aIterator;
     } else {
-      // printf("a !done b !done\n");
-      EntityId a = subjectIdFromTriple(aIterator->peek(aIterator));
-      EntityId b = subjectIdFromTriple(bIterator->peek(bIterator));
+      EntityId a = aIterator->peekKey(aIterator);
+      EntityId b = bIterator->peekKey(bIterator);
+      ITERATOR_STATS_ADD(iterator, comparisons, 1);
       p->currentIterator = (a <= b) ? p->aIterator : p->bIterator;
     }
   }
-  // printf("nextOperandOR:E\n");
 }
 
-Iterator* createPredicateEntryORIterator(Iterator *aIterator, Iterator *bIterator) {
-  PredicateEntryJoinIterator *iterator = malloc(sizeof(PredicateEntryJoinIterator));
+unsigned long nextBatchOR(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  unsigned long count = 0;
+
+  if (isPlainEntryIterator(p->aIterator) && isPlainEntryIterator(p->bIterator)) {
+    // merge the two pair arrays directly on their key halves; ties go to a, as in nextOperandOR
+    PredicateEntryIterator *a = (PredicateEntryIterator *)p->aIterator;
+    PredicateEntryIterator *b = (PredicateEntryIterator *)p->bIterator;
+    EntityPair *aPairs = entryIteratorPairs(a);
+    EntityPair *bPairs = entryIteratorPairs(b);
+    unsigned long aPosition = a->position, aCount = a->entry->entryCount;
+    unsigned long bPosition = b->position, bCount = b->entry->entryCount;
+    Triple aPredicateBits = predicateBitsForTriple(a->entry->predicate);
+    Triple bPredicateBits = predicateBitsForTriple(b->entry->predicate);
+
+    // alternate runs: a's pairs with keys <= b's current key, then b's below a's
+    while (count < capacity && aPosition < aCount && bPosition < bCount) {
+      EntityPair bKey = bPairs[bPosition] >> ENTITY_PAIR_HALF_BIT_COUNT;
+      unsigned long aEnd = (bKey == ENTITY_PAIR_HALF_MASK) ? aCount : lowerBoundEntityPairs(aPairs, aPosition, aCount, (bKey + 1) << ENTITY_PAIR_HALF_BIT_COUNT);
+      if (aEnd - aPosition > capacity - count) {
+        aEnd = aPosition + (capacity - count);
+      }
+      for (; aPosition < aEnd; aPosition++) {
+        triples[count++] = pairToTriple(aPairs[aPosition], aPredicateBits, a->order);
+      }
+      if (count == capacity || aPosition >= aCount) {
+        break;
+      }
+
+      EntityPair aKey = aPairs[aPosition] >> ENTITY_PAIR_HALF_BIT_COUNT;
+      unsigned long bEnd = lowerBoundEntityPairs(bPairs, bPosition, bCount, aKey << ENTITY_PAIR_HALF_BIT_COUNT);
+      if (bEnd - bPosition > capacity - count) {
+        bEnd = bPosition + (capacity - count);
+      }
+      for (; bPosition < bEnd; bPosition++) {
+        triples[count++] = pairToTriple(bPairs[bPosition], bPredicateBits, b->order);
+      }
+    }
+    for (; count < capacity && aPosition < aCount; aPosition++) {
+      triples[count++] = pairToTriple(aPairs[aPosition], aPredicateBits, a->order);
+    }
+    for (; count < capacity && bPosition < bCount; bPosition++) {
+      triples[count++] = pairToTriple(bPairs[bPosition], bPredicateBits, b->order);
+    }
+
+    a->position = aPosition;
+    b->position = bPosition;
+    nextOperandOR(iterator);
+    return count;
+  }
+
+  while (count < capacity && p->currentIterator != NULL) {
+    triples[count++] = p->currentIterator->peek(p->currentIterator);
+    p->currentIterator->advance(p->currentIterator);
+    nextOperandOR(iterator);
+  }
+  return count;
+}
+
+void describeOR(Iterator *iterator, char *label, unsigned long length) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  snprintf(label, length, "OR");
+}
+
+Iterator* cloneOR(Iterator *iterator) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  return createPredicateEntryORIterator(p->aIterator->clone(p->aIterator), p->bIterator->clone(p->bIterator));
+}
+
+void initORIterator(PredicateEntryJoinIterator *iterator, Iterator *aIterator, Iterator *bIterator) {
   iterator->fn.TYPE = JOIN_ITERATOR;
   iterator->fn.advance = &advanceJoin;
   iterator->fn.nextOperand = &nextOperandOR;
+  iterator->fn.nextBatch = &nextBatchOR;
   iterator->fn.peek = &peekJoin;
+  iterator->fn.peekKey = &peekKeyJoin;
   iterator->fn.done = &doneJoin;
   iterator->fn.init = &initJoin;
   iterator->fn.free = &freeJoin;
+  iterator->fn.seek = &seekJoin;
+  iterator->fn.clone = &cloneOR;
+  iterator->fn.describe = &describeOR;
+  iterator->fn.input = &inputJoin;
   iterator->aIterator = aIterator;
   iterator->bIterator = bIterator;
   iterator->currentIterator = NULL;
+  iterator->strategy = JOIN_STRATEGY_SEEK;
+  ITERATOR_STATS_INSTALL(iterator);
+}
+
+Iterator* createPredicateEntryORIterator(Iterator *aIterator, Iterator *bIterator) {
+  PredicateEntryJoinIterator *iterator = malloc(sizeof(PredicateEntryJoinIterator));
+  initORIterator(iterator, aIterator, bIterator);
+  return (Iterator*)iterator;
+}
+
+Iterator* createPredicateEntryORIteratorInArena(Arena *arena, Iterator *aIterator, Iterator *bIterator) {
+  PredicateEntryJoinIterator *iterator = arenaAllocate(arena, sizeof(PredicateEntryJoinIterator));
+  initORIterator(iterator, aIterator, bIterator);
+  iterator->fn.free = &freeArenaIterator;
   return (Iterator*)iterator;
 }
 
@@ -267,49 +1780,304 @@ Iterator* createPredicateEntryORIterator(Iterator *aIterator, Iterator *bIterato
 AND
 */
 
+// the subject bitmap behind an iterator whose keys are an entry's subjects, when there is one
+static inline SubjectBitmap *iteratorSubjectBitmap(Iterator *iterator) {
+  if (iterator->TYPE != ENTRY_ITERATOR || ((PredicateEntryIterator *)iterator)->order != SUBJECT_ORDER) {
+    return NULL;
+  }
+  return ((PredicateEntryIterator *)iterator)->entry->subjectBitmap;
+}
+
+// the smallest key >= key that aIterator may hold and bBitmap holds; aBitmap, when not NULL, is aIterator's key set
+static inline BOOL nextBitmapMatch(SubjectBitmap *aBitmap, SubjectBitmap *bBitmap, EntityId key, EntityId *next) {
+  return (aBitmap != NULL) ? nextCommonSubjectBitmapId(aBitmap, bBitmap, key, next) : nextSubjectBitmapId(bBitmap, key, next);
+}
+
+typedef unsigned long (*keyPositionsFn)(EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+                                       EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+                                       unsigned long *positions, unsigned long capacity);
+
+// the batch intersection kernel for the join strategy picked for this AND
+static inline keyPositionsFn joinKeyPositions(PredicateEntryJoinIterator *p) {
+  return (p->strategy == JOIN_STRATEGY_MERGE) ? &mergeKeyPositions : &intersectKeyPositions;
+}
+
+// with b's key set in a bitmap, b itself never moves: a is tested against the set and skips
+// straight to the next key b has, both sets' words at a time when a has a bitmap too
+void nextOperandANDWithBitmap(PredicateEntryJoinIterator *p, SubjectBitmap *bBitmap) {
+  Iterator *aIterator = p->aIterator;
+  SubjectBitmap *aBitmap = iteratorSubjectBitmap(aIterator);
+  while (!aIterator->done(aIterator)) {
+    EntityId key = aIterator->peekKey(aIterator);
+    EntityId next;
+    ITERATOR_STATS_ADD(p, comparisons, 1);
+    if (!nextBitmapMatch(aBitmap, bBitmap, key, &next)) {
+      break;
+    }
+    if (next == key) {
+      p->currentIterator = aIterator;
+      return;
+    }
+    aIterator->seek(aIterator, next);
+  }
+  p->currentIterator = NULL;
+}
+
+// emits the triples of aIterator whose key also occurs in bIterator
+// whichever side is behind seeks straight to the other's key, so a small input
+// intersected with a large one only touches O(small * log(large / small)) of the large side
 void nextOperandAND(Iterator *iterator) {
   assert(iterator->TYPE == JOIN_ITERATOR);
   PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
   Iterator *aIterator = p->aIterator;
   Iterator *bIterator = p->bIterator;
-  Iterator *nextIterator = NULL;
-  BOOL firstAdvance = TRUE;
+
+  SubjectBitmap *bBitmap = iteratorSubjectBitmap(bIterator);
+  if (bBitmap != NULL) {
+    nextOperandANDWithBitmap(p, bBitmap);
+    return;
+  }
+
+  if (isPlainEntryIterator(aIterator) && isPlainEntryIterator(bIterator)) {
+    // both sides are sorted arrays, so skip through them with the vector kernel, or step through them
+    PredicateEntryIterator *a = (PredicateEntryIterator *)aIterator;
+    PredicateEntryIterator *b = (PredicateEntryIterator *)bIterator;
+    unsigned long match;
+    unsigned long passed = a->position + b->position;
+    if (joinKeyPositions(p)(entryIteratorPairs(a), &a->position, a->entry->entryCount,
+                            entryIteratorPairs(b), &b->position, b->entry->entryCount, &match, 1) > 0) {
+      a->position = match;
+      p->currentIterator = aIterator;
+    } else {
+      p->currentIterator = NULL;
+    }
+    ITERATOR_STATS_ADD(iterator, skipped, a->position + b->position - passed);
+    return;
+  }
 
   while (!aIterator->done(aIterator) && !bIterator->done(bIterator)) {
-    EntityId a = subjectIdFromTriple(aIterator->peek(aIterator));
-    EntityId b = subjectIdFromTriple(bIterator->peek(bIterator));
+    EntityId a = aIterator->peekKey(aIterator);
+    EntityId b = bIterator->peekKey(bIterator);
+    ITERATOR_STATS_ADD(iterator, comparisons, 1);
 
     if (a > b) {
-      bIterator->advance(bIterator);
-      firstAdvance = FALSE;
-    } else if (a == b) {
-      if (p->currentIterator != NULL) {
-        if (firstAdvance) {
-          p->currentIterator->advance(p->currentIterator);
+      bIterator->seek(bIterator, a);
+    } else if (a < b) {
+      aIterator->seek(aIterator, b);
+    } else {
+      p->currentIterator = aIterator;
+      return;
+    }
+  }
+
+  p->currentIterator = NULL;
+}
+
+unsigned long nextBatchAND(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  unsigned long count = 0;
+
+  SubjectBitmap *bBitmap = iteratorSubjectBitmap(p->bIterator);
+  if (bBitmap != NULL && isPlainEntryIterator(p->aIterator)) {
+    // copy out whole runs of a whose key b has, skipping the others by bitmap
+    PredicateEntryIterator *a = (PredicateEntryIterator *)p->aIterator;
+    SubjectBitmap *aBitmap = iteratorSubjectBitmap(p->aIterator);
+    EntityPair *pairs = entryIteratorPairs(a);
+    unsigned long position = a->position;
+    unsigned long entryCount = a->entry->entryCount;
+    Triple predicateBits = predicateBitsForTriple(a->entry->predicate);
+    SubjectBitmapCursor cursor;
+    initSubjectBitmapCursor(&cursor, bBitmap);
+    while (count < capacity && position < entryCount) {
+      EntityId key = (EntityId)(pairs[position] >> ENTITY_PAIR_HALF_BIT_COUNT);
+      if (!subjectBitmapCursorContains(&cursor, key)) {
+        EntityId next;
+        unsigned long skippedFrom = position;
+        if (!nextBitmapMatch(aBitmap, bBitmap, key, &next)) {
+          position = entryCount;
+        } else {
+          position = lowerBoundEntityPairs(pairs, position, entryCount, (EntityPair)next << ENTITY_PAIR_HALF_BIT_COUNT);
         }
+        ITERATOR_STATS_ADD(iterator, skipped, position - skippedFrom);
+        continue;
+      }
+      while (count < capacity && position < entryCount && (EntityId)(pairs[position] >> ENTITY_PAIR_HALF_BIT_COUNT) == key) {
+        triples[count++] = pairToTriple(pairs[position++], predicateBits, a->order);
       }
-      nextIterator = (p->currentIterator == aIterator) ? bIterator : aIterator;
-      break;
-    } else {
-      aIterator->advance(aIterator);
-      firstAdvance = FALSE;
     }
+    a->position = position;
+    nextOperandAND(iterator);
+    return count;
+  }
+
+  if (isPlainEntryIterator(p->aIterator) && isPlainEntryIterator(p->bIterator)) {
+    PredicateEntryIterator *a = (PredicateEntryIterator *)p->aIterator;
+    PredicateEntryIterator *b = (PredicateEntryIterator *)p->bIterator;
+    EntityPair *aPairs = entryIteratorPairs(a);
+    EntityPair *bPairs = entryIteratorPairs(b);
+    unsigned long aPosition = a->position, aCount = a->entry->entryCount;
+    unsigned long bPosition = b->position, bCount = b->entry->entryCount;
+    Triple aPredicateBits = predicateBitsForTriple(a->entry->predicate);
+
+    keyPositionsFn keyPositions = joinKeyPositions(p);
+    unsigned long positions[ITERATOR_BATCH_LENGTH];
+    while (count < capacity) {
+      unsigned long limit = (capacity - count < ITERATOR_BATCH_LENGTH) ? capacity - count : ITERATOR_BATCH_LENGTH;
+      unsigned long found = keyPositions(aPairs, &aPosition, aCount, bPairs, &bPosition, bCount, positions, limit);
+      for (unsigned long i = 0; i < found; i++) {
+        triples[count++] = pairToTriple(aPairs[positions[i]], aPredicateBits, a->order);
+      }
+      if (found < limit) {
+        break;
+      }
+    }
+    // every pair of b and the pairs of a without a match
+    ITERATOR_STATS_ADD(iterator, skipped, (aPosition - a->position) + (bPosition - b->position) - count);
+
+    a->position = aPosition;
+    b->position = bPosition;
+    nextOperandAND(iterator);
+    return count;
+  }
+
+  while (count < capacity && p->currentIterator != NULL) {
+    triples[count++] = p->currentIterator->peek(p->currentIterator);
+    p->currentIterator->advance(p->currentIterator);
+    nextOperandAND(iterator);
   }
+  return count;
+}
 
-  p->currentIterator = nextIterator;
+void describeAND(Iterator *iterator, char *label, unsigned long length) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  if (iteratorSubjectBitmap(p->bIterator) != NULL) {
+    snprintf(label, length, "AND bitmap");
+  } else {
+    snprintf(label, length, "AND %s", (p->strategy == JOIN_STRATEGY_MERGE) ? "merge" : "seek");
+  }
 }
 
-Iterator* createPredicateEntryANDIterator(Iterator *aIterator, Iterator *bIterator) {
-  PredicateEntryJoinIterator *iterator = malloc(sizeof(PredicateEntryJoinIterator));
+Iterator* cloneAND(Iterator *iterator) {
+  assert(iterator->TYPE == JOIN_ITERATOR);
+  PredicateEntryJoinIterator *p = (PredicateEntryJoinIterator *)iterator;
+  return createPredicateEntryANDIteratorWithStrategy(p->aIterator->clone(p->aIterator), p->bIterator->clone(p->bIterator), p->strategy);
+}
+
+void initANDIterator(PredicateEntryJoinIterator *iterator, Iterator *aIterator, Iterator *bIterator) {
   iterator->fn.TYPE = JOIN_ITERATOR;
   iterator->fn.advance = &advanceJoin;
   iterator->fn.nextOperand = &nextOperandAND;
+  iterator->fn.nextBatch = &nextBatchAND;
   iterator->fn.peek = &peekJoin;
+  iterator->fn.peekKey = &peekKeyJoin;
   iterator->fn.done = &doneJoin;
   iterator->fn.init = &initJoin;
   iterator->fn.free = &freeJoin;
+  iterator->fn.seek = &seekJoin;
+  iterator->fn.clone = &cloneAND;
+  iterator->fn.describe = &describeAND;
+  iterator->fn.input = &inputJoin;
   iterator->aIterator = aIterator;
   iterator->bIterator = bIterator;
   iterator->currentIterator = NULL;
+  iterator->strategy = JOIN_STRATEGY_SEEK;
+  ITERATOR_STATS_INSTALL(iterator);
+}
+
+Iterator* createPredicateEntryANDIterator(Iterator *aIterator, Iterator *bIterator) {
+  PredicateEntryJoinIterator *iterator = malloc(sizeof(PredicateEntryJoinIterator));
+  initANDIterator(iterator, aIterator, bIterator);
   return (Iterator*)iterator;
 }
+
+Iterator* createPredicateEntryANDIteratorWithStrategy(Iterator *aIterator, Iterator *bIterator, unsigned char strategy) {
+  assert(strategy == JOIN_STRATEGY_SEEK || strategy == JOIN_STRATEGY_MERGE);
+  PredicateEntryJoinIterator *iterator = malloc(sizeof(PredicateEntryJoinIterator));
+  initANDIterator(iterator, aIterator, bIterator);
+  iterator->strategy = strategy;
+  return (Iterator*)iterator;
+}
+
+Iterator* createPredicateEntryANDIteratorInArena(Arena *arena, Iterator *aIterator, Iterator *bIterator) {
+  PredicateEntryJoinIterator *iterator = arenaAllocate(arena, sizeof(PredicateEntryJoinIterator));
+  initANDIterator(iterator, aIterator, bIterator);
+  iterator->fn.free = &freeArenaIterator;
+  return (Iterator*)iterator;
+}
+
+/*
+Keyed joins
+*/
+
+void orderedInputsForJoinKeyMode(unsigned char joinKeyMode, unsigned char *aOrder, unsigned char *bOrder) {
+  assert(joinKeyMode <= JOIN_ON_SUBJECT_OBJECT);
+  *aOrder = (joinKeyMode == JOIN_ON_OBJECT) ? OBJECT_ORDER : SUBJECT_ORDER;
+  *bOrder = (joinKeyMode == JOIN_ON_SUBJECT) ? SUBJECT_ORDER : OBJECT_ORDER;
+}
+
+Iterator* createPredicateEntryKeyedORIterator(PredicateEntry *aEntry, PredicateEntry *bEntry, unsigned char joinKeyMode) {
+  unsigned char aOrder, bOrder;
+  orderedInputsForJoinKeyMode(joinKeyMode, &aOrder, &bOrder);
+  return createPredicateEntryORIterator(createPredicateEntryOrderedIterator(aEntry, aOrder), createPredicateEntryOrderedIterator(bEntry, bOrder));
+}
+
+Iterator* createPredicateEntryKeyedANDIterator(PredicateEntry *aEntry, PredicateEntry *bEntry, unsigned char joinKeyMode) {
+  unsigned char aOrder, bOrder;
+  orderedInputsForJoinKeyMode(joinKeyMode, &aOrder, &bOrder);
+  return createPredicateEntryANDIterator(createPredicateEntryOrderedIterator(aEntry, aOrder), createPredicateEntryOrderedIterator(bEntry, bOrder));
+}
+
+unsigned long mergeJoin(Iterator *aIterator, Iterator *bIterator, MergeJoinCallback callback, void *context) {
+  aIterator->init(aIterator);
+  bIterator->init(bIterator);
+
+  // a's triples for the current key, crossed with each of b's
+  unsigned long groupLength = 16;
+  Triple *group = malloc(sizeof(Triple) * groupLength);
+  unsigned long count = 0;
+
+  while (!aIterator->done(aIterator) && !bIterator->done(bIterator)) {
+    EntityId a = aIterator->peekKey(aIterator);
+    EntityId b = bIterator->peekKey(bIterator);
+
+    if (a < b) {
+      aIterator->seek(aIterator, b);
+    } else if (a > b) {
+      bIterator->seek(bIterator, a);
+    } else {
+      unsigned long groupCount = 0;
+      while (!aIterator->done(aIterator) && aIterator->peekKey(aIterator) == a) {
+        if (groupCount >= groupLength) {
+          groupLength *= 2;
+          group = realloc(group, sizeof(Triple) * groupLength);
+        }
+        group[groupCount++] = aIterator->peek(aIterator);
+        aIterator->advance(aIterator);
+      }
+      while (!bIterator->done(bIterator) && bIterator->peekKey(bIterator) == a) {
+        Triple bTriple = bIterator->peek(bIterator);
+        for (unsigned long i = 0; i < groupCount; i++) {
+          callback(group[i], bTriple, context);
+        }
+        count += groupCount;
+        bIterator->advance(bIterator);
+      }
+    }
+  }
+
+  free(group);
+  return count;
+}
+
+unsigned long mergeJoinPredicateEntries(PredicateEntry *aEntry, PredicateEntry *bEntry, unsigned char joinKeyMode, MergeJoinCallback callback, void *context) {
+  unsigned char aOrder, bOrder;
+  orderedInputsForJoinKeyMode(joinKeyMode, &aOrder, &bOrder);
+  Iterator *aIterator = createPredicateEntryOrderedIterator(aEntry, aOrder);
+  Iterator *bIterator = createPredicateEntryOrderedIterator(bEntry, bOrder);
+  unsigned long count = mergeJoin(aIterator, bIterator, callback, context);
+  aIterator->free(aIterator);
+  bIterator->free(bIterator);
+  return count;
+}
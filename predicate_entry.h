@@ -3,9 +3,19 @@
 
 #include "triple.h"
 #include "iterator.h"
+#include "bit_packed.h"
+#include "arena.h"
+#include "subject_bitmap.h"
+#include "bloom_filter.h"
 
 // EntityPair must be wide enough to hold sizeof(EntityId) * 2
+#if CGRAPH_ID_MODE == CGRAPH_ID_MODE_WIDE40
+__extension__ typedef unsigned __int128 EntityPair;
+#define ENTITY_PAIR_WORD_COUNT 2
+#else
 typedef unsigned long long EntityPair;
+#define ENTITY_PAIR_WORD_COUNT 1
+#endif
 
 #define ENTITY_PAIR_BIT_COUNT (sizeof(EntityPair) * 8)
 #define ENTITY_PAIR_HALF_BIT_COUNT (ENTITY_PAIR_BIT_COUNT >> 1)
@@ -24,6 +34,35 @@ Triple toTripleFromOSEntry(EntityPair osPair, PredicateId predicate);
 
 #define PREDICATE_ENTRY_INITIAL_ALLOCATION_LENGTH 16
 
+// CSR form of one sorted side of an entry: the distinct keys (subjects for SO, objects for OS)
+// ascending, and values[offsets[i]] .. values[offsets[i + 1] - 1] the ascending neighbors of key i
+typedef struct {
+  unsigned long keyCount;
+  BitPackedArray keys;
+  BitPackedArray offsets;
+  BitPackedArray values;
+} CompressedAdjacency;
+
+// degree histograms bucket by powers of two: bucket i counts the keys with 2^i .. 2^(i+1) - 1 neighbors,
+// and the last bucket every key with more
+#define PREDICATE_ENTRY_DEGREE_BUCKET_COUNT 32
+
+// the shape of an entry as of its last optimize, for the query planner; removals are not
+// reflected until the entry is compacted
+typedef struct {
+  unsigned long entryCount;
+  unsigned long distinctSubjects;
+  unsigned long distinctObjects;
+  SubjectId minSubject;
+  SubjectId maxSubject;
+  ObjectId minObject;
+  ObjectId maxObject;
+  unsigned long maxSubjectDegree;
+  unsigned long maxObjectDegree;
+  unsigned long subjectDegrees[PREDICATE_ENTRY_DEGREE_BUCKET_COUNT];
+  unsigned long objectDegrees[PREDICATE_ENTRY_DEGREE_BUCKET_COUNT];
+} PredicateEntryStatistics;
+
 typedef struct {
   PredicateId predicate;
 
@@ -33,34 +72,222 @@ typedef struct {
   EntityPair *soEntries;
   EntityPair *osEntries;
 
+  // both arrays are laid out as a sorted base [0, sortedCount), then a sorted delta of the next
+  // deltaSortedCount pairs, then the unsorted tail of pairs added since; optimize merges all three
+  unsigned long sortedCount;
+  unsigned long deltaSortedCount;
+
+  // pairs removed since the last compaction, one array per side like the entries; readers skip them
+  // [0, sortedTombstoneCount) is sorted and the rest is a short unsorted buffer of recent removals
+  // every tombstone shadows pairs still present, so compaction drops both together
+  EntityPair *soTombstones;
+  EntityPair *osTombstones;
+  unsigned long tombstoneCount;
+  unsigned long sortedTombstoneCount;
+  unsigned long currentTombstonesLength;
+
+  // set by compressPredicateEntry, which releases soEntries and osEntries
+  CompressedAdjacency *soCompressed;
+  CompressedAdjacency *osCompressed;
+
+  // soEntries/osEntries live in memory the entry does not own, e.g. a mapped segment file
+  // borrowed entries are sorted and read-only
+  BOOL borrowed;
+
+  // the distinct subjects, built by optimize for dense entries (see OptimizeOptions); dropped on add
+  SubjectBitmap *subjectBitmap;
+  // the (subject, object) pairs, built by optimize on request; dropped on add
+  BloomFilter *bloomFilter;
+  // recorded by optimize, see predicateEntryStatistics
+  PredicateEntryStatistics *statistics;
+
 } PredicateEntry;
 
 PredicateEntry *createPredicateEntry(PredicateId predicate);
+// sized exactly, for loaders that know the entry count up front and fill soEntries/osEntries directly
+PredicateEntry *createPredicateEntryWithCapacity(PredicateId predicate, unsigned long capacity);
+PredicateEntry *createBorrowedPredicateEntry(PredicateId predicate, EntityPair *soEntries, EntityPair *osEntries, unsigned long entryCount);
 void freePredicateEntry(PredicateEntry *entry);
+// a private copy of the pairs, tombstones and statistics with room for extraCapacity more pairs, e.g. to
+// change an entry without touching it under its readers; the subject bitmap and Bloom filter are left out
+PredicateEntry *copyPredicateEntry(PredicateEntry *entry, unsigned long extraCapacity);
+// a borrowed entry over a fully sorted entry's pairs with a private copy of its tombstones and statistics,
+// so pairs can be removed from it without touching the shared arrays; free it before the entry it borrows from
+PredicateEntry *createPredicateEntryView(PredicateEntry *entry);
 
 void growPredicateEntry(PredicateEntry *entry);
 void addToPredicateEntry(PredicateEntry *entry, SubjectId subject, ObjectId object);
+// hides the pair, and every copy of it, from readers; returns FALSE when it is not present
+// removals only record a tombstone, so they are cheap and leave the pair arrays alone until compaction
+// tombstones are matched against sorted runs, so removing from an entry never optimized optimizes it first
+BOOL removeFromPredicateEntry(PredicateEntry *entry, SubjectId subject, ObjectId object);
+// shows a removed pair again by dropping its tombstone; returns FALSE when the pair has none
+BOOL dropPredicateEntryTombstone(PredicateEntry *entry, SubjectId subject, ObjectId object);
+
+// compaction rewrites the pair arrays without the removed pairs once tombstones pass
+// 1/PREDICATE_ENTRY_COMPACTION_RATIO of the entry
+#define PREDICATE_ENTRY_COMPACTION_RATIO 8
+// recent removals are scanned linearly until this many are pending, then sorted into the rest
+#define PREDICATE_ENTRY_TOMBSTONE_BUFFER_LENGTH 256
+
+BOOL predicateEntryNeedsCompaction(PredicateEntry *entry);
+// optimizes the entry and drops its tombstoned pairs, whatever the ratio; a borrowed entry gets arrays of its own
+void compactPredicateEntry(PredicateEntry *entry);
+
+// once an entry has been optimized, later optimizes sort only the pairs added since and merge
+// them into the base in one linear pass, so trickle updates do not re-sort the whole entry
 void optimizePredicateEntry(PredicateEntry *entry);
+// scratch must hold predicateEntryUnsortedCount pairs, letting callers reuse one buffer across entries
+void optimizePredicateEntryWithScratch(PredicateEntry *entry, EntityPair *scratch);
+// threadCount > 0 caps the sort's threads; 0 leaves it to the sort
+void optimizePredicateEntryWithThreads(PredicateEntry *entry, EntityPair *scratch, int threadCount);
+// the pairs past the sorted base, i.e. what the next optimize has to place
+unsigned long predicateEntryUnsortedCount(PredicateEntry *entry);
+
+// recording statistics reads the whole entry, so optimize and compaction only record them again
+// once the entry count has drifted by more than 1/PREDICATE_ENTRY_STATISTICS_DRIFT_RATIO
+#define PREDICATE_ENTRY_STATISTICS_DRIFT_RATIO 8
+
+// the statistics of a sorted entry: optimized, compressed or borrowed; recorded on first use when
+// optimize has not done so, e.g. for entries of a mapped segment file
+PredicateEntryStatistics *predicateEntryStatistics(PredicateEntry *entry);
+// records them now, whatever the drift
+void recordPredicateEntryStatistics(PredicateEntry *entry);
+
+// once the delta exceeds 1/PREDICATE_ENTRY_DELTA_MERGE_RATIO of the base, reading merges it in
+#define PREDICATE_ENTRY_DELTA_MERGE_RATIO 8
+
+// readies an optimized entry with additions or removals for iteration: the tail is sorted into the delta, or,
+// past the ratio, everything is merged, and pending tombstones are sorted; iterators call this, so do it
+// before sharing the entry between threads
+void preparePredicateEntryForReading(PredicateEntry *entry);
+
+#define OPTIMIZE_DEFAULT_SUBJECT_BITMAP_DENSITY 0.0625
+
+typedef struct {
+  // for optimizeSegmentWithOptions; < 1 uses availableThreadCount()
+  int threadCount;
+  // build a subject bitmap for entries whose distinct subjects fill at least
+  // subjectBitmapDensity of the range between their smallest and largest subject
+  BOOL buildSubjectBitmaps;
+  double subjectBitmapDensity;
+  // a Bloom filter over each entry's pairs, so most failed point lookups cost one cache line
+  BOOL buildBloomFilters;
+  unsigned int bloomFilterBitsPerKey;
+} OptimizeOptions;
+
+void initOptimizeOptions(OptimizeOptions *options);
+void optimizePredicateEntryWithOptions(PredicateEntry *entry, OptimizeOptions *options);
+// for a sorted entry; returns whether the bitmap was built
+BOOL buildPredicateEntrySubjectBitmap(PredicateEntry *entry, double minDensity);
+void buildPredicateEntryBloomFilter(PredicateEntry *entry, unsigned int bitsPerKey);
+
+// point lookups on any entry: a never optimized one is optimized first, and pairs added since the last
+// optimize are found after preparePredicateEntryForReading, so like iterators these may write to the entry
+BOOL predicateEntryHasPair(PredicateEntry *entry, SubjectId subject, ObjectId object);
+// write up to capacity of the key's neighbors, ascending, and return how many it has
+unsigned long lookupPredicateEntrySubject(PredicateEntry *entry, SubjectId subject, ObjectId *objects, unsigned long capacity);
+unsigned long lookupPredicateEntryObject(PredicateEntry *entry, ObjectId object, SubjectId *subjects, unsigned long capacity);
+
+// replaces the pair arrays of an entry with their CSR form, optimizing and compacting it first when needed
+// a compressed entry is read-only: it can be iterated but not added to
+void compressPredicateEntry(PredicateEntry *entry);
+BOOL isCompressedPredicateEntry(PredicateEntry *entry);
+unsigned long predicateEntryMemoryUsage(PredicateEntry *entry);
+
+// first index in [begin, count) of sorted pairs whose pair is >= bound
+unsigned long gallopEntityPairs(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound);
+// merges the sorted runs [0, middle) and [middle, count) in place; scratch must hold count - middle pairs
+void mergeEntityPairRuns(EntityPair *pairs, unsigned long middle, unsigned long count, EntityPair *scratch);
+// the same over all count pairs, for lookups with no position to start from
+// starts from an interpolated guess, so evenly spread pairs take a handful of probes
+unsigned long interpolationSearchEntityPairs(EntityPair *pairs, unsigned long count, EntityPair bound);
+
+// which sorted side an entry iterator walks, and so which component is its key
+#define SUBJECT_ORDER ((unsigned char)0)
+#define OBJECT_ORDER  ((unsigned char)1)
 
 typedef struct {
   Iterator fn;
   PredicateEntry *entry;
+  unsigned char order;
   unsigned long position;
   BOOL done;
+
+  // decode state for compressed entries: the key owning position and where its neighbors end
+  unsigned long keyIndex;
+  unsigned long keyEnd;
+  EntityId key;
 } PredicateEntryIterator;
 
 Iterator* createPredicateEntryIterator(PredicateEntry *entry);
+// walks osEntries: triples come out ordered by object and seek targets objects
+Iterator* createPredicateEntryObjectIterator(PredicateEntry *entry);
+Iterator* createPredicateEntryOrderedIterator(PredicateEntry *entry, unsigned char order);
 void freePredicateEntryIterator(PredicateEntryIterator *iterator);
+// plain iterators over uncompressed entries are the ones batch loops can read directly through position
+BOOL isPlainEntryIterator(Iterator *iterator);
+
+// reads an optimized entry's base and delta as one sorted run, skipping tombstoned pairs; the ordered
+// constructors return it in place of a PredicateEntryIterator when the entry has pairs added since its
+// last optimize or removed since its last compaction
+typedef struct {
+  Iterator fn;
+  PredicateEntry *entry;
+  unsigned char order;
+  unsigned long basePosition;
+  unsigned long baseEnd;
+  unsigned long deltaPosition;
+  unsigned long deltaEnd;
+  // tombstones below tombstonePosition sort before the current pair
+  unsigned long tombstonePosition;
+  unsigned long tombstoneEnd;
+} PredicateEntryMergedIterator;
+
+/*
+  InArena variants build the same iterators inside an arena, so a query's whole tree is a few
+  adjacent allocations and goes away with resetArena/freeArena. Their free is a no-op, so give
+  them only inputs from the same arena. Clones of an arena tree are ordinary heap trees.
+*/
+Iterator* createPredicateEntryIteratorInArena(Arena *arena, PredicateEntry *entry);
+Iterator* createPredicateEntryOrderedIteratorInArena(Arena *arena, PredicateEntry *entry, unsigned char order);
+
+// how an AND of two plain entry iterators intersects them: seeking jumps the side that is behind
+// straight to the other's key, which pays off when one side is much larger; merging steps both
+// sides a pair at a time, which is cheaper per pair when they are of similar size
+#define JOIN_STRATEGY_SEEK  ((unsigned char)0)
+#define JOIN_STRATEGY_MERGE ((unsigned char)1)
 
 typedef struct {
   Iterator fn;
   Iterator *aIterator;
   Iterator *bIterator;
   Iterator *currentIterator;
+  // AND only
+  unsigned char strategy;
 } PredicateEntryJoinIterator;
 
 Iterator* createPredicateEntryORIterator(Iterator *aIterator, Iterator *bIterator);
 Iterator* createPredicateEntryANDIterator(Iterator *aIterator, Iterator *bIterator);
+// the plain AND seeks; inputs that are not plain entry iterators, or have a subject bitmap, always do
+Iterator* createPredicateEntryANDIteratorWithStrategy(Iterator *aIterator, Iterator *bIterator, unsigned char strategy);
 void freePredicateEntryJoinIterator(PredicateEntryJoinIterator *iterator);
+Iterator* createPredicateEntryORIteratorInArena(Arena *arena, Iterator *aIterator, Iterator *bIterator);
+Iterator* createPredicateEntryANDIteratorInArena(Arena *arena, Iterator *aIterator, Iterator *bIterator);
+
+// joins compare their inputs' keys, so the key mode is just the order each input is read in
+#define JOIN_ON_SUBJECT        ((unsigned char)0)
+#define JOIN_ON_OBJECT         ((unsigned char)1)
+// subject of a = object of b, e.g. a = q and b = p for ?x p ?y . ?y q ?z
+#define JOIN_ON_SUBJECT_OBJECT ((unsigned char)2)
+
+Iterator* createPredicateEntryKeyedORIterator(PredicateEntry *aEntry, PredicateEntry *bEntry, unsigned char joinKeyMode);
+Iterator* createPredicateEntryKeyedANDIterator(PredicateEntry *aEntry, PredicateEntry *bEntry, unsigned char joinKeyMode);
+
+// sorted merge join: calls back once per pair of triples, one from each input, with equal keys
+// the iterators must be freshly created; they are initialized here and left for the caller to free
+typedef void (*MergeJoinCallback)(Triple aTriple, Triple bTriple, void *context);
+unsigned long mergeJoin(Iterator *aIterator, Iterator *bIterator, MergeJoinCallback callback, void *context);
+unsigned long mergeJoinPredicateEntries(PredicateEntry *aEntry, PredicateEntry *bEntry, unsigned char joinKeyMode, MergeJoinCallback callback, void *context);
 
 #endif
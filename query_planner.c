@@ -0,0 +1,354 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "query_planner.h"
+#include "union_iterator.h"
+
+QueryPattern *createQueryPattern(unsigned char type, QueryPattern **operands, int operandCount) {
+  QueryPattern *pattern = malloc(sizeof(QueryPattern));
+  pattern->type = type;
+  pattern->entry = NULL;
+  pattern->order = SUBJECT_ORDER;
+  pattern->operands = NULL;
+  pattern->operandCount = operandCount;
+  if (operandCount > 0) {
+    pattern->operands = malloc(sizeof(QueryPattern *) * operandCount);
+    memcpy(pattern->operands, operands, sizeof(QueryPattern *) * operandCount);
+  }
+  return pattern;
+}
+
+QueryPattern *createEntryPattern(PredicateEntry *entry, unsigned char order) {
+  assert(order == SUBJECT_ORDER || order == OBJECT_ORDER || order == QUERY_PATTERN_ANY_ORDER);
+  QueryPattern *pattern = createQueryPattern(QUERY_PATTERN_ENTRY, NULL, 0);
+  pattern->entry = entry;
+  pattern->order = order;
+  return pattern;
+}
+
+QueryPattern *createANDPattern(QueryPattern **operands, int operandCount) {
+  assert(operandCount > 0);
+  return createQueryPattern(QUERY_PATTERN_AND, operands, operandCount);
+}
+
+QueryPattern *createORPattern(QueryPattern **operands, int operandCount) {
+  assert(operandCount > 0);
+  return createQueryPattern(QUERY_PATTERN_OR, operands, operandCount);
+}
+
+void freeQueryPattern(QueryPattern *pattern) {
+  for (int i = 0; i < pattern->operandCount; i++) {
+    freeQueryPattern(pattern->operands[i]);
+  }
+  free(pattern->operands);
+  free(pattern);
+}
+
+/*
+  Estimates
+*/
+
+static inline double minDouble(double a, double b) {
+  return (a < b) ? a : b;
+}
+
+static inline double maxDouble(double a, double b) {
+  return (a > b) ? a : b;
+}
+
+static inline double keySpan(QueryEstimate *estimate) {
+  return estimate->maxKey - estimate->minKey + 1;
+}
+
+QueryEstimate emptyQueryEstimate() {
+  QueryEstimate estimate;
+  estimate.rows = 0;
+  estimate.keys = 0;
+  estimate.minKey = 1;
+  estimate.maxKey = 0;
+  return estimate;
+}
+
+// a leaf's own order, or the one chosen for the query when it leaves that to the planner
+static inline unsigned char leafOrder(QueryPattern *pattern, unsigned char order) {
+  return (pattern->order == QUERY_PATTERN_ANY_ORDER) ? order : pattern->order;
+}
+
+QueryEstimate estimateEntryPattern(QueryPattern *pattern, unsigned char order) {
+  order = leafOrder(pattern, order);
+  PredicateEntry *entry = pattern->entry;
+  preparePredicateEntryForReading(entry);
+  unsigned long rows = entry->entryCount - entry->tombstoneCount;
+  if (rows == 0) {
+    return emptyQueryEstimate();
+  }
+  PredicateEntryStatistics *statistics = predicateEntryStatistics(entry);
+  QueryEstimate estimate;
+  estimate.rows = rows;
+  if (order == SUBJECT_ORDER) {
+    estimate.keys = statistics->distinctSubjects;
+    estimate.minKey = statistics->minSubject;
+    estimate.maxKey = statistics->maxSubject;
+  } else {
+    estimate.keys = statistics->distinctObjects;
+    estimate.minKey = statistics->minObject;
+    estimate.maxKey = statistics->maxObject;
+  }
+  // the statistics can lag the entry by up to the drift ratio; keys per row carry over
+  if (statistics->entryCount > 0) {
+    estimate.keys = minDouble(estimate.keys * estimate.rows / statistics->entryCount, estimate.rows);
+  } else {
+    estimate.keys = estimate.rows;
+    estimate.minKey = 0;
+    estimate.maxKey = (order == SUBJECT_ORDER) ? (double)SUBJECT_ID_MAX : (double)OBJECT_ID_MAX;
+  }
+  return estimate;
+}
+
+// the triples of left whose key right has; left's keys are taken to be spread evenly over its range,
+// and right to hold the keys of the ranges' overlap as densely as it holds its own range
+QueryEstimate estimateIntersection(QueryEstimate left, QueryEstimate right) {
+  double low = maxDouble(left.minKey, right.minKey);
+  double high = minDouble(left.maxKey, right.maxKey);
+  if (left.rows == 0 || right.rows == 0 || low > high) {
+    return emptyQueryEstimate();
+  }
+  double fraction = (high - low + 1) / keySpan(&left) * minDouble(right.keys / keySpan(&right), 1);
+  QueryEstimate estimate;
+  estimate.rows = left.rows * fraction;
+  estimate.keys = left.keys * fraction;
+  estimate.minKey = low;
+  estimate.maxKey = high;
+  return estimate;
+}
+
+QueryEstimate estimateUnion(QueryEstimate a, QueryEstimate b) {
+  if (a.rows == 0) {
+    return b;
+  }
+  if (b.rows == 0) {
+    return a;
+  }
+  QueryEstimate estimate;
+  estimate.rows = a.rows + b.rows;
+  estimate.minKey = minDouble(a.minKey, b.minKey);
+  estimate.maxKey = maxDouble(a.maxKey, b.maxKey);
+  estimate.keys = minDouble(a.keys + b.keys, keySpan(&estimate));
+  return estimate;
+}
+
+QueryEstimate estimatePattern(QueryPattern *pattern, unsigned char order) {
+  if (pattern->type == QUERY_PATTERN_ENTRY) {
+    return estimateEntryPattern(pattern, order);
+  }
+  QueryEstimate estimate = estimatePattern(pattern->operands[0], order);
+  for (int i = 1; i < pattern->operandCount; i++) {
+    QueryEstimate operand = estimatePattern(pattern->operands[i], order);
+    estimate = (pattern->type == QUERY_PATTERN_AND) ? estimateIntersection(estimate, operand) : estimateUnion(estimate, operand);
+  }
+  return estimate;
+}
+
+unsigned char choosePatternOrder(QueryPattern *pattern);
+
+QueryEstimate estimateQueryPattern(QueryPattern *pattern) {
+  return estimatePattern(pattern, choosePatternOrder(pattern));
+}
+
+// log2(x) for x >= 1, exact at powers of two and linear in between, which is all the cost model needs
+static inline double approximateLog2(double x) {
+  unsigned long long whole = (unsigned long long)x;
+  int bits = 63 - __builtin_clzll(whole | 1);
+  return bits + x / (double)(1ULL << bits) - 1;
+}
+
+// merging steps through every pair of both sides; seeking jumps once per key of the side with fewer
+// keys, on each side, over about as many pairs as the larger side has per such key
+unsigned char chooseJoinStrategy(QueryEstimate *a, QueryEstimate *b) {
+  double mergeCost = a->rows + b->rows;
+  double fewerKeys = maxDouble(minDouble(a->keys, b->keys), 1);
+  double moreRows = maxDouble(a->rows, b->rows);
+  double seekCost = QUERY_PLANNER_SEEK_COST * 2 * fewerKeys * approximateLog2(1 + moreRows / fewerKeys);
+  return (mergeCost < seekCost) ? JOIN_STRATEGY_MERGE : JOIN_STRATEGY_SEEK;
+}
+
+/*
+  Access paths
+*/
+
+// the order of the first leaf under pattern that fixes one, or QUERY_PATTERN_ANY_ORDER when none does
+unsigned char fixedPatternOrder(QueryPattern *pattern) {
+  if (pattern->type == QUERY_PATTERN_ENTRY) {
+    return pattern->order;
+  }
+  for (int i = 0; i < pattern->operandCount; i++) {
+    unsigned char order = fixedPatternOrder(pattern->operands[i]);
+    if (order != QUERY_PATTERN_ANY_ORDER) {
+      return order;
+    }
+  }
+  return QUERY_PATTERN_ANY_ORDER;
+}
+
+BOOL patternHasAND(QueryPattern *pattern) {
+  if (pattern->type == QUERY_PATTERN_AND) {
+    return 1;
+  }
+  for (int i = 0; i < pattern->operandCount; i++) {
+    if (patternHasAND(pattern->operands[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int countPatternLeaves(QueryPattern *pattern) {
+  if (pattern->type == QUERY_PATTERN_ENTRY) {
+    return 1;
+  }
+  int count = 0;
+  for (int i = 0; i < pattern->operandCount; i++) {
+    count += countPatternLeaves(pattern->operands[i]);
+  }
+  return count;
+}
+
+// writes the estimates of the leaves of a union keyed on order after the count already written
+int estimateUnionLeaves(QueryPattern *pattern, unsigned char order, QueryEstimate *estimates, int count) {
+  // ANDs are keyed by choosePatternOrder before any costing
+  assert(pattern->type != QUERY_PATTERN_AND);
+  if (pattern->type == QUERY_PATTERN_ENTRY) {
+    estimates[count] = estimateEntryPattern(pattern, order);
+    return count + 1;
+  }
+  for (int i = 0; i < pattern->operandCount; i++) {
+    count = estimateUnionLeaves(pattern->operands[i], order, estimates, count);
+  }
+  return count;
+}
+
+// how often the inputs of a union take turns: for every two, about the keys the sparser one has in the
+// overlap of their ranges; both unions copy whole runs while one input stays below the others
+double estimateInterleaving(QueryEstimate *estimates, int count) {
+  double turns = 0;
+  for (int i = 0; i < count; i++) {
+    for (int j = i + 1; j < count; j++) {
+      double low = maxDouble(estimates[i].minKey, estimates[j].minKey);
+      double high = minDouble(estimates[i].maxKey, estimates[j].maxKey);
+      if (estimates[i].rows == 0 || estimates[j].rows == 0 || low > high) {
+        continue;
+      }
+      double overlap = high - low + 1;
+      turns += minDouble(estimates[i].keys * overlap / keySpan(&estimates[i]), estimates[j].keys * overlap / keySpan(&estimates[j]));
+    }
+  }
+  return turns;
+}
+
+// the side every leaf of the query that leaves it to the planner is keyed on: the one its other leaves fix;
+// with none fixed, subjects when there is an AND, whose result depends on the side it joins on, and for a
+// union of whole entries the side whose inputs interleave least, subjects on a tie as only they have bitmaps
+unsigned char choosePatternOrder(QueryPattern *pattern) {
+  unsigned char order = fixedPatternOrder(pattern);
+  if (order != QUERY_PATTERN_ANY_ORDER) {
+    return order;
+  }
+  if (patternHasAND(pattern)) {
+    return SUBJECT_ORDER;
+  }
+  int leafCount = countPatternLeaves(pattern);
+  QueryEstimate *estimates = malloc(sizeof(QueryEstimate) * leafCount);
+  estimateUnionLeaves(pattern, SUBJECT_ORDER, estimates, 0);
+  double subjectTurns = estimateInterleaving(estimates, leafCount);
+  estimateUnionLeaves(pattern, OBJECT_ORDER, estimates, 0);
+  double objectTurns = estimateInterleaving(estimates, leafCount);
+  free(estimates);
+  return (objectTurns < subjectTurns) ? OBJECT_ORDER : SUBJECT_ORDER;
+}
+
+/*
+  Planning
+*/
+
+typedef struct {
+  Iterator *iterator;
+  QueryEstimate estimate;
+} PlannedPattern;
+
+Iterator *planPattern(QueryPattern *pattern, unsigned char order, QueryEstimate *estimate);
+
+PlannedPattern *planOperands(QueryPattern *pattern, unsigned char order) {
+  PlannedPattern *planned = malloc(sizeof(PlannedPattern) * pattern->operandCount);
+  for (int i = 0; i < pattern->operandCount; i++) {
+    planned[i].iterator = planPattern(pattern->operands[i], order, &planned[i].estimate);
+  }
+  return planned;
+}
+
+// the first operand is the one whose triples come out; the others only filter it, smallest first,
+// so every intersection after the first works on as few rows as possible
+Iterator *planAND(QueryPattern *pattern, unsigned char order, QueryEstimate *estimate) {
+  PlannedPattern *planned = planOperands(pattern, order);
+  for (int i = 2; i < pattern->operandCount; i++) {
+    PlannedPattern operand = planned[i];
+    int j = i;
+    for (; j > 1 && planned[j - 1].estimate.rows > operand.estimate.rows; j--) {
+      planned[j] = planned[j - 1];
+    }
+    planned[j] = operand;
+  }
+
+  Iterator *iterator = planned[0].iterator;
+  *estimate = planned[0].estimate;
+  for (int i = 1; i < pattern->operandCount; i++) {
+    unsigned char strategy = chooseJoinStrategy(estimate, &planned[i].estimate);
+    iterator = createPredicateEntryANDIteratorWithStrategy(iterator, planned[i].iterator, strategy);
+    *estimate = estimateIntersection(*estimate, planned[i].estimate);
+  }
+  free(planned);
+  return iterator;
+}
+
+// two operands get a binary OR, which merges plain entries a run at a time; more get one union,
+// which picks each triple in O(log k) instead of passing it up through a tree of ORs
+Iterator *planOR(QueryPattern *pattern, unsigned char order, QueryEstimate *estimate) {
+  PlannedPattern *planned = planOperands(pattern, order);
+  Iterator *iterator = planned[0].iterator;
+  *estimate = planned[0].estimate;
+  for (int i = 1; i < pattern->operandCount; i++) {
+    *estimate = estimateUnion(*estimate, planned[i].estimate);
+  }
+  if (pattern->operandCount == 2) {
+    iterator = createPredicateEntryORIterator(planned[0].iterator, planned[1].iterator);
+  } else if (pattern->operandCount > 2) {
+    Iterator **inputs = malloc(sizeof(Iterator *) * pattern->operandCount);
+    for (int i = 0; i < pattern->operandCount; i++) {
+      inputs[i] = planned[i].iterator;
+    }
+    iterator = createUnionIterator(inputs, pattern->operandCount, UNION_ALL_TRIPLES);
+    free(inputs);
+  }
+  free(planned);
+  return iterator;
+}
+
+// order is the side chosen for the leaves that leave it to the planner, see choosePatternOrder
+Iterator *planPattern(QueryPattern *pattern, unsigned char order, QueryEstimate *estimate) {
+  switch (pattern->type) {
+    case QUERY_PATTERN_ENTRY:
+      *estimate = estimateEntryPattern(pattern, order);
+      return createPredicateEntryOrderedIterator(pattern->entry, leafOrder(pattern, order));
+    case QUERY_PATTERN_AND:
+      return planAND(pattern, order, estimate);
+    default:
+      assert(pattern->type == QUERY_PATTERN_OR);
+      return planOR(pattern, order, estimate);
+  }
+}
+
+Iterator *planQuery(QueryPattern *pattern) {
+  QueryEstimate estimate;
+  return planPattern(pattern, choosePatternOrder(pattern), &estimate);
+}
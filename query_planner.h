@@ -0,0 +1,69 @@
+#ifndef QUERY_PLANNER_H_INCLUDED
+#define QUERY_PLANNER_H_INCLUDED
+
+#include "iterator.h"
+#include "predicate_entry.h"
+
+/*
+  Cost-based planning of OR/AND trees. A query is a pattern: a leaf reads one entry keyed on its
+  subjects or its objects, an AND keeps the triples of its first operand whose key occurs in every
+  other operand, and an OR is the union of its operands. The planner estimates the rows and
+  distinct keys of every pattern from the entries' statistics (see predicateEntryStatistics) and
+  builds the tree from them: an AND applies its other operands smallest first, an OR of more than
+  two operands becomes one k-way union (see union_iterator.h), and every AND picks seeking or
+  merging (see JOIN_STRATEGY_SEEK) by the estimated cost of each. Only which operand of an AND
+  comes first changes the result, so nothing else about how a query is written changes how fast
+  it runs. All operands of an AND or OR must be keyed on the same kind of id, as for the joins.
+
+  A leaf may leave its key to the planner (QUERY_PATTERN_ANY_ORDER). It then takes the side the
+  query's other leaves are keyed on. When none fixes one and the query has an AND, every leaf is
+  keyed on subjects: the side an AND joins on decides which triples it keeps, so the planner never
+  picks it by cost. A union of whole entries with no fixed leaf has the same triples either way, only
+  their order differs, so the planner picks the side whose ranges overlap least between the inputs,
+  since the unions copy a run at a time while one input stays ahead.
+*/
+
+#define QUERY_PATTERN_ENTRY ((unsigned char)0)
+#define QUERY_PATTERN_AND   ((unsigned char)1)
+#define QUERY_PATTERN_OR    ((unsigned char)2)
+
+// a leaf order besides SUBJECT_ORDER and OBJECT_ORDER: whichever the planner picks
+#define QUERY_PATTERN_ANY_ORDER ((unsigned char)2)
+
+// a jump of the seeking intersection costs about this many merge steps per doubling of its distance,
+// measured on intersectKeyPositions against mergeKeyPositions over uniformly spread keys
+#define QUERY_PLANNER_SEEK_COST 6.0
+
+typedef struct QueryPattern_t QueryPattern;
+
+struct QueryPattern_t {
+  unsigned char type;
+  // leaves: the entry and the component its triples are keyed on, SUBJECT_ORDER, OBJECT_ORDER or QUERY_PATTERN_ANY_ORDER
+  PredicateEntry *entry;
+  unsigned char order;
+  // AND and OR: at least one operand, each owned by the pattern
+  QueryPattern **operands;
+  int operandCount;
+};
+
+typedef struct {
+  double rows;
+  double keys;
+  // the range the keys lie in; empty when minKey > maxKey
+  double minKey;
+  double maxKey;
+} QueryEstimate;
+
+QueryPattern *createEntryPattern(PredicateEntry *entry, unsigned char order);
+// operands is copied, the operands themselves are taken over
+QueryPattern *createANDPattern(QueryPattern **operands, int operandCount);
+QueryPattern *createORPattern(QueryPattern **operands, int operandCount);
+void freeQueryPattern(QueryPattern *pattern);
+
+// the entries must be sorted, as for iterating them; leaves that leave their order to the planner
+// are estimated keyed on the side planQuery would pick
+QueryEstimate estimateQueryPattern(QueryPattern *pattern);
+// an uninitialized tree, as from the create functions; the pattern may be freed right away
+Iterator *planQuery(QueryPattern *pattern);
+
+#endif
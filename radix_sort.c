@@ -0,0 +1,155 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "radix_sort.h"
+
+int compareEntityPairs(const void *a, const void *b) {
+  EntityPair x = *(const EntityPair *)a;
+  EntityPair y = *(const EntityPair *)b;
+  return (x > y) - (x < y);
+}
+
+typedef struct {
+  EntityPair *pairs;
+  EntityPair *scratch;
+  unsigned long count;
+  unsigned int digitBitWidth;
+  unsigned long bucketCount;
+
+  // one histogram per thread, rewritten on every pass
+  unsigned long *histograms;
+  EntityPair *orReductions;
+  EntityPair *andReductions;
+
+  pthread_barrier_t barrier;
+} RadixSortContext;
+
+void radixSortBarrier(RadixSortContext *context, int threadCount) {
+  if (threadCount > 1) {
+    pthread_barrier_wait(&context->barrier);
+  }
+}
+
+void radixSortTask(int threadIndex, int threadCount, void *arg) {
+  RadixSortContext *context = (RadixSortContext *)arg;
+  unsigned long begin, end;
+  parallelChunk(context->count, threadIndex, threadCount, &begin, &end);
+
+  // a digit every key agrees on would move nothing, so find those first and skip their passes
+  EntityPair orReduction = 0;
+  EntityPair andReduction = ~((EntityPair)0);
+  for (unsigned long i = begin; i < end; i++) {
+    orReduction |= context->pairs[i];
+    andReduction &= context->pairs[i];
+  }
+  context->orReductions[threadIndex] = orReduction;
+  context->andReductions[threadIndex] = andReduction;
+  radixSortBarrier(context, threadCount);
+
+  EntityPair varyingBits = 0;
+  for (int t = 0; t < threadCount; t++) {
+    varyingBits |= context->orReductions[t] ^ context->andReductions[t];
+    // bits that differ between threads vary too
+    varyingBits |= context->orReductions[t] ^ context->orReductions[0];
+  }
+
+  EntityPair *source = context->pairs;
+  EntityPair *destination = context->scratch;
+  unsigned long bucketCount = context->bucketCount;
+  EntityPair digitMask = (EntityPair)(bucketCount - 1);
+  unsigned long *histogram = context->histograms + (unsigned long)threadIndex * bucketCount;
+  unsigned long *offsets = malloc(sizeof(unsigned long) * bucketCount);
+
+  for (unsigned int shift = 0; shift < ENTITY_PAIR_BIT_COUNT; shift += context->digitBitWidth) {
+    if (((varyingBits >> shift) & digitMask) == 0) {
+      continue;
+    }
+
+    memset(histogram, 0, sizeof(unsigned long) * bucketCount);
+    for (unsigned long i = begin; i < end; i++) {
+      histogram[(source[i] >> shift) & digitMask]++;
+    }
+    radixSortBarrier(context, threadCount);
+
+    // this thread's slice of bucket b starts after every key in smaller buckets
+    // and after the keys earlier threads hold for bucket b, which keeps the pass stable
+    unsigned long offset = 0;
+    for (unsigned long b = 0; b < bucketCount; b++) {
+      offsets[b] = offset;
+      for (int t = 0; t < threadCount; t++) {
+        unsigned long keyCount = context->histograms[(unsigned long)t * bucketCount + b];
+        if (t < threadIndex) {
+          offsets[b] += keyCount;
+        }
+        offset += keyCount;
+      }
+    }
+    for (unsigned long i = begin; i < end; i++) {
+      EntityPair pair = source[i];
+      destination[offsets[(pair >> shift) & digitMask]++] = pair;
+    }
+
+    // nobody may rewrite histograms or read the new source until the scatter is complete
+    radixSortBarrier(context, threadCount);
+
+    EntityPair *swap = source;
+    source = destination;
+    destination = swap;
+  }
+
+  free(offsets);
+
+  if (source != context->pairs) {
+    memcpy(context->pairs + begin, source + begin, sizeof(EntityPair) * (end - begin));
+  }
+}
+
+void radixSortEntityPairsWithThreads(EntityPair *pairs, EntityPair *scratch, unsigned long count, int threadCount) {
+  if (count < RADIX_SORT_MIN_LENGTH) {
+    qsort(pairs, count, sizeof(EntityPair), compareEntityPairs);
+    return;
+  }
+  if (threadCount < 1) {
+    threadCount = 1;
+  }
+
+  RadixSortContext context;
+  context.pairs = pairs;
+  context.scratch = scratch;
+  context.count = count;
+  context.digitBitWidth = (count < RADIX_SORT_WIDE_DIGIT_MIN_LENGTH) ? RADIX_SORT_NARROW_DIGIT_BIT_WIDTH : RADIX_SORT_DIGIT_BIT_WIDTH;
+  context.bucketCount = (unsigned long)1 << context.digitBitWidth;
+  context.histograms = malloc(sizeof(unsigned long) * context.bucketCount * threadCount);
+  context.orReductions = malloc(sizeof(EntityPair) * threadCount);
+  context.andReductions = malloc(sizeof(EntityPair) * threadCount);
+  if (threadCount > 1) {
+    pthread_barrier_init(&context.barrier, NULL, threadCount);
+  }
+
+  runParallel(threadCount, &radixSortTask, &context);
+
+  if (threadCount > 1) {
+    pthread_barrier_destroy(&context.barrier);
+  }
+  free(context.andReductions);
+  free(context.orReductions);
+  free(context.histograms);
+}
+
+int radixSortThreadCount(unsigned long count, int maxThreadCount) {
+  if (count < RADIX_SORT_PARALLEL_THRESHOLD || maxThreadCount < 1) {
+    return 1;
+  }
+  // keep every thread's chunk large enough to amortize its histogram
+  unsigned long maxThreads = count / (RADIX_SORT_PARALLEL_THRESHOLD / 4);
+  return ((unsigned long)maxThreadCount > maxThreads) ? (int)maxThreads : maxThreadCount;
+}
+
+void radixSortEntityPairs(EntityPair *pairs, EntityPair *scratch, unsigned long count) {
+  int threadCount = radixSortThreadCount(count, availableThreadCount());
+  radixSortEntityPairsWithThreads(pairs, scratch, count, threadCount);
+}
@@ -0,0 +1,26 @@
+#ifndef RADIX_SORT_H_INCLUDED
+#define RADIX_SORT_H_INCLUDED
+
+#include "predicate_entry.h"
+
+#define RADIX_SORT_DIGIT_BIT_WIDTH 16
+// a 64K-entry histogram and scatter miss cache on every key, so below RADIX_SORT_WIDE_DIGIT_MIN_LENGTH
+// twice as many passes over 256-entry ones are quicker, and small inputs skip clearing 64K counts
+#define RADIX_SORT_NARROW_DIGIT_BIT_WIDTH 8
+#define RADIX_SORT_WIDE_DIGIT_MIN_LENGTH ((unsigned long)1 << 24)
+
+// below this length a comparison sort beats clearing the histograms
+#define RADIX_SORT_MIN_LENGTH 256
+// above this length histogram and scatter are split across threads
+#define RADIX_SORT_PARALLEL_THRESHOLD ((unsigned long)1 << 20)
+
+// sorts pairs ascending by their full value, so ties on the high half are broken by the low half
+// scratch must hold count pairs; it is clobbered and can be reused across calls
+void radixSortEntityPairs(EntityPair *pairs, EntityPair *scratch, unsigned long count);
+void radixSortEntityPairsWithThreads(EntityPair *pairs, EntityPair *scratch, unsigned long count, int threadCount);
+// how many of maxThreadCount threads are worth using to sort count pairs
+int radixSortThreadCount(unsigned long count, int maxThreadCount);
+
+int compareEntityPairs(const void *a, const void *b);
+
+#endif
@@ -1,6 +1,264 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
+#include "parallel.h"
+#include "radix_sort.h"
 #include "segment.h"
 
+Segment *createSegment() {
+  Segment *segment = malloc(sizeof(Segment));
+  segment->predicatePages = NULL;
+  segment->predicateCount = 0;
+  segment->currentPredicatesLength = SEGMENT_INITIAL_PREDICATES_LENGTH;
+  segment->predicates = malloc(sizeof(PredicateId) * segment->currentPredicatesLength);
+  segment->tripleCount = 0;
+  segment->mapping = NULL;
+  segment->mappingLength = 0;
+  return segment;
+}
+
+void freeSegment(Segment *segment) {
+  for (unsigned long i = 0; i < segment->predicateCount; i++) {
+    freePredicateEntry(getSegmentPredicateEntry(segment, segment->predicates[i]));
+  }
+  if (segment->predicatePages != NULL) {
+    for (unsigned long i = 0; i < SEGMENT_PREDICATE_PAGE_COUNT; i++) {
+      free(segment->predicatePages[i]);
+    }
+  }
+  free(segment->predicatePages);
+  free(segment->predicates);
+  if (segment->mapping != NULL) {
+    munmap(segment->mapping, segment->mappingLength);
+  }
+  free(segment);
+}
+
+void addPredicateEntryToSegment(Segment *segment, PredicateEntry *entry) {
+  PredicateId predicate = entry->predicate;
+  assert(isValidPredicateId(predicate));
+  assert(getSegmentPredicateEntry(segment, predicate) == NULL);
+  if (segment->predicatePages == NULL) {
+    // calloc lets the OS hand out zero pages on demand, so a wide id space stays cheap
+    segment->predicatePages = calloc(SEGMENT_PREDICATE_PAGE_COUNT, sizeof(PredicateEntry **));
+  }
+  PredicateEntry ***page = &segment->predicatePages[predicate >> SEGMENT_PREDICATE_PAGE_BIT_WIDTH];
+  if (*page == NULL) {
+    *page = calloc(SEGMENT_PREDICATE_PAGE_LENGTH, sizeof(PredicateEntry *));
+  }
+  if (segment->predicateCount >= segment->currentPredicatesLength) {
+    segment->currentPredicatesLength *= 2;
+    segment->predicates = realloc(segment->predicates, sizeof(PredicateId) * segment->currentPredicatesLength);
+  }
+  (*page)[predicate & SEGMENT_PREDICATE_PAGE_MASK] = entry;
+  segment->predicates[segment->predicateCount++] = predicate;
+}
+
+PredicateEntry *createSegmentPredicateEntry(Segment *segment, PredicateId predicate) {
+  PredicateEntry *entry = createPredicateEntry(predicate);
+  addPredicateEntryToSegment(segment, entry);
+  return entry;
+}
+
+void addTripleToSegment(Segment *segment, Triple triple) {
+  PredicateId predicate = predicateIdFromTriple(triple);
+  assert(isValidPredicateId(predicate));
+  PredicateEntry *entry = getSegmentPredicateEntry(segment, predicate);
+  if (entry == NULL) {
+    entry = createSegmentPredicateEntry(segment, predicate);
+  }
+  addToPredicateEntry(entry, subjectIdFromTriple(triple), objectIdFromTriple(triple));
+  segment->tripleCount++;
+}
+
+BOOL removeTripleFromSegment(Segment *segment, Triple triple) {
+  PredicateEntry *entry = getSegmentPredicateEntry(segment, predicateIdFromTriple(triple));
+  if (entry == NULL || !removeFromPredicateEntry(entry, subjectIdFromTriple(triple), objectIdFromTriple(triple))) {
+    return FALSE;
+  }
+  segment->tripleCount--;
+  return TRUE;
+}
+
+void optimizeSegment(Segment *segment) {
+  unsigned long maxEntryCount = 0;
+  for (unsigned long i = 0; i < segment->predicateCount; i++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[i]);
+    if (entry->entryCount > maxEntryCount) {
+      maxEntryCount = entry->entryCount;
+    }
+  }
+
+  // one scratch buffer serves every entry's sorts
+  EntityPair *scratch = malloc(sizeof(EntityPair) * (maxEntryCount > 0 ? maxEntryCount : 1));
+  for (unsigned long i = 0; i < segment->predicateCount; i++) {
+    optimizePredicateEntryWithScratch(getSegmentPredicateEntry(segment, segment->predicates[i]), scratch);
+  }
+  free(scratch);
+}
+
+typedef struct {
+  // entries small enough to be sorted whole by a single thread
+  PredicateEntry **entries;
+  unsigned long entryCount;
+  unsigned long nextEntry;
+  unsigned long maxEntryCount;
+} OptimizeSegmentContext;
+
+void optimizeSegmentTask(int threadIndex, int threadCount, void *arg) {
+  OptimizeSegmentContext *context = (OptimizeSegmentContext *)arg;
+  EntityPair *scratch = malloc(sizeof(EntityPair) * (context->maxEntryCount > 0 ? context->maxEntryCount : 1));
+  (void)threadIndex;
+  (void)threadCount;
+
+  // entries vary wildly in size, so threads claim them one by one rather than in fixed chunks
+  for (;;) {
+    unsigned long i = __atomic_fetch_add(&context->nextEntry, 1, __ATOMIC_RELAXED);
+    if (i >= context->entryCount) {
+      break;
+    }
+    optimizePredicateEntryWithThreads(context->entries[i], scratch, 1);
+  }
+  free(scratch);
+}
+
+void optimizeSegmentWithThreads(Segment *segment, int threadCount) {
+  OptimizeSegmentContext context;
+  context.entries = malloc(sizeof(PredicateEntry *) * (segment->predicateCount > 0 ? segment->predicateCount : 1));
+  context.entryCount = 0;
+  context.nextEntry = 0;
+  context.maxEntryCount = 0;
+
+  // sizes are what each entry has to sort, so entries optimized before and only appended to since stay cheap
+  unsigned long maxLargeEntryCount = 0;
+  for (unsigned long i = 0; i < segment->predicateCount; i++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[i]);
+    unsigned long unsortedCount = predicateEntryUnsortedCount(entry);
+    if (unsortedCount == 0) {
+      continue;
+    }
+    if (radixSortThreadCount(unsortedCount, threadCount) > 1) {
+      if (unsortedCount > maxLargeEntryCount) {
+        maxLargeEntryCount = unsortedCount;
+      }
+    } else {
+      context.entries[context.entryCount++] = entry;
+      if (unsortedCount > context.maxEntryCount) {
+        context.maxEntryCount = unsortedCount;
+      }
+    }
+  }
+
+  if (maxLargeEntryCount > 0) {
+    EntityPair *scratch = malloc(sizeof(EntityPair) * maxLargeEntryCount);
+    for (unsigned long i = 0; i < segment->predicateCount; i++) {
+      PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[i]);
+      unsigned long unsortedCount = predicateEntryUnsortedCount(entry);
+      int sortThreadCount = radixSortThreadCount(unsortedCount, threadCount);
+      if (unsortedCount > 0 && sortThreadCount > 1) {
+        optimizePredicateEntryWithThreads(entry, scratch, sortThreadCount);
+      }
+    }
+    free(scratch);
+  }
+
+  if (context.entryCount > 0) {
+    int smallThreadCount = threadCount;
+    if ((unsigned long)smallThreadCount > context.entryCount) {
+      smallThreadCount = (int)context.entryCount;
+    }
+    runParallel(smallThreadCount > 0 ? smallThreadCount : 1, &optimizeSegmentTask, &context);
+  }
+  free(context.entries);
+}
+
+void optimizeSegmentWithOptions(Segment *segment, OptimizeOptions *options) {
+  optimizeSegmentWithThreads(segment, (options->threadCount > 0) ? options->threadCount : availableThreadCount());
+  for (unsigned long i = 0; i < segment->predicateCount; i++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[i]);
+    if (options->buildSubjectBitmaps) {
+      buildPredicateEntrySubjectBitmap(entry, options->subjectBitmapDensity);
+    }
+    if (options->buildBloomFilters) {
+      buildPredicateEntryBloomFilter(entry, options->bloomFilterBitsPerKey);
+    }
+  }
+}
+
+void compactSegmentTask(int threadIndex, int threadCount, void *arg) {
+  OptimizeSegmentContext *context = (OptimizeSegmentContext *)arg;
+  (void)threadIndex;
+  (void)threadCount;
+  for (;;) {
+    unsigned long i = __atomic_fetch_add(&context->nextEntry, 1, __ATOMIC_RELAXED);
+    if (i >= context->entryCount) {
+      break;
+    }
+    compactPredicateEntry(context->entries[i]);
+  }
+}
+
+unsigned long compactSegment(Segment *segment, int threadCount) {
+  OptimizeSegmentContext context;
+  context.entries = malloc(sizeof(PredicateEntry *) * (segment->predicateCount > 0 ? segment->predicateCount : 1));
+  context.entryCount = 0;
+  context.nextEntry = 0;
+  context.maxEntryCount = 0;
+  for (unsigned long i = 0; i < segment->predicateCount; i++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[i]);
+    if (predicateEntryNeedsCompaction(entry)) {
+      context.entries[context.entryCount++] = entry;
+    }
+  }
+  if (context.entryCount > 0) {
+    if (threadCount < 1) {
+      threadCount = availableThreadCount();
+    }
+    if ((unsigned long)threadCount > context.entryCount) {
+      threadCount = (int)context.entryCount;
+    }
+    runParallel(threadCount, &compactSegmentTask, &context);
+  }
+  free(context.entries);
+  return context.entryCount;
+}
+
+void compressSegment(Segment *segment) {
+  optimizeSegment(segment);
+  for (unsigned long i = 0; i < segment->predicateCount; i++) {
+    compressPredicateEntry(getSegmentPredicateEntry(segment, segment->predicates[i]));
+  }
+}
+
+PredicateEntry *getSegmentPredicateEntry(Segment *segment, PredicateId predicate) {
+  if (segment->predicatePages == NULL || !isValidPredicateId(predicate)) {
+    return NULL;
+  }
+  PredicateEntry **page = segment->predicatePages[predicate >> SEGMENT_PREDICATE_PAGE_BIT_WIDTH];
+  return (page == NULL) ? NULL : page[predicate & SEGMENT_PREDICATE_PAGE_MASK];
+}
+
+Iterator *createSegmentPredicateIterator(Segment *segment, PredicateId predicate) {
+  PredicateEntry *entry = getSegmentPredicateEntry(segment, predicate);
+  if (entry == NULL) {
+    return NULL;
+  }
+  return createPredicateEntryIterator(entry);
+}
+
+BOOL hasTriple(Segment *segment, SubjectId subject, PredicateId predicate, ObjectId object) {
+  PredicateEntry *entry = getSegmentPredicateEntry(segment, predicate);
+  return entry != NULL && predicateEntryHasPair(entry, subject, object);
+}
+
+unsigned long lookupSubject(Segment *segment, PredicateId predicate, SubjectId subject, ObjectId *objects, unsigned long capacity) {
+  PredicateEntry *entry = getSegmentPredicateEntry(segment, predicate);
+  return (entry == NULL) ? 0 : lookupPredicateEntrySubject(entry, subject, objects, capacity);
+}
+
+unsigned long lookupObject(Segment *segment, PredicateId predicate, ObjectId object, SubjectId *subjects, unsigned long capacity) {
+  PredicateEntry *entry = getSegmentPredicateEntry(segment, predicate);
+  return (entry == NULL) ? 0 : lookupPredicateEntryObject(entry, object, subjects, capacity);
+}
@@ -4,4 +4,58 @@
 #include "triple.h"
 #include "predicate_entry.h"
 
+// the predicate table is a directory of pages, so wide PredicateIds do not need one huge array
+#define SEGMENT_PREDICATE_PAGE_BIT_WIDTH 12
+#define SEGMENT_PREDICATE_PAGE_LENGTH ((unsigned long)1 << SEGMENT_PREDICATE_PAGE_BIT_WIDTH)
+#define SEGMENT_PREDICATE_PAGE_MASK ((PredicateId)(SEGMENT_PREDICATE_PAGE_LENGTH - 1))
+#define SEGMENT_PREDICATE_PAGE_COUNT (((unsigned long)PREDICATE_ID_MAX >> SEGMENT_PREDICATE_PAGE_BIT_WIDTH) + 1)
+#define SEGMENT_INITIAL_PREDICATES_LENGTH 16
+
+typedef struct {
+  // indexed by PredicateId >> SEGMENT_PREDICATE_PAGE_BIT_WIDTH, then by the low bits
+  // the directory is allocated on the first add, each page the first time one of its predicates is seen
+  PredicateEntry ***predicatePages;
+
+  // dense list of the predicates present, in first-seen order
+  PredicateId *predicates;
+  unsigned long predicateCount;
+  unsigned long currentPredicatesLength;
+
+  unsigned long tripleCount;
+
+  // set when the entries are views into a mapped segment file, unmapped by freeSegment
+  void *mapping;
+  unsigned long mappingLength;
+} Segment;
+
+Segment *createSegment();
+void freeSegment(Segment *segment);
+
+void addTripleToSegment(Segment *segment, Triple triple);
+// see removeFromPredicateEntry; returns FALSE when the triple is not in the segment
+BOOL removeTripleFromSegment(Segment *segment, Triple triple);
+// takes ownership of an entry built elsewhere; its predicate must not be present yet
+void addPredicateEntryToSegment(Segment *segment, PredicateEntry *entry);
+void optimizeSegment(Segment *segment);
+// sorts entries concurrently; large entries are sorted one at a time with the threads split across them
+void optimizeSegmentWithThreads(Segment *segment, int threadCount);
+// optimizeSegmentWithThreads, then the per-entry extras the options ask for, e.g. subject bitmaps
+void optimizeSegmentWithOptions(Segment *segment, OptimizeOptions *options);
+// compacts the entries whose tombstones pass the compaction ratio, several at a time on up to
+// threadCount threads (< 1 uses availableThreadCount()); returns how many it compacted
+// run it between queries: the entries' arrays are rewritten in place
+unsigned long compactSegment(Segment *segment, int threadCount);
+// optimizes and then compresses every entry; the segment becomes read-only
+void compressSegment(Segment *segment);
+
+// returns NULL when the predicate has no triples in the segment
+PredicateEntry *getSegmentPredicateEntry(Segment *segment, PredicateId predicate);
+Iterator *createSegmentPredicateIterator(Segment *segment, PredicateId predicate);
+
+// point lookups, see predicateEntryHasPair: they may sort the entry they read
+BOOL hasTriple(Segment *segment, SubjectId subject, PredicateId predicate, ObjectId object);
+// write up to capacity neighbors, ascending, and return how many there are
+unsigned long lookupSubject(Segment *segment, PredicateId predicate, SubjectId subject, ObjectId *objects, unsigned long capacity);
+unsigned long lookupObject(Segment *segment, PredicateId predicate, ObjectId object, SubjectId *subjects, unsigned long capacity);
+
 #endif
@@ -0,0 +1,253 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "segment_file.h"
+
+unsigned long long segmentFileChecksum(const unsigned long long *words, unsigned long count) {
+  // word at a time multiply-xorshift; catches torn writes and bit flips, not adversarial edits
+  unsigned long long hash = 0x9E3779B97F4A7C15ULL ^ count;
+  for (unsigned long i = 0; i < count; i++) {
+    hash ^= words[i];
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+unsigned long long alignSegmentFileOffset(unsigned long long offset) {
+  return (offset + SEGMENT_FILE_ALIGNMENT - 1) & ~((unsigned long long)SEGMENT_FILE_ALIGNMENT - 1);
+}
+
+unsigned long long segmentFileHeaderChecksum(const SegmentFileHeader *header) {
+  SegmentFileHeader copy = *header;
+  copy.headerChecksum = 0;
+  return segmentFileChecksum((const unsigned long long *)&copy, sizeof(copy) / sizeof(unsigned long long));
+}
+
+unsigned long long checksumEntityPairs(const EntityPair *pairs, unsigned long count) {
+  return segmentFileChecksum((const unsigned long long *)pairs, count * ENTITY_PAIR_WORD_COUNT);
+}
+
+BOOL isSortedEntityPairs(EntityPair *pairs, unsigned long count) {
+  for (unsigned long i = 1; i < count; i++) {
+    if (pairs[i - 1] > pairs[i]) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+BOOL writeSegmentFilePadding(FILE *file, unsigned long long *position, unsigned long long offset) {
+  static const char zeros[SEGMENT_FILE_ALIGNMENT];
+  while (*position < offset) {
+    unsigned long long length = offset - *position;
+    if (length > SEGMENT_FILE_ALIGNMENT) {
+      length = SEGMENT_FILE_ALIGNMENT;
+    }
+    if (fwrite(zeros, 1, length, file) != length) {
+      return FALSE;
+    }
+    *position += length;
+  }
+  return TRUE;
+}
+
+BOOL writeSegmentFileBytes(FILE *file, unsigned long long *position, const void *bytes, unsigned long long length) {
+  if (length > 0 && fwrite(bytes, 1, length, file) != length) {
+    return FALSE;
+  }
+  *position += length;
+  return TRUE;
+}
+
+BOOL writeSegmentFile(Segment *segment, const char *path) {
+  unsigned long predicateCount = segment->predicateCount;
+  SegmentFileDirectoryEntry *directory = calloc(predicateCount > 0 ? predicateCount : 1, sizeof(SegmentFileDirectoryEntry));
+
+  // lay the file out up front so the header and directory can be written first
+  unsigned long long directoryOffset = SEGMENT_FILE_ALIGNMENT;
+  unsigned long long offset = alignSegmentFileOffset(directoryOffset + sizeof(SegmentFileDirectoryEntry) * predicateCount);
+  for (unsigned long i = 0; i < predicateCount; i++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[i]);
+    unsigned long long arrayLength = sizeof(EntityPair) * entry->entryCount;
+    if (isCompressedPredicateEntry(entry) || entry->tombstoneCount > 0 ||
+        !isSortedEntityPairs(entry->soEntries, entry->entryCount) ||
+        !isSortedEntityPairs(entry->osEntries, entry->entryCount)) {
+      free(directory);
+      errno = EINVAL;
+      return FALSE;
+    }
+    directory[i].predicate = entry->predicate;
+    directory[i].entryCount = entry->entryCount;
+    directory[i].soOffset = offset;
+    offset = alignSegmentFileOffset(offset + arrayLength);
+    directory[i].osOffset = offset;
+    offset = alignSegmentFileOffset(offset + arrayLength);
+    directory[i].soChecksum = checksumEntityPairs(entry->soEntries, entry->entryCount);
+    directory[i].osChecksum = checksumEntityPairs(entry->osEntries, entry->entryCount);
+  }
+
+  SegmentFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SEGMENT_FILE_MAGIC, sizeof(header.magic));
+  header.version = SEGMENT_FILE_VERSION;
+  header.byteOrder = SEGMENT_FILE_BYTE_ORDER;
+  header.alignment = SEGMENT_FILE_ALIGNMENT;
+  header.subjectBitWidth = SUBJECT_BIT_WIDTH;
+  header.predicateBitWidth = PREDICATE_BIT_WIDTH;
+  header.objectBitWidth = OBJECT_BIT_WIDTH;
+  header.entityPairSize = sizeof(EntityPair);
+  header.predicateCount = predicateCount;
+  header.tripleCount = segment->tripleCount;
+  header.fileLength = offset;
+  header.directoryOffset = directoryOffset;
+  header.directoryChecksum = segmentFileChecksum(
+    (const unsigned long long *)directory, sizeof(SegmentFileDirectoryEntry) * predicateCount / sizeof(unsigned long long));
+  header.headerChecksum = segmentFileHeaderChecksum(&header);
+
+  unsigned long pathLength = strlen(path);
+  char *temporaryPath = malloc(pathLength + sizeof(".tmp"));
+  memcpy(temporaryPath, path, pathLength);
+  memcpy(temporaryPath + pathLength, ".tmp", sizeof(".tmp"));
+
+  FILE *file = fopen(temporaryPath, "wb");
+  BOOL written = file != NULL;
+  unsigned long long position = 0;
+  written = written && writeSegmentFileBytes(file, &position, &header, sizeof(header));
+  written = written && writeSegmentFilePadding(file, &position, directoryOffset);
+  written = written && writeSegmentFileBytes(file, &position, directory, sizeof(SegmentFileDirectoryEntry) * predicateCount);
+  for (unsigned long i = 0; written && i < predicateCount; i++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[i]);
+    unsigned long long arrayLength = sizeof(EntityPair) * entry->entryCount;
+    written = written && writeSegmentFilePadding(file, &position, directory[i].soOffset);
+    written = written && writeSegmentFileBytes(file, &position, entry->soEntries, arrayLength);
+    written = written && writeSegmentFilePadding(file, &position, directory[i].osOffset);
+    written = written && writeSegmentFileBytes(file, &position, entry->osEntries, arrayLength);
+  }
+  written = written && writeSegmentFilePadding(file, &position, header.fileLength);
+  written = written && fflush(file) == 0 && fsync(fileno(file)) == 0;
+
+  int savedErrno = errno;
+  if (file != NULL && fclose(file) != 0) {
+    written = FALSE;
+  }
+  if (written && rename(temporaryPath, path) != 0) {
+    written = FALSE;
+  }
+  if (!written) {
+    savedErrno = errno;
+    unlink(temporaryPath);
+    errno = savedErrno;
+  }
+
+  free(temporaryPath);
+  free(directory);
+  return written;
+}
+
+BOOL isValidSegmentFileArray(unsigned long long offset, unsigned long long entryCount, unsigned long long fileLength) {
+  if (offset % sizeof(EntityPair) != 0 || offset > fileLength) {
+    return FALSE;
+  }
+  return entryCount <= (fileLength - offset) / sizeof(EntityPair);
+}
+
+BOOL isValidSegmentFileHeader(const SegmentFileHeader *header, unsigned long long fileLength) {
+  return memcmp(header->magic, SEGMENT_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+    header->version == SEGMENT_FILE_VERSION &&
+    header->byteOrder == SEGMENT_FILE_BYTE_ORDER &&
+    header->headerChecksum == segmentFileHeaderChecksum(header) &&
+    header->subjectBitWidth == SUBJECT_BIT_WIDTH &&
+    header->predicateBitWidth == PREDICATE_BIT_WIDTH &&
+    header->objectBitWidth == OBJECT_BIT_WIDTH &&
+    header->entityPairSize == sizeof(EntityPair) &&
+    header->fileLength == fileLength &&
+    header->directoryOffset % sizeof(unsigned long long) == 0 &&
+    header->directoryOffset <= fileLength &&
+    header->predicateCount <= (fileLength - header->directoryOffset) / sizeof(SegmentFileDirectoryEntry);
+}
+
+Segment *openSegmentMapped(const char *path) {
+  int descriptor = open(path, O_RDONLY);
+  if (descriptor < 0) {
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    return NULL;
+  }
+  unsigned long long fileLength = status.st_size;
+  if (fileLength < sizeof(SegmentFileHeader)) {
+    close(descriptor);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  // shared and read-only, so every process opening the file shares the same page cache pages
+  void *mapping = mmap(NULL, fileLength, PROT_READ, MAP_SHARED, descriptor, 0);
+  close(descriptor);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  char *base = mapping;
+  const SegmentFileHeader *header = mapping;
+  if (!isValidSegmentFileHeader(header, fileLength)) {
+    munmap(mapping, fileLength);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  const SegmentFileDirectoryEntry *directory = (const SegmentFileDirectoryEntry *)(base + header->directoryOffset);
+  unsigned long long directoryChecksum = segmentFileChecksum(
+    (const unsigned long long *)directory, sizeof(SegmentFileDirectoryEntry) * header->predicateCount / sizeof(unsigned long long));
+  if (directoryChecksum != header->directoryChecksum) {
+    munmap(mapping, fileLength);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  Segment *segment = createSegment();
+  segment->mapping = mapping;
+  segment->mappingLength = fileLength;
+  segment->tripleCount = header->tripleCount;
+  for (unsigned long i = 0; i < header->predicateCount; i++) {
+    const SegmentFileDirectoryEntry *record = &directory[i];
+    if (!isValidPredicateId(record->predicate) ||
+        getSegmentPredicateEntry(segment, record->predicate) != NULL ||
+        !isValidSegmentFileArray(record->soOffset, record->entryCount, fileLength) ||
+        !isValidSegmentFileArray(record->osOffset, record->entryCount, fileLength)) {
+      freeSegment(segment);
+      errno = EINVAL;
+      return NULL;
+    }
+    // the entries only read through these pointers; PROT_READ turns any stray write into a fault
+    PredicateEntry *entry = createBorrowedPredicateEntry(
+      record->predicate, (EntityPair *)(base + record->soOffset), (EntityPair *)(base + record->osOffset), record->entryCount);
+    addPredicateEntryToSegment(segment, entry);
+  }
+  return segment;
+}
+
+BOOL verifySegmentFile(Segment *segment) {
+  assert(segment->mapping != NULL);
+  const SegmentFileHeader *header = segment->mapping;
+  const SegmentFileDirectoryEntry *directory =
+    (const SegmentFileDirectoryEntry *)((char *)segment->mapping + header->directoryOffset);
+  for (unsigned long i = 0; i < header->predicateCount; i++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, directory[i].predicate);
+    if (checksumEntityPairs(entry->soEntries, entry->entryCount) != directory[i].soChecksum ||
+        checksumEntityPairs(entry->osEntries, entry->entryCount) != directory[i].osChecksum) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
@@ -0,0 +1,69 @@
+#ifndef SEGMENT_FILE_H_INCLUDED
+#define SEGMENT_FILE_H_INCLUDED
+
+#include "segment.h"
+
+/*
+  On-disk layout of an optimized segment, in native byte order:
+
+    [header]      one SEGMENT_FILE_ALIGNMENT block
+    [directory]   predicateCount SegmentFileDirectoryEntry records
+    [arrays]      per predicate, soEntries then osEntries, each starting on an aligned offset
+
+  The header and directory are checksummed and checked on open. The arrays carry their own
+  checksums, which verifySegmentFile checks on demand since doing so touches every page.
+*/
+
+#define SEGMENT_FILE_MAGIC "CGRAPHSG"
+#define SEGMENT_FILE_VERSION 1
+#define SEGMENT_FILE_ALIGNMENT 4096
+// written as-is and compared on open, so files from a machine of the other endianness are rejected
+#define SEGMENT_FILE_BYTE_ORDER 0x01020304
+
+typedef struct {
+  char magic[8];
+  unsigned int version;
+  unsigned int byteOrder;
+  unsigned int alignment;
+
+  // the id layout the file was written with; opening with a different one fails
+  unsigned int subjectBitWidth;
+  unsigned int predicateBitWidth;
+  unsigned int objectBitWidth;
+  unsigned int entityPairSize;
+  unsigned int reserved;
+
+  unsigned long long predicateCount;
+  unsigned long long tripleCount;
+  unsigned long long fileLength;
+  unsigned long long directoryOffset;
+  unsigned long long directoryChecksum;
+
+  // computed with this field zeroed
+  unsigned long long headerChecksum;
+} SegmentFileHeader;
+
+typedef struct {
+  unsigned int predicate;
+  unsigned int reserved;
+  unsigned long long entryCount;
+  unsigned long long soOffset;
+  unsigned long long osOffset;
+  unsigned long long soChecksum;
+  unsigned long long osChecksum;
+} SegmentFileDirectoryEntry;
+
+unsigned long long segmentFileChecksum(const unsigned long long *words, unsigned long count);
+
+// the segment must be optimized, compacted if anything was removed, and uncompressed; returns FALSE with errno set on failure
+// the file is written next to path and renamed into place, so processes mapping the old file are unaffected
+BOOL writeSegmentFile(Segment *segment, const char *path);
+
+// maps the file read-only and returns a segment whose entries point straight into the mapping
+// returns NULL with errno set when the file cannot be mapped or its header or directory is invalid
+Segment *openSegmentMapped(const char *path);
+
+// checks every array against its checksum; segment must come from openSegmentMapped
+BOOL verifySegmentFile(Segment *segment);
+
+#endif
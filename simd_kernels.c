@@ -0,0 +1,297 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "simd_kernels.h"
+
+// the vector kernels compare 64-bit lanes, so wide pairs always take the scalar path
+#if (defined(__x86_64__) || defined(__i386__)) && ENTITY_PAIR_WORD_COUNT == 1
+#define SIMD_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+typedef unsigned long (*lowerBoundFn)(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound);
+
+typedef unsigned long (*keyPositionsFn)(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity);
+
+unsigned long lowerBoundEntityPairsScalar(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound) {
+  return gallopEntityPairs(pairs, begin, count, bound);
+}
+
+unsigned long mergeKeyPositionsScalar(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity) {
+  unsigned long a = *aPosition;
+  unsigned long b = *bPosition;
+  unsigned long count = 0;
+
+  while (count < capacity && a < aCount && b < bCount) {
+    EntityPair aKey = aPairs[a] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    EntityPair bKey = bPairs[b] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    if (aKey < bKey) {
+      a++;
+    } else if (aKey > bKey) {
+      b++;
+    } else {
+      // b stays on the key until a's run sharing it is through
+      positions[count++] = a++;
+    }
+  }
+
+  *aPosition = a;
+  *bPosition = b;
+  return count;
+}
+
+#ifdef SIMD_KERNELS_X86
+
+// there is no unsigned 64-bit compare, so both sides are biased into signed range first
+#define SIMD_SIGN_BIAS ((long long)0x8000000000000000ULL)
+
+__attribute__((target("sse4.2")))
+unsigned long lowerBoundEntityPairsSSE42(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound) {
+  __m128i bias = _mm_set1_epi64x(SIMD_SIGN_BIAS);
+  __m128i biasedBound = _mm_xor_si128(_mm_set1_epi64x((long long)bound), bias);
+  unsigned long scanEnd = (count - begin > SIMD_LINEAR_SCAN_LENGTH) ? begin + SIMD_LINEAR_SCAN_LENGTH : count;
+
+  unsigned long i = begin;
+  for (; i + 2 <= scanEnd; i += 2) {
+    __m128i lanes = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(pairs + i)), bias);
+    // lanes below the bound form a prefix because the pairs are sorted
+    int below = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(biasedBound, lanes)));
+    if (below != 0x3) {
+      return i + __builtin_ctz(~below);
+    }
+  }
+  for (; i < scanEnd; i++) {
+    if (pairs[i] >= bound) {
+      return i;
+    }
+  }
+  return (i < count) ? gallopEntityPairs(pairs, i, count, bound) : count;
+}
+
+__attribute__((target("avx2")))
+unsigned long lowerBoundEntityPairsAVX2(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound) {
+  __m256i bias = _mm256_set1_epi64x(SIMD_SIGN_BIAS);
+  __m256i biasedBound = _mm256_xor_si256(_mm256_set1_epi64x((long long)bound), bias);
+  unsigned long scanEnd = (count - begin > SIMD_LINEAR_SCAN_LENGTH) ? begin + SIMD_LINEAR_SCAN_LENGTH : count;
+
+  unsigned long i = begin;
+  for (; i + 4 <= scanEnd; i += 4) {
+    __m256i lanes = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(pairs + i)), bias);
+    int below = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(biasedBound, lanes)));
+    if (below != 0xF) {
+      return i + __builtin_ctz(~below);
+    }
+  }
+  for (; i < scanEnd; i++) {
+    if (pairs[i] >= bound) {
+      return i;
+    }
+  }
+  return (i < count) ? gallopEntityPairs(pairs, i, count, bound) : count;
+}
+
+// the block kernels compare keys, which fit in the low half of a lane once shifted down, so
+// the signed compares need no bias; they run while a whole block of each side and of positions
+// is left, and hand the rest to the scalar kernel
+
+// the lanes of a block of a whose key equals one of the keys of b's remaining pairs, when fewer
+// than a block of them are left
+static inline int matchKeyTail(EntityPair *aPairs, unsigned long a, int laneCount, EntityPair *bPairs, unsigned long b, unsigned long bCount) {
+  int matched = 0;
+  for (int lane = 0; lane < laneCount; lane++) {
+    for (unsigned long j = b; j < bCount; j++) {
+      if ((aPairs[a + lane] >> ENTITY_PAIR_HALF_BIT_COUNT) == (bPairs[j] >> ENTITY_PAIR_HALF_BIT_COUNT)) {
+        matched |= 1 << lane;
+      }
+    }
+  }
+  return matched;
+}
+
+// a block of a is compared with every lane of b's block at once, and b's blocks stream past it
+// until one ends at or beyond a's last key; matches gather in a mask, so a key b repeats across
+// two of its blocks is still emitted once, in a's order
+__attribute__((target("sse4.2")))
+unsigned long mergeKeyPositionsSSE42(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity) {
+  unsigned long a = *aPosition;
+  unsigned long b = *bPosition;
+  unsigned long count = 0;
+
+  while (capacity - count >= 2 && a + 2 <= aCount && b + 2 <= bCount) {
+    __m128i aKeys = _mm_srli_epi64(_mm_loadu_si128((const __m128i *)(aPairs + a)), ENTITY_PAIR_HALF_BIT_COUNT);
+    EntityPair aLast = aPairs[a + 1] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    int matched = 0;
+    for (;;) {
+      __m128i bKeys = _mm_srli_epi64(_mm_loadu_si128((const __m128i *)(bPairs + b)), ENTITY_PAIR_HALF_BIT_COUNT);
+      __m128i equal = _mm_or_si128(_mm_cmpeq_epi64(aKeys, bKeys), _mm_cmpeq_epi64(aKeys, _mm_shuffle_epi32(bKeys, 0x4E)));
+      matched |= _mm_movemask_pd(_mm_castsi128_pd(equal));
+      if ((bPairs[b + 1] >> ENTITY_PAIR_HALF_BIT_COUNT) >= aLast) {
+        break;
+      }
+      b += 2;
+      if (b + 2 > bCount) {
+        matched |= matchKeyTail(aPairs, a, 2, bPairs, b, bCount);
+        break;
+      }
+    }
+    for (; matched != 0; matched &= matched - 1) {
+      positions[count++] = a + __builtin_ctz(matched);
+    }
+    a += 2;
+  }
+
+  *aPosition = a;
+  *bPosition = b;
+  return count + mergeKeyPositionsScalar(aPairs, aPosition, aCount, bPairs, bPosition, bCount, positions + count, capacity - count);
+}
+
+__attribute__((target("avx2")))
+unsigned long mergeKeyPositionsAVX2(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity) {
+  unsigned long a = *aPosition;
+  unsigned long b = *bPosition;
+  unsigned long count = 0;
+
+  while (capacity - count >= 4 && a + 4 <= aCount && b + 4 <= bCount) {
+    __m256i aKeys = _mm256_srli_epi64(_mm256_loadu_si256((const __m256i *)(aPairs + a)), ENTITY_PAIR_HALF_BIT_COUNT);
+    EntityPair aLast = aPairs[a + 3] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    int matched = 0;
+    for (;;) {
+      __m256i bKeys = _mm256_srli_epi64(_mm256_loadu_si256((const __m256i *)(bPairs + b)), ENTITY_PAIR_HALF_BIT_COUNT);
+      // b's block and its three rotations cover every pairing of lanes
+      __m256i equal = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi64(aKeys, bKeys), _mm256_cmpeq_epi64(aKeys, _mm256_permute4x64_epi64(bKeys, 0x39))),
+        _mm256_or_si256(_mm256_cmpeq_epi64(aKeys, _mm256_permute4x64_epi64(bKeys, 0x4E)), _mm256_cmpeq_epi64(aKeys, _mm256_permute4x64_epi64(bKeys, 0x93))));
+      matched |= _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+      if ((bPairs[b + 3] >> ENTITY_PAIR_HALF_BIT_COUNT) >= aLast) {
+        break;
+      }
+      b += 4;
+      if (b + 4 > bCount) {
+        matched |= matchKeyTail(aPairs, a, 4, bPairs, b, bCount);
+        break;
+      }
+    }
+    for (; matched != 0; matched &= matched - 1) {
+      positions[count++] = a + __builtin_ctz(matched);
+    }
+    a += 4;
+  }
+
+  *aPosition = a;
+  *bPosition = b;
+  return count + mergeKeyPositionsScalar(aPairs, aPosition, aCount, bPairs, bPosition, bCount, positions + count, capacity - count);
+}
+
+#endif
+
+static unsigned char currentSIMDKernelLevel = SIMD_KERNEL_SCALAR;
+static lowerBoundFn currentLowerBound = NULL;
+static keyPositionsFn currentMergeKeyPositions = NULL;
+
+unsigned char detectSIMDKernelLevel() {
+#ifdef SIMD_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_KERNEL_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return SIMD_KERNEL_SSE42;
+  }
+#endif
+  return SIMD_KERNEL_SCALAR;
+}
+
+void setSIMDKernelLevel(unsigned char level) {
+  unsigned char supported = detectSIMDKernelLevel();
+  currentSIMDKernelLevel = (level < supported) ? level : supported;
+  switch (currentSIMDKernelLevel) {
+#ifdef SIMD_KERNELS_X86
+    case SIMD_KERNEL_AVX2:
+      currentMergeKeyPositions = &mergeKeyPositionsAVX2;
+      currentLowerBound = &lowerBoundEntityPairsAVX2;
+      break;
+    case SIMD_KERNEL_SSE42:
+      currentMergeKeyPositions = &mergeKeyPositionsSSE42;
+      currentLowerBound = &lowerBoundEntityPairsSSE42;
+      break;
+#endif
+    default:
+      currentMergeKeyPositions = &mergeKeyPositionsScalar;
+      currentLowerBound = &lowerBoundEntityPairsScalar;
+      break;
+  }
+}
+
+unsigned char simdKernelLevel() {
+  if (currentLowerBound == NULL) {
+    setSIMDKernelLevel(SIMD_KERNEL_AVX2);
+  }
+  return currentSIMDKernelLevel;
+}
+
+unsigned long lowerBoundEntityPairs(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound) {
+  // racing first calls all resolve to the same kernel, so no lock is needed
+  if (currentLowerBound == NULL) {
+    setSIMDKernelLevel(SIMD_KERNEL_AVX2);
+  }
+  return currentLowerBound(pairs, begin, count, bound);
+}
+
+unsigned long intersectKeyPositions(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity) {
+  if (currentLowerBound == NULL) {
+    setSIMDKernelLevel(SIMD_KERNEL_AVX2);
+  }
+  lowerBoundFn lowerBound = currentLowerBound;
+  unsigned long a = *aPosition;
+  unsigned long b = *bPosition;
+  unsigned long count = 0;
+
+  while (count < capacity && a < aCount && b < bCount) {
+    EntityPair aKey = aPairs[a] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    EntityPair bKey = bPairs[b] >> ENTITY_PAIR_HALF_BIT_COUNT;
+    if (aKey < bKey) {
+      a = lowerBound(aPairs, a + 1, aCount, bKey << ENTITY_PAIR_HALF_BIT_COUNT);
+    } else if (aKey > bKey) {
+      b = lowerBound(bPairs, b + 1, bCount, aKey << ENTITY_PAIR_HALF_BIT_COUNT);
+    } else {
+      // the whole run of a sharing this key matches
+      unsigned long runEnd = (aKey == ENTITY_PAIR_HALF_MASK) ? aCount : lowerBound(aPairs, a + 1, aCount, (aKey + 1) << ENTITY_PAIR_HALF_BIT_COUNT);
+      if (runEnd - a > capacity - count) {
+        runEnd = a + (capacity - count);
+      }
+      for (; a < runEnd; a++) {
+        positions[count++] = a;
+      }
+    }
+  }
+
+  *aPosition = a;
+  *bPosition = b;
+  return count;
+}
+
+unsigned long mergeKeyPositions(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity) {
+  if (currentLowerBound == NULL) {
+    setSIMDKernelLevel(SIMD_KERNEL_AVX2);
+  }
+  return currentMergeKeyPositions(aPairs, aPosition, aCount, bPairs, bPosition, bCount, positions, capacity);
+}
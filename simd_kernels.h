@@ -0,0 +1,36 @@
+#ifndef SIMD_KERNELS_H_INCLUDED
+#define SIMD_KERNELS_H_INCLUDED
+
+#include "predicate_entry.h"
+
+// kernel levels, picked once at runtime from what the CPU supports
+#define SIMD_KERNEL_SCALAR ((unsigned char)0)
+#define SIMD_KERNEL_SSE42  ((unsigned char)1)
+#define SIMD_KERNEL_AVX2   ((unsigned char)2)
+
+// how far the vector kernels scan linearly before falling back to galloping
+#define SIMD_LINEAR_SCAN_LENGTH 32
+
+unsigned char detectSIMDKernelLevel();
+unsigned char simdKernelLevel();
+// overrides detection, e.g. to compare kernels; levels the CPU lacks are clamped
+void setSIMDKernelLevel(unsigned char level);
+
+// first index in [begin, count) of sorted pairs whose pair is >= bound; OR batches copy each side's
+// runs up to the bound it finds, which is as far as vectorizing the union pays off
+unsigned long lowerBoundEntityPairs(EntityPair *pairs, unsigned long begin, unsigned long count, EntityPair bound);
+
+// writes the positions of a's pairs whose key half also occurs in b, advancing both positions
+// stops once capacity positions are written or either side runs out
+unsigned long intersectKeyPositions(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity);
+// the same by walking both sides in step, a block of lanes at a time compared all against all;
+// faster than seeking while neither side is much larger than the other, see JOIN_STRATEGY_MERGE
+unsigned long mergeKeyPositions(
+  EntityPair *aPairs, unsigned long *aPosition, unsigned long aCount,
+  EntityPair *bPairs, unsigned long *bPosition, unsigned long bCount,
+  unsigned long *positions, unsigned long capacity);
+
+#endif
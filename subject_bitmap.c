@@ -0,0 +1,477 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "subject_bitmap.h"
+
+/* Containers */
+
+static inline unsigned int containerKey(EntityId id) {
+  return (unsigned int)(id >> SUBJECT_BITMAP_CONTAINER_BIT_WIDTH);
+}
+
+static inline unsigned int containerLow(EntityId id) {
+  return (unsigned int)(id & SUBJECT_BITMAP_CONTAINER_MASK);
+}
+
+static inline EntityId containerId(unsigned int key, unsigned int low) {
+  return ((EntityId)key << SUBJECT_BITMAP_CONTAINER_BIT_WIDTH) | low;
+}
+
+static inline BOOL containerHasWords(const SubjectBitmapContainer *container) {
+  return container->words != NULL;
+}
+
+static inline BOOL wordsContain(const unsigned long long *words, unsigned int low) {
+  return (words[low >> 6] >> (low & 63)) & 1;
+}
+
+// first index of a sorted value array whose value is >= low
+unsigned int lowerBoundValues(const unsigned short *values, unsigned int count, unsigned int low) {
+  unsigned int begin = 0;
+  unsigned int end = count;
+  while (begin < end) {
+    unsigned int middle = begin + (end - begin) / 2;
+    if (values[middle] < low) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return begin;
+}
+
+// first set bit of words at or after low, limited to the bits also set in mask when it is not NULL
+BOOL nextWordsBit(const unsigned long long *words, const unsigned long long *mask, unsigned int low, unsigned int *result) {
+  unsigned int word = low >> 6;
+  unsigned long long bits = words[word] & (mask != NULL ? mask[word] : ~0ULL) & (~0ULL << (low & 63));
+  while (bits == 0) {
+    if (++word == SUBJECT_BITMAP_CONTAINER_WORD_COUNT) {
+      return FALSE;
+    }
+    bits = words[word] & (mask != NULL ? mask[word] : ~0ULL);
+  }
+  *result = (word << 6) + __builtin_ctzll(bits);
+  return TRUE;
+}
+
+BOOL nextContainerValue(const SubjectBitmapContainer *container, unsigned int low, unsigned int *result) {
+  if (containerHasWords(container)) {
+    return nextWordsBit(container->words, NULL, low, result);
+  }
+  unsigned int index = lowerBoundValues(container->values, container->cardinality, low);
+  if (index == container->cardinality) {
+    return FALSE;
+  }
+  *result = container->values[index];
+  return TRUE;
+}
+
+BOOL nextCommonContainerValue(const SubjectBitmapContainer *a, const SubjectBitmapContainer *b, unsigned int low, unsigned int *result) {
+  if (containerHasWords(a) && containerHasWords(b)) {
+    return nextWordsBit(a->words, b->words, low, result);
+  }
+  if (containerHasWords(a)) {
+    const SubjectBitmapContainer *swap = a;
+    a = b;
+    b = swap;
+  }
+  // a is an array: walk it, testing b
+  unsigned int i = lowerBoundValues(a->values, a->cardinality, low);
+  if (containerHasWords(b)) {
+    for (; i < a->cardinality; i++) {
+      if (wordsContain(b->words, a->values[i])) {
+        *result = a->values[i];
+        return TRUE;
+      }
+    }
+    return FALSE;
+  }
+  unsigned int j = lowerBoundValues(b->values, b->cardinality, low);
+  while (i < a->cardinality && j < b->cardinality) {
+    if (a->values[i] < b->values[j]) {
+      i++;
+    } else if (a->values[i] > b->values[j]) {
+      j++;
+    } else {
+      *result = a->values[i];
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+void containerToWords(const SubjectBitmapContainer *container, unsigned long long *words) {
+  if (containerHasWords(container)) {
+    memcpy(words, container->words, sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+    return;
+  }
+  memset(words, 0, sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+  for (unsigned int i = 0; i < container->cardinality; i++) {
+    words[container->values[i] >> 6] |= 1ULL << (container->values[i] & 63);
+  }
+}
+
+void convertContainerToWords(SubjectBitmapContainer *container) {
+  unsigned long long *words = malloc(sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+  containerToWords(container, words);
+  free(container->values);
+  container->values = NULL;
+  container->currentValuesLength = 0;
+  container->words = words;
+}
+
+void freeContainer(SubjectBitmapContainer *container) {
+  free(container->values);
+  free(container->words);
+}
+
+/* Bitmap */
+
+SubjectBitmap *createSubjectBitmap() {
+  SubjectBitmap *bitmap = malloc(sizeof(SubjectBitmap));
+  bitmap->containers = NULL;
+  bitmap->containerCount = 0;
+  bitmap->currentContainersLength = 0;
+  bitmap->cardinality = 0;
+  return bitmap;
+}
+
+void freeSubjectBitmap(SubjectBitmap *bitmap) {
+  for (unsigned long i = 0; i < bitmap->containerCount; i++) {
+    freeContainer(&bitmap->containers[i]);
+  }
+  free(bitmap->containers);
+  free(bitmap);
+}
+
+SubjectBitmapContainer *addContainer(SubjectBitmap *bitmap, unsigned int key) {
+  assert(bitmap->containerCount == 0 || bitmap->containers[bitmap->containerCount - 1].key < key);
+  if (bitmap->containerCount == bitmap->currentContainersLength) {
+    bitmap->currentContainersLength = (bitmap->currentContainersLength > 0) ? bitmap->currentContainersLength * 2 : 4;
+    bitmap->containers = realloc(bitmap->containers, sizeof(SubjectBitmapContainer) * bitmap->currentContainersLength);
+  }
+  SubjectBitmapContainer *container = &bitmap->containers[bitmap->containerCount++];
+  container->key = key;
+  container->cardinality = 0;
+  container->values = NULL;
+  container->currentValuesLength = 0;
+  container->words = NULL;
+  return container;
+}
+
+void appendSubjectBitmap(SubjectBitmap *bitmap, EntityId id) {
+  unsigned int key = containerKey(id);
+  unsigned int low = containerLow(id);
+  SubjectBitmapContainer *container = (bitmap->containerCount > 0) ? &bitmap->containers[bitmap->containerCount - 1] : NULL;
+  if (container == NULL || container->key != key) {
+    container = addContainer(bitmap, key);
+  }
+
+  if (containerHasWords(container)) {
+    if (wordsContain(container->words, low)) {
+      return;
+    }
+    container->words[low >> 6] |= 1ULL << (low & 63);
+  } else {
+    if (container->cardinality > 0) {
+      assert(container->values[container->cardinality - 1] <= low);
+      if (container->values[container->cardinality - 1] == low) {
+        return;
+      }
+    }
+    if (container->cardinality == SUBJECT_BITMAP_ARRAY_LIMIT) {
+      convertContainerToWords(container);
+      container->words[low >> 6] |= 1ULL << (low & 63);
+    } else {
+      if (container->cardinality == container->currentValuesLength) {
+        container->currentValuesLength = (container->currentValuesLength > 0) ? container->currentValuesLength * 2 : 4;
+        container->values = realloc(container->values, sizeof(unsigned short) * container->currentValuesLength);
+      }
+      container->values[container->cardinality] = (unsigned short)low;
+    }
+  }
+  container->cardinality++;
+  bitmap->cardinality++;
+}
+
+unsigned long subjectBitmapMemoryUsage(SubjectBitmap *bitmap) {
+  unsigned long usage = sizeof(SubjectBitmap) + sizeof(SubjectBitmapContainer) * bitmap->currentContainersLength;
+  for (unsigned long i = 0; i < bitmap->containerCount; i++) {
+    SubjectBitmapContainer *container = &bitmap->containers[i];
+    usage += containerHasWords(container)
+      ? sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT
+      : sizeof(unsigned short) * container->currentValuesLength;
+  }
+  return usage;
+}
+
+// first container whose key is >= key
+unsigned long lowerBoundContainers(SubjectBitmap *bitmap, unsigned int key) {
+  unsigned long begin = 0;
+  unsigned long end = bitmap->containerCount;
+  while (begin < end) {
+    unsigned long middle = begin + (end - begin) / 2;
+    if (bitmap->containers[middle].key < key) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return begin;
+}
+
+BOOL containerContains(const SubjectBitmapContainer *container, unsigned int low) {
+  if (containerHasWords(container)) {
+    return wordsContain(container->words, low);
+  }
+  unsigned int i = lowerBoundValues(container->values, container->cardinality, low);
+  return i < container->cardinality && container->values[i] == low;
+}
+
+BOOL subjectBitmapContains(SubjectBitmap *bitmap, EntityId id) {
+  unsigned int key = containerKey(id);
+  unsigned long index = lowerBoundContainers(bitmap, key);
+  if (index == bitmap->containerCount || bitmap->containers[index].key != key) {
+    return FALSE;
+  }
+  return containerContains(&bitmap->containers[index], containerLow(id));
+}
+
+void initSubjectBitmapCursor(SubjectBitmapCursor *cursor, SubjectBitmap *bitmap) {
+  cursor->bitmap = bitmap;
+  cursor->containerIndex = 0;
+}
+
+BOOL subjectBitmapCursorContains(SubjectBitmapCursor *cursor, EntityId id) {
+  SubjectBitmap *bitmap = cursor->bitmap;
+  unsigned int key = containerKey(id);
+  unsigned long index = cursor->containerIndex;
+  // ids ascend, so the walk over the containers is linear in total
+  while (index < bitmap->containerCount && bitmap->containers[index].key < key) {
+    index++;
+  }
+  cursor->containerIndex = index;
+  if (index == bitmap->containerCount || bitmap->containers[index].key != key) {
+    return FALSE;
+  }
+  return containerContains(&bitmap->containers[index], containerLow(id));
+}
+
+BOOL nextSubjectBitmapId(SubjectBitmap *bitmap, EntityId target, EntityId *id) {
+  unsigned int key = containerKey(target);
+  unsigned int low = containerLow(target);
+  for (unsigned long index = lowerBoundContainers(bitmap, key); index < bitmap->containerCount; index++) {
+    SubjectBitmapContainer *container = &bitmap->containers[index];
+    unsigned int result;
+    if (nextContainerValue(container, (container->key == key) ? low : 0, &result)) {
+      *id = containerId(container->key, result);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+BOOL nextCommonSubjectBitmapId(SubjectBitmap *a, SubjectBitmap *b, EntityId target, EntityId *id) {
+  unsigned int key = containerKey(target);
+  unsigned int low = containerLow(target);
+  unsigned long i = lowerBoundContainers(a, key);
+  unsigned long j = lowerBoundContainers(b, key);
+  while (i < a->containerCount && j < b->containerCount) {
+    SubjectBitmapContainer *aContainer = &a->containers[i];
+    SubjectBitmapContainer *bContainer = &b->containers[j];
+    if (aContainer->key < bContainer->key) {
+      i++;
+    } else if (aContainer->key > bContainer->key) {
+      j++;
+    } else {
+      unsigned int result;
+      if (nextCommonContainerValue(aContainer, bContainer, (aContainer->key == key) ? low : 0, &result)) {
+        *id = containerId(aContainer->key, result);
+        return TRUE;
+      }
+      i++;
+      j++;
+    }
+  }
+  return FALSE;
+}
+
+/* Set operations */
+
+// adds a container holding the set bits of words, as an array when they are few enough
+void addContainerFromWords(SubjectBitmap *bitmap, unsigned int key, const unsigned long long *words) {
+  unsigned int cardinality = 0;
+  for (unsigned int w = 0; w < SUBJECT_BITMAP_CONTAINER_WORD_COUNT; w++) {
+    cardinality += __builtin_popcountll(words[w]);
+  }
+  if (cardinality == 0) {
+    return;
+  }
+  SubjectBitmapContainer *container = addContainer(bitmap, key);
+  container->cardinality = cardinality;
+  bitmap->cardinality += cardinality;
+  if (cardinality > SUBJECT_BITMAP_ARRAY_LIMIT) {
+    container->words = malloc(sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+    memcpy(container->words, words, sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+    return;
+  }
+  container->values = malloc(sizeof(unsigned short) * cardinality);
+  container->currentValuesLength = cardinality;
+  unsigned int count = 0;
+  for (unsigned int w = 0; w < SUBJECT_BITMAP_CONTAINER_WORD_COUNT; w++) {
+    unsigned long long bits = words[w];
+    while (bits != 0) {
+      container->values[count++] = (unsigned short)((w << 6) + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+}
+
+void copyContainer(SubjectBitmap *bitmap, const SubjectBitmapContainer *source) {
+  SubjectBitmapContainer *container = addContainer(bitmap, source->key);
+  container->cardinality = source->cardinality;
+  bitmap->cardinality += source->cardinality;
+  if (containerHasWords(source)) {
+    container->words = malloc(sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+    memcpy(container->words, source->words, sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+  } else {
+    container->values = malloc(sizeof(unsigned short) * source->cardinality);
+    container->currentValuesLength = source->cardinality;
+    memcpy(container->values, source->values, sizeof(unsigned short) * source->cardinality);
+  }
+}
+
+// intersects two containers with the same key; returns the size and, when result is not NULL, appends it there
+unsigned int andContainers(const SubjectBitmapContainer *a, const SubjectBitmapContainer *b, SubjectBitmap *result, unsigned long long *scratch) {
+  if (containerHasWords(a) && containerHasWords(b)) {
+    unsigned int cardinality = 0;
+    for (unsigned int w = 0; w < SUBJECT_BITMAP_CONTAINER_WORD_COUNT; w++) {
+      scratch[w] = a->words[w] & b->words[w];
+      cardinality += __builtin_popcountll(scratch[w]);
+    }
+    if (result != NULL) {
+      addContainerFromWords(result, a->key, scratch);
+    }
+    return cardinality;
+  }
+  if (containerHasWords(a)) {
+    const SubjectBitmapContainer *swap = a;
+    a = b;
+    b = swap;
+  }
+  // a is an array, so the intersection is one too
+  SubjectBitmapContainer *container = NULL;
+  unsigned int cardinality = 0;
+  unsigned int i = 0;
+  unsigned int j = 0;
+  while (i < a->cardinality) {
+    unsigned short value = a->values[i++];
+    BOOL found;
+    if (containerHasWords(b)) {
+      found = wordsContain(b->words, value);
+    } else {
+      while (j < b->cardinality && b->values[j] < value) {
+        j++;
+      }
+      found = j < b->cardinality && b->values[j] == value;
+    }
+    if (!found) {
+      continue;
+    }
+    if (result != NULL) {
+      if (container == NULL) {
+        container = addContainer(result, a->key);
+        container->values = malloc(sizeof(unsigned short) * a->cardinality);
+        container->currentValuesLength = a->cardinality;
+      }
+      container->values[container->cardinality++] = value;
+      result->cardinality++;
+    }
+    cardinality++;
+  }
+  return cardinality;
+}
+
+SubjectBitmap *andSubjectBitmaps(SubjectBitmap *a, SubjectBitmap *b) {
+  SubjectBitmap *result = createSubjectBitmap();
+  unsigned long long *scratch = malloc(sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+  unsigned long i = 0;
+  unsigned long j = 0;
+  while (i < a->containerCount && j < b->containerCount) {
+    if (a->containers[i].key < b->containers[j].key) {
+      i++;
+    } else if (a->containers[i].key > b->containers[j].key) {
+      j++;
+    } else {
+      andContainers(&a->containers[i++], &b->containers[j++], result, scratch);
+    }
+  }
+  free(scratch);
+  return result;
+}
+
+unsigned long long andSubjectBitmapsCardinality(SubjectBitmap *a, SubjectBitmap *b) {
+  unsigned long long *scratch = malloc(sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+  unsigned long long cardinality = 0;
+  unsigned long i = 0;
+  unsigned long j = 0;
+  while (i < a->containerCount && j < b->containerCount) {
+    if (a->containers[i].key < b->containers[j].key) {
+      i++;
+    } else if (a->containers[i].key > b->containers[j].key) {
+      j++;
+    } else {
+      cardinality += andContainers(&a->containers[i++], &b->containers[j++], NULL, scratch);
+    }
+  }
+  free(scratch);
+  return cardinality;
+}
+
+SubjectBitmap *orSubjectBitmaps(SubjectBitmap *a, SubjectBitmap *b) {
+  SubjectBitmap *result = createSubjectBitmap();
+  unsigned long long *words = malloc(sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+  unsigned long long *bWords = malloc(sizeof(unsigned long long) * SUBJECT_BITMAP_CONTAINER_WORD_COUNT);
+  unsigned long i = 0;
+  unsigned long j = 0;
+  while (i < a->containerCount || j < b->containerCount) {
+    if (j == b->containerCount || (i < a->containerCount && a->containers[i].key < b->containers[j].key)) {
+      copyContainer(result, &a->containers[i++]);
+    } else if (i == a->containerCount || a->containers[i].key > b->containers[j].key) {
+      copyContainer(result, &b->containers[j++]);
+    } else {
+      containerToWords(&a->containers[i], words);
+      containerToWords(&b->containers[j], bWords);
+      for (unsigned int w = 0; w < SUBJECT_BITMAP_CONTAINER_WORD_COUNT; w++) {
+        words[w] |= bWords[w];
+      }
+      addContainerFromWords(result, a->containers[i].key, words);
+      i++;
+      j++;
+    }
+  }
+  free(bWords);
+  free(words);
+  return result;
+}
+
+void subjectBitmapToArray(SubjectBitmap *bitmap, EntityId *ids) {
+  unsigned long long count = 0;
+  for (unsigned long i = 0; i < bitmap->containerCount; i++) {
+    SubjectBitmapContainer *container = &bitmap->containers[i];
+    if (!containerHasWords(container)) {
+      for (unsigned int v = 0; v < container->cardinality; v++) {
+        ids[count++] = containerId(container->key, container->values[v]);
+      }
+      continue;
+    }
+    for (unsigned int w = 0; w < SUBJECT_BITMAP_CONTAINER_WORD_COUNT; w++) {
+      unsigned long long bits = container->words[w];
+      while (bits != 0) {
+        ids[count++] = containerId(container->key, (w << 6) + __builtin_ctzll(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef SUBJECT_BITMAP_H_INCLUDED
+#define SUBJECT_BITMAP_H_INCLUDED
+
+#include "triple.h"
+
+/*
+  Roaring-style set of entity ids. Ids are split into a container key (id >> 16) and a
+  16-bit low part; each container holds the low parts of one key either as a sorted array,
+  while it has at most SUBJECT_BITMAP_ARRAY_LIMIT values, or as a 65536-bit bitmap. So a set
+  costs at most 2 bytes per id, and far less where ids are dense, and set operations between
+  bitmap containers run a 64-bit word at a time.
+*/
+
+#define SUBJECT_BITMAP_CONTAINER_BIT_WIDTH 16
+#define SUBJECT_BITMAP_CONTAINER_MASK ((1U << SUBJECT_BITMAP_CONTAINER_BIT_WIDTH) - 1)
+#define SUBJECT_BITMAP_CONTAINER_WORD_COUNT ((1U << SUBJECT_BITMAP_CONTAINER_BIT_WIDTH) / 64)
+// past this an array container is as large as a bitmap one
+#define SUBJECT_BITMAP_ARRAY_LIMIT 4096
+
+typedef struct {
+  unsigned int key;
+  unsigned int cardinality;
+  // sorted low parts while cardinality <= SUBJECT_BITMAP_ARRAY_LIMIT
+  unsigned short *values;
+  unsigned int currentValuesLength;
+  // SUBJECT_BITMAP_CONTAINER_WORD_COUNT words past it, when values is NULL
+  unsigned long long *words;
+} SubjectBitmapContainer;
+
+typedef struct {
+  // ascending by key
+  SubjectBitmapContainer *containers;
+  unsigned long containerCount;
+  unsigned long currentContainersLength;
+  unsigned long long cardinality;
+} SubjectBitmap;
+
+SubjectBitmap *createSubjectBitmap();
+void freeSubjectBitmap(SubjectBitmap *bitmap);
+// ids must be appended in ascending order; repeats of the last id are ignored
+void appendSubjectBitmap(SubjectBitmap *bitmap, EntityId id);
+unsigned long subjectBitmapMemoryUsage(SubjectBitmap *bitmap);
+
+BOOL subjectBitmapContains(SubjectBitmap *bitmap, EntityId id);
+
+// membership tests for ascending ids, which keep their place in the container list
+typedef struct {
+  SubjectBitmap *bitmap;
+  unsigned long containerIndex;
+} SubjectBitmapCursor;
+
+void initSubjectBitmapCursor(SubjectBitmapCursor *cursor, SubjectBitmap *bitmap);
+BOOL subjectBitmapCursorContains(SubjectBitmapCursor *cursor, EntityId id);
+// the smallest id in the set that is >= target; FALSE when there is none
+BOOL nextSubjectBitmapId(SubjectBitmap *bitmap, EntityId target, EntityId *id);
+// the smallest id in both sets that is >= target; FALSE when there is none
+BOOL nextCommonSubjectBitmapId(SubjectBitmap *a, SubjectBitmap *b, EntityId target, EntityId *id);
+
+SubjectBitmap *andSubjectBitmaps(SubjectBitmap *a, SubjectBitmap *b);
+SubjectBitmap *orSubjectBitmaps(SubjectBitmap *a, SubjectBitmap *b);
+// |a & b| without building it
+unsigned long long andSubjectBitmapsCardinality(SubjectBitmap *a, SubjectBitmap *b);
+// writes the ids ascending; ids must hold cardinality values
+void subjectBitmapToArray(SubjectBitmap *bitmap, EntityId *ids);
+
+#endif
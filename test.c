@@ -1,8 +1,23 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "graph.h"
+#include "radix_sort.h"
+#include "leapfrog_join.h"
+#include "simd_kernels.h"
+#include "segment_file.h"
+#include "bulk_loader.h"
+#include "dictionary.h"
+#include "morsel_executor.h"
+#include "query_planner.h"
+#include "union_iterator.h"
+#include "traversal.h"
+#include "analytics.h"
+#include "versioned_segment.h"
+#include "parallel.h"
 // #include "quicksort.h"
 
 void testTriple() {
@@ -37,26 +52,43 @@ void testTriple() {
   assert(toTripleFromSOEntry(soPair, 2) == triple);
   assert(toTripleFromOSEntry(osPair, 2) == triple);
 
-  for (SubjectId i = 0; i < (2 ^ SUBJECT_BIT_WIDTH); i++) {
-    Triple triple = toTriple(i,2,3);
-    assert(subjectIdFromTriple(triple) == i);
+  // the low ids and the top of each field, where a wrong mask or shift would bleed into a neighbour
+  for (unsigned long long j = 0; j < 2048; j++) {
+    SubjectId subject = (j < 1024) ? (SubjectId)j : SUBJECT_ID_MAX - (SubjectId)(j - 1024);
+    PredicateId predicate = (j < 1024) ? (PredicateId)j : PREDICATE_ID_MAX - (PredicateId)(j - 1024);
+    ObjectId object = (j < 1024) ? (ObjectId)j : OBJECT_ID_MAX - (ObjectId)(j - 1024);
+
+    Triple triple = toTriple(subject, 2, 3);
+    assert(subjectIdFromTriple(triple) == subject);
     assert(predicateIdFromTriple(triple) == 2);
     assert(objectIdFromTriple(triple) == 3);
-  }
 
-  for (PredicateId i = 0; i < (2 ^ PREDICATE_BIT_WIDTH); i++) {
-    Triple triple = toTriple(1,i,3);
+    triple = toTriple(1, predicate, 3);
     assert(subjectIdFromTriple(triple) == 1);
-    assert(predicateIdFromTriple(triple) == i);
+    assert(predicateIdFromTriple(triple) == predicate);
     assert(objectIdFromTriple(triple) == 3);
-  }
 
-  for (ObjectId i = 0; i < (2 ^ OBJECT_BIT_WIDTH); i++) {
-    Triple triple = toTriple(1,2,i);
+    triple = toTriple(1, 2, object);
     assert(subjectIdFromTriple(triple) == 1);
     assert(predicateIdFromTriple(triple) == 2);
-    assert(objectIdFromTriple(triple) == i);
+    assert(objectIdFromTriple(triple) == object);
+
+    triple = toTriple(subject, predicate, object);
+    assert(toTripleFromSOEntry(tripleToSOEntry(triple), predicate) == triple);
+    assert(toTripleFromOSEntry(tripleToOSEntry(triple), predicate) == triple);
   }
+
+  // the masks tile exactly the bits the layout uses
+  Triple full = toTriple(SUBJECT_ID_MAX, PREDICATE_ID_MAX, OBJECT_ID_MAX);
+  assert(full == toTriple(SUBJECT_ID_MAX, 0, 0) + toTriple(0, PREDICATE_ID_MAX, 0) + toTriple(0, 0, OBJECT_ID_MAX));
+  assert((SUBJECT_MASK & PREDICATE_MASK) == 0);
+  assert((SUBJECT_MASK & OBJECT_MASK) == 0);
+  assert((PREDICATE_MASK & OBJECT_MASK) == 0);
+  assert((SUBJECT_MASK | PREDICATE_MASK | OBJECT_MASK) == full);
+  assert((full & SUBJECT_MASK) == toTriple(SUBJECT_ID_MAX, 0, 0));
+  assert((full & PREDICATE_MASK) == toTriple(0, PREDICATE_ID_MAX, 0));
+  assert((full & OBJECT_MASK) == toTriple(0, 0, OBJECT_ID_MAX));
+  assert(isValidPredicateId(PREDICATE_ID_MAX));
 }
 
 // int cmpfunc (const void * a, const void * b) {
@@ -134,6 +166,229 @@ void testPredicateEntry() {
   // freePredicateEntry(entry);
 }
 
+unsigned long long testRandomState = 0x9E3779B97F4A7C15ULL;
+
+unsigned long long testRandom() {
+  // xorshift64, deterministic across runs
+  testRandomState ^= testRandomState << 13;
+  testRandomState ^= testRandomState >> 7;
+  testRandomState ^= testRandomState << 17;
+  return testRandomState;
+}
+
+// fills every word of a wide pair
+EntityPair testRandomPair() {
+  EntityPair pair = testRandom();
+  for (int i = 1; i < ENTITY_PAIR_WORD_COUNT; i++) {
+    pair = (pair << 32 << 32) | testRandom();
+  }
+  return pair;
+}
+
+void checkRadixSort(unsigned long length, int threadCount, EntityPair mask) {
+  EntityPair *pairs = malloc(sizeof(EntityPair) * length);
+  EntityPair *expected = malloc(sizeof(EntityPair) * length);
+  EntityPair *scratch = malloc(sizeof(EntityPair) * length);
+
+  for (unsigned long i = 0; i < length; i++) {
+    pairs[i] = testRandomPair() & mask;
+    expected[i] = pairs[i];
+  }
+
+  qsort(expected, length, sizeof(EntityPair), compareEntityPairs);
+  radixSortEntityPairsWithThreads(pairs, scratch, length, threadCount);
+
+  for (unsigned long i = 0; i < length; i++) {
+    assert(pairs[i] == expected[i]);
+  }
+
+  free(scratch);
+  free(expected);
+  free(pairs);
+}
+
+void testRadixSort() {
+  printf("testRadixSort\n");
+
+  EntityPair packedMask = toSOEntry(SUBJECT_ID_MAX, OBJECT_ID_MAX);
+
+  checkRadixSort(10, 1, ~((EntityPair)0));
+  checkRadixSort(RADIX_SORT_MIN_LENGTH * 4, 1, ~((EntityPair)0));
+  checkRadixSort(RADIX_SORT_MIN_LENGTH * 4, 1, packedMask);
+  // few distinct subjects, so ties must be broken by the object half
+  checkRadixSort(RADIX_SORT_MIN_LENGTH * 4, 1, toSOEntry(7, OBJECT_ID_MAX));
+  checkRadixSort(RADIX_SORT_MIN_LENGTH * 4 + 3, 3, ~((EntityPair)0));
+  // the shortest input sorted on wide digits, and the longest on narrow ones
+  checkRadixSort(RADIX_SORT_WIDE_DIGIT_MIN_LENGTH, 1, ~((EntityPair)0));
+  checkRadixSort(RADIX_SORT_WIDE_DIGIT_MIN_LENGTH - 1, 2, packedMask);
+  checkRadixSort(RADIX_SORT_PARALLEL_THRESHOLD + 7, 4, packedMask);
+
+  // every key equal
+  checkRadixSort(RADIX_SORT_MIN_LENGTH * 2, 2, 0);
+
+  // subjects far enough apart that subtracting them overflows an int
+  PredicateEntry *entry = createPredicateEntry(2);
+  for (unsigned long i = 0; i < RADIX_SORT_MIN_LENGTH; i++) {
+    addToPredicateEntry(entry, (i & 1) ? 0xFFFFFFF0 - i : i, (EntityId)(RADIX_SORT_MIN_LENGTH - i));
+  }
+  optimizePredicateEntry(entry);
+  for (unsigned long i = 1; i < entry->entryCount; i++) {
+    assert(entry->soEntries[i - 1] < entry->soEntries[i]);
+    assert(entry->osEntries[i - 1] < entry->osEntries[i]);
+    assert(subjectIdFromSOEntry(entry->soEntries[i - 1]) <= subjectIdFromSOEntry(entry->soEntries[i]));
+    assert(objectIdFromOSEntry(entry->osEntries[i - 1]) <= objectIdFromOSEntry(entry->osEntries[i]));
+  }
+  freePredicateEntry(entry);
+}
+
+void testBitPackedArray() {
+  printf("testBitPackedArray\n");
+
+  assert(bitWidthForValue(0) == 0);
+  assert(bitWidthForValue(1) == 1);
+  assert(bitWidthForValue(SUBJECT_ID_MAX) == SUBJECT_BIT_WIDTH);
+  assert(bitWidthForValue(~0ULL) == 64);
+
+  unsigned int widths[] = {0, 1, 7, OBJECT_BIT_WIDTH, 33, 63, 64};
+  for (unsigned int w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+    BitPackedArray array;
+    unsigned long length = 257;
+    initBitPackedArray(&array, length, widths[w]);
+    for (unsigned long i = 0; i < length; i++) {
+      setBitPackedValue(&array, i, (i * 0x9E3779B97F4A7C15ULL) & array.mask);
+    }
+    // overwrite every other value to check neighbors are left alone
+    for (unsigned long i = 0; i < length; i += 2) {
+      setBitPackedValue(&array, i, (~i) & array.mask);
+    }
+    for (unsigned long i = 0; i < length; i++) {
+      unsigned long long expected = (i % 2 == 0) ? (~i) : (i * 0x9E3779B97F4A7C15ULL);
+      assert(getBitPackedValue(&array, i) == (expected & array.mask));
+    }
+    destroyBitPackedArray(&array);
+  }
+}
+
+void testCompressedPredicateEntry() {
+  printf("testCompressedPredicateEntry\n");
+
+  PredicateEntry *entry = createPredicateEntry(7);
+  unsigned long length = 5000;
+  for (unsigned long i = 0; i < length; i++) {
+    // roughly ten objects per subject
+    addToPredicateEntry(entry, testRandom() % (length / 10), (testRandom() & OBJECT_ID_MAX));
+  }
+  optimizePredicateEntry(entry);
+
+  Triple *expected = malloc(sizeof(Triple) * length);
+  Iterator *iterator = createPredicateEntryIterator(entry);
+  iterator->init(iterator);
+  unsigned long count = 0;
+  while (iterate(iterator, &expected[count])) {
+    count++;
+  }
+  iterator->free(iterator);
+  assert(count == length);
+
+  EntityPair *osExpected = malloc(sizeof(EntityPair) * length);
+  for (unsigned long i = 0; i < length; i++) {
+    osExpected[i] = entry->osEntries[i];
+  }
+
+  unsigned long uncompressedUsage = predicateEntryMemoryUsage(entry);
+  compressPredicateEntry(entry);
+  assert(isCompressedPredicateEntry(entry));
+  assert(entry->soEntries == NULL);
+  assert(entry->entryCount == length);
+  assert(predicateEntryMemoryUsage(entry) * 2 < uncompressedUsage);
+
+  iterator = createPredicateEntryIterator(entry);
+  iterator->init(iterator);
+  Triple triple;
+  count = 0;
+  while (iterate(iterator, &triple)) {
+    assert(triple == expected[count++]);
+  }
+  assert(count == length);
+  iterator->free(iterator);
+
+  // the object side mirrors the subject side
+  CompressedAdjacency *os = entry->osCompressed;
+  unsigned long position = 0;
+  for (unsigned long k = 0; k < os->keyCount; k++) {
+    ObjectId object = getBitPackedValue(&os->keys, k);
+    for (; position < getBitPackedValue(&os->offsets, k + 1); position++) {
+      SubjectId subject = getBitPackedValue(&os->values, position);
+      assert(toOSEntry(object, subject) == osExpected[position]);
+    }
+  }
+  assert(position == length);
+
+  free(osExpected);
+  free(expected);
+  freePredicateEntry(entry);
+
+  // pairs added after the last optimize, both in the delta and in the tail, are merged in before packing
+  entry = createPredicateEntry(7);
+  EntityPair *soSorted = malloc(sizeof(EntityPair) * length);
+  for (unsigned long i = 0; i < length; i++) {
+    SubjectId subject = testRandom() % (length / 10);
+    ObjectId object = testRandom() & OBJECT_ID_MAX;
+    addToPredicateEntry(entry, subject, object);
+    soSorted[i] = toSOEntry(subject, object);
+    if (i == length - 400 - 1) {
+      optimizePredicateEntry(entry);
+    } else if (i == length - 200 - 1) {
+      preparePredicateEntryForReading(entry);
+    }
+  }
+  assert(entry->deltaSortedCount == 200 && predicateEntryUnsortedCount(entry) == 400);
+  qsort(soSorted, length, sizeof(EntityPair), compareEntityPairs);
+  compressPredicateEntry(entry);
+  iterator = createPredicateEntryIterator(entry);
+  iterator->init(iterator);
+  count = 0;
+  while (iterate(iterator, &triple)) {
+    assert(triple == toTripleFromSOEntry(soSorted[count++], 7));
+  }
+  assert(count == length);
+  iterator->free(iterator);
+  for (unsigned long i = 0; i < length; i += 7) {
+    assert(predicateEntryHasPair(entry, subjectIdFromSOEntry(soSorted[i]), objectIdFromSOEntry(soSorted[i])));
+  }
+  free(soSorted);
+  freePredicateEntry(entry);
+
+  // compressed and uncompressed entries compose in joins
+  PredicateEntry *aEntry = createPredicateEntry(2);
+  PredicateEntry *bEntry = createPredicateEntry(3);
+  for (SubjectId i = 1; i < 9; i++) {
+    addToPredicateEntry(aEntry, i, 10);
+    addToPredicateEntry(aEntry, i, 11);
+    if (i % 2 == 0) {
+      addToPredicateEntry(bEntry, i, 20);
+    }
+  }
+  optimizePredicateEntry(aEntry);
+  optimizePredicateEntry(bEntry);
+  compressPredicateEntry(aEntry);
+
+  iterator = createPredicateEntryORIterator(createPredicateEntryIterator(aEntry), createPredicateEntryIterator(bEntry));
+  iterator->init(iterator);
+  count = 0;
+  SubjectId previous = 0;
+  while (iterate(iterator, &triple)) {
+    assert(subjectIdFromTriple(triple) >= previous);
+    previous = subjectIdFromTriple(triple);
+    count++;
+  }
+  assert(count == 20);
+  iterator->free(iterator);
+
+  freePredicateEntry(aEntry);
+  freePredicateEntry(bEntry);
+}
+
 void testPredicateEntryORIterator() {
   printf("testPredicateEntryORIterator\n");
 
@@ -281,6 +536,2583 @@ void testPredicateEntryANDIterator() {
   iterator->free(iterator);
 }
 
+void testSegment() {
+  printf("testSegment\n");
+
+  Segment *segment = createSegment();
+
+  assert(getSegmentPredicateEntry(segment, 2) == NULL);
+  assert(createSegmentPredicateIterator(segment, 2) == NULL);
+
+  // interleave predicates and add subjects in descending order so optimize has work to do
+  for (SubjectId i = 8; i > 0; i--) {
+    addTripleToSegment(segment, toTriple(i, 2, 10));
+    addTripleToSegment(segment, toTriple(i, PREDICATE_ID_MAX, 20));
+  }
+
+  assert(segment->tripleCount == 16);
+  assert(segment->predicateCount == 2);
+  assert(getSegmentPredicateEntry(segment, 2)->entryCount == 8);
+  assert(getSegmentPredicateEntry(segment, PREDICATE_ID_MAX)->entryCount == 8);
+  assert(getSegmentPredicateEntry(segment, 3) == NULL);
+
+  optimizeSegment(segment);
+
+  Iterator *iterator = createSegmentPredicateIterator(segment, 2);
+  iterator->init(iterator);
+
+  SubjectId i = 1;
+
+  Triple triple;
+  while (iterate(iterator, &triple)) {
+    assert(subjectIdFromTriple(triple) == i++);
+    assert(predicateIdFromTriple(triple) == 2);
+    assert(objectIdFromTriple(triple) == 10);
+  }
+
+  assert(i == 9);
+
+  iterator->free(iterator);
+  freeSegment(segment);
+}
+
+void testIteratorSeek() {
+  printf("testIteratorSeek\n");
+
+  PredicateEntry *entry = createPredicateEntry(2);
+  PredicateEntry *compressedEntry = createPredicateEntry(2);
+  // subjects 10, 20, ..., 1000 with two objects each
+  for (SubjectId i = 10; i <= 1000; i += 10) {
+    addToPredicateEntry(entry, i, 1);
+    addToPredicateEntry(entry, i, 2);
+    addToPredicateEntry(compressedEntry, i, 1);
+    addToPredicateEntry(compressedEntry, i, 2);
+  }
+  optimizePredicateEntry(entry);
+  optimizePredicateEntry(compressedEntry);
+  compressPredicateEntry(compressedEntry);
+
+  PredicateEntry *entries[] = {entry, compressedEntry};
+  for (int e = 0; e < 2; e++) {
+    Iterator *iterator = createPredicateEntryIterator(entries[e]);
+    iterator->init(iterator);
+
+    iterator->seek(iterator, 0);
+    assert(subjectIdFromTriple(iterator->peek(iterator)) == 10);
+    assert(objectIdFromTriple(iterator->peek(iterator)) == 1);
+
+    iterator->seek(iterator, 15);
+    assert(subjectIdFromTriple(iterator->peek(iterator)) == 20);
+    assert(objectIdFromTriple(iterator->peek(iterator)) == 1);
+
+    iterator->advance(iterator);
+    // seeking to the current key stays put
+    iterator->seek(iterator, 20);
+    assert(subjectIdFromTriple(iterator->peek(iterator)) == 20);
+    assert(objectIdFromTriple(iterator->peek(iterator)) == 2);
+
+    // never moves backwards
+    iterator->seek(iterator, 5);
+    assert(subjectIdFromTriple(iterator->peek(iterator)) == 20);
+
+    iterator->seek(iterator, 990);
+    assert(subjectIdFromTriple(iterator->peek(iterator)) == 990);
+
+    iterator->seek(iterator, 1001);
+    assert(iterator->done(iterator));
+    iterator->seek(iterator, 2000);
+    assert(iterator->done(iterator));
+
+    iterator->free(iterator);
+  }
+
+  // a small input ANDed with a large one
+  PredicateEntry *large = createPredicateEntry(3);
+  for (SubjectId i = 0; i < 100000; i++) {
+    addToPredicateEntry(large, i, 3);
+  }
+  optimizePredicateEntry(large);
+
+  Iterator *iterator = createPredicateEntryANDIterator(createPredicateEntryIterator(entry), createPredicateEntryIterator(large));
+  iterator->init(iterator);
+  SubjectId expected = 10;
+  unsigned long count = 0;
+  Triple triple;
+  while (iterate(iterator, &triple)) {
+    // every triple of the left input whose subject is in the right one
+    assert(subjectIdFromTriple(triple) == expected);
+    assert(predicateIdFromTriple(triple) == 2);
+    assert(objectIdFromTriple(triple) == 1 + (count % 2));
+    count++;
+    if (count % 2 == 0) {
+      expected += 10;
+    }
+  }
+  assert(count == 200);
+  iterator->free(iterator);
+
+  // joins forward seeks to their inputs
+  iterator = createPredicateEntryANDIterator(createPredicateEntryIterator(large), createPredicateEntryIterator(compressedEntry));
+  iterator->init(iterator);
+  iterator->seek(iterator, 501);
+  assert(subjectIdFromTriple(iterator->peek(iterator)) == 510);
+  assert(predicateIdFromTriple(iterator->peek(iterator)) == 3);
+  iterator->free(iterator);
+
+  iterator = createPredicateEntryORIterator(createPredicateEntryIterator(large), createPredicateEntryIterator(entry));
+  iterator->init(iterator);
+  iterator->seek(iterator, 99999);
+  assert(subjectIdFromTriple(iterator->peek(iterator)) == 99999);
+  iterator->advance(iterator);
+  assert(iterator->done(iterator));
+  iterator->free(iterator);
+
+  freePredicateEntry(large);
+  freePredicateEntry(compressedEntry);
+  freePredicateEntry(entry);
+}
+
+void testLeapfrogJoin() {
+  printf("testLeapfrogJoin\n");
+
+  int inputCount = 4;
+  PredicateEntry *entries[4];
+  for (int e = 0; e < inputCount; e++) {
+    entries[e] = createPredicateEntry(e + 1);
+    // denser inputs further right, some subjects repeated
+    for (int i = 0; i < 200 * (e + 1); i++) {
+      addToPredicateEntry(entries[e], testRandom() % 400, testRandom() % 4);
+    }
+    optimizePredicateEntry(entries[e]);
+  }
+
+  Iterator *tree = createPredicateEntryIterator(entries[0]);
+  Iterator *inputs[4];
+  for (int e = 0; e < inputCount; e++) {
+    inputs[e] = createPredicateEntryIterator(entries[e]);
+    if (e > 0) {
+      tree = createPredicateEntryANDIterator(tree, createPredicateEntryIterator(entries[e]));
+    }
+  }
+  Iterator *leapfrog = createLeapfrogJoinIterator(inputs, inputCount);
+  tree->init(tree);
+  leapfrog->init(leapfrog);
+
+  unsigned long count = 0;
+  Triple expected, triple;
+  while (iterate(tree, &expected)) {
+    assert(iterate(leapfrog, &triple));
+    assert(triple == expected);
+    count++;
+  }
+  assert(!iterate(leapfrog, &triple));
+  assert(count > 0);
+
+  tree->free(tree);
+  leapfrog->free(leapfrog);
+
+  // seek lands on the first matching key at or after the target
+  for (int e = 0; e < inputCount; e++) {
+    inputs[e] = createPredicateEntryIterator(entries[e]);
+  }
+  leapfrog = createLeapfrogJoinIterator(inputs, inputCount);
+  leapfrog->init(leapfrog);
+  leapfrog->seek(leapfrog, 200);
+  while (iterate(leapfrog, &triple)) {
+    SubjectId subject = subjectIdFromTriple(triple);
+    assert(subject >= 200);
+    for (int e = 1; e < inputCount; e++) {
+      BOOL found = FALSE;
+      for (unsigned long i = 0; i < entries[e]->entryCount; i++) {
+        if (subjectIdFromSOEntry(entries[e]->soEntries[i]) == subject) {
+          found = TRUE;
+        }
+      }
+      assert(found);
+    }
+  }
+  leapfrog->free(leapfrog);
+
+  for (int e = 0; e < inputCount; e++) {
+    freePredicateEntry(entries[e]);
+  }
+}
+
+void countTriejoinResult(const EntityId *bindings, void *context) {
+  (void)bindings;
+  (*(unsigned long *)context)++;
+}
+
+void testLeapfrogTriejoin() {
+  printf("testLeapfrogTriejoin\n");
+
+  int vertexCount = 40;
+  BOOL edges[40][40] = {{0}};
+  PredicateEntry *edgeEntry = createPredicateEntry(1);
+  PredicateEntry *colorEntry = createPredicateEntry(2);
+  BOOL colors[40][3] = {{0}};
+
+  for (int i = 0; i < 300; i++) {
+    EntityId s = testRandom() % vertexCount;
+    EntityId o = testRandom() % vertexCount;
+    // duplicates are stored but must not produce duplicate results
+    addToPredicateEntry(edgeEntry, s, o);
+    edges[s][o] = TRUE;
+  }
+  for (EntityId v = 0; v < (EntityId)vertexCount; v++) {
+    EntityId color = testRandom() % 3;
+    addToPredicateEntry(colorEntry, v, color);
+    colors[v][color] = TRUE;
+  }
+  optimizePredicateEntry(edgeEntry);
+  optimizePredicateEntry(colorEntry);
+
+  // triangles: edge(x, y), edge(y, z), edge(x, z)
+  unsigned long expected = 0;
+  for (int x = 0; x < vertexCount; x++) {
+    for (int y = 0; y < vertexCount; y++) {
+      for (int z = 0; z < vertexCount; z++) {
+        if (edges[x][y] && edges[y][z] && edges[x][z]) {
+          expected++;
+        }
+      }
+    }
+  }
+  TriejoinAtom triangle[] = {
+    {edgeEntry, 0, 1},
+    {edgeEntry, 1, 2},
+    {edgeEntry, 0, 2}
+  };
+  unsigned long callbackCount = 0;
+  assert(leapfrogTriejoin(triangle, 3, 3, &countTriejoinResult, &callbackCount) == expected);
+  assert(callbackCount == expected);
+
+  // two hops into a color, with the color bound first so osEntries are used: color(y, c), edge(x, y)
+  expected = 0;
+  for (int c = 0; c < 3; c++) {
+    for (int y = 0; y < vertexCount; y++) {
+      for (int x = 0; x < vertexCount; x++) {
+        if (colors[y][c] && edges[x][y]) {
+          expected++;
+        }
+      }
+    }
+  }
+  TriejoinAtom path[] = {
+    {colorEntry, 1, 0},
+    {edgeEntry, 2, 1}
+  };
+  assert(leapfrogTriejoin(path, 2, 3, NULL, NULL) == expected);
+
+  // a sorted delta, an unsorted tail and a tombstone are all merged before the join seeks
+  for (int i = 0; i < 30; i++) {
+    EntityId s = testRandom() % vertexCount;
+    EntityId o = testRandom() % vertexCount;
+    addToPredicateEntry(edgeEntry, s, o);
+    edges[s][o] = TRUE;
+  }
+  preparePredicateEntryForReading(edgeEntry);
+  assert(edgeEntry->deltaSortedCount > 0);
+  EntityPair removed = edgeEntry->soEntries[edgeEntry->sortedCount / 2];
+  assert(removeFromPredicateEntry(edgeEntry, subjectIdFromSOEntry(removed), objectIdFromSOEntry(removed)));
+  edges[subjectIdFromSOEntry(removed)][objectIdFromSOEntry(removed)] = FALSE;
+  addToPredicateEntry(edgeEntry, 39, 0);
+  addToPredicateEntry(edgeEntry, 0, 39);
+  edges[39][0] = TRUE;
+  edges[0][39] = TRUE;
+  assert(predicateEntryUnsortedCount(edgeEntry) > edgeEntry->deltaSortedCount);
+  expected = 0;
+  for (int x = 0; x < vertexCount; x++) {
+    for (int y = 0; y < vertexCount; y++) {
+      for (int z = 0; z < vertexCount; z++) {
+        if (edges[x][y] && edges[y][z] && edges[x][z]) {
+          expected++;
+        }
+      }
+    }
+  }
+  assert(leapfrogTriejoin(triangle, 3, 3, NULL, NULL) == expected);
+
+  freePredicateEntry(colorEntry);
+  freePredicateEntry(edgeEntry);
+}
+
+Iterator *createBatchTestIterator(int shape, PredicateEntry **entries) {
+  Iterator *inputs[3];
+  switch (shape) {
+    case 0:
+      return createPredicateEntryIterator(entries[0]);
+    case 1:
+      return createPredicateEntryIterator(entries[3]);
+    case 2:
+      return createPredicateEntryORIterator(createPredicateEntryIterator(entries[0]), createPredicateEntryIterator(entries[1]));
+    case 3:
+      return createPredicateEntryANDIterator(createPredicateEntryIterator(entries[0]), createPredicateEntryIterator(entries[2]));
+    case 4:
+      return createPredicateEntryORIterator(
+        createPredicateEntryANDIterator(createPredicateEntryIterator(entries[3]), createPredicateEntryIterator(entries[1])),
+        createPredicateEntryORIterator(createPredicateEntryIterator(entries[2]), createPredicateEntryIterator(entries[0])));
+    case 6:
+      return createPredicateEntryORIterator(createPredicateEntryObjectIterator(entries[3]), createPredicateEntryObjectIterator(entries[1]));
+    case 7:
+      return createPredicateEntryKeyedANDIterator(entries[0], entries[2], JOIN_ON_SUBJECT_OBJECT);
+    case 8:
+      return createPredicateEntryObjectIterator(entries[3]);
+    default:
+      inputs[0] = createPredicateEntryIterator(entries[1]);
+      inputs[1] = createPredicateEntryIterator(entries[2]);
+      inputs[2] = createPredicateEntryIterator(entries[3]);
+      return createLeapfrogJoinIterator(inputs, 3);
+  }
+}
+
+void testNextBatch() {
+  printf("testNextBatch\n");
+
+  PredicateEntry *entries[4];
+  for (int e = 0; e < 4; e++) {
+    entries[e] = createPredicateEntry(e + 1);
+    for (int i = 0; i < 3000; i++) {
+      addToPredicateEntry(entries[e], testRandom() % (1000 * (e + 1)), testRandom() % 8);
+    }
+    optimizePredicateEntry(entries[e]);
+  }
+  compressPredicateEntry(entries[3]);
+
+  unsigned long capacities[] = {1, 7, ITERATOR_BATCH_LENGTH, 100000};
+  Triple *expected = malloc(sizeof(Triple) * 12000);
+  Triple *batch = malloc(sizeof(Triple) * 100000);
+
+  for (int shape = 0; shape < 10; shape++) {
+    Iterator *iterator = createBatchTestIterator(shape, entries);
+    iterator->init(iterator);
+    unsigned long expectedCount = 0;
+    while (iterate(iterator, &expected[expectedCount])) {
+      expectedCount++;
+    }
+    iterator->free(iterator);
+    assert(expectedCount > 0);
+
+    for (unsigned long c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+      iterator = createBatchTestIterator(shape, entries);
+      iterator->init(iterator);
+      unsigned long count = 0;
+      unsigned long returned;
+      while ((returned = nextBatch(iterator, batch, capacities[c])) > 0) {
+        assert(returned <= capacities[c]);
+        for (unsigned long i = 0; i < returned; i++) {
+          assert(batch[i] == expected[count++]);
+        }
+        // batches and single steps interleave
+        Triple triple;
+        if (iterate(iterator, &triple)) {
+          assert(triple == expected[count++]);
+        }
+      }
+      assert(count == expectedCount);
+      assert(iterator->done(iterator));
+      iterator->free(iterator);
+    }
+  }
+
+  free(batch);
+  free(expected);
+  for (int e = 0; e < 4; e++) {
+    freePredicateEntry(entries[e]);
+  }
+}
+
+// the merge kernel against what it should emit, read back in chunks of capacity positions
+void checkMergeKeyPositions(EntityPair *aPairs, unsigned long aCount, EntityPair *bPairs, unsigned long bCount, unsigned long capacity) {
+  unsigned long *positions = malloc(sizeof(unsigned long) * (aCount + bCount));
+
+  unsigned long aPosition = 0;
+  unsigned long bPosition = 0;
+  unsigned long found = 0;
+  unsigned long returned;
+  while ((returned = mergeKeyPositions(aPairs, &aPosition, aCount, bPairs, &bPosition, bCount, positions + found, capacity)) > 0) {
+    found += returned;
+  }
+  unsigned long expected = 0;
+  for (unsigned long i = 0; i < aCount; i++) {
+    SubjectId subject = subjectIdFromSOEntry(aPairs[i]);
+    unsigned long j = gallopEntityPairs(bPairs, 0, bCount, toSOEntry(subject, 0));
+    if (j < bCount && subjectIdFromSOEntry(bPairs[j]) == subject) {
+      assert(expected < found && positions[expected] == i);
+      expected++;
+    }
+  }
+  assert(expected == found);
+
+  free(positions);
+}
+
+void testSIMDKernels() {
+  printf("testSIMDKernels (detected level %d)\n", (int)detectSIMDKernelLevel());
+
+  unsigned long length = 3000;
+  EntityPair *aPairs = malloc(sizeof(EntityPair) * length);
+  EntityPair *bPairs = malloc(sizeof(EntityPair) * length);
+  EntityPair *scratch = malloc(sizeof(EntityPair) * length);
+  for (unsigned long i = 0; i < length; i++) {
+    aPairs[i] = toSOEntry(testRandom() % 2000, testRandom() % 4);
+    bPairs[i] = toSOEntry(testRandom() % 6000, testRandom() % 4);
+  }
+  // the top key exercises the run end logic
+  aPairs[0] = bPairs[0] = toSOEntry((EntityId)ENTITY_PAIR_HALF_MASK, 1);
+  radixSortEntityPairs(aPairs, scratch, length);
+  radixSortEntityPairs(bPairs, scratch, length);
+
+  unsigned long *positions = malloc(sizeof(unsigned long) * length);
+  unsigned char levels[] = {SIMD_KERNEL_SCALAR, SIMD_KERNEL_SSE42, SIMD_KERNEL_AVX2};
+  for (int l = 0; l < 3; l++) {
+    setSIMDKernelLevel(levels[l]);
+    assert(simdKernelLevel() <= levels[l]);
+
+    for (int i = 0; i < 500; i++) {
+      unsigned long begin = testRandom() % (length + 1);
+      EntityPair bound = toSOEntry(testRandom() % 2100, testRandom() % 5);
+      assert(lowerBoundEntityPairs(aPairs, begin, length, bound) == gallopEntityPairs(aPairs, begin, length, bound));
+    }
+
+    // positions of a whose subject is somewhere in b, collected in small chunks
+    unsigned long aPosition = 0;
+    unsigned long bPosition = 0;
+    unsigned long found = 0;
+    unsigned long returned;
+    while ((returned = intersectKeyPositions(aPairs, &aPosition, length, bPairs, &bPosition, length, positions + found, 5)) > 0) {
+      found += returned;
+    }
+    unsigned long expected = 0;
+    for (unsigned long i = 0; i < length; i++) {
+      SubjectId subject = subjectIdFromSOEntry(aPairs[i]);
+      unsigned long j = gallopEntityPairs(bPairs, 0, length, toSOEntry(subject, 0));
+      if (j < length && subjectIdFromSOEntry(bPairs[j]) == subject) {
+        assert(expected < found && positions[expected] == i);
+        expected++;
+      }
+    }
+    assert(expected == found);
+
+    // sides of equal size, one much smaller, empty, and shorter than a block
+    unsigned long capacities[] = {1, 5, ITERATOR_BATCH_LENGTH};
+    for (int c = 0; c < 3; c++) {
+      checkMergeKeyPositions(aPairs, length, bPairs, length, capacities[c]);
+      checkMergeKeyPositions(bPairs, length, aPairs, length, capacities[c]);
+      checkMergeKeyPositions(aPairs, length, bPairs + length / 2, length / 50, capacities[c]);
+      checkMergeKeyPositions(aPairs, length, bPairs, 0, capacities[c]);
+      checkMergeKeyPositions(aPairs + 7, 3, bPairs + 9, 2, capacities[c]);
+    }
+    // equal keys runs across block boundaries on both sides
+    checkMergeKeyPositions(aPairs, length, aPairs + 1, length - 1, 7);
+
+    testNextBatch();
+  }
+  setSIMDKernelLevel(SIMD_KERNEL_AVX2);
+
+  free(positions);
+  free(scratch);
+  free(bPairs);
+  free(aPairs);
+}
+
+typedef struct {
+  unsigned long count;
+  unsigned long long checksum;
+} PathJoinResult;
+
+void collectPathJoin(Triple aTriple, Triple bTriple, void *context) {
+  PathJoinResult *result = (PathJoinResult *)context;
+  // a is y q z and b is x p y
+  assert(subjectIdFromTriple(aTriple) == objectIdFromTriple(bTriple));
+  result->count++;
+  result->checksum += (subjectIdFromTriple(bTriple) * 31 + subjectIdFromTriple(aTriple)) * 31 + objectIdFromTriple(aTriple);
+}
+
+void testObjectOrderedIterators() {
+  printf("testObjectOrderedIterators\n");
+
+  PredicateEntry *p = createPredicateEntry(1);
+  PredicateEntry *q = createPredicateEntry(2);
+  PredicateEntry *compressedP = createPredicateEntry(1);
+  unsigned long length = 2000;
+  for (unsigned long i = 0; i < length; i++) {
+    SubjectId subject = testRandom() % 300;
+    ObjectId object = testRandom() % 300;
+    addToPredicateEntry(p, subject, object);
+    addToPredicateEntry(compressedP, subject, object);
+    addToPredicateEntry(q, testRandom() % 300, testRandom() % 300);
+  }
+  optimizePredicateEntry(p);
+  optimizePredicateEntry(q);
+  optimizePredicateEntry(compressedP);
+  compressPredicateEntry(compressedP);
+
+  // object order: sorted by object, then subject
+  PredicateEntry *entries[] = {p, compressedP};
+  for (int e = 0; e < 2; e++) {
+    Iterator *iterator = createPredicateEntryObjectIterator(entries[e]);
+    iterator->init(iterator);
+    unsigned long i = 0;
+    Triple triple;
+    while (!iterator->done(iterator)) {
+      assert(iterator->peekKey(iterator) == objectIdFromTriple(iterator->peek(iterator)));
+      assert(iterate(iterator, &triple));
+      assert(tripleToOSEntry(triple) == p->osEntries[i++]);
+      assert(predicateIdFromTriple(triple) == 1);
+    }
+    assert(i == length);
+    iterator->free(iterator);
+
+    iterator = createPredicateEntryObjectIterator(entries[e]);
+    iterator->init(iterator);
+    iterator->seek(iterator, 150);
+    assert(tripleToOSEntry(iterator->peek(iterator)) == p->osEntries[gallopEntityPairs(p->osEntries, 0, length, toOSEntry(150, 0))]);
+    iterator->free(iterator);
+  }
+
+  // objects of p that are also objects of q
+  Iterator *iterator = createPredicateEntryKeyedANDIterator(p, q, JOIN_ON_OBJECT);
+  iterator->init(iterator);
+  Triple triple;
+  unsigned long count = 0;
+  while (iterate(iterator, &triple)) {
+    assert(predicateIdFromTriple(triple) == 1);
+    unsigned long j = gallopEntityPairs(q->osEntries, 0, length, toOSEntry(objectIdFromTriple(triple), 0));
+    assert(j < length && objectIdFromOSEntry(q->osEntries[j]) == objectIdFromTriple(triple));
+    count++;
+  }
+  assert(count > 0);
+  iterator->free(iterator);
+
+  // ?x p ?y . ?y q ?z as a merge join against a nested loop
+  PathJoinResult expected = {0, 0};
+  for (unsigned long i = 0; i < length; i++) {
+    for (unsigned long j = 0; j < length; j++) {
+      if (objectIdFromSOEntry(p->soEntries[i]) == subjectIdFromSOEntry(q->soEntries[j])) {
+        collectPathJoin(toTripleFromSOEntry(q->soEntries[j], 2), toTripleFromSOEntry(p->soEntries[i], 1), &expected);
+      }
+    }
+  }
+  PathJoinResult result = {0, 0};
+  assert(mergeJoinPredicateEntries(q, p, JOIN_ON_SUBJECT_OBJECT, &collectPathJoin, &result) == expected.count);
+  assert(result.count == expected.count);
+  assert(result.checksum == expected.checksum);
+
+  // the compressed form joins the same way
+  result.count = 0;
+  result.checksum = 0;
+  Iterator *qIterator = createPredicateEntryIterator(q);
+  Iterator *pIterator = createPredicateEntryObjectIterator(compressedP);
+  mergeJoin(qIterator, pIterator, &collectPathJoin, &result);
+  qIterator->free(qIterator);
+  pIterator->free(pIterator);
+  assert(result.count == expected.count);
+  assert(result.checksum == expected.checksum);
+
+  freePredicateEntry(compressedP);
+  freePredicateEntry(q);
+  freePredicateEntry(p);
+}
+
+void corruptTestFile(const char *path, long offset) {
+  FILE *file = fopen(path, "r+b");
+  assert(file != NULL);
+  fseek(file, offset, SEEK_SET);
+  int byte = fgetc(file);
+  fseek(file, offset, SEEK_SET);
+  fputc(byte ^ 0x40, file);
+  fclose(file);
+}
+
+void testSegmentFile() {
+  printf("testSegmentFile\n");
+
+  Segment *segment = createSegment();
+  for (unsigned long i = 0; i < 5000; i++) {
+    addTripleToSegment(segment, toTriple(testRandom() % 1000, 1 + testRandom() % 5, testRandom() % 1000));
+  }
+  addTripleToSegment(segment, toTriple(7, PREDICATE_ID_MAX, 9));
+  optimizeSegment(segment);
+
+  char path[] = "/tmp/cgraph_segment_XXXXXX";
+  int descriptor = mkstemp(path);
+  assert(descriptor >= 0);
+  close(descriptor);
+  assert(writeSegmentFile(segment, path));
+
+  Segment *mapped = openSegmentMapped(path);
+  assert(mapped != NULL);
+  assert(verifySegmentFile(mapped));
+  assert(mapped->tripleCount == segment->tripleCount);
+  assert(mapped->predicateCount == segment->predicateCount);
+  for (unsigned long p = 0; p < segment->predicateCount; p++) {
+    PredicateEntry *entry = getSegmentPredicateEntry(segment, segment->predicates[p]);
+    PredicateEntry *mappedEntry = getSegmentPredicateEntry(mapped, segment->predicates[p]);
+    assert(mapped->predicates[p] == segment->predicates[p]);
+    assert(mappedEntry->entryCount == entry->entryCount);
+    assert(((unsigned long)mappedEntry->soEntries % SEGMENT_FILE_ALIGNMENT) == 0);
+    assert(memcmp(mappedEntry->soEntries, entry->soEntries, sizeof(EntityPair) * entry->entryCount) == 0);
+    assert(memcmp(mappedEntry->osEntries, entry->osEntries, sizeof(EntityPair) * entry->entryCount) == 0);
+  }
+
+  // mapped entries are already sorted, so optimize leaves the read-only mapping alone
+  optimizeSegment(mapped);
+  Iterator *iterator = createPredicateEntryKeyedANDIterator(
+    getSegmentPredicateEntry(mapped, 1), getSegmentPredicateEntry(mapped, 2), JOIN_ON_SUBJECT);
+  Iterator *expected = createPredicateEntryKeyedANDIterator(
+    getSegmentPredicateEntry(segment, 1), getSegmentPredicateEntry(segment, 2), JOIN_ON_SUBJECT);
+  iterator->init(iterator);
+  expected->init(expected);
+  Triple triple;
+  Triple expectedTriple;
+  while (iterate(expected, &expectedTriple)) {
+    assert(iterate(iterator, &triple));
+    assert(triple == expectedTriple);
+  }
+  assert(!iterate(iterator, &triple));
+  iterator->free(iterator);
+  expected->free(expected);
+
+  // compressing a mapped segment copies it out of the mapping
+  compressSegment(mapped);
+  assert(!writeSegmentFile(mapped, path));
+  freeSegment(mapped);
+
+  // a flipped bit in an array opens, but fails verification
+  PredicateEntry *first = getSegmentPredicateEntry(segment, segment->predicates[0]);
+  corruptTestFile(path, 2 * SEGMENT_FILE_ALIGNMENT + sizeof(EntityPair) * (first->entryCount / 2));
+  mapped = openSegmentMapped(path);
+  assert(mapped != NULL);
+  assert(!verifySegmentFile(mapped));
+  freeSegment(mapped);
+
+  // a flipped bit in the header or directory fails the open
+  corruptTestFile(path, 40);
+  assert(openSegmentMapped(path) == NULL);
+  assert(writeSegmentFile(segment, path));
+  corruptTestFile(path, SEGMENT_FILE_ALIGNMENT + 8);
+  assert(openSegmentMapped(path) == NULL);
+
+  unlink(path);
+  freeSegment(segment);
+}
+
+void assertSameSegments(Segment *a, Segment *b) {
+  assert(a->tripleCount == b->tripleCount);
+  assert(a->predicateCount == b->predicateCount);
+  for (unsigned long p = 0; p < a->predicateCount; p++) {
+    PredicateEntry *aEntry = getSegmentPredicateEntry(a, a->predicates[p]);
+    PredicateEntry *bEntry = getSegmentPredicateEntry(b, a->predicates[p]);
+    assert(bEntry != NULL);
+    assert(aEntry->entryCount == bEntry->entryCount);
+    assert(memcmp(aEntry->soEntries, bEntry->soEntries, sizeof(EntityPair) * aEntry->entryCount) == 0);
+    assert(memcmp(aEntry->osEntries, bEntry->osEntries, sizeof(EntityPair) * aEntry->entryCount) == 0);
+  }
+}
+
+void testBulkLoader() {
+  printf("testBulkLoader\n");
+
+  // enough triples that every thread gets a chunk, with one predicate above the parallel sort threshold
+  unsigned long length = 2 * RADIX_SORT_PARALLEL_THRESHOLD;
+  Triple *triples = malloc(sizeof(Triple) * length);
+  Segment *expected = createSegment();
+  for (unsigned long i = 0; i < length; i++) {
+    PredicateId predicate = (i % 3 == 0) ? 1 + testRandom() % 200 : PREDICATE_ID_MAX;
+    triples[i] = toTriple(testRandom() % ((unsigned long long)SUBJECT_ID_MAX + 1), predicate, testRandom() % ((unsigned long long)OBJECT_ID_MAX + 1));
+    addTripleToSegment(expected, triples[i]);
+  }
+  optimizeSegment(expected);
+
+  Segment *segment = bulkLoadTriples(triples, length, 4);
+  assertSameSegments(expected, segment);
+  freeSegment(segment);
+
+  char path[] = "/tmp/cgraph_bulk_XXXXXX";
+  int descriptor = mkstemp(path);
+  assert(descriptor >= 0);
+  FILE *file = fdopen(descriptor, "wb");
+  assert(fwrite(triples, sizeof(Triple), length, file) == length);
+  fclose(file);
+  segment = bulkLoadSegment(path, BULK_LOAD_BINARY, 4);
+  assertSameSegments(expected, segment);
+  freeSegment(segment);
+
+  // the same triples as text, mixing bare and bracketed ids, comments, blank lines and CRLF
+  file = fopen(path, "w");
+  fprintf(file, "# integer N-Triples\n\n");
+  for (unsigned long i = 0; i < length; i++) {
+    if (i % 2 == 0) {
+      fprintf(file, "<%llu> <%llu> <%llu> .\n", (unsigned long long)subjectIdFromTriple(triples[i]), (unsigned long long)predicateIdFromTriple(triples[i]), (unsigned long long)objectIdFromTriple(triples[i]));
+    } else {
+      fprintf(file, "%llu\t%llu %llu .\r\n", (unsigned long long)subjectIdFromTriple(triples[i]), (unsigned long long)predicateIdFromTriple(triples[i]), (unsigned long long)objectIdFromTriple(triples[i]));
+    }
+  }
+  fclose(file);
+  segment = bulkLoadSegment(path, BULK_LOAD_NTRIPLES, 4);
+  assertSameSegments(expected, segment);
+  freeSegment(segment);
+  segment = bulkLoadSegment(path, BULK_LOAD_NTRIPLES, 1);
+  assertSameSegments(expected, segment);
+  freeSegment(segment);
+
+  // malformed lines and ids wider than the layout are rejected
+  const char *malformed[] = {"1 2 .\n", "1 2 3 4 .\n", "<1 2 3 .\n", "1 2 99999999999999999 .\n"};
+  for (int i = 0; i < 4; i++) {
+    file = fopen(path, "w");
+    fprintf(file, "1 2 3 .\n%s", malformed[i]);
+    fclose(file);
+    assert(bulkLoadSegment(path, BULK_LOAD_NTRIPLES, 1) == NULL);
+  }
+
+  unlink(path);
+  assert(bulkLoadSegment(path, BULK_LOAD_BINARY, 1) == NULL);
+
+  free(triples);
+  freeSegment(expected);
+}
+
+void testDictionary() {
+  printf("testDictionary\n");
+
+  // shared prefixes exercise front coding; the empty term and a prefix of another term are edge cases
+  unsigned long length = 5000;
+  char (*terms)[64] = malloc(sizeof(*terms) * length);
+  DictionaryBuilder *builder = createDictionaryBuilder();
+  for (unsigned long i = 0; i < length; i++) {
+    snprintf(terms[i], sizeof(terms[i]), "http://example.org/%s/%lu", (i % 3 == 0) ? "person" : "place", (unsigned long)(testRandom() % 3000));
+    addDictionaryBuilderTerm(builder, terms[i], strlen(terms[i]));
+  }
+  addDictionaryBuilderTerm(builder, "", 0);
+  addDictionaryBuilderTerm(builder, "http://example.org/", strlen("http://example.org/"));
+  Dictionary *dictionary = buildDictionary(builder);
+  freeDictionaryBuilder(builder);
+
+  assert(dictionary->termCount < length + 2);
+  assert(encodeDictionaryTerm(dictionary, "", 0) == 0);
+  assert(encodeDictionaryTerm(dictionary, "http://example.org/", strlen("http://example.org/")) == 1);
+  assert(encodeDictionaryTerm(dictionary, "http://example.org/person", strlen("http://example.org/person")) == DICTIONARY_MISSING_ID);
+  assert(encodeDictionaryTerm(dictionary, "http://example.org/place/30000", strlen("http://example.org/place/30000")) == DICTIONARY_MISSING_ID);
+
+  Dictionary *mapped = NULL;
+  char path[] = "/tmp/cgraph_dictionary_XXXXXX";
+  int descriptor = mkstemp(path);
+  assert(descriptor >= 0);
+  close(descriptor);
+  assert(saveDictionary(dictionary, path));
+  mapped = openDictionaryMapped(path);
+  assert(mapped != NULL);
+
+  Dictionary *dictionaries[] = {dictionary, mapped};
+  for (int d = 0; d < 2; d++) {
+    Dictionary *current = dictionaries[d];
+    char buffer[64];
+    char previous[64] = "";
+    // ids are ranks, so decoding in id order yields strictly increasing terms
+    for (unsigned int id = 0; id < current->termCount; id++) {
+      unsigned long termLength = decodeDictionaryTerm(current, id, buffer, sizeof(buffer));
+      assert(termLength <= current->maxTermLength);
+      buffer[termLength] = '\0';
+      assert(id == 0 || strcmp(previous, buffer) < 0);
+      assert(encodeDictionaryTerm(current, buffer, termLength) == id);
+      strcpy(previous, buffer);
+    }
+
+    // a short buffer receives the term's prefix and the full length
+    unsigned int id = encodeDictionaryTerm(current, terms[0], strlen(terms[0]));
+    assert(decodeDictionaryTerm(current, id, buffer, 10) == strlen(terms[0]));
+    assert(memcmp(buffer, terms[0], 10) == 0);
+
+    const char **termPointers = malloc(sizeof(char *) * length);
+    unsigned long *lengths = malloc(sizeof(unsigned long) * length);
+    unsigned int *ids = malloc(sizeof(unsigned int) * length);
+    for (unsigned long i = 0; i < length; i++) {
+      termPointers[i] = terms[i];
+      lengths[i] = strlen(terms[i]);
+    }
+    encodeDictionaryTerms(current, termPointers, lengths, length, ids);
+
+    unsigned long *offsets = malloc(sizeof(unsigned long) * (length + 1));
+    unsigned long needed = decodeDictionaryTerms(current, ids, length, NULL, 0, offsets);
+    char *decoded = malloc(needed);
+    assert(decodeDictionaryTerms(current, ids, length, decoded, needed, offsets) == needed);
+    for (unsigned long i = 0; i < length; i++) {
+      assert(ids[i] == encodeDictionaryTerm(current, terms[i], lengths[i]));
+      assert(offsets[i + 1] - offsets[i] == lengths[i]);
+      assert(memcmp(decoded + offsets[i], terms[i], lengths[i]) == 0);
+    }
+    free(decoded);
+    free(offsets);
+    free(ids);
+    free(lengths);
+    free(termPointers);
+  }
+  freeDictionary(mapped);
+
+  corruptTestFile(path, 20);
+  assert(openDictionaryMapped(path) == NULL);
+  unlink(path);
+
+  freeDictionary(dictionary);
+  free(terms);
+}
+
+typedef struct {
+  Triple *triples;
+  unsigned long count;
+  // per worker, since unordered callbacks run concurrently
+  unsigned long long checksums[16];
+} MorselTestResult;
+
+void collectMorselTriples(int threadIndex, const Triple *triples, unsigned long count, void *context) {
+  MorselTestResult *result = (MorselTestResult *)context;
+  for (unsigned long i = 0; i < count; i++) {
+    result->checksums[threadIndex] += (unsigned long long)triples[i] * 0x9E3779B97F4A7C15ULL;
+  }
+  if (result->triples != NULL) {
+    memcpy(result->triples + result->count, triples, sizeof(Triple) * count);
+    result->count += count;
+  }
+}
+
+void checkMorselExecution(Iterator *iterator, MorselOptions *options) {
+  Triple *expected = malloc(sizeof(Triple) * 100000);
+  Iterator *sequential = iterator->clone(iterator);
+  sequential->init(sequential);
+  unsigned long expectedCount = 0;
+  unsigned long long expectedChecksum = 0;
+  Triple triple;
+  while (iterate(sequential, &triple)) {
+    expectedChecksum += (unsigned long long)triple * 0x9E3779B97F4A7C15ULL;
+    expected[expectedCount++] = triple;
+  }
+  sequential->free(sequential);
+
+  // ordered: the exact sequence of the single-threaded run
+  MorselTestResult result;
+  memset(&result, 0, sizeof(result));
+  result.triples = malloc(sizeof(Triple) * (expectedCount + 1));
+  options->ordered = TRUE;
+  assert(executeMorsels(iterator, options, &collectMorselTriples, &result) == expectedCount);
+  assert(result.count == expectedCount);
+  assert(memcmp(result.triples, expected, sizeof(Triple) * expectedCount) == 0);
+  free(result.triples);
+
+  // unordered: the same multiset
+  memset(&result, 0, sizeof(result));
+  options->ordered = FALSE;
+  assert(executeMorsels(iterator, options, &collectMorselTriples, &result) == expectedCount);
+  unsigned long long checksum = 0;
+  for (int t = 0; t < 16; t++) {
+    checksum += result.checksums[t];
+  }
+  assert(checksum == expectedChecksum);
+
+  assert(executeMorsels(iterator, options, NULL, NULL) == expectedCount);
+  free(expected);
+}
+
+void testMorselExecutor() {
+  printf("testMorselExecutor\n");
+
+  PredicateEntry *p = createPredicateEntry(1);
+  PredicateEntry *q = createPredicateEntry(2);
+  PredicateEntry *compressedQ = createPredicateEntry(2);
+  unsigned long length = 20000;
+  for (unsigned long i = 0; i < length; i++) {
+    // a heavy subject bigger than a morsel, so partition bounds repeat
+    SubjectId subject = (i % 5 == 0) ? 77 : testRandom() % 4000;
+    addToPredicateEntry(p, subject, testRandom() % 4000);
+    SubjectId qSubject = testRandom() % 4000;
+    ObjectId qObject = testRandom() % 4000;
+    addToPredicateEntry(q, qSubject, qObject);
+    addToPredicateEntry(compressedQ, qSubject, qObject);
+  }
+  optimizePredicateEntry(p);
+  optimizePredicateEntry(q);
+  optimizePredicateEntry(compressedQ);
+  compressPredicateEntry(compressedQ);
+
+  MorselOptions options;
+  initMorselOptions(&options);
+  options.threadCount = 4;
+  options.morselCount = 37;
+
+  Iterator *iterators[] = {
+    createPredicateEntryIterator(p),
+    createPredicateEntryANDIterator(createPredicateEntryIterator(p), createPredicateEntryIterator(compressedQ)),
+    createPredicateEntryORIterator(createPredicateEntryIterator(p), createPredicateEntryIterator(q)),
+  };
+  for (int i = 0; i < 3; i++) {
+    options.partitionEntry = NULL;
+    checkMorselExecution(iterators[i], &options);
+    options.partitionEntry = p;
+    checkMorselExecution(iterators[i], &options);
+    options.partitionEntry = compressedQ;
+    checkMorselExecution(iterators[i], &options);
+    iterators[i]->free(iterators[i]);
+  }
+
+  Iterator *inputs[] = {createPredicateEntryIterator(p), createPredicateEntryIterator(q), createPredicateEntryIterator(compressedQ)};
+  Iterator *leapfrog = createLeapfrogJoinIterator(inputs, 3);
+  options.partitionEntry = q;
+  checkMorselExecution(leapfrog, &options);
+  leapfrog->free(leapfrog);
+
+  // keyed on objects, with more threads than morsels
+  Iterator *objects = createPredicateEntryKeyedANDIterator(p, q, JOIN_ON_OBJECT);
+  options.order = OBJECT_ORDER;
+  options.partitionEntry = p;
+  options.morselCount = 3;
+  options.threadCount = 8;
+  checkMorselExecution(objects, &options);
+  options.threadCount = 1;
+  checkMorselExecution(objects, &options);
+  objects->free(objects);
+
+  // bounds are sampled from the sorted base once the partition entry's delta and tail are prepared
+  for (unsigned long i = 0; i < length / 20; i++) {
+    addToPredicateEntry(p, testRandom() % 4000, testRandom() % 4000);
+  }
+  preparePredicateEntryForReading(p);
+  addToPredicateEntry(p, 3999, 1);
+  addToPredicateEntry(p, 0, 1);
+  assert(p->deltaSortedCount > 0 && predicateEntryUnsortedCount(p) > p->deltaSortedCount);
+  Iterator *updated = createPredicateEntryIterator(p);
+  options.order = SUBJECT_ORDER;
+  options.partitionEntry = p;
+  options.morselCount = 37;
+  options.threadCount = 4;
+  checkMorselExecution(updated, &options);
+  assert(predicateEntryUnsortedCount(p) == p->deltaSortedCount);
+  updated->free(updated);
+
+  freePredicateEntry(compressedQ);
+  freePredicateEntry(q);
+  freePredicateEntry(p);
+}
+
+void testArena() {
+  printf("testArena\n");
+
+  Arena *arena = createArena(256);
+  unsigned char *previous = NULL;
+  for (int i = 0; i < 100; i++) {
+    unsigned char *allocation = arenaAllocate(arena, 1 + i % 40);
+    assert((unsigned long)allocation % ARENA_ALIGNMENT == 0);
+    memset(allocation, i, 1 + i % 40);
+    previous = allocation;
+  }
+  assert(previous[0] == 99);
+  unsigned char *large = arenaAllocate(arena, 10000);
+  memset(large, 1, 10000);
+  assert(arenaMemoryUsage(arena) > 10000);
+  resetArena(arena);
+  assert(arenaMemoryUsage(arena) < 1000);
+  freeArena(arena);
+
+  SlabPool pool;
+  initSlabPool(&pool, 24, 4);
+  void *items[10];
+  for (int i = 0; i < 10; i++) {
+    items[i] = slabAllocate(&pool);
+    assert((unsigned long)items[i] % ARENA_ALIGNMENT == 0);
+    memset(items[i], 0xFF, 24);
+  }
+  assert(pool.slabCount == 3);
+  slabFree(&pool, items[3]);
+  assert(slabAllocate(&pool) == items[3]);
+  destroySlabPool(&pool);
+
+  // iterator trees built in an arena behave exactly like their heap clones
+  PredicateEntry *p = createPredicateEntry(1);
+  PredicateEntry *q = createPredicateEntry(2);
+  for (int i = 0; i < 5000; i++) {
+    addToPredicateEntry(p, testRandom() % 1000, testRandom() % 1000);
+    addToPredicateEntry(q, testRandom() % 1000, testRandom() % 1000);
+  }
+  optimizePredicateEntry(p);
+  optimizePredicateEntry(q);
+
+  arena = createArena(0);
+  for (int round = 0; round < 3; round++) {
+    Iterator *inputs[] = {createPredicateEntryIteratorInArena(arena, q), createPredicateEntryIteratorInArena(arena, p)};
+    Iterator *tree = createPredicateEntryORIteratorInArena(arena,
+      createPredicateEntryANDIteratorInArena(arena, createPredicateEntryIteratorInArena(arena, p), createPredicateEntryIteratorInArena(arena, q)),
+      createLeapfrogJoinIteratorInArena(arena, inputs, 2));
+    // the whole tree shares one chunk
+    assert(arenaMemoryUsage(arena) == sizeof(Arena) + ARENA_DEFAULT_CHUNK_LENGTH + 2 * sizeof(void *));
+
+    Iterator *clone = tree->clone(tree);
+    tree->init(tree);
+    clone->init(clone);
+    Triple triple;
+    Triple cloneTriple;
+    while (iterate(tree, &triple)) {
+      assert(iterate(clone, &cloneTriple));
+      assert(triple == cloneTriple);
+    }
+    assert(!iterate(clone, &cloneTriple));
+    clone->free(clone);
+    tree->free(tree);
+    resetArena(arena);
+  }
+  freeArena(arena);
+
+  freePredicateEntry(q);
+  freePredicateEntry(p);
+}
+
+// one reference byte per id in [0, SUBJECT_BITMAP_TEST_RANGE)
+#define SUBJECT_BITMAP_TEST_RANGE 300000
+
+SubjectBitmap *createTestSubjectBitmap(unsigned char *present, int dense) {
+  SubjectBitmap *bitmap = createSubjectBitmap();
+  for (unsigned long id = 0; id < SUBJECT_BITMAP_TEST_RANGE; id++) {
+    // the first two containers dense enough for words, the rest arrays or empty
+    unsigned long percent = (id < 131072) ? (unsigned long)dense : (id < 200000 ? 2 : 0);
+    present[id] = testRandom() % 100 < percent;
+    if (present[id]) {
+      appendSubjectBitmap(bitmap, id);
+      // repeats are ignored
+      appendSubjectBitmap(bitmap, id);
+    }
+  }
+  return bitmap;
+}
+
+void checkSubjectBitmap(SubjectBitmap *bitmap, unsigned char *present) {
+  unsigned long long cardinality = 0;
+  for (unsigned long id = 0; id < SUBJECT_BITMAP_TEST_RANGE; id++) {
+    assert(subjectBitmapContains(bitmap, id) == present[id]);
+    cardinality += present[id];
+  }
+  assert(bitmap->cardinality == cardinality);
+  assert(!subjectBitmapContains(bitmap, SUBJECT_BITMAP_TEST_RANGE + 70000));
+
+  EntityId *ids = malloc(sizeof(EntityId) * (cardinality + 1));
+  subjectBitmapToArray(bitmap, ids);
+  unsigned long long count = 0;
+  for (unsigned long id = 0; id < SUBJECT_BITMAP_TEST_RANGE; id++) {
+    if (present[id]) {
+      assert(ids[count++] == id);
+    }
+  }
+  free(ids);
+
+  for (int i = 0; i < 2000; i++) {
+    EntityId target = testRandom() % SUBJECT_BITMAP_TEST_RANGE;
+    EntityId expected = target;
+    while (expected < SUBJECT_BITMAP_TEST_RANGE && !present[expected]) {
+      expected++;
+    }
+    EntityId next;
+    BOOL found = nextSubjectBitmapId(bitmap, target, &next);
+    assert(found == (expected < SUBJECT_BITMAP_TEST_RANGE));
+    assert(!found || next == expected);
+  }
+}
+
+void testSubjectBitmap() {
+  printf("testSubjectBitmap\n");
+
+  unsigned char *aPresent = malloc(SUBJECT_BITMAP_TEST_RANGE);
+  unsigned char *bPresent = malloc(SUBJECT_BITMAP_TEST_RANGE);
+  unsigned char *expected = malloc(SUBJECT_BITMAP_TEST_RANGE);
+  SubjectBitmap *a = createTestSubjectBitmap(aPresent, 60);
+  SubjectBitmap *b = createTestSubjectBitmap(bPresent, 5);
+  checkSubjectBitmap(a, aPresent);
+  checkSubjectBitmap(b, bPresent);
+  // dense containers cost a bit per id, sparse ones two bytes per member
+  assert(subjectBitmapMemoryUsage(a) < SUBJECT_BITMAP_TEST_RANGE);
+
+  // every mix of word and array containers
+  SubjectBitmap *pairs[][2] = {{a, a}, {a, b}, {b, a}, {b, b}};
+  unsigned char *presents[][2] = {{aPresent, aPresent}, {aPresent, bPresent}, {bPresent, aPresent}, {bPresent, bPresent}};
+  for (int pair = 0; pair < 4; pair++) {
+    SubjectBitmap *x = pairs[pair][0];
+    SubjectBitmap *y = pairs[pair][1];
+    unsigned char *xPresent = presents[pair][0];
+    unsigned char *yPresent = presents[pair][1];
+
+    unsigned long long expectedCardinality = 0;
+    for (unsigned long id = 0; id < SUBJECT_BITMAP_TEST_RANGE; id++) {
+      expected[id] = xPresent[id] && yPresent[id];
+      expectedCardinality += expected[id];
+    }
+    SubjectBitmap *intersection = andSubjectBitmaps(x, y);
+    checkSubjectBitmap(intersection, expected);
+    assert(andSubjectBitmapsCardinality(x, y) == expectedCardinality);
+    freeSubjectBitmap(intersection);
+
+    for (int i = 0; i < 2000; i++) {
+      EntityId target = testRandom() % SUBJECT_BITMAP_TEST_RANGE;
+      EntityId common = target;
+      while (common < SUBJECT_BITMAP_TEST_RANGE && !expected[common]) {
+        common++;
+      }
+      EntityId next;
+      BOOL found = nextCommonSubjectBitmapId(x, y, target, &next);
+      assert(found == (common < SUBJECT_BITMAP_TEST_RANGE));
+      assert(!found || next == common);
+    }
+
+    for (unsigned long id = 0; id < SUBJECT_BITMAP_TEST_RANGE; id++) {
+      expected[id] = xPresent[id] || yPresent[id];
+    }
+    SubjectBitmap *merged = orSubjectBitmaps(x, y);
+    checkSubjectBitmap(merged, expected);
+    freeSubjectBitmap(merged);
+  }
+  freeSubjectBitmap(b);
+  freeSubjectBitmap(a);
+  free(expected);
+  free(bPresent);
+  free(aPresent);
+
+  // AND iterators over entries with bitmaps give the same triples as without
+  PredicateEntry *dense = createPredicateEntry(1);
+  PredicateEntry *sparse = createPredicateEntry(2);
+  PredicateEntry *compressedDense = createPredicateEntry(3);
+  for (int i = 0; i < 60000; i++) {
+    SubjectId subject = testRandom() % 80000;
+    ObjectId object = testRandom() % 5;
+    addToPredicateEntry(dense, subject, object);
+    addToPredicateEntry(compressedDense, subject, object);
+    addToPredicateEntry(sparse, testRandom() % 80000 * 70, testRandom() % 100);
+  }
+  optimizePredicateEntry(sparse);
+  optimizePredicateEntry(compressedDense);
+  compressPredicateEntry(compressedDense);
+  OptimizeOptions options;
+  initOptimizeOptions(&options);
+  optimizePredicateEntryWithOptions(dense, &options);
+  assert(dense->subjectBitmap != NULL);
+  optimizePredicateEntryWithOptions(sparse, &options);
+  assert(sparse->subjectBitmap == NULL);
+
+  PredicateEntry *shapes[][2] = {
+    {sparse, dense}, {dense, dense}, {dense, sparse}, {compressedDense, dense}, {dense, compressedDense}, {sparse, compressedDense}};
+  Triple *withBitmaps = malloc(sizeof(Triple) * 200000);
+  Triple *withoutBitmaps = malloc(sizeof(Triple) * 200000);
+  Triple *batch = malloc(sizeof(Triple) * 200000);
+  Triple *iterated = malloc(sizeof(Triple) * 200000);
+  for (int shape = 0; shape < 6; shape++) {
+    unsigned long counts[2];
+    for (int withBitmap = 0; withBitmap < 2; withBitmap++) {
+      if (withBitmap) {
+        buildPredicateEntrySubjectBitmap(dense, 0);
+        buildPredicateEntrySubjectBitmap(sparse, 0);
+        buildPredicateEntrySubjectBitmap(compressedDense, 0);
+      }
+      Iterator *iterator = createPredicateEntryANDIterator(
+        createPredicateEntryIterator(shapes[shape][0]), createPredicateEntryIterator(shapes[shape][1]));
+      iterator->init(iterator);
+      unsigned long count = 0;
+      Triple *triples = withBitmap ? withBitmaps : withoutBitmaps;
+      while (iterate(iterator, &triples[count])) {
+        count++;
+        // seek past every 100th key
+        if (count % 100 == 0 && !iterator->done(iterator)) {
+          iterator->seek(iterator, iterator->peekKey(iterator) + 1);
+        }
+      }
+      iterator->free(iterator);
+      counts[withBitmap] = count;
+      if (withBitmap) {
+        assert(counts[0] == counts[1]);
+        assert(memcmp(withBitmaps, withoutBitmaps, sizeof(Triple) * count) == 0);
+      }
+
+      iterator = createPredicateEntryANDIterator(
+        createPredicateEntryIterator(shapes[shape][0]), createPredicateEntryIterator(shapes[shape][1]));
+      iterator->init(iterator);
+      unsigned long batchCount = 0;
+      unsigned long returned;
+      while ((returned = nextBatch(iterator, batch + batchCount, 777)) > 0) {
+        batchCount += returned;
+      }
+      iterator->free(iterator);
+      iterator = createPredicateEntryANDIterator(
+        createPredicateEntryIterator(shapes[shape][0]), createPredicateEntryIterator(shapes[shape][1]));
+      iterator->init(iterator);
+      unsigned long iteratedCount = 0;
+      while (iterate(iterator, &iterated[iteratedCount])) {
+        iteratedCount++;
+      }
+      iterator->free(iterator);
+      assert(batchCount == iteratedCount && batchCount > 0);
+      assert(memcmp(batch, iterated, sizeof(Triple) * batchCount) == 0);
+    }
+    freeSubjectBitmap(dense->subjectBitmap);
+    dense->subjectBitmap = NULL;
+    freeSubjectBitmap(sparse->subjectBitmap);
+    sparse->subjectBitmap = NULL;
+    freeSubjectBitmap(compressedDense->subjectBitmap);
+    compressedDense->subjectBitmap = NULL;
+  }
+  Segment *segment = createSegment();
+  for (int i = 0; i < 1000; i++) {
+    addTripleToSegment(segment, toTriple(i, 1, i % 3));
+    addTripleToSegment(segment, toTriple(i * 1000, 2, i % 3));
+  }
+  optimizeSegmentWithOptions(segment, &options);
+  assert(getSegmentPredicateEntry(segment, 1)->subjectBitmap->cardinality == 1000);
+  assert(getSegmentPredicateEntry(segment, 2)->subjectBitmap == NULL);
+  freeSegment(segment);
+
+  // adding drops the bitmap, which would no longer match
+  buildPredicateEntrySubjectBitmap(sparse, 0);
+  addToPredicateEntry(sparse, 1, 1);
+  assert(sparse->subjectBitmap == NULL);
+
+  free(iterated);
+  free(batch);
+  free(withoutBitmaps);
+  free(withBitmaps);
+  freePredicateEntry(compressedDense);
+  freePredicateEntry(sparse);
+  freePredicateEntry(dense);
+}
+
+void checkPointLookups(PredicateEntry *entry, EntityPair *soPairs, unsigned long count, EntityId range) {
+  ObjectId *neighbors = malloc(sizeof(ObjectId) * (count + 1));
+  for (int i = 0; i < 20000; i++) {
+    SubjectId subject;
+    ObjectId object;
+    if (i % 2 == 0) {
+      // present
+      EntityPair pair = soPairs[testRandom() % count];
+      subject = subjectIdFromSOEntry(pair);
+      object = objectIdFromSOEntry(pair);
+    } else {
+      subject = testRandom() % range;
+      object = testRandom() % range;
+    }
+    EntityPair pair = toSOEntry(subject, object);
+    BOOL expected = bsearch(&pair, soPairs, count, sizeof(EntityPair), compareEntityPairs) != NULL;
+    assert(predicateEntryHasPair(entry, subject, object) == expected);
+
+    // the subject's objects are the run of pairs starting at it
+    unsigned long begin = 0;
+    while (begin < count && subjectIdFromSOEntry(soPairs[begin]) < subject) {
+      begin++;
+    }
+    unsigned long expectedCount = 0;
+    while (begin + expectedCount < count && subjectIdFromSOEntry(soPairs[begin + expectedCount]) == subject) {
+      expectedCount++;
+    }
+    unsigned long capacity = (i % 3 == 0) ? 1 : count;
+    unsigned long found = lookupPredicateEntrySubject(entry, subject, neighbors, capacity);
+    assert(found == expectedCount);
+    for (unsigned long n = 0; n < found && n < capacity; n++) {
+      assert(neighbors[n] == objectIdFromSOEntry(soPairs[begin + n]));
+    }
+
+    // every object found through lookupObject has the subject among its subjects
+    if (expectedCount > 0) {
+      ObjectId neighbor = objectIdFromSOEntry(soPairs[begin]);
+      found = lookupPredicateEntryObject(entry, neighbor, neighbors, count);
+      BOOL seen = FALSE;
+      for (unsigned long n = 0; n < found; n++) {
+        assert(n == 0 || neighbors[n - 1] <= neighbors[n]);
+        seen |= neighbors[n] == subject;
+      }
+      assert(seen);
+    }
+  }
+  free(neighbors);
+}
+
+void testPointLookups() {
+  printf("testPointLookups\n");
+
+  // evenly spread subjects suit interpolation, clustered ones make it fall back to halving
+  for (int shape = 0; shape < 2; shape++) {
+    PredicateEntry *entry = createPredicateEntry(1);
+    PredicateEntry *compressed = createPredicateEntry(1);
+    // never optimized, and optimized with a delta and a tail added after
+    PredicateEntry *unoptimized = createPredicateEntry(1);
+    PredicateEntry *incremental = createPredicateEntry(1);
+    unsigned long count = 20000;
+    EntityId range = 50000;
+    for (unsigned long i = 0; i < count; i++) {
+      SubjectId subject = testRandom() % range;
+      if (shape == 1) {
+        subject = (i % 10 == 0) ? subject : subject % 100;
+      }
+      ObjectId object = testRandom() % range;
+      addToPredicateEntry(entry, subject, object);
+      addToPredicateEntry(compressed, subject, object);
+      addToPredicateEntry(unoptimized, subject, object);
+      addToPredicateEntry(incremental, subject, object);
+      if (i == count - 2000 - 1) {
+        optimizePredicateEntry(incremental);
+      } else if (i == count - 1000 - 1) {
+        preparePredicateEntryForReading(incremental);
+        assert(incremental->deltaSortedCount == 1000);
+      }
+    }
+    assert(unoptimized->sortedCount == 0 && predicateEntryUnsortedCount(incremental) == 2000);
+    optimizePredicateEntry(entry);
+    optimizePredicateEntry(compressed);
+    EntityPair *soPairs = malloc(sizeof(EntityPair) * count);
+    memcpy(soPairs, entry->soEntries, sizeof(EntityPair) * count);
+    compressPredicateEntry(compressed);
+
+    checkPointLookups(entry, soPairs, count, range);
+    checkPointLookups(compressed, soPairs, count, range);
+    checkPointLookups(unoptimized, soPairs, count, range);
+    checkPointLookups(incremental, soPairs, count, range);
+    buildPredicateEntryBloomFilter(entry, BLOOM_FILTER_DEFAULT_BITS_PER_KEY);
+    buildPredicateEntryBloomFilter(compressed, BLOOM_FILTER_DEFAULT_BITS_PER_KEY);
+    checkPointLookups(entry, soPairs, count, range);
+    checkPointLookups(compressed, soPairs, count, range);
+
+    unsigned long falsePositives = 0;
+    unsigned long absent = 0;
+    for (int i = 0; i < 100000; i++) {
+      SubjectId subject = range + testRandom() % range;
+      absent++;
+      falsePositives += bloomFilterMayContainHash(entry->bloomFilter, bloomFilterHashPair(subject, testRandom() % range));
+    }
+    assert(falsePositives < absent / 50);
+
+    free(soPairs);
+    freePredicateEntry(incremental);
+    freePredicateEntry(unoptimized);
+    freePredicateEntry(compressed);
+    freePredicateEntry(entry);
+  }
+
+  Segment *segment = createSegment();
+  for (int i = 0; i < 100; i++) {
+    addTripleToSegment(segment, toTriple(i, 3, i * 2));
+  }
+  OptimizeOptions options;
+  initOptimizeOptions(&options);
+  options.buildBloomFilters = TRUE;
+  optimizeSegmentWithOptions(segment, &options);
+  assert(getSegmentPredicateEntry(segment, 3)->bloomFilter != NULL);
+  assert(hasTriple(segment, 7, 3, 14));
+  assert(!hasTriple(segment, 7, 3, 15));
+  assert(!hasTriple(segment, 7, 4, 14));
+  ObjectId objects[4];
+  assert(lookupSubject(segment, 3, 9, objects, 4) == 1 && objects[0] == 18);
+  assert(lookupSubject(segment, 3, 100, objects, 4) == 0);
+  assert(lookupObject(segment, 3, 18, objects, 4) == 1 && objects[0] == 9);
+  assert(lookupObject(segment, 5, 18, objects, 4) == 0);
+  freeSegment(segment);
+
+  // lookups on a segment that was never optimized sort the entry first
+  segment = createSegment();
+  for (int i = 100; i > 0; i--) {
+    addTripleToSegment(segment, toTriple(i, 3, i * 2));
+  }
+  assert(hasTriple(segment, 7, 3, 14));
+  assert(!hasTriple(segment, 7, 3, 15));
+  assert(lookupSubject(segment, 3, 9, objects, 4) == 1 && objects[0] == 18);
+  assert(lookupObject(segment, 3, 18, objects, 4) == 1 && objects[0] == 9);
+  freeSegment(segment);
+}
+
+// drains an ordered iterator over entry through nextBatch and checks it against the sorted pairs
+void checkIncrementalIteration(Iterator *iterator, EntityPair *sorted, unsigned long count, PredicateId predicate, unsigned char order) {
+  Triple *batch = malloc(sizeof(Triple) * 100);
+  unsigned long seen = 0;
+  iterator->init(iterator);
+  for (;;) {
+    unsigned long found = nextBatch(iterator, batch, 100);
+    if (found == 0) {
+      break;
+    }
+    for (unsigned long i = 0; i < found; i++) {
+      Triple expected = (order == SUBJECT_ORDER) ? toTripleFromSOEntry(sorted[seen + i], predicate) : toTripleFromOSEntry(sorted[seen + i], predicate);
+      assert(batch[i] == expected);
+    }
+    seen += found;
+  }
+  assert(seen == count);
+  assert(iterator->done(iterator));
+  free(batch);
+}
+
+void testIncrementalOptimize() {
+  printf("testIncrementalOptimize\n");
+
+  EntityPair a[] = {1, 4, 6, 9, 2, 3, 7};
+  EntityPair scratch[8];
+  mergeEntityPairRuns(a, 4, 7, scratch);
+  for (int i = 1; i < 7; i++) {
+    assert(a[i - 1] <= a[i]);
+  }
+
+  EntityId range = 5000;
+  unsigned long capacity = 20000;
+  EntityPair *soPairs = malloc(sizeof(EntityPair) * capacity);
+  EntityPair *osPairs = malloc(sizeof(EntityPair) * capacity);
+  EntityPair *soSorted = malloc(sizeof(EntityPair) * capacity);
+  EntityPair *osSorted = malloc(sizeof(EntityPair) * capacity);
+  unsigned long count = 0;
+
+  PredicateEntry *entry = createPredicateEntry(2);
+  for (; count < 4000; count++) {
+    SubjectId subject = testRandom() % range;
+    ObjectId object = testRandom() % range;
+    addToPredicateEntry(entry, subject, object);
+    soPairs[count] = toSOEntry(subject, object);
+    osPairs[count] = toOSEntry(object, subject);
+  }
+  optimizePredicateEntry(entry);
+  assert(entry->sortedCount == count && entry->deltaSortedCount == 0);
+
+  for (int round = 0; round < 24; round++) {
+    // mostly trickles that stay in the delta, now and then one big enough to force a merge
+    unsigned long batchLength = (round % 8 == 7) ? 1500 : 1 + testRandom() % 60;
+    for (unsigned long i = 0; i < batchLength; i++, count++) {
+      SubjectId subject = testRandom() % range;
+      ObjectId object = testRandom() % range;
+      addToPredicateEntry(entry, subject, object);
+      soPairs[count] = toSOEntry(subject, object);
+      osPairs[count] = toOSEntry(object, subject);
+    }
+    memcpy(soSorted, soPairs, sizeof(EntityPair) * count);
+    memcpy(osSorted, osPairs, sizeof(EntityPair) * count);
+    qsort(soSorted, count, sizeof(EntityPair), compareEntityPairs);
+    qsort(osSorted, count, sizeof(EntityPair), compareEntityPairs);
+
+    unsigned long pending = predicateEntryUnsortedCount(entry);
+    BOOL merges = pending * PREDICATE_ENTRY_DELTA_MERGE_RATIO > entry->sortedCount;
+    Iterator *subjects = createPredicateEntryOrderedIterator(entry, SUBJECT_ORDER);
+    Iterator *objects = createPredicateEntryObjectIterator(entry);
+    assert(subjects->TYPE == (merges ? ENTRY_ITERATOR : MERGED_ENTRY_ITERATOR));
+    assert(entry->sortedCount + entry->deltaSortedCount == count);
+    checkIncrementalIteration(subjects, soSorted, count, 2, SUBJECT_ORDER);
+    checkIncrementalIteration(objects, osSorted, count, 2, OBJECT_ORDER);
+
+    // seeks land on the first pair of the target key or after, in either run
+    Iterator *clone = subjects->clone(subjects);
+    clone->init(clone);
+    EntityId target = 0;
+    unsigned long expected = 0;
+    while (!clone->done(clone)) {
+      target += testRandom() % 300;
+      clone->seek(clone, target);
+      while (expected < count && subjectIdFromSOEntry(soSorted[expected]) < target) {
+        expected++;
+      }
+      if (expected == count) {
+        assert(clone->done(clone));
+        break;
+      }
+      assert(clone->peekKey(clone) == subjectIdFromSOEntry(soSorted[expected]));
+      assert(clone->peek(clone) == toTripleFromSOEntry(soSorted[expected], 2));
+      clone->advance(clone);
+      expected++;
+    }
+    clone->free(clone);
+    checkPointLookups(entry, soSorted, count, range);
+
+    subjects->free(subjects);
+    objects->free(objects);
+
+    if (round % 5 == 4) {
+      optimizePredicateEntry(entry);
+      assert(entry->sortedCount == count && predicateEntryUnsortedCount(entry) == 0);
+      assert(memcmp(entry->soEntries, soSorted, sizeof(EntityPair) * count) == 0);
+      assert(memcmp(entry->osEntries, osSorted, sizeof(EntityPair) * count) == 0);
+    }
+  }
+  freePredicateEntry(entry);
+
+  // a never optimized entry keeps iterating in insertion order
+  entry = createPredicateEntry(2);
+  addToPredicateEntry(entry, 5, 1);
+  addToPredicateEntry(entry, 3, 1);
+  Iterator *iterator = createPredicateEntryIterator(entry);
+  assert(iterator->TYPE == ENTRY_ITERATOR && iterator->peekKey(iterator) == 5);
+  iterator->free(iterator);
+  freePredicateEntry(entry);
+
+  // segments only sort what was added since their last optimize
+  Segment *segment = createSegment();
+  for (int i = 0; i < 1000; i++) {
+    addTripleToSegment(segment, toTriple(999 - i, 4, i));
+  }
+  optimizeSegment(segment);
+  for (int i = 0; i < 10; i++) {
+    addTripleToSegment(segment, toTriple(500 + i, 4, 7));
+    addTripleToSegment(segment, toTriple(i, 6, 7));
+  }
+  assert(predicateEntryUnsortedCount(getSegmentPredicateEntry(segment, 4)) == 10);
+  optimizeSegment(segment);
+  for (int p = 4; p <= 6; p += 2) {
+    entry = getSegmentPredicateEntry(segment, p);
+    assert(entry->sortedCount == entry->entryCount);
+    for (unsigned long i = 1; i < entry->entryCount; i++) {
+      assert(entry->soEntries[i - 1] <= entry->soEntries[i]);
+      assert(entry->osEntries[i - 1] <= entry->osEntries[i]);
+    }
+  }
+  freeSegment(segment);
+
+  free(soPairs);
+  free(osPairs);
+  free(soSorted);
+  free(osSorted);
+}
+
+// sorts the live pairs into soSorted and osSorted for checkIncrementalIteration and checkPointLookups
+void sortLivePairs(EntityPair *live, unsigned long count, EntityPair *soSorted, EntityPair *osSorted) {
+  for (unsigned long i = 0; i < count; i++) {
+    soSorted[i] = live[i];
+    osSorted[i] = toOSEntry(objectIdFromSOEntry(live[i]), subjectIdFromSOEntry(live[i]));
+  }
+  qsort(soSorted, count, sizeof(EntityPair), compareEntityPairs);
+  qsort(osSorted, count, sizeof(EntityPair), compareEntityPairs);
+}
+
+void testRemoval() {
+  printf("testRemoval\n");
+
+  EntityId range = 3000;
+  unsigned long count = 6000;
+  EntityPair *live = malloc(sizeof(EntityPair) * count);
+  EntityPair *soSorted = malloc(sizeof(EntityPair) * count);
+  EntityPair *osSorted = malloc(sizeof(EntityPair) * count);
+
+  // distinct pairs, so one removal takes exactly one pair out of live
+  PredicateEntry *entry = createPredicateEntry(3);
+  for (unsigned long i = 0; i < count; i++) {
+    live[i] = toSOEntry((i * 7919) % range, i);
+    addToPredicateEntry(entry, subjectIdFromSOEntry(live[i]), objectIdFromSOEntry(live[i]));
+  }
+  // removing from an entry that was never optimized sorts it first
+  assert(removeFromPredicateEntry(entry, subjectIdFromSOEntry(live[0]), objectIdFromSOEntry(live[0])));
+  assert(entry->sortedCount == count);
+  live[0] = live[--count];
+  assert(!removeFromPredicateEntry(entry, 1, range + 5));
+
+  for (int round = 0; round < 12; round++) {
+    for (int i = 0; i < 80; i++) {
+      unsigned long victim = testRandom() % count;
+      EntityPair pair = live[victim];
+      assert(removeFromPredicateEntry(entry, subjectIdFromSOEntry(pair), objectIdFromSOEntry(pair)));
+      assert(!removeFromPredicateEntry(entry, subjectIdFromSOEntry(pair), objectIdFromSOEntry(pair)));
+      live[victim] = live[--count];
+      if (i % 10 == 0) {
+        // adding a removed pair back only drops its tombstone
+        unsigned long entryCount = entry->entryCount;
+        addToPredicateEntry(entry, subjectIdFromSOEntry(pair), objectIdFromSOEntry(pair));
+        assert(entry->entryCount == entryCount);
+        live[count++] = pair;
+      }
+    }
+    // new pairs land in the delta and removals apply to them too
+    for (int i = 0; i < 5; i++) {
+      EntityPair pair = toSOEntry(testRandom() % range, range + round * 5 + i);
+      addToPredicateEntry(entry, subjectIdFromSOEntry(pair), objectIdFromSOEntry(pair));
+      live[count++] = pair;
+    }
+    EntityPair added = live[count - 1];
+    assert(removeFromPredicateEntry(entry, subjectIdFromSOEntry(added), objectIdFromSOEntry(added)));
+    count--;
+
+    sortLivePairs(live, count, soSorted, osSorted);
+    Iterator *subjects = createPredicateEntryIterator(entry);
+    Iterator *objects = createPredicateEntryObjectIterator(entry);
+    assert(subjects->TYPE == MERGED_ENTRY_ITERATOR);
+    checkIncrementalIteration(subjects, soSorted, count, 3, SUBJECT_ORDER);
+    checkIncrementalIteration(objects, osSorted, count, 3, OBJECT_ORDER);
+    subjects->free(subjects);
+    objects->free(objects);
+
+    // seeks skip removed pairs too
+    Iterator *iterator = createPredicateEntryIterator(entry);
+    unsigned long expected = 0;
+    for (EntityId target = 0; target < range; target += 1 + testRandom() % 100) {
+      iterator->seek(iterator, target);
+      while (expected < count && subjectIdFromSOEntry(soSorted[expected]) < target) {
+        expected++;
+      }
+      if (expected == count) {
+        assert(iterator->done(iterator));
+        break;
+      }
+      assert(iterator->peek(iterator) == toTripleFromSOEntry(soSorted[expected], 3));
+    }
+    iterator->free(iterator);
+    checkPointLookups(entry, soSorted, count, range);
+  }
+
+  assert(predicateEntryNeedsCompaction(entry));
+  compactPredicateEntry(entry);
+  assert(entry->tombstoneCount == 0 && entry->entryCount == count);
+  assert(memcmp(entry->soEntries, soSorted, sizeof(EntityPair) * count) == 0);
+  assert(memcmp(entry->osEntries, osSorted, sizeof(EntityPair) * count) == 0);
+  Iterator *iterator = createPredicateEntryIterator(entry);
+  assert(iterator->TYPE == ENTRY_ITERATOR);
+  iterator->free(iterator);
+
+  // compaction gives a borrowed entry arrays of its own and leaves the borrowed ones alone
+  EntityPair *soBorrowed = malloc(sizeof(EntityPair) * count);
+  EntityPair *osBorrowed = malloc(sizeof(EntityPair) * count);
+  memcpy(soBorrowed, soSorted, sizeof(EntityPair) * count);
+  memcpy(osBorrowed, osSorted, sizeof(EntityPair) * count);
+  PredicateEntry *borrowed = createBorrowedPredicateEntry(3, soBorrowed, osBorrowed, count);
+  assert(removeFromPredicateEntry(borrowed, subjectIdFromSOEntry(soSorted[5]), objectIdFromSOEntry(soSorted[5])));
+  assert(!predicateEntryHasPair(borrowed, subjectIdFromSOEntry(soSorted[5]), objectIdFromSOEntry(soSorted[5])));
+  compactPredicateEntry(borrowed);
+  assert(!borrowed->borrowed && borrowed->entryCount == count - 1);
+  assert(borrowed->soEntries[5] == soSorted[6] && soBorrowed[5] == soSorted[5]);
+  freePredicateEntry(borrowed);
+  free(soBorrowed);
+  free(osBorrowed);
+
+  // compressing compacts first
+  removeFromPredicateEntry(entry, subjectIdFromSOEntry(soSorted[0]), objectIdFromSOEntry(soSorted[0]));
+  compressPredicateEntry(entry);
+  assert(entry->entryCount == count - 1);
+  assert(!predicateEntryHasPair(entry, subjectIdFromSOEntry(soSorted[0]), objectIdFromSOEntry(soSorted[0])));
+  freePredicateEntry(entry);
+
+  Segment *segment = createSegment();
+  for (int i = 0; i < 100; i++) {
+    addTripleToSegment(segment, toTriple(i, 1, i + 1));
+    addTripleToSegment(segment, toTriple(i, 2, i + 2));
+  }
+  optimizeSegment(segment);
+  for (int i = 0; i < 20; i++) {
+    assert(removeTripleFromSegment(segment, toTriple(i, 1, i + 1)));
+  }
+  assert(removeTripleFromSegment(segment, toTriple(0, 2, 2)));
+  assert(!removeTripleFromSegment(segment, toTriple(0, 2, 2)));
+  assert(!removeTripleFromSegment(segment, toTriple(0, 5, 2)));
+  assert(segment->tripleCount == 179);
+  assert(!hasTriple(segment, 3, 1, 4) && hasTriple(segment, 30, 1, 31));
+  assert(compactSegment(segment, 2) == 1);
+  assert(getSegmentPredicateEntry(segment, 1)->entryCount == 80);
+  assert(getSegmentPredicateEntry(segment, 2)->tombstoneCount == 1);
+  freeSegment(segment);
+
+  free(live);
+  free(soSorted);
+  free(osSorted);
+}
+
+void testExplainIterator() {
+  printf("testExplainIterator\n");
+
+  PredicateEntry *a = createPredicateEntry(1);
+  PredicateEntry *b = createPredicateEntry(2);
+  PredicateEntry *c = createPredicateEntry(3);
+  for (EntityId s = 0; s < 3000; s++) {
+    addToPredicateEntry(a, s, s);
+    if (s % 3 == 0) {
+      addToPredicateEntry(b, s, s + 1);
+    }
+    if (s % 5 == 0) {
+      addToPredicateEntry(c, s, s + 2);
+    }
+  }
+  optimizePredicateEntry(a);
+  optimizePredicateEntry(b);
+  optimizePredicateEntry(c);
+
+  // subjects divisible by 3 or 5
+  unsigned long expected = 3000 / 3 + 3000 / 5 - 3000 / 15;
+  Iterator *iterator = createPredicateEntryANDIterator(createPredicateEntryIterator(a),
+    createPredicateEntryORIterator(createPredicateEntryIterator(b), createPredicateEntryIterator(c)));
+  iterator->init(iterator);
+  Triple triples[ITERATOR_BATCH_LENGTH];
+  unsigned long count = 0;
+  unsigned long found;
+  while ((found = nextBatch(iterator, triples, 100)) > 0) {
+    count += found;
+  }
+  assert(count == expected);
+
+  FILE *file = tmpfile();
+  explainIteratorToFile(iterator, file);
+  rewind(file);
+  char line[512];
+  const char *labels[] = {"AND", "  ENTRY predicate=1 order=subject pairs=3000", "  OR",
+                          "    ENTRY predicate=2 order=subject", "    ENTRY predicate=3 order=subject"};
+  for (int i = 0; i < 5; i++) {
+    assert(fgets(line, sizeof(line), file) != NULL);
+    assert(strncmp(line, labels[i], strlen(labels[i])) == 0);
+  }
+  assert(fgets(line, sizeof(line), file) == NULL);
+  fclose(file);
+
+#if CGRAPH_ITERATOR_STATS
+  assert(iterator->stats.rows == expected);
+  assert(iterator->stats.batches == (expected + 99) / 100 + 1);
+  assert(iterator->stats.cycles > 0);
+  resetIteratorStats(iterator);
+  assert(iterator->stats.rows == 0);
+  assert(((PredicateEntryJoinIterator *)iterator)->aIterator->stats.cycles == 0);
+#endif
+  iterator->free(iterator);
+
+  // triple at a time, through the leapfrog join's own counters
+  Iterator *inputs[] = {createPredicateEntryIterator(a), createPredicateEntryIterator(b), createPredicateEntryIterator(c)};
+  iterator = createLeapfrogJoinIterator(inputs, 3);
+  iterator->init(iterator);
+  Triple triple;
+  count = 0;
+  while (iterate(iterator, &triple)) {
+    assert(subjectIdFromTriple(triple) % 15 == 0);
+    count++;
+  }
+  assert(count == 3000 / 15);
+#if CGRAPH_ITERATOR_STATS
+  assert(iterator->stats.rows == count);
+  assert(iterator->stats.advances == count);
+  assert(iterator->stats.peeks == count);
+  assert(iterator->stats.comparisons >= 2 * count);
+  assert(inputs[1]->stats.seeks > 0);
+  assert(inputs[1]->stats.skipped > 0);
+#endif
+  iterator->free(iterator);
+
+  freePredicateEntry(a);
+  freePredicateEntry(b);
+  freePredicateEntry(c);
+}
+
+void testPredicateEntryStatistics() {
+  printf("testPredicateEntryStatistics\n");
+
+  // subject s has s % 7 + 1 objects, every object is used once
+  PredicateEntry *entry = createPredicateEntry(4);
+  unsigned long count = 0;
+  unsigned long degreeOne = 0;
+  for (SubjectId s = 10; s < 110; s++) {
+    for (unsigned int k = 0; k <= s % 7; k++) {
+      addToPredicateEntry(entry, s, s * 10 + k);
+      count++;
+    }
+    degreeOne += (s % 7 == 0);
+  }
+  assert(entry->statistics == NULL);
+  optimizePredicateEntry(entry);
+  PredicateEntryStatistics *statistics = entry->statistics;
+  assert(statistics != NULL);
+  assert(statistics->entryCount == count);
+  assert(statistics->distinctSubjects == 100);
+  assert(statistics->minSubject == 10 && statistics->maxSubject == 109);
+  assert(statistics->maxSubjectDegree == 7);
+  assert(statistics->subjectDegrees[0] == degreeOne);
+  unsigned long subjects = 0;
+  for (int i = 0; i < PREDICATE_ENTRY_DEGREE_BUCKET_COUNT; i++) {
+    subjects += statistics->subjectDegrees[i];
+  }
+  assert(subjects == 100);
+  assert(statistics->subjectDegrees[3] == 0);
+  assert(statistics->distinctObjects == count);
+  assert(statistics->minObject == 100 && statistics->maxObject == 1094);
+  assert(statistics->maxObjectDegree == 1 && statistics->objectDegrees[0] == count);
+
+  // a trickle of additions leaves them alone until the entry has drifted far enough
+  addToPredicateEntry(entry, 5, 5);
+  optimizePredicateEntry(entry);
+  assert(statistics->entryCount == count && statistics->minSubject == 10);
+  for (SubjectId s = 200; s < 300; s++) {
+    addToPredicateEntry(entry, s, s);
+  }
+  optimizePredicateEntry(entry);
+  assert(statistics->entryCount == count + 101);
+  assert(statistics->distinctSubjects == 201 && statistics->minSubject == 5 && statistics->maxSubject == 299);
+
+  // compressed entries keep theirs, and record them from the compressed form when they have none
+  PredicateEntryStatistics recorded = *statistics;
+  compressPredicateEntry(entry);
+  free(entry->statistics);
+  entry->statistics = NULL;
+  statistics = predicateEntryStatistics(entry);
+  assert(memcmp(statistics, &recorded, sizeof(PredicateEntryStatistics)) == 0);
+  freePredicateEntry(entry);
+}
+
+// initializes, drains and frees the iterator, returning how many triples it wrote
+unsigned long drainIterator(Iterator *iterator, Triple *triples) {
+  iterator->init(iterator);
+  unsigned long count = 0;
+  unsigned long found;
+  while ((found = nextBatch(iterator, triples + count, ITERATOR_BATCH_LENGTH)) > 0) {
+    count += found;
+  }
+  iterator->free(iterator);
+  return count;
+}
+
+int compareTriples(const void *a, const void *b) {
+  Triple x = *(const Triple *)a;
+  Triple y = *(const Triple *)b;
+  return (x > y) - (x < y);
+}
+
+void testQueryPlanner() {
+  printf("testQueryPlanner\n");
+
+  // big has every subject, the others every 2nd, 3rd and 200th
+  PredicateEntry *big = createPredicateEntry(1);
+  PredicateEntry *half = createPredicateEntry(2);
+  PredicateEntry *third = createPredicateEntry(3);
+  PredicateEntry *rare = createPredicateEntry(4);
+  for (SubjectId s = 0; s < 20000; s++) {
+    addToPredicateEntry(big, s, s + 1);
+    if (s % 2 == 0) {
+      addToPredicateEntry(half, s, s + 2);
+    }
+    if (s % 3 == 0) {
+      addToPredicateEntry(third, s, s + 3);
+    }
+    if (s % 200 == 0) {
+      addToPredicateEntry(rare, s, s + 4);
+    }
+  }
+  optimizePredicateEntry(big);
+  optimizePredicateEntry(half);
+  optimizePredicateEntry(third);
+  optimizePredicateEntry(rare);
+
+  QueryPattern *operands[4] = {createEntryPattern(big, SUBJECT_ORDER), createEntryPattern(half, SUBJECT_ORDER),
+                               createEntryPattern(rare, SUBJECT_ORDER), createEntryPattern(third, SUBJECT_ORDER)};
+  QueryPattern *pattern = createANDPattern(operands, 4);
+  QueryEstimate estimate = estimateQueryPattern(pattern);
+  assert(estimate.rows > 10 && estimate.rows < 40);
+
+  // big stays first, the filters go smallest first, and skewed inputs seek
+  Iterator *planned = planQuery(pattern);
+  PredicateEntryJoinIterator *root = (PredicateEntryJoinIterator *)planned;
+  PredicateEntryJoinIterator *middle = (PredicateEntryJoinIterator *)root->aIterator;
+  PredicateEntryJoinIterator *bottom = (PredicateEntryJoinIterator *)middle->aIterator;
+  assert(((PredicateEntryIterator *)root->bIterator)->entry == half);
+  assert(((PredicateEntryIterator *)middle->bIterator)->entry == third);
+  assert(((PredicateEntryIterator *)bottom->bIterator)->entry == rare);
+  assert(((PredicateEntryIterator *)bottom->aIterator)->entry == big);
+  assert(bottom->strategy == JOIN_STRATEGY_SEEK && root->strategy == JOIN_STRATEGY_SEEK);
+
+  Triple *expected = malloc(sizeof(Triple) * 40000);
+  Triple *actual = malloc(sizeof(Triple) * 40000);
+  Iterator *written = createPredicateEntryANDIterator(
+    createPredicateEntryANDIterator(createPredicateEntryANDIterator(createPredicateEntryIterator(big), createPredicateEntryIterator(half)),
+                                    createPredicateEntryIterator(rare)), createPredicateEntryIterator(third));
+  unsigned long expectedCount = drainIterator(written, expected);
+  assert(expectedCount == 20000 / 600 + 1);
+  assert(drainIterator(planned, actual) == expectedCount);
+  assert(memcmp(expected, actual, sizeof(Triple) * expectedCount) == 0);
+  freeQueryPattern(pattern);
+
+  // inputs of similar size merge
+  QueryPattern *similar[2] = {createEntryPattern(half, SUBJECT_ORDER), createEntryPattern(third, SUBJECT_ORDER)};
+  pattern = createANDPattern(similar, 2);
+  planned = planQuery(pattern);
+  assert(((PredicateEntryJoinIterator *)planned)->strategy == JOIN_STRATEGY_MERGE);
+  expectedCount = drainIterator(createPredicateEntryANDIterator(createPredicateEntryIterator(half), createPredicateEntryIterator(third)), expected);
+  assert(expectedCount == 20000 / 6 + 1);
+  assert(drainIterator(planned, actual) == expectedCount);
+  assert(memcmp(expected, actual, sizeof(Triple) * expectedCount) == 0);
+  freeQueryPattern(pattern);
+
+  // unions of more than two operands become one k-way union, which keeps the written order's ties
+  QueryPattern *alternatives[4] = {createEntryPattern(half, SUBJECT_ORDER), createEntryPattern(rare, SUBJECT_ORDER),
+                                   createEntryPattern(third, SUBJECT_ORDER), createEntryPattern(big, SUBJECT_ORDER)};
+  pattern = createORPattern(alternatives, 4);
+  planned = planQuery(pattern);
+  assert(planned->TYPE == UNION_ITERATOR && ((UnionIterator *)planned)->inputCount == 4);
+  written = createPredicateEntryORIterator(
+    createPredicateEntryORIterator(createPredicateEntryORIterator(createPredicateEntryIterator(half), createPredicateEntryIterator(rare)),
+                                   createPredicateEntryIterator(third)), createPredicateEntryIterator(big));
+  expectedCount = drainIterator(written, expected);
+  assert(drainIterator(planned, actual) == expectedCount);
+  assert(memcmp(expected, actual, sizeof(Triple) * expectedCount) == 0);
+  freeQueryPattern(pattern);
+
+  // object keyed leaves estimate from the objects' statistics
+  QueryPattern *byObject[2] = {createEntryPattern(big, SUBJECT_ORDER), createEntryPattern(rare, OBJECT_ORDER)};
+  pattern = createANDPattern(byObject, 2);
+  estimate = estimateQueryPattern(pattern);
+  assert(estimate.rows > 50 && estimate.rows < 200);
+  assert(estimate.minKey == 4 && estimate.maxKey == 19804);
+  freeQueryPattern(pattern);
+
+  // leaves that leave their order to the planner take the one the other leaves fix
+  QueryPattern *adopted[2] = {createEntryPattern(big, QUERY_PATTERN_ANY_ORDER), createEntryPattern(rare, OBJECT_ORDER)};
+  pattern = createANDPattern(adopted, 2);
+  planned = planQuery(pattern);
+  assert(((PredicateEntryIterator *)((PredicateEntryJoinIterator *)planned)->aIterator)->order == OBJECT_ORDER);
+  planned->free(planned);
+  freeQueryPattern(pattern);
+
+  // with no leaf fixing the side, an AND joins on subjects, also inside a union
+  QueryPattern *unfixed[2] = {createEntryPattern(half, QUERY_PATTERN_ANY_ORDER), createEntryPattern(third, QUERY_PATTERN_ANY_ORDER)};
+  pattern = createANDPattern(unfixed, 2);
+  estimate = estimateQueryPattern(pattern);
+  assert(estimate.minKey == 0 && estimate.maxKey == 19998);
+  planned = planQuery(pattern);
+  root = (PredicateEntryJoinIterator *)planned;
+  assert(((PredicateEntryIterator *)root->aIterator)->order == SUBJECT_ORDER);
+  assert(((PredicateEntryIterator *)root->bIterator)->order == SUBJECT_ORDER);
+  expectedCount = drainIterator(createPredicateEntryANDIterator(createPredicateEntryIterator(half), createPredicateEntryIterator(third)), expected);
+  assert(expectedCount == 20000 / 6 + 1);
+  assert(drainIterator(planned, actual) == expectedCount);
+  assert(memcmp(expected, actual, sizeof(Triple) * expectedCount) == 0);
+  QueryPattern *withAND[2] = {pattern, createEntryPattern(rare, QUERY_PATTERN_ANY_ORDER)};
+  pattern = createORPattern(withAND, 2);
+  planned = planQuery(pattern);
+  assert(((PredicateEntryIterator *)((PredicateEntryJoinIterator *)planned)->bIterator)->order == SUBJECT_ORDER);
+  assert(drainIterator(planned, actual) == expectedCount + 20000 / 200);
+  freeQueryPattern(pattern);
+
+  // a union of whole entries is keyed on the side whose ranges overlap least: here the entries share
+  // their subjects and not their objects, and, mirrored, their objects and not their subjects
+  PredicateEntry *low = createPredicateEntry(5);
+  PredicateEntry *high = createPredicateEntry(6);
+  PredicateEntry *shifted = createPredicateEntry(7);
+  for (SubjectId s = 0; s < 5000; s++) {
+    addToPredicateEntry(low, s, s);
+    addToPredicateEntry(high, s, s + 5000);
+    addToPredicateEntry(shifted, s + 5000, s);
+  }
+  optimizePredicateEntry(low);
+  optimizePredicateEntry(high);
+  optimizePredicateEntry(shifted);
+  PredicateEntry *pairs[2][2] = {{low, high}, {low, shifted}};
+  unsigned char expectedOrders[2] = {OBJECT_ORDER, SUBJECT_ORDER};
+  for (int k = 0; k < 2; k++) {
+    QueryPattern *whole[2] = {createEntryPattern(pairs[k][0], QUERY_PATTERN_ANY_ORDER), createEntryPattern(pairs[k][1], QUERY_PATTERN_ANY_ORDER)};
+    pattern = createORPattern(whole, 2);
+    estimate = estimateQueryPattern(pattern);
+    assert(estimate.rows == 10000);
+    planned = planQuery(pattern);
+    root = (PredicateEntryJoinIterator *)planned;
+    assert(((PredicateEntryIterator *)root->aIterator)->order == expectedOrders[k]);
+    assert(((PredicateEntryIterator *)root->bIterator)->order == expectedOrders[k]);
+    written = createPredicateEntryORIterator(createPredicateEntryIterator(pairs[k][0]), createPredicateEntryIterator(pairs[k][1]));
+    expectedCount = drainIterator(written, expected);
+    assert(drainIterator(planned, actual) == expectedCount);
+    qsort(expected, expectedCount, sizeof(Triple), compareTriples);
+    qsort(actual, expectedCount, sizeof(Triple), compareTriples);
+    assert(memcmp(expected, actual, sizeof(Triple) * expectedCount) == 0);
+    freeQueryPattern(pattern);
+  }
+
+  free(expected);
+  free(actual);
+  freePredicateEntry(big);
+  freePredicateEntry(half);
+  freePredicateEntry(third);
+  freePredicateEntry(rare);
+  freePredicateEntry(low);
+  freePredicateEntry(high);
+  freePredicateEntry(shifted);
+}
+
+void testUnionIterator() {
+  printf("testUnionIterator\n");
+
+  // inputs of every size, overlapping keys and the odd compressed or delta input
+  int inputCount = 37;
+  PredicateEntry **entries = malloc(sizeof(PredicateEntry *) * inputCount);
+  unsigned long total = 0;
+  for (int i = 0; i < inputCount; i++) {
+    entries[i] = createPredicateEntry(i + 1);
+    unsigned long count = (testRandom() % 4 == 0) ? testRandom() % 5000 : testRandom() % 200;
+    for (unsigned long k = 0; k < count; k++) {
+      addToPredicateEntry(entries[i], testRandom() % 3000, testRandom() % 50);
+    }
+    optimizePredicateEntry(entries[i]);
+    if (i % 7 == 3) {
+      compressPredicateEntry(entries[i]);
+    } else if (i % 7 == 5) {
+      addToPredicateEntry(entries[i], testRandom() % 3000, 60);
+    }
+    total += entries[i]->entryCount;
+  }
+
+  Triple *expected = malloc(sizeof(Triple) * total);
+  Triple *actual = malloc(sizeof(Triple) * total);
+  Iterator **inputs = malloc(sizeof(Iterator *) * inputCount);
+  for (int k = 1; k <= inputCount; k += (k < 4) ? 1 : 11) {
+    // a left-deep chain of ORs gives ties to the earlier input, as the union does
+    Iterator *chain = createPredicateEntryIterator(entries[0]);
+    for (int i = 0; i < k; i++) {
+      inputs[i] = createPredicateEntryIterator(entries[i]);
+      if (i > 0) {
+        chain = createPredicateEntryORIterator(chain, createPredicateEntryIterator(entries[i]));
+      }
+    }
+    unsigned long expectedCount = drainIterator(chain, expected);
+    Iterator *iterator = createUnionIterator(inputs, k, UNION_ALL_TRIPLES);
+
+    // triple at a time, then in batches of awkward sizes from a clone
+    Iterator *clone = iterator->clone(iterator);
+    iterator->init(iterator);
+    unsigned long count = 0;
+    Triple triple;
+    while (iterate(iterator, &triple)) {
+      assert(triple == expected[count]);
+      count++;
+    }
+    assert(count == expectedCount);
+    iterator->free(iterator);
+    clone->init(clone);
+    count = 0;
+    unsigned long found;
+    while ((found = nextBatch(clone, actual + count, 1 + count % 97)) > 0) {
+      count += found;
+    }
+    assert(count == expectedCount);
+    assert(memcmp(expected, actual, sizeof(Triple) * count) == 0);
+    clone->free(clone);
+
+    // seeks land on the first triple of the first key at or past the target
+    for (int i = 0; i < k; i++) {
+      inputs[i] = createPredicateEntryIterator(entries[i]);
+    }
+    iterator = createUnionIterator(inputs, k, UNION_ALL_TRIPLES);
+    iterator->init(iterator);
+    unsigned long position = 0;
+    for (EntityId target = 0; target < 3100 && !iterator->done(iterator); target += 1 + testRandom() % 400) {
+      iterator->seek(iterator, target);
+      while (position < expectedCount && subjectIdFromTriple(expected[position]) < target) {
+        position++;
+      }
+      assert(iterator->done(iterator) == (position == expectedCount));
+      if (position < expectedCount) {
+        assert(iterator->peek(iterator) == expected[position]);
+      }
+    }
+    iterator->free(iterator);
+
+    // distinct keys keep the first triple of each key
+    for (int i = 0; i < k; i++) {
+      inputs[i] = createPredicateEntryIterator(entries[i]);
+    }
+    iterator = createUnionIterator(inputs, k, UNION_DISTINCT_KEYS);
+    iterator->init(iterator);
+    count = 0;
+    while ((found = nextBatch(iterator, actual + count, 64)) > 0) {
+      count += found;
+    }
+    unsigned long distinct = 0;
+    for (unsigned long i = 0; i < expectedCount; i++) {
+      if (i == 0 || subjectIdFromTriple(expected[i]) != subjectIdFromTriple(expected[i - 1])) {
+        assert(actual[distinct++] == expected[i]);
+      }
+    }
+    assert(count == distinct);
+    iterator->free(iterator);
+  }
+
+  // the arena variant gives the same triples
+  Arena *arena = createArena(0);
+  Iterator *chain = createPredicateEntryIterator(entries[0]);
+  for (int i = 0; i < inputCount; i++) {
+    inputs[i] = createPredicateEntryIteratorInArena(arena, entries[i]);
+    if (i > 0) {
+      chain = createPredicateEntryORIterator(chain, createPredicateEntryIterator(entries[i]));
+    }
+  }
+  unsigned long expectedCount = drainIterator(chain, expected);
+  assert(drainIterator(createUnionIteratorInArena(arena, inputs, inputCount, UNION_ALL_TRIPLES), actual) == expectedCount);
+  assert(memcmp(expected, actual, sizeof(Triple) * expectedCount) == 0);
+  freeArena(arena);
+
+  // explain lists the inputs under the union
+  for (int i = 0; i < 3; i++) {
+    inputs[i] = createPredicateEntryIterator(entries[i]);
+  }
+  Iterator *iterator = createUnionIterator(inputs, 3, UNION_DISTINCT_KEYS);
+  FILE *file = tmpfile();
+  explainIteratorToFile(iterator, file);
+  rewind(file);
+  char line[512];
+  assert(fgets(line, sizeof(line), file) != NULL && strncmp(line, "UNION inputs=3 distinct keys", 28) == 0);
+  assert(fgets(line, sizeof(line), file) != NULL && strncmp(line, "  ENTRY predicate=1", 19) == 0);
+  fclose(file);
+  iterator->free(iterator);
+
+  for (int i = 0; i < inputCount; i++) {
+    freePredicateEntry(entries[i]);
+  }
+  free(inputs);
+  free(entries);
+  free(expected);
+  free(actual);
+}
+
+// level by level over every edge, for checking traversals
+void referenceTraversal(Triple *edges, unsigned long edgeCount, unsigned char direction, unsigned int *depths, unsigned long vertexCount,
+                        EntityId *sources, unsigned long sourceCount, unsigned int maxDepth) {
+  memset(depths, 0xFF, sizeof(unsigned int) * vertexCount);
+  for (unsigned long i = 0; i < sourceCount; i++) {
+    depths[sources[i]] = 0;
+  }
+  for (unsigned int depth = 0; depth < maxDepth; depth++) {
+    BOOL grew = 0;
+    for (unsigned long i = 0; i < edgeCount; i++) {
+      EntityId subject = subjectIdFromTriple(edges[i]);
+      EntityId object = objectIdFromTriple(edges[i]);
+      if (direction != TRAVERSE_BACKWARD && depths[subject] == depth && depths[object] == TRAVERSAL_UNREACHED) {
+        depths[object] = depth + 1;
+        grew = 1;
+      }
+      if (direction != TRAVERSE_FORWARD && depths[object] == depth && depths[subject] == TRAVERSAL_UNREACHED) {
+        depths[subject] = depth + 1;
+        grew = 1;
+      }
+    }
+    if (!grew) {
+      return;
+    }
+  }
+}
+
+void testTraversal() {
+  printf("testTraversal\n");
+
+  // a sparse random graph over three predicates: one plain, one compressed, one with a delta and removals
+  unsigned long vertexCount = 3000;
+  PredicateEntry *entries[3];
+  for (int p = 0; p < 3; p++) {
+    entries[p] = createPredicateEntry(p + 1);
+    for (unsigned long i = 0; i < vertexCount; i++) {
+      addToPredicateEntry(entries[p], testRandom() % vertexCount, testRandom() % vertexCount);
+    }
+    // a hub, so bottom-up steps find parents early
+    for (unsigned long i = 0; i < 200; i++) {
+      addToPredicateEntry(entries[p], 7, testRandom() % vertexCount);
+    }
+    optimizePredicateEntry(entries[p]);
+  }
+  compressPredicateEntry(entries[1]);
+  for (unsigned long i = 0; i < 50; i++) {
+    addToPredicateEntry(entries[2], testRandom() % vertexCount, testRandom() % vertexCount);
+  }
+  Triple triple = entries[2]->soEntries[10];
+  assert(removeFromPredicateEntry(entries[2], subjectIdFromSOEntry(triple), objectIdFromSOEntry(triple)));
+
+  Triple *edges = malloc(sizeof(Triple) * 3 * (vertexCount + 300));
+  unsigned long edgeCount = 0;
+  for (int p = 0; p < 3; p++) {
+    edgeCount += drainIterator(createPredicateEntryIterator(entries[p]), edges + edgeCount);
+  }
+  unsigned int *expected = malloc(sizeof(unsigned int) * vertexCount);
+  EntityId sources[] = {7, 1234, 7, 2999};
+
+  static const unsigned char directions[] = {TRAVERSE_FORWARD, TRAVERSE_BACKWARD, TRAVERSE_BOTH};
+  static const unsigned char strategies[] = {TRAVERSAL_AUTOMATIC, TRAVERSAL_TOP_DOWN, TRAVERSAL_BOTTOM_UP};
+  for (int d = 0; d < 3; d++) {
+    TraversalIndex *index = createTraversalIndex(entries, 3, directions[d], 3);
+    assert(index->vertexCount <= vertexCount && index->edgeCount == edgeCount * ((directions[d] == TRAVERSE_BOTH) ? 2 : 1));
+    for (int s = 0; s < 3; s++) {
+      for (unsigned int maxDepth = 0; maxDepth < 5; maxDepth += 2) {
+        TraversalOptions options;
+        initTraversalOptions(&options);
+        options.threadCount = 1 + s;
+        options.strategy = strategies[s];
+        options.maxDepth = (maxDepth == 4) ? TRAVERSAL_UNLIMITED_DEPTH : maxDepth;
+        // small thresholds, so the automatic traversal switches both ways on a graph this size
+        options.alpha = 2;
+        options.beta = 4;
+        TraversalResult *result = traverseBreadthFirst(index, sources, 4, &options);
+        referenceTraversal(edges, edgeCount, directions[d], expected, index->vertexCount, sources, 4, options.maxDepth);
+        unsigned long reached = 0;
+        unsigned int depth = 0;
+        for (unsigned long v = 0; v < index->vertexCount; v++) {
+          assert(result->depths[v] == expected[v]);
+          if (expected[v] != TRAVERSAL_UNREACHED) {
+            reached++;
+            depth = (expected[v] > depth) ? expected[v] : depth;
+          }
+        }
+        assert(result->reachedCount == reached && result->depth == depth);
+        assert(result->depth <= options.maxDepth);
+        if (strategies[s] == TRAVERSAL_TOP_DOWN) {
+          assert(result->bottomUpSteps == 0);
+        } else if (strategies[s] == TRAVERSAL_BOTTOM_UP) {
+          assert(result->bottomUpSteps > 0 || options.maxDepth == 0);
+        } else if (options.maxDepth == TRAVERSAL_UNLIMITED_DEPTH) {
+          // starts top-down, switches once the frontier fans out and back once it thins
+          assert(result->bottomUpSteps > 0 && result->bottomUpSteps < result->depth);
+        }
+        freeTraversalResult(result);
+      }
+    }
+    freeTraversalIndex(index);
+  }
+
+  for (int p = 0; p < 3; p++) {
+    freePredicateEntry(entries[p]);
+  }
+  free(edges);
+  free(expected);
+}
+
+void testPageRank() {
+  printf("testPageRank\n");
+
+  // a small graph pulled straight from osEntries, and one past a block of vertices pulled segment by segment
+  static const unsigned long vertexCounts[] = {500, 3 * PAGE_RANK_BLOCK_VERTEX_COUNT + 123};
+  for (int g = 0; g < 2; g++) {
+    unsigned long vertexCount = vertexCounts[g];
+    unsigned long edgeCount = vertexCount * 2;
+    PredicateEntry *entry = createPredicateEntry(1);
+    for (unsigned long i = 0; i < edgeCount; i++) {
+      // a few hubs draw most of the in-edges; every id below the largest is a vertex, edges or not
+      EntityId object = (testRandom() % 4 == 0) ? testRandom() % 8 : testRandom() % vertexCount;
+      addToPredicateEntry(entry, testRandom() % (vertexCount - 1), object);
+    }
+    addToPredicateEntry(entry, vertexCount - 1, 0);
+    optimizePredicateEntry(entry);
+    // pending additions and removals are compacted in first
+    addToPredicateEntry(entry, 3, 5);
+    assert(removeFromPredicateEntry(entry, subjectIdFromSOEntry(entry->soEntries[0]), objectIdFromSOEntry(entry->soEntries[0])));
+    Triple *edges = malloc(sizeof(Triple) * (edgeCount + 2));
+    edgeCount = drainIterator(createPredicateEntryIterator(entry), edges);
+
+    // the plain power iteration
+    double damping = 0.85;
+    int iterations = 15;
+    unsigned long *degrees = calloc(vertexCount, sizeof(unsigned long));
+    double *expected = malloc(sizeof(double) * vertexCount);
+    double *next = malloc(sizeof(double) * vertexCount);
+    for (unsigned long i = 0; i < edgeCount; i++) {
+      degrees[subjectIdFromTriple(edges[i])]++;
+    }
+    for (unsigned long v = 0; v < vertexCount; v++) {
+      expected[v] = 1.0 / vertexCount;
+    }
+    for (int iteration = 0; iteration < iterations; iteration++) {
+      double dangling = 0;
+      for (unsigned long v = 0; v < vertexCount; v++) {
+        dangling += (degrees[v] == 0) ? expected[v] : 0;
+      }
+      for (unsigned long v = 0; v < vertexCount; v++) {
+        next[v] = (1 - damping) / vertexCount + damping * dangling / vertexCount;
+      }
+      for (unsigned long i = 0; i < edgeCount; i++) {
+        next[objectIdFromTriple(edges[i])] += damping * expected[subjectIdFromTriple(edges[i])] / degrees[subjectIdFromTriple(edges[i])];
+      }
+      memcpy(expected, next, sizeof(double) * vertexCount);
+    }
+
+    for (int threadCount = 1; threadCount <= 3; threadCount += 2) {
+      PageRankOptions options;
+      initPageRankOptions(&options);
+      options.threadCount = threadCount;
+      options.damping = damping;
+      options.maxIterations = iterations;
+      options.tolerance = 0;
+      PageRankResult *result = computePageRank(entry, &options);
+      assert(entry->tombstoneCount == 0 && entry->entryCount == edgeCount);
+      assert(result->vertexCount == vertexCount && result->iterations == iterations && result->change > 0);
+      double total = 0;
+      for (unsigned long v = 0; v < vertexCount; v++) {
+        assert(result->ranks[v] - expected[v] < 1e-12 && expected[v] - result->ranks[v] < 1e-12);
+        total += result->ranks[v];
+      }
+      assert(total > 1 - 1e-9 && total < 1 + 1e-9);
+      freePageRankResult(result);
+
+      // converged ranks stop early
+      options.maxIterations = 1000;
+      options.tolerance = 1e-9;
+      result = computePageRank(entry, &options);
+      assert(result->iterations < 1000 && result->change < 1e-9);
+      freePageRankResult(result);
+    }
+    free(degrees);
+    free(expected);
+    free(next);
+    free(edges);
+    freePredicateEntry(entry);
+  }
+
+  PageRankOptions options;
+  initPageRankOptions(&options);
+  PredicateEntry *empty = createPredicateEntry(2);
+  PageRankResult *result = computePageRank(empty, &options);
+  assert(result->vertexCount == 0 && result->iterations == 0);
+  freePageRankResult(result);
+  freePredicateEntry(empty);
+}
+
+// sequential union-find, labelling every vertex with the smallest of its component
+EntityId referenceComponentRoot(EntityId *parents, EntityId vertex) {
+  while (parents[vertex] != vertex) {
+    vertex = parents[vertex];
+  }
+  return vertex;
+}
+
+void testConnectedComponents() {
+  printf("testConnectedComponents\n");
+
+  unsigned long vertexCount = 20000;
+  PredicateEntry *entry = createPredicateEntry(1);
+  // fewer edges than vertices, so there are components of every size
+  for (unsigned long i = 0; i < vertexCount * 3 / 5; i++) {
+    addToPredicateEntry(entry, testRandom() % vertexCount, testRandom() % vertexCount);
+  }
+  addToPredicateEntry(entry, vertexCount - 1, vertexCount - 1);
+  optimizePredicateEntry(entry);
+
+  EntityId *parents = malloc(sizeof(EntityId) * vertexCount);
+  for (unsigned long v = 0; v < vertexCount; v++) {
+    parents[v] = v;
+  }
+  for (unsigned long i = 0; i < entry->entryCount; i++) {
+    EntityId a = referenceComponentRoot(parents, subjectIdFromSOEntry(entry->soEntries[i]));
+    EntityId b = referenceComponentRoot(parents, objectIdFromSOEntry(entry->soEntries[i]));
+    if (a < b) {
+      parents[b] = a;
+    } else {
+      parents[a] = b;
+    }
+  }
+  unsigned long componentCount = 0;
+  for (unsigned long v = 0; v < vertexCount; v++) {
+    componentCount += referenceComponentRoot(parents, v) == v;
+  }
+
+  for (int threadCount = 1; threadCount <= 4; threadCount++) {
+    ComponentsResult *result = computeConnectedComponents(entry, threadCount);
+    assert(result->vertexCount == vertexCount && result->componentCount == componentCount);
+    for (unsigned long v = 0; v < vertexCount; v++) {
+      assert(result->labels[v] == referenceComponentRoot(parents, v));
+    }
+    freeComponentsResult(result);
+  }
+
+  // one more edge joins two components
+  EntityId a = referenceComponentRoot(parents, 0);
+  EntityId b = a;
+  for (unsigned long v = 1; b == a; v++) {
+    b = referenceComponentRoot(parents, v);
+  }
+  addToPredicateEntry(entry, b, a);
+  ComponentsResult *result = computeConnectedComponents(entry, 2);
+  assert(result->componentCount == componentCount - 1 && result->labels[b] == ((a < b) ? a : b));
+  freeComponentsResult(result);
+
+  free(parents);
+  freePredicateEntry(entry);
+}
+
+unsigned long countSnapshotPredicate(SegmentSnapshot *snapshot, PredicateId predicate) {
+  Iterator *iterator = createSnapshotPredicateIterator(snapshot, predicate);
+  if (iterator == NULL) {
+    return 0;
+  }
+  iterator->init(iterator);
+  unsigned long count = 0;
+  Triple triple;
+  while (iterate(iterator, &triple)) {
+    assert(predicateIdFromTriple(triple) == predicate);
+    count++;
+  }
+  iterator->free(iterator);
+  return count;
+}
+
+void testVersionedSegment() {
+  printf("testVersionedSegment\n");
+
+  VersionedSegment *segment = createVersionedSegment();
+  int reader = registerSnapshotReader(segment);
+  assert(reader >= 0);
+
+  // nothing is visible before it is published
+  for (SubjectId s = 0; s < 1000; s++) {
+    addTripleToVersionedSegment(segment, toTriple(s, 1 + s % 3, s + 1));
+  }
+  SegmentSnapshot *empty = beginSnapshot(segment, reader);
+  assert(empty->version == 0 && empty->predicateCount == 0 && createSnapshotPredicateIterator(empty, 1) == NULL);
+  endSnapshot(segment, reader);
+  assert(publishVersionedSegment(segment) == 1);
+
+  // a reader inside version 1 keeps seeing it while the writer publishes changes to predicate 1 and 4
+  SegmentSnapshot *first = beginSnapshot(segment, reader);
+  assert(first->version == 1 && first->predicateCount == 3 && first->tripleCount == 1000);
+  assert(countSnapshotPredicate(first, 1) == 334 && countSnapshotPredicate(first, 2) == 333);
+  // entries are sized for the batch, so applying it never doubles them
+  assert(getSnapshotPredicate(first, 1)->base->currentEntriesLength == 334 + 1);
+  Iterator *open = createSnapshotPredicateIterator(first, 1);
+  open->init(open);
+  for (SubjectId s = 0; s < 300; s += 3) {
+    removeTripleFromVersionedSegment(segment, toTriple(s, 1, s + 1));
+  }
+  removeTripleFromVersionedSegment(segment, toTriple(1, 1, 1));
+  for (SubjectId s = 0; s < 50; s++) {
+    addTripleToVersionedSegment(segment, toTriple(5000 + s, 4, s));
+    addTripleToVersionedSegment(segment, toTriple(6000 + s, 1, s));
+  }
+  // changes to one predicate apply in order: added, removed, added again
+  addTripleToVersionedSegment(segment, toTriple(7000, 5, 1));
+  removeTripleFromVersionedSegment(segment, toTriple(7000, 5, 1));
+  addTripleToVersionedSegment(segment, toTriple(7000, 5, 2));
+  assert(publishVersionedSegment(segment) == 2);
+  // predicate 1's delta outgrew its base, so the base was merged anew and the old one retired too
+  assert(segment->epochs->retiredCount == 3);
+
+  SegmentSnapshot *second = segment->current;
+  assert(second->version == 2 && second->predicateCount == 5 && second->tripleCount == 1000 - 100 + 101);
+  assert(getSnapshotPredicate(second, 2) == getSnapshotPredicate(first, 2));
+  assert(getSnapshotPredicate(second, 1) != getSnapshotPredicate(first, 1));
+  assert(countSnapshotPredicate(second, 1) == 334 - 100 + 50 && countSnapshotPredicate(second, 4) == 50);
+  assert(getSnapshotPredicate(second, 1)->base->currentEntriesLength == 334 + 50 + 1);
+  assert(getSnapshotPredicate(second, 4)->base->currentEntriesLength == 50 + 1);
+  assert(!hasSnapshotTriple(second, 7000, 5, 1) && hasSnapshotTriple(second, 7000, 5, 2));
+  assert(hasSnapshotTriple(first, 0, 1, 1) && !hasSnapshotTriple(second, 0, 1, 1));
+  unsigned long count = 0;
+  Triple triple;
+  while (iterate(open, &triple)) {
+    count++;
+  }
+  assert(count == 334 && countSnapshotPredicate(first, 1) == 334 && first->version == 1);
+  open->free(open);
+
+  // the replaced snapshot, version and base go once the reader has left
+  endSnapshot(segment, reader);
+  assert(reclaimEpochObjects(segment->epochs) == 3 && segment->epochs->retiredCount == 0);
+
+  // removing every triple of a predicate drops it
+  removeTripleFromVersionedSegment(segment, toTriple(7000, 5, 2));
+  assert(publishVersionedSegment(segment) == 3 && segment->current->predicateCount == 4);
+  assert(getSnapshotPredicate(segment->current, 5) == NULL && segment->epochs->retiredCount == 0);
+  assert(publishVersionedSegment(segment) == 3);
+
+  // small batches share the base: only the removals from it and the pairs added since are copied
+  for (SubjectId s = 0; s < 10000; s++) {
+    addTripleToVersionedSegment(segment, toTriple(s, 6, s));
+  }
+  assert(publishVersionedSegment(segment) == 4);
+  SegmentSnapshot *fourth = beginSnapshot(segment, reader);
+  SnapshotPredicate *built = getSnapshotPredicate(fourth, 6);
+  assert(built->delta == NULL && built->view->soEntries == built->base->soEntries && built->view->borrowed);
+  for (SubjectId s = 0; s < 20; s++) {
+    addTripleToVersionedSegment(segment, toTriple(20000 + s, 6, s));
+    removeTripleFromVersionedSegment(segment, toTriple(s, 6, s));
+  }
+  // a pair added again after its removal is only shown again
+  addTripleToVersionedSegment(segment, toTriple(0, 6, 0));
+  assert(publishVersionedSegment(segment) == 5);
+  SnapshotPredicate *shared = getSnapshotPredicate(segment->current, 6);
+  assert(shared != built && shared->base == built->base && shared->view->soEntries == built->base->soEntries);
+  assert(shared->view->tombstoneCount == 19 && shared->delta->entryCount == 20);
+  // the reader's version and the old snapshot are retired, the base is not
+  assert(segment->epochs->retiredCount == 2);
+  assert(countSnapshotPredicate(fourth, 6) == 10000 && countSnapshotPredicate(segment->current, 6) == 10000 + 20 - 19);
+  assert(segment->current->tripleCount == fourth->tripleCount + 20 - 19);
+  assert(hasSnapshotTriple(segment->current, 0, 6, 0) && !hasSnapshotTriple(segment->current, 1, 6, 1));
+  assert(hasSnapshotTriple(segment->current, 20005, 6, 5) && !hasSnapshotTriple(fourth, 20005, 6, 5));
+  // triples come out in subject order across the base and the delta
+  Iterator *merged = createSnapshotPredicateIterator(segment->current, 6);
+  merged->init(merged);
+  SubjectId previous = 0;
+  while (iterate(merged, &triple)) {
+    assert(subjectIdFromTriple(triple) >= previous);
+    previous = subjectIdFromTriple(triple);
+  }
+  assert(previous == 20019);
+  merged->free(merged);
+  endSnapshot(segment, reader);
+
+  // a delta past the merge ratio folds into a new base and retires the old one
+  SegmentSnapshot *fifth = beginSnapshot(segment, reader);
+  for (SubjectId s = 0; s < 10000 / PREDICATE_ENTRY_DELTA_MERGE_RATIO; s++) {
+    addTripleToVersionedSegment(segment, toTriple(30000 + s, 6, s));
+  }
+  assert(publishVersionedSegment(segment) == 6);
+  assert(segment->epochs->retiredCount == 3);
+  SnapshotPredicate *rebuilt = getSnapshotPredicate(segment->current, 6);
+  assert(rebuilt->base != getSnapshotPredicate(fifth, 6)->base && rebuilt->delta == NULL && rebuilt->view->tombstoneCount == 0);
+  assert(rebuilt->base->entryCount == 10000 + 20 - 19 + 10000 / PREDICATE_ENTRY_DELTA_MERGE_RATIO);
+  assert(countSnapshotPredicate(segment->current, 6) == rebuilt->base->entryCount);
+  assert(countSnapshotPredicate(fifth, 6) == 10000 + 20 - 19);
+  endSnapshot(segment, reader);
+
+  unregisterSnapshotReader(segment, reader);
+  // every slot can be claimed once
+  int readers[EPOCH_DOMAIN_MAX_READERS];
+  for (int i = 0; i < EPOCH_DOMAIN_MAX_READERS; i++) {
+    readers[i] = registerSnapshotReader(segment);
+    assert(readers[i] >= 0);
+  }
+  assert(registerSnapshotReader(segment) == -1);
+  for (int i = 0; i < EPOCH_DOMAIN_MAX_READERS; i++) {
+    unregisterSnapshotReader(segment, readers[i]);
+  }
+  freeVersionedSegment(segment);
+}
+
+typedef struct {
+  VersionedSegment *segment;
+  unsigned long publishCount;
+  unsigned long done;
+  unsigned long snapshotCounts[4];
+} SnapshotTestContext;
+
+// every batch adds one triple to predicates 1 and 2 and removes one from 3, so a consistent snapshot
+// of version v has v triples in each of the first two and 100 - v in the third
+void snapshotTestTask(int threadIndex, int threadCount, void *context) {
+  SnapshotTestContext *test = (SnapshotTestContext *)context;
+  (void)threadCount;
+  if (threadIndex == 0) {
+    for (unsigned long v = 1; v <= test->publishCount; v++) {
+      addTripleToVersionedSegment(test->segment, toTriple(v, 1, v));
+      addTripleToVersionedSegment(test->segment, toTriple(v, 2, v));
+      removeTripleFromVersionedSegment(test->segment, toTriple(v, 3, v));
+      assert(publishVersionedSegment(test->segment) == v + 1);
+      if (v % 16 == 0) {
+        usleep(100);
+      }
+    }
+    __atomic_store_n(&test->done, 1, __ATOMIC_RELEASE);
+    return;
+  }
+  int reader = registerSnapshotReader(test->segment);
+  assert(reader >= 0);
+  unsigned long lastVersion = 0;
+  while (!__atomic_load_n(&test->done, __ATOMIC_ACQUIRE)) {
+    SegmentSnapshot *snapshot = beginSnapshot(test->segment, reader);
+    unsigned long v = snapshot->version - 1;
+    assert(snapshot->version >= lastVersion);
+    lastVersion = snapshot->version;
+    assert(countSnapshotPredicate(snapshot, 1) == v && countSnapshotPredicate(snapshot, 2) == v);
+    assert(countSnapshotPredicate(snapshot, 3) == 100 - v);
+    endSnapshot(test->segment, reader);
+    test->snapshotCounts[threadIndex]++;
+  }
+  unregisterSnapshotReader(test->segment, reader);
+}
+
+void testConcurrentSnapshots() {
+  printf("testConcurrentSnapshots\n");
+
+  SnapshotTestContext test;
+  test.segment = createVersionedSegment();
+  test.publishCount = 100;
+  test.done = 0;
+  for (SubjectId s = 1; s <= 100; s++) {
+    addTripleToVersionedSegment(test.segment, toTriple(s, 3, s));
+  }
+  publishVersionedSegment(test.segment);
+  memset(test.snapshotCounts, 0, sizeof(test.snapshotCounts));
+  runParallel(4, &snapshotTestTask, &test);
+  assert(test.segment->current->version == 101 && test.segment->current->predicateCount == 2);
+  // with the readers gone everything retired can go
+  reclaimEpochObjects(test.segment->epochs);
+  assert(test.segment->epochs->retiredCount == 0);
+  freeVersionedSegment(test.segment);
+}
+
 void testGlobalAssertions() {
   printf("testGlobalAssertions\n");
 
@@ -306,7 +3138,35 @@ int main(void) {
   testTriple();
   // testQuickSort();
   testPredicateEntry();
+  testRadixSort();
+  testBitPackedArray();
+  testCompressedPredicateEntry();
   testPredicateEntryORIterator();
   testPredicateEntryORIteratorNested();
   testPredicateEntryANDIterator();
+  testSegment();
+  testIteratorSeek();
+  testLeapfrogJoin();
+  testLeapfrogTriejoin();
+  testNextBatch();
+  testSIMDKernels();
+  testObjectOrderedIterators();
+  testSegmentFile();
+  testBulkLoader();
+  testDictionary();
+  testMorselExecutor();
+  testArena();
+  testSubjectBitmap();
+  testPointLookups();
+  testIncrementalOptimize();
+  testRemoval();
+  testExplainIterator();
+  testPredicateEntryStatistics();
+  testQueryPlanner();
+  testUnionIterator();
+  testTraversal();
+  testPageRank();
+  testConnectedComponents();
+  testVersionedSegment();
+  testConcurrentSnapshots();
 }
@@ -0,0 +1,425 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "traversal.h"
+#include "parallel.h"
+
+/*
+  Index
+*/
+
+// top-down steps hand out the frontier, and bottom-up steps the bitmap words, this many at a time
+#define TRAVERSAL_CHUNK_LENGTH 256
+// frontiers with fewer edges than this are expanded on the calling thread
+#define TRAVERSAL_PARALLEL_EDGE_COUNT 65536
+
+// one past the largest key of a sorted side, 0 when it is empty
+unsigned long long traversalKeyLimit(PredicateEntry *entry, unsigned char order) {
+  if (isCompressedPredicateEntry(entry)) {
+    CompressedAdjacency *adjacency = (order == SUBJECT_ORDER) ? entry->soCompressed : entry->osCompressed;
+    return (adjacency->keyCount == 0) ? 0 : getBitPackedValue(&adjacency->keys, adjacency->keyCount - 1) + 1;
+  }
+  assert(entry->entryCount == 0 || entry->sortedCount > 0);
+  // the base and the delta after it each end on their largest pair
+  EntityPair *pairs = (order == SUBJECT_ORDER) ? entry->soEntries : entry->osEntries;
+  unsigned long long limit = 0;
+  unsigned long ends[2] = {entry->sortedCount, entry->sortedCount + entry->deltaSortedCount};
+  for (int i = 0; i < 2; i++) {
+    if (ends[i] > 0) {
+      unsigned long long key = (unsigned long long)(pairs[ends[i] - 1] >> ENTITY_PAIR_HALF_BIT_COUNT) + 1;
+      limit = (key > limit) ? key : limit;
+    }
+  }
+  return limit;
+}
+
+typedef struct {
+  PredicateEntry **entries;
+  int entryCount;
+  // the sides read: a vertex's neighbors are the other component of the pairs keyed on it
+  unsigned char *orders;
+  int orderCount;
+  unsigned long vertexCount;
+  unsigned long *offsets;
+  EntityId *neighbors;
+  // counting fills offsets[v + 1] with v's degree; placing writes the neighbors
+  BOOL placing;
+} AdjacencyBuild;
+
+// each thread reads the pairs keyed on its own range of vertices, seeking every side to its start,
+// so neither pass needs atomics and each vertex's neighbors are placed in a fixed order
+void buildAdjacencyTask(int threadIndex, int threadCount, void *context) {
+  AdjacencyBuild *build = (AdjacencyBuild *)context;
+  unsigned long begin;
+  unsigned long end;
+  parallelChunk(build->vertexCount, threadIndex, threadCount, &begin, &end);
+  if (begin == end) {
+    return;
+  }
+  unsigned long *cursors = NULL;
+  if (build->placing) {
+    cursors = malloc(sizeof(unsigned long) * (end - begin));
+    memcpy(cursors, build->offsets + begin, sizeof(unsigned long) * (end - begin));
+  }
+  Triple *batch = malloc(sizeof(Triple) * ITERATOR_BATCH_LENGTH);
+  for (int e = 0; e < build->entryCount; e++) {
+    for (int o = 0; o < build->orderCount; o++) {
+      unsigned char order = build->orders[o];
+      Iterator *iterator = createPredicateEntryOrderedIterator(build->entries[e], order);
+      iterator->init(iterator);
+      if (!iterator->done(iterator)) {
+        iterator->seek(iterator, (EntityId)begin);
+      }
+      BOOL inRange = 1;
+      while (inRange) {
+        unsigned long found = nextBatch(iterator, batch, ITERATOR_BATCH_LENGTH);
+        inRange = found > 0;
+        for (unsigned long i = 0; i < found; i++) {
+          EntityId key = (order == SUBJECT_ORDER) ? subjectIdFromTriple(batch[i]) : objectIdFromTriple(batch[i]);
+          if (key >= end) {
+            inRange = 0;
+            break;
+          }
+          if (build->placing) {
+            build->neighbors[cursors[key - begin]++] = (order == SUBJECT_ORDER) ? objectIdFromTriple(batch[i]) : subjectIdFromTriple(batch[i]);
+          } else {
+            build->offsets[key + 1]++;
+          }
+        }
+      }
+      iterator->free(iterator);
+    }
+  }
+  free(batch);
+  free(cursors);
+}
+
+void buildAdjacency(AdjacencyBuild *build, int threadCount) {
+  build->offsets = calloc(build->vertexCount + 1, sizeof(unsigned long));
+  build->placing = 0;
+  runParallel(threadCount, &buildAdjacencyTask, build);
+  for (unsigned long v = 0; v < build->vertexCount; v++) {
+    build->offsets[v + 1] += build->offsets[v];
+  }
+  build->neighbors = malloc(sizeof(EntityId) * (build->offsets[build->vertexCount] + 1));
+  build->placing = 1;
+  runParallel(threadCount, &buildAdjacencyTask, build);
+}
+
+TraversalIndex *createTraversalIndex(PredicateEntry **entries, int entryCount, unsigned char direction, int threadCount) {
+  assert(direction == TRAVERSE_FORWARD || direction == TRAVERSE_BACKWARD || direction == TRAVERSE_BOTH);
+  if (threadCount < 1) {
+    threadCount = availableThreadCount();
+  }
+  unsigned long long vertexCount = 0;
+  for (int e = 0; e < entryCount; e++) {
+    // iterators call this too, so do it once up front rather than on every thread
+    preparePredicateEntryForReading(entries[e]);
+    for (unsigned char order = SUBJECT_ORDER; order <= OBJECT_ORDER; order++) {
+      unsigned long long limit = traversalKeyLimit(entries[e], order);
+      vertexCount = (limit > vertexCount) ? limit : vertexCount;
+    }
+  }
+
+  TraversalIndex *index = malloc(sizeof(TraversalIndex));
+  index->direction = direction;
+  index->vertexCount = vertexCount;
+
+  unsigned char forwardOrders[2] = {SUBJECT_ORDER, OBJECT_ORDER};
+  unsigned char backwardOrders[2] = {OBJECT_ORDER, SUBJECT_ORDER};
+  AdjacencyBuild build;
+  build.entries = entries;
+  build.entryCount = entryCount;
+  build.vertexCount = vertexCount;
+  build.orders = (direction == TRAVERSE_BACKWARD) ? backwardOrders : forwardOrders;
+  build.orderCount = (direction == TRAVERSE_BOTH) ? 2 : 1;
+  buildAdjacency(&build, threadCount);
+  index->offsets = build.offsets;
+  index->neighbors = build.neighbors;
+  index->edgeCount = index->offsets[vertexCount];
+
+  if (direction == TRAVERSE_BOTH) {
+    index->reverseOffsets = index->offsets;
+    index->reverseNeighbors = index->neighbors;
+  } else {
+    build.orders = (direction == TRAVERSE_BACKWARD) ? forwardOrders : backwardOrders;
+    buildAdjacency(&build, threadCount);
+    index->reverseOffsets = build.offsets;
+    index->reverseNeighbors = build.neighbors;
+  }
+  return index;
+}
+
+void freeTraversalIndex(TraversalIndex *index) {
+  if (index->reverseOffsets != index->offsets) {
+    free(index->reverseOffsets);
+    free(index->reverseNeighbors);
+  }
+  free(index->offsets);
+  free(index->neighbors);
+  free(index);
+}
+
+unsigned long traversalIndexMemoryUsage(TraversalIndex *index) {
+  unsigned long sides = (index->reverseOffsets != index->offsets) ? 2 : 1;
+  return sizeof(TraversalIndex) + sides * (sizeof(unsigned long) * (index->vertexCount + 1) + sizeof(EntityId) * index->edgeCount);
+}
+
+/*
+  Breadth-first traversal
+*/
+
+void initTraversalOptions(TraversalOptions *options) {
+  options->threadCount = 0;
+  options->maxDepth = TRAVERSAL_UNLIMITED_DEPTH;
+  options->strategy = TRAVERSAL_AUTOMATIC;
+  options->alpha = TRAVERSAL_DEFAULT_ALPHA;
+  options->beta = TRAVERSAL_DEFAULT_BETA;
+}
+
+// the vertices one thread reached in a top-down step
+typedef struct {
+  EntityId *vertices;
+  unsigned long count;
+  unsigned long currentLength;
+} TraversalBuffer;
+
+typedef struct {
+  TraversalIndex *index;
+  unsigned int *depths;
+  // the depth being assigned
+  unsigned int depth;
+  unsigned long nextChunk;
+
+  // top-down: the frontier as a list, the next one gathered from the threads' buffers
+  EntityId *frontier;
+  unsigned long frontierCount;
+  TraversalBuffer *buffers;
+
+  // bottom-up: the frontier and the next one as bitmaps
+  unsigned long long *frontierBits;
+  unsigned long long *nextBits;
+  unsigned long wordCount;
+
+  // per thread: the vertices reached and the edges out of them
+  unsigned long *reachedCounts;
+  unsigned long *reachedEdges;
+} TraversalStep;
+
+static inline unsigned long traversalDegree(TraversalIndex *index, EntityId vertex) {
+  return index->offsets[vertex + 1] - index->offsets[vertex];
+}
+
+void appendTraversalBuffer(TraversalBuffer *buffer, EntityId vertex) {
+  if (buffer->count == buffer->currentLength) {
+    buffer->currentLength = (buffer->currentLength > 0) ? buffer->currentLength * 2 : TRAVERSAL_CHUNK_LENGTH;
+    buffer->vertices = realloc(buffer->vertices, sizeof(EntityId) * buffer->currentLength);
+  }
+  buffer->vertices[buffer->count++] = vertex;
+}
+
+// the frontier's vertices claim their unreached neighbors; a claim is one compare and swap on the depth
+void topDownTask(int threadIndex, int threadCount, void *context) {
+  (void)threadCount;
+  TraversalStep *step = (TraversalStep *)context;
+  TraversalIndex *index = step->index;
+  TraversalBuffer *buffer = &step->buffers[threadIndex];
+  unsigned long edges = 0;
+  buffer->count = 0;
+  for (;;) {
+    unsigned long begin = __atomic_fetch_add(&step->nextChunk, TRAVERSAL_CHUNK_LENGTH, __ATOMIC_RELAXED);
+    if (begin >= step->frontierCount) {
+      break;
+    }
+    unsigned long end = (begin + TRAVERSAL_CHUNK_LENGTH < step->frontierCount) ? begin + TRAVERSAL_CHUNK_LENGTH : step->frontierCount;
+    for (unsigned long i = begin; i < end; i++) {
+      EntityId vertex = step->frontier[i];
+      unsigned long neighborsEnd = index->offsets[vertex + 1];
+      for (unsigned long e = index->offsets[vertex]; e < neighborsEnd; e++) {
+        EntityId neighbor = index->neighbors[e];
+        unsigned int unreached = TRAVERSAL_UNREACHED;
+        if (__atomic_load_n(&step->depths[neighbor], __ATOMIC_RELAXED) == TRAVERSAL_UNREACHED &&
+            __atomic_compare_exchange_n(&step->depths[neighbor], &unreached, step->depth, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+          appendTraversalBuffer(buffer, neighbor);
+          edges += traversalDegree(index, neighbor);
+        }
+      }
+    }
+  }
+  step->reachedCounts[threadIndex] = buffer->count;
+  step->reachedEdges[threadIndex] = edges;
+}
+
+// every unreached vertex looks for a parent in the frontier; a thread owns whole words of the
+// bitmaps and the depths under them, so nothing is shared but the frontier it reads
+void bottomUpTask(int threadIndex, int threadCount, void *context) {
+  (void)threadCount;
+  TraversalStep *step = (TraversalStep *)context;
+  TraversalIndex *index = step->index;
+  unsigned long count = 0;
+  unsigned long edges = 0;
+  for (;;) {
+    unsigned long begin = __atomic_fetch_add(&step->nextChunk, TRAVERSAL_CHUNK_LENGTH, __ATOMIC_RELAXED);
+    if (begin >= step->wordCount) {
+      break;
+    }
+    unsigned long end = (begin + TRAVERSAL_CHUNK_LENGTH < step->wordCount) ? begin + TRAVERSAL_CHUNK_LENGTH : step->wordCount;
+    for (unsigned long word = begin; word < end; word++) {
+      unsigned long long reached = 0;
+      unsigned long vertexEnd = (word + 1) * 64;
+      vertexEnd = (vertexEnd < index->vertexCount) ? vertexEnd : index->vertexCount;
+      for (unsigned long vertex = word * 64; vertex < vertexEnd; vertex++) {
+        if (step->depths[vertex] != TRAVERSAL_UNREACHED) {
+          continue;
+        }
+        unsigned long parentsEnd = index->reverseOffsets[vertex + 1];
+        for (unsigned long e = index->reverseOffsets[vertex]; e < parentsEnd; e++) {
+          EntityId parent = index->reverseNeighbors[e];
+          if ((step->frontierBits[parent >> 6] >> (parent & 63)) & 1) {
+            step->depths[vertex] = step->depth;
+            reached |= 1ULL << (vertex & 63);
+            count++;
+            edges += traversalDegree(index, (EntityId)vertex);
+            break;
+          }
+        }
+      }
+      step->nextBits[word] = reached;
+    }
+  }
+  step->reachedCounts[threadIndex] = count;
+  step->reachedEdges[threadIndex] = edges;
+}
+
+// runs one step and returns the vertices it reached, adding the edges out of them to edges
+unsigned long runTraversalStep(TraversalStep *step, ParallelTaskFn task, int threadCount, unsigned long *edges) {
+  step->nextChunk = 0;
+  runParallel(threadCount, task, step);
+  unsigned long count = 0;
+  *edges = 0;
+  for (int t = 0; t < threadCount; t++) {
+    count += step->reachedCounts[t];
+    *edges += step->reachedEdges[t];
+  }
+  return count;
+}
+
+void frontierToBits(TraversalStep *step) {
+  memset(step->frontierBits, 0, sizeof(unsigned long long) * step->wordCount);
+  for (unsigned long i = 0; i < step->frontierCount; i++) {
+    step->frontierBits[step->frontier[i] >> 6] |= 1ULL << (step->frontier[i] & 63);
+  }
+}
+
+void bitsToFrontier(TraversalStep *step) {
+  step->frontierCount = 0;
+  for (unsigned long word = 0; word < step->wordCount; word++) {
+    for (unsigned long long bits = step->frontierBits[word]; bits != 0; bits &= bits - 1) {
+      step->frontier[step->frontierCount++] = (EntityId)(word * 64 + __builtin_ctzll(bits));
+    }
+  }
+}
+
+TraversalResult *traverseBreadthFirst(TraversalIndex *index, EntityId *sources, unsigned long sourceCount, TraversalOptions *options) {
+  int threadCount = (options->threadCount < 1) ? availableThreadCount() : options->threadCount;
+  unsigned long vertexCount = index->vertexCount;
+  TraversalResult *result = malloc(sizeof(TraversalResult));
+  result->vertexCount = vertexCount;
+  result->depths = malloc(sizeof(unsigned int) * vertexCount);
+  memset(result->depths, 0xFF, sizeof(unsigned int) * vertexCount);
+  result->reachedCount = 0;
+  result->depth = 0;
+  result->bottomUpSteps = 0;
+
+  TraversalStep step;
+  step.index = index;
+  step.depths = result->depths;
+  step.frontier = malloc(sizeof(EntityId) * (vertexCount + 1));
+  step.frontierCount = 0;
+  step.buffers = calloc(threadCount, sizeof(TraversalBuffer));
+  step.wordCount = (vertexCount + 63) / 64;
+  step.frontierBits = NULL;
+  step.nextBits = NULL;
+  step.reachedCounts = malloc(sizeof(unsigned long) * threadCount);
+  step.reachedEdges = malloc(sizeof(unsigned long) * threadCount);
+
+  // the edges out of the frontier, and out of the vertices not reached yet
+  unsigned long frontierEdges = 0;
+  unsigned long unexploredEdges = index->edgeCount;
+  for (unsigned long i = 0; i < sourceCount; i++) {
+    assert(sources[i] < vertexCount);
+    if (result->depths[sources[i]] == TRAVERSAL_UNREACHED) {
+      result->depths[sources[i]] = 0;
+      step.frontier[step.frontierCount++] = sources[i];
+      frontierEdges += traversalDegree(index, sources[i]);
+    }
+  }
+  result->reachedCount = step.frontierCount;
+  unexploredEdges -= frontierEdges;
+
+  BOOL bottomUp = 0;
+  unsigned long frontierCount = step.frontierCount;
+  for (unsigned int depth = 1; frontierCount > 0 && depth - 1 < options->maxDepth; depth++) {
+    BOOL wasBottomUp = bottomUp;
+    if (options->strategy == TRAVERSAL_AUTOMATIC) {
+      if (!bottomUp) {
+        bottomUp = frontierEdges > unexploredEdges / options->alpha;
+      } else {
+        bottomUp = frontierCount >= vertexCount / options->beta;
+      }
+    } else {
+      bottomUp = options->strategy == TRAVERSAL_BOTTOM_UP;
+    }
+    if (bottomUp && step.frontierBits == NULL) {
+      step.frontierBits = malloc(sizeof(unsigned long long) * step.wordCount);
+      step.nextBits = malloc(sizeof(unsigned long long) * step.wordCount);
+    }
+    if (bottomUp && !wasBottomUp) {
+      frontierToBits(&step);
+    } else if (!bottomUp && wasBottomUp) {
+      bitsToFrontier(&step);
+    }
+
+    step.depth = depth;
+    unsigned long edges;
+    if (bottomUp) {
+      frontierCount = runTraversalStep(&step, &bottomUpTask, threadCount, &edges);
+      unsigned long long *bits = step.frontierBits;
+      step.frontierBits = step.nextBits;
+      step.nextBits = bits;
+      result->bottomUpSteps++;
+    } else {
+      int stepThreadCount = (frontierEdges < TRAVERSAL_PARALLEL_EDGE_COUNT) ? 1 : threadCount;
+      frontierCount = runTraversalStep(&step, &topDownTask, stepThreadCount, &edges);
+      step.frontierCount = 0;
+      for (int t = 0; t < stepThreadCount; t++) {
+        memcpy(step.frontier + step.frontierCount, step.buffers[t].vertices, sizeof(EntityId) * step.buffers[t].count);
+        step.frontierCount += step.buffers[t].count;
+      }
+    }
+    frontierEdges = edges;
+    unexploredEdges -= edges;
+    result->reachedCount += frontierCount;
+    if (frontierCount > 0) {
+      result->depth = depth;
+    }
+  }
+
+  for (int t = 0; t < threadCount; t++) {
+    free(step.buffers[t].vertices);
+  }
+  free(step.buffers);
+  free(step.frontier);
+  free(step.frontierBits);
+  free(step.nextBits);
+  free(step.reachedCounts);
+  free(step.reachedEdges);
+  return result;
+}
+
+void freeTraversalResult(TraversalResult *result) {
+  free(result->depths);
+  free(result);
+}
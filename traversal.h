@@ -0,0 +1,83 @@
+#ifndef TRAVERSAL_H_INCLUDED
+#define TRAVERSAL_H_INCLUDED
+
+#include "triple.h"
+#include "predicate_entry.h"
+
+/*
+  Breadth-first traversal over the edges of one or more predicates. A TraversalIndex lays the
+  entries' pairs out as CSR indexed directly by vertex id, so expanding a vertex is two offsets
+  and a run of neighbors instead of a seek into every entry. It is built once, read-only after,
+  and shared by any number of traversals.
+
+  Traversals are direction-optimizing (Beamer et al.): while the frontier is small its vertices
+  push to their unvisited neighbors (top-down); once the frontier's edges pass 1/alpha of the
+  edges still unexplored, every unvisited vertex instead looks through its reverse edges for a
+  parent in a bitmap of the frontier and stops at the first (bottom-up), which skips most of the
+  edges of the big middle levels. Once the frontier shrinks below vertexCount / beta vertices the
+  traversal goes top-down again. Both kinds of step run on several threads.
+*/
+
+// which way edges are followed: subject to object, object to subject, or both, as if undirected
+#define TRAVERSE_FORWARD  ((unsigned char)0)
+#define TRAVERSE_BACKWARD ((unsigned char)1)
+#define TRAVERSE_BOTH     ((unsigned char)2)
+
+typedef struct {
+  unsigned char direction;
+  // vertices are the ids 0 .. vertexCount - 1, subjects and objects alike
+  unsigned long vertexCount;
+  // the edges followed, once per predicate holding them; twice over for TRAVERSE_BOTH
+  unsigned long edgeCount;
+  // neighbors[offsets[v] .. offsets[v + 1] - 1] are the vertices one edge on from v
+  unsigned long *offsets;
+  EntityId *neighbors;
+  // the same edges reversed, for bottom-up steps; the arrays above for TRAVERSE_BOTH
+  unsigned long *reverseOffsets;
+  EntityId *reverseNeighbors;
+} TraversalIndex;
+
+// the entries must be sorted, as for iterating them; threadCount < 1 uses availableThreadCount()
+TraversalIndex *createTraversalIndex(PredicateEntry **entries, int entryCount, unsigned char direction, int threadCount);
+void freeTraversalIndex(TraversalIndex *index);
+unsigned long traversalIndexMemoryUsage(TraversalIndex *index);
+
+#define TRAVERSAL_UNREACHED       (~0U)
+#define TRAVERSAL_UNLIMITED_DEPTH (~0U)
+
+#define TRAVERSAL_AUTOMATIC ((unsigned char)0)
+#define TRAVERSAL_TOP_DOWN  ((unsigned char)1)
+#define TRAVERSAL_BOTTOM_UP ((unsigned char)2)
+
+// the switching thresholds from the paper, which hold up on social and web graphs
+#define TRAVERSAL_DEFAULT_ALPHA 14
+#define TRAVERSAL_DEFAULT_BETA  24
+
+typedef struct {
+  // < 1 uses availableThreadCount()
+  int threadCount;
+  // vertices more than maxDepth edges from every source are left unreached, e.g. 2 for 2-hop neighborhoods
+  unsigned int maxDepth;
+  // TRAVERSAL_AUTOMATIC switches as above; the others fix the kind of step, for testing and measuring
+  unsigned char strategy;
+  unsigned int alpha;
+  unsigned int beta;
+} TraversalOptions;
+
+typedef struct {
+  unsigned long vertexCount;
+  // edges from the nearest source, TRAVERSAL_UNREACHED for the vertices not reached
+  unsigned int *depths;
+  // the sources included
+  unsigned long reachedCount;
+  // of the farthest vertex reached
+  unsigned int depth;
+  unsigned int bottomUpSteps;
+} TraversalResult;
+
+void initTraversalOptions(TraversalOptions *options);
+// sources must be below the index's vertexCount; repeats are fine
+TraversalResult *traverseBreadthFirst(TraversalIndex *index, EntityId *sources, unsigned long sourceCount, TraversalOptions *options);
+void freeTraversalResult(TraversalResult *result);
+
+#endif
@@ -5,6 +5,20 @@ typedef unsigned char BOOL;
 #define TRUE ((BOOL)1);
 #define FALSE ((BOOL)0);
 
+// id layouts, picked at build time with -DCGRAPH_ID_MODE=<mode>
+// packed64 keeps a whole triple in one 64-bit word and is the fastest
+#define CGRAPH_ID_MODE_PACKED64 0
+// 32/32/32 bit ids in a 128-bit Triple; EntityPair stays 64 bits, so entries and kernels are unchanged
+#define CGRAPH_ID_MODE_WIDE32 1
+// 40/32/40 bit ids in a 128-bit Triple, with a 128-bit EntityPair
+#define CGRAPH_ID_MODE_WIDE40 2
+
+#ifndef CGRAPH_ID_MODE
+#define CGRAPH_ID_MODE CGRAPH_ID_MODE_PACKED64
+#endif
+
+#if CGRAPH_ID_MODE == CGRAPH_ID_MODE_PACKED64
+
 typedef unsigned int EntityId;
 typedef EntityId SubjectId;
 typedef unsigned int PredicateId;
@@ -20,13 +34,49 @@ typedef unsigned long long Triple;
 // NOTE: these widths must fit into PredicateId
 #define PREDICATE_BIT_WIDTH 20
 
+#elif CGRAPH_ID_MODE == CGRAPH_ID_MODE_WIDE32
+
+typedef unsigned int EntityId;
+typedef EntityId SubjectId;
+typedef unsigned int PredicateId;
+typedef EntityId ObjectId;
+
+// __extension__ keeps -Wpedantic quiet about the GCC/Clang 128-bit integer
+__extension__ typedef unsigned __int128 Triple;
+
+#define SUBJECT_BIT_WIDTH 32
+#define OBJECT_BIT_WIDTH 32
+#define PREDICATE_BIT_WIDTH 32
+
+#elif CGRAPH_ID_MODE == CGRAPH_ID_MODE_WIDE40
+
+typedef unsigned long long EntityId;
+typedef EntityId SubjectId;
+typedef unsigned int PredicateId;
+typedef EntityId ObjectId;
+
+__extension__ typedef unsigned __int128 Triple;
+
+#define SUBJECT_BIT_WIDTH 40
+#define OBJECT_BIT_WIDTH 40
+#define PREDICATE_BIT_WIDTH 32
+
+#else
+#error "unknown CGRAPH_ID_MODE"
+#endif
+
+// largest id each position can hold
+#define SUBJECT_ID_MAX ((SubjectId)(((unsigned long long)1 << SUBJECT_BIT_WIDTH) - 1))
+#define PREDICATE_ID_MAX ((PredicateId)(((unsigned long long)1 << PREDICATE_BIT_WIDTH) - 1))
+#define OBJECT_ID_MAX ((ObjectId)(((unsigned long long)1 << OBJECT_BIT_WIDTH) - 1))
+
 #define TRIPLE_MASK ((Triple)~((Triple)0))
 #define TRIPLE_BIT_COUNT (SUBJECT_BIT_WIDTH + PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH)
 
 #if (TRIPLE_BIT_COUNT && (TRIPLE_BIT_COUNT & (TRIPLE_BIT_COUNT - 1)))
 // #pragma message ( "correcting for extra bits" )
 #define EXTRA_MSB_MASK ((Triple)~(TRIPLE_MASK << (SUBJECT_BIT_WIDTH + PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH)))
-#define SUBJECT_MASK ((EXTRA_MSB_MASK & TRIPLE_MASK) << (PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH))
+#define SUBJECT_MASK (EXTRA_MSB_MASK & (TRIPLE_MASK << (PREDICATE_BIT_WIDTH + OBJECT_BIT_WIDTH)))
 #define OBJECT_MASK ((EXTRA_MSB_MASK & TRIPLE_MASK) >> (SUBJECT_BIT_WIDTH + PREDICATE_BIT_WIDTH))
 #define PREDICATE_MASK (EXTRA_MSB_MASK & ((Triple)~((Triple)SUBJECT_MASK) & (Triple)~((Triple)OBJECT_MASK)))
 #else
@@ -41,4 +91,9 @@ PredicateId predicateIdFromTriple(Triple triple);
 ObjectId objectIdFromTriple(Triple triple);
 Triple toTriple(SubjectId subject, PredicateId predicate, ObjectId object);
 
+// checked by widening first, so it does not turn into an always-true compare when an id fills its type
+static inline BOOL isValidPredicateId(PredicateId predicate) {
+  return ((unsigned long long)predicate >> PREDICATE_BIT_WIDTH) == 0;
+}
+
 #endif
@@ -0,0 +1,284 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "union_iterator.h"
+#include "simd_kernels.h"
+
+/*
+  Loser tree
+*/
+
+// whether leaf a's triple comes before leaf b's; equal keys go to the earlier input, as in nextOperandOR
+static inline BOOL unionLeafBeats(UnionIterator *p, int a, int b) {
+  return p->keys[a] < p->keys[b] || (p->keys[a] == p->keys[b] && a < b);
+}
+
+void loadUnionKey(UnionIterator *p, int leaf) {
+  Iterator *input = p->inputs[leaf];
+  p->keys[leaf] = input->done(input) ? UNION_EXHAUSTED_KEY : (unsigned long long)input->peekKey(input);
+}
+
+// plays the matches below node and returns the winner, leaving each match's loser in the tree
+int buildUnionTree(UnionIterator *p, int node) {
+  if (node >= p->leafCount) {
+    return node - p->leafCount;
+  }
+  int left = buildUnionTree(p, 2 * node);
+  int right = buildUnionTree(p, 2 * node + 1);
+  if (unionLeafBeats(p, left, right)) {
+    p->tree[node] = right;
+    return left;
+  }
+  p->tree[node] = left;
+  return right;
+}
+
+void rebuildUnionTree(UnionIterator *p) {
+  for (int leaf = 0; leaf < p->inputCount; leaf++) {
+    loadUnionKey(p, leaf);
+  }
+  p->tree[0] = buildUnionTree(p, 1);
+}
+
+// replays the matches on the path of the winner, whose key has just moved
+void replayUnionTree(UnionIterator *p) {
+  int winner = p->tree[0];
+  for (int node = (winner + p->leafCount) >> 1; node > 0; node >>= 1) {
+    if (unionLeafBeats(p, p->tree[node], winner)) {
+      int loser = winner;
+      winner = p->tree[node];
+      p->tree[node] = loser;
+    }
+  }
+  ITERATOR_STATS_ADD(p, comparisons, __builtin_ctz(p->leafCount));
+  p->tree[0] = winner;
+}
+
+// the leaf that would win if the winner were gone: the best of the losers on the winner's path
+int unionRunnerUp(UnionIterator *p) {
+  int runnerUp = -1;
+  for (int node = (p->tree[0] + p->leafCount) >> 1; node > 0; node >>= 1) {
+    if (runnerUp < 0 || unionLeafBeats(p, p->tree[node], runnerUp)) {
+      runnerUp = p->tree[node];
+    }
+  }
+  return runnerUp;
+}
+
+// moves every input off the key just emitted, for UNION_DISTINCT_KEYS
+void skipUnionKey(UnionIterator *p, unsigned long long key) {
+  while (p->keys[p->tree[0]] == key) {
+    Iterator *input = p->inputs[p->tree[0]];
+    if (key < (unsigned long long)(EntityId)~(EntityId)0) {
+      input->seek(input, (EntityId)(key + 1));
+    } else {
+      while (!input->done(input) && input->peekKey(input) == key) {
+        input->advance(input);
+      }
+    }
+    loadUnionKey(p, p->tree[0]);
+    replayUnionTree(p);
+  }
+}
+
+/*
+  Union iterator
+*/
+
+void advanceUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  assert(!iterator->done(iterator));
+  UnionIterator *p = (UnionIterator *)iterator;
+  int winner = p->tree[0];
+  if (p->mode == UNION_DISTINCT_KEYS) {
+    skipUnionKey(p, p->keys[winner]);
+    return;
+  }
+  p->inputs[winner]->advance(p->inputs[winner]);
+  loadUnionKey(p, winner);
+  replayUnionTree(p);
+}
+
+void nextOperandUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+}
+
+Triple peekUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  assert(!iterator->done(iterator));
+  UnionIterator *p = (UnionIterator *)iterator;
+  Iterator *input = p->inputs[p->tree[0]];
+  return input->peek(input);
+}
+
+EntityId peekKeyUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  assert(!iterator->done(iterator));
+  UnionIterator *p = (UnionIterator *)iterator;
+  return (EntityId)p->keys[p->tree[0]];
+}
+
+BOOL doneUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  return p->keys[p->tree[0]] == UNION_EXHAUSTED_KEY;
+}
+
+void initUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  for (int i = 0; i < p->inputCount; i++) {
+    p->inputs[i]->init(p->inputs[i]);
+  }
+  rebuildUnionTree(p);
+}
+
+void seekUnion(Iterator *iterator, EntityId target) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  // inputs already at or past the target stay put; every key may move, so the tree is played again
+  for (int i = 0; i < p->inputCount; i++) {
+    if (p->keys[i] < (unsigned long long)target) {
+      p->inputs[i]->seek(p->inputs[i], target);
+    }
+  }
+  rebuildUnionTree(p);
+}
+
+unsigned long nextBatchUnion(Iterator *iterator, Triple *triples, unsigned long capacity) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  unsigned long count = 0;
+  while (count < capacity && p->keys[p->tree[0]] != UNION_EXHAUSTED_KEY) {
+    int winner = p->tree[0];
+    Iterator *input = p->inputs[winner];
+    if (p->mode == UNION_DISTINCT_KEYS) {
+      triples[count++] = input->peek(input);
+      skipUnionKey(p, p->keys[winner]);
+      continue;
+    }
+
+    // the winner keeps winning up to the runner-up's key, and through it when it is the earlier input
+    int runnerUp = unionRunnerUp(p);
+    unsigned long long bound = (runnerUp < 0) ? UNION_EXHAUSTED_KEY : p->keys[runnerUp];
+    BOOL throughBound = runnerUp < 0 || winner < runnerUp;
+    if (isPlainEntryIterator(input)) {
+      PredicateEntryIterator *entryIterator = (PredicateEntryIterator *)input;
+      EntityPair *pairs = (entryIterator->order == SUBJECT_ORDER) ? entryIterator->entry->soEntries : entryIterator->entry->osEntries;
+      unsigned long entryCount = entryIterator->entry->entryCount;
+      unsigned long end = entryCount;
+      if (bound != UNION_EXHAUSTED_KEY && !(throughBound && bound >= (unsigned long long)ENTITY_PAIR_HALF_MASK)) {
+        EntityPair boundPair = (EntityPair)(bound + throughBound) << ENTITY_PAIR_HALF_BIT_COUNT;
+        end = lowerBoundEntityPairs(pairs, entryIterator->position, entryCount, boundPair);
+      }
+      unsigned long run = end - entryIterator->position;
+      count += input->nextBatch(input, triples + count, (run < capacity - count) ? run : capacity - count);
+    } else {
+      do {
+        triples[count++] = input->peek(input);
+        input->advance(input);
+      } while (count < capacity && !input->done(input) &&
+               ((unsigned long long)input->peekKey(input) < bound || (throughBound && (unsigned long long)input->peekKey(input) == bound)));
+    }
+    loadUnionKey(p, winner);
+    replayUnionTree(p);
+  }
+  return count;
+}
+
+void freeUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  for (int i = 0; i < p->inputCount; i++) {
+    p->inputs[i]->free(p->inputs[i]);
+  }
+  free(p->inputs);
+  free(p->keys);
+  free(p->tree);
+  free(iterator);
+}
+
+Iterator *cloneUnion(Iterator *iterator) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  Iterator **inputs = malloc(sizeof(Iterator *) * p->inputCount);
+  for (int i = 0; i < p->inputCount; i++) {
+    inputs[i] = p->inputs[i]->clone(p->inputs[i]);
+  }
+  Iterator *clone = createUnionIterator(inputs, p->inputCount, p->mode);
+  free(inputs);
+  return clone;
+}
+
+void describeUnion(Iterator *iterator, char *label, unsigned long length) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  snprintf(label, length, "UNION inputs=%d%s", p->inputCount, (p->mode == UNION_DISTINCT_KEYS) ? " distinct keys" : "");
+}
+
+Iterator *inputUnion(Iterator *iterator, int index) {
+  assert(iterator->TYPE == UNION_ITERATOR);
+  UnionIterator *p = (UnionIterator *)iterator;
+  return (index < p->inputCount) ? p->inputs[index] : NULL;
+}
+
+int unionLeafCount(int inputCount) {
+  int leafCount = 1;
+  while (leafCount < inputCount) {
+    leafCount <<= 1;
+  }
+  return leafCount;
+}
+
+// ownInputs holds inputCount inputs, keys leafCount keys and tree leafCount leaves
+void initUnionIterator(UnionIterator *iterator, Iterator **inputs, int inputCount, unsigned char mode,
+                       Iterator **ownInputs, unsigned long long *keys, int *tree) {
+  assert(inputCount > 0);
+  assert(mode == UNION_ALL_TRIPLES || mode == UNION_DISTINCT_KEYS);
+  iterator->fn.TYPE = UNION_ITERATOR;
+  iterator->fn.advance = &advanceUnion;
+  iterator->fn.nextOperand = &nextOperandUnion;
+  iterator->fn.peek = &peekUnion;
+  iterator->fn.peekKey = &peekKeyUnion;
+  iterator->fn.done = &doneUnion;
+  iterator->fn.init = &initUnion;
+  iterator->fn.free = &freeUnion;
+  iterator->fn.seek = &seekUnion;
+  iterator->fn.nextBatch = &nextBatchUnion;
+  iterator->fn.clone = &cloneUnion;
+  iterator->fn.describe = &describeUnion;
+  iterator->fn.input = &inputUnion;
+  iterator->inputs = ownInputs;
+  for (int i = 0; i < inputCount; i++) {
+    iterator->inputs[i] = inputs[i];
+  }
+  iterator->inputCount = inputCount;
+  iterator->mode = mode;
+  iterator->leafCount = unionLeafCount(inputCount);
+  iterator->keys = keys;
+  iterator->tree = tree;
+  // done until init loads the inputs' keys
+  for (int leaf = 0; leaf < iterator->leafCount; leaf++) {
+    iterator->keys[leaf] = UNION_EXHAUSTED_KEY;
+    iterator->tree[leaf] = 0;
+  }
+  ITERATOR_STATS_INSTALL(iterator);
+}
+
+Iterator *createUnionIterator(Iterator **inputs, int inputCount, unsigned char mode) {
+  UnionIterator *iterator = malloc(sizeof(UnionIterator));
+  int leafCount = unionLeafCount(inputCount);
+  initUnionIterator(iterator, inputs, inputCount, mode, malloc(sizeof(Iterator *) * inputCount),
+                    malloc(sizeof(unsigned long long) * leafCount), malloc(sizeof(int) * leafCount));
+  return (Iterator*)iterator;
+}
+
+Iterator *createUnionIteratorInArena(Arena *arena, Iterator **inputs, int inputCount, unsigned char mode) {
+  UnionIterator *iterator = arenaAllocate(arena, sizeof(UnionIterator));
+  int leafCount = unionLeafCount(inputCount);
+  initUnionIterator(iterator, inputs, inputCount, mode, arenaAllocate(arena, sizeof(Iterator *) * inputCount),
+                    arenaAllocate(arena, sizeof(unsigned long long) * leafCount), arenaAllocate(arena, sizeof(int) * leafCount));
+  iterator->fn.free = &freeArenaIterator;
+  return (Iterator*)iterator;
+}
@@ -0,0 +1,40 @@
+#ifndef UNION_ITERATOR_H_INCLUDED
+#define UNION_ITERATOR_H_INCLUDED
+
+#include "triple.h"
+#include "iterator.h"
+#include "predicate_entry.h"
+
+/*
+  K-way union over inputs sorted by key (see peekKey): the same triples, in the same order, as a
+  tree of OR iterators with the inputs as its leaves from left to right, so triples with equal keys
+  come out in input order. A loser tree over the inputs' cached keys picks the next triple in
+  O(log k) comparisons without calling into the inputs, and the batch loop copies whole runs out of
+  plain entry iterators. The union takes ownership of the inputs.
+*/
+
+// every triple of every input
+#define UNION_ALL_TRIPLES  ((unsigned char)0)
+// only the first triple of each key, e.g. the distinct subjects of a set of predicates
+#define UNION_DISTINCT_KEYS ((unsigned char)1)
+
+typedef struct {
+  Iterator fn;
+  Iterator **inputs;
+  int inputCount;
+  unsigned char mode;
+  // a power of two >= inputCount; the leaves past inputCount are always exhausted
+  int leafCount;
+  // each leaf's current key, UNION_EXHAUSTED_KEY once its input is done
+  unsigned long long *keys;
+  // tree[0] is the leaf under the iterator, tree[1 .. leafCount - 1] the loser of each match below it
+  int *tree;
+} UnionIterator;
+
+#define UNION_EXHAUSTED_KEY (~0ULL)
+
+Iterator *createUnionIterator(Iterator **inputs, int inputCount, unsigned char mode);
+// see the InArena iterators in predicate_entry.h; inputs is copied into the arena
+Iterator *createUnionIteratorInArena(Arena *arena, Iterator **inputs, int inputCount, unsigned char mode);
+
+#endif
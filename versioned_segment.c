@@ -0,0 +1,297 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "versioned_segment.h"
+
+#define VERSIONED_SEGMENT_INITIAL_CHANGES_LENGTH 64
+
+SegmentSnapshot *createSegmentSnapshot(unsigned long version, unsigned long predicateCount) {
+  SegmentSnapshot *snapshot = malloc(sizeof(SegmentSnapshot));
+  snapshot->version = version;
+  snapshot->predicates = malloc(sizeof(PredicateId) * (predicateCount + 1));
+  snapshot->entries = malloc(sizeof(SnapshotPredicate *) * (predicateCount + 1));
+  snapshot->predicateCount = 0;
+  snapshot->tripleCount = 0;
+  return snapshot;
+}
+
+// only the snapshot itself: its predicates may live on in later snapshots
+void freeSegmentSnapshot(void *object) {
+  SegmentSnapshot *snapshot = (SegmentSnapshot *)object;
+  free(snapshot->predicates);
+  free(snapshot->entries);
+  free(snapshot);
+}
+
+// only the version itself: its base may live on in later versions
+void freeSnapshotPredicate(void *object) {
+  SnapshotPredicate *predicate = (SnapshotPredicate *)object;
+  freePredicateEntry(predicate->view);
+  if (predicate->delta != NULL) {
+    freePredicateEntry(predicate->delta);
+  }
+  free(predicate);
+}
+
+void freeRetiredPredicateEntry(void *object) {
+  freePredicateEntry((PredicateEntry *)object);
+}
+
+VersionedSegment *createVersionedSegment() {
+  VersionedSegment *segment = malloc(sizeof(VersionedSegment));
+  segment->current = createSegmentSnapshot(0, 0);
+  segment->epochs = createEpochDomain();
+  segment->changeCount = 0;
+  segment->currentChangesLength = VERSIONED_SEGMENT_INITIAL_CHANGES_LENGTH;
+  segment->changes = malloc(sizeof(SegmentChange) * segment->currentChangesLength);
+  return segment;
+}
+
+void freeVersionedSegment(VersionedSegment *segment) {
+  SegmentSnapshot *snapshot = segment->current;
+  for (unsigned long i = 0; i < snapshot->predicateCount; i++) {
+    PredicateEntry *base = snapshot->entries[i]->base;
+    freeSnapshotPredicate(snapshot->entries[i]);
+    freePredicateEntry(base);
+  }
+  freeSegmentSnapshot(snapshot);
+  freeEpochDomain(segment->epochs);
+  free(segment->changes);
+  free(segment);
+}
+
+/*
+  Readers
+*/
+
+int registerSnapshotReader(VersionedSegment *segment) {
+  return registerEpochReader(segment->epochs);
+}
+
+void unregisterSnapshotReader(VersionedSegment *segment, int reader) {
+  unregisterEpochReader(segment->epochs, reader);
+}
+
+SegmentSnapshot *beginSnapshot(VersionedSegment *segment, int reader) {
+  enterEpoch(segment->epochs, reader);
+  return __atomic_load_n(&segment->current, __ATOMIC_SEQ_CST);
+}
+
+void endSnapshot(VersionedSegment *segment, int reader) {
+  exitEpoch(segment->epochs, reader);
+}
+
+SnapshotPredicate *getSnapshotPredicate(SegmentSnapshot *snapshot, PredicateId predicate) {
+  unsigned long low = 0;
+  unsigned long high = snapshot->predicateCount;
+  while (low < high) {
+    unsigned long middle = low + (high - low) / 2;
+    if (snapshot->predicates[middle] < predicate) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return (low < snapshot->predicateCount && snapshot->predicates[low] == predicate) ? snapshot->entries[low] : NULL;
+}
+
+Iterator *createSnapshotPredicateIterator(SegmentSnapshot *snapshot, PredicateId predicate) {
+  SnapshotPredicate *entry = getSnapshotPredicate(snapshot, predicate);
+  if (entry == NULL) {
+    return NULL;
+  }
+  Iterator *iterator = createPredicateEntryIterator(entry->view);
+  if (entry->delta != NULL) {
+    iterator = createPredicateEntryORIterator(iterator, createPredicateEntryIterator(entry->delta));
+  }
+  return iterator;
+}
+
+BOOL hasSnapshotTriple(SegmentSnapshot *snapshot, SubjectId subject, PredicateId predicate, ObjectId object) {
+  SnapshotPredicate *entry = getSnapshotPredicate(snapshot, predicate);
+  return entry != NULL && (predicateEntryHasPair(entry->view, subject, object)
+                           || (entry->delta != NULL && predicateEntryHasPair(entry->delta, subject, object)));
+}
+
+/*
+  Writer
+*/
+
+void recordSegmentChange(VersionedSegment *segment, Triple triple, BOOL removal) {
+  assert(isValidPredicateId(predicateIdFromTriple(triple)));
+  if (segment->changeCount == segment->currentChangesLength) {
+    segment->currentChangesLength *= 2;
+    segment->changes = realloc(segment->changes, sizeof(SegmentChange) * segment->currentChangesLength);
+  }
+  SegmentChange *change = &segment->changes[segment->changeCount];
+  change->triple = triple;
+  change->removal = removal;
+  change->sequence = segment->changeCount++;
+}
+
+void addTripleToVersionedSegment(VersionedSegment *segment, Triple triple) {
+  recordSegmentChange(segment, triple, 0);
+}
+
+void removeTripleFromVersionedSegment(VersionedSegment *segment, Triple triple) {
+  recordSegmentChange(segment, triple, 1);
+}
+
+int compareSegmentChanges(const void *a, const void *b) {
+  const SegmentChange *x = (const SegmentChange *)a;
+  const SegmentChange *y = (const SegmentChange *)b;
+  PredicateId xPredicate = predicateIdFromTriple(x->triple);
+  PredicateId yPredicate = predicateIdFromTriple(y->triple);
+  if (xPredicate != yPredicate) {
+    return (xPredicate > yPredicate) - (xPredicate < yPredicate);
+  }
+  return (x->sequence > y->sequence) - (x->sequence < y->sequence);
+}
+
+// the live pairs of view and delta as one sorted entry, for the versions after this one to share
+PredicateEntry *mergeSnapshotPredicate(PredicateId predicate, PredicateEntry *view, PredicateEntry *delta) {
+  PredicateEntry *base = (view != NULL) ? copyPredicateEntry(view, delta->entryCount) : createPredicateEntryWithCapacity(predicate, delta->entryCount + 1);
+  compactPredicateEntry(base);
+  compactPredicateEntry(delta);
+  memcpy(base->soEntries + base->entryCount, delta->soEntries, sizeof(EntityPair) * delta->entryCount);
+  memcpy(base->osEntries + base->entryCount, delta->osEntries, sizeof(EntityPair) * delta->entryCount);
+  base->entryCount += delta->entryCount;
+  optimizePredicateEntry(base);
+  return base;
+}
+
+// the predicate's next version with the changes applied, or NULL when it ends up empty; tripleCount
+// is adjusted by the triples added and removed
+SnapshotPredicate *applySegmentChanges(PredicateId predicate, SnapshotPredicate *published, SegmentChange *changes, unsigned long changeCount,
+                                       unsigned long *tripleCount) {
+  unsigned long additions = 0;
+  for (unsigned long i = 0; i < changeCount; i++) {
+    additions += !changes[i].removal;
+  }
+  // the base stays shared: only the removals from it and the pairs added since are copied
+  PredicateEntry *view = (published != NULL) ? createPredicateEntryView(published->view) : NULL;
+  PredicateEntry *delta = (published != NULL && published->delta != NULL) ? copyPredicateEntry(published->delta, additions)
+                                                                          : createPredicateEntryWithCapacity(predicate, additions + 1);
+  for (unsigned long i = 0; i < changeCount; i++) {
+    SubjectId subject = subjectIdFromTriple(changes[i].triple);
+    ObjectId object = objectIdFromTriple(changes[i].triple);
+    if (!changes[i].removal) {
+      // adding a removed pair back only drops its tombstones, as addToPredicateEntry does within one entry
+      if (view != NULL && dropPredicateEntryTombstone(view, subject, object)) {
+        dropPredicateEntryTombstone(delta, subject, object);
+      } else {
+        addToPredicateEntry(delta, subject, object);
+      }
+      (*tripleCount)++;
+      continue;
+    }
+    // a removal hides every copy of the pair, and it may be in both
+    BOOL removedFromBase = view != NULL && removeFromPredicateEntry(view, subject, object);
+    BOOL removedFromDelta = delta->entryCount > 0 && removeFromPredicateEntry(delta, subject, object);
+    if (removedFromBase || removedFromDelta) {
+      (*tripleCount)--;
+    }
+  }
+
+  SnapshotPredicate *entry = malloc(sizeof(SnapshotPredicate));
+  if (view == NULL || delta->entryCount * PREDICATE_ENTRY_DELTA_MERGE_RATIO > view->entryCount || predicateEntryNeedsCompaction(view)) {
+    PredicateEntry *base = mergeSnapshotPredicate(predicate, view, delta);
+    if (view != NULL) {
+      freePredicateEntry(view);
+    }
+    freePredicateEntry(delta);
+    if (base->entryCount == 0) {
+      freePredicateEntry(base);
+      free(entry);
+      return NULL;
+    }
+    predicateEntryStatistics(base);
+    entry->base = base;
+    entry->view = createPredicateEntryView(base);
+    entry->delta = NULL;
+    return entry;
+  }
+
+  // readers only iterate published entries, so everything iterators would otherwise do lazily is done here
+  preparePredicateEntryForReading(view);
+  if (delta->sortedCount == 0 || predicateEntryNeedsCompaction(delta)) {
+    compactPredicateEntry(delta);
+  } else {
+    preparePredicateEntryForReading(delta);
+  }
+  if (delta->entryCount == 0) {
+    freePredicateEntry(delta);
+    delta = NULL;
+  } else {
+    predicateEntryStatistics(delta);
+  }
+  entry->base = published->base;
+  entry->view = view;
+  entry->delta = delta;
+  return entry;
+}
+
+unsigned long publishVersionedSegment(VersionedSegment *segment) {
+  SegmentSnapshot *published = segment->current;
+  if (segment->changeCount == 0) {
+    return published->version;
+  }
+  qsort(segment->changes, segment->changeCount, sizeof(SegmentChange), compareSegmentChanges);
+  unsigned long touchedCount = 0;
+  for (unsigned long i = 0; i < segment->changeCount; i++) {
+    touchedCount += i == 0 || predicateIdFromTriple(segment->changes[i].triple) != predicateIdFromTriple(segment->changes[i - 1].triple);
+  }
+
+  // a merge of the published predicates with the changed ones, sharing the predicates left alone
+  SegmentSnapshot *snapshot = createSegmentSnapshot(published->version + 1, published->predicateCount + touchedCount);
+  snapshot->tripleCount = published->tripleCount;
+  SnapshotPredicate **replaced = malloc(sizeof(SnapshotPredicate *) * touchedCount);
+  unsigned long replacedCount = 0;
+  PredicateEntry **replacedBases = malloc(sizeof(PredicateEntry *) * touchedCount);
+  unsigned long replacedBaseCount = 0;
+  unsigned long p = 0;
+  unsigned long c = 0;
+  while (p < published->predicateCount || c < segment->changeCount) {
+    PredicateId predicate = (c < segment->changeCount) ? predicateIdFromTriple(segment->changes[c].triple) : 0;
+    if (c == segment->changeCount || (p < published->predicateCount && published->predicates[p] < predicate)) {
+      snapshot->predicates[snapshot->predicateCount] = published->predicates[p];
+      snapshot->entries[snapshot->predicateCount++] = published->entries[p++];
+      continue;
+    }
+    unsigned long end = c;
+    while (end < segment->changeCount && predicateIdFromTriple(segment->changes[end].triple) == predicate) {
+      end++;
+    }
+    SnapshotPredicate *previous = NULL;
+    if (p < published->predicateCount && published->predicates[p] == predicate) {
+      previous = published->entries[p++];
+      replaced[replacedCount++] = previous;
+    }
+    SnapshotPredicate *entry = applySegmentChanges(predicate, previous, segment->changes + c, end - c, &snapshot->tripleCount);
+    if (previous != NULL && (entry == NULL || entry->base != previous->base)) {
+      replacedBases[replacedBaseCount++] = previous->base;
+    }
+    if (entry != NULL) {
+      snapshot->predicates[snapshot->predicateCount] = predicate;
+      snapshot->entries[snapshot->predicateCount++] = entry;
+    }
+    c = end;
+  }
+  segment->changeCount = 0;
+
+  // retiring bumps the epoch, so it has to follow the swap: readers that see the new epoch see the new snapshot
+  __atomic_store_n(&segment->current, snapshot, __ATOMIC_SEQ_CST);
+  retireEpochObject(segment->epochs, published, &freeSegmentSnapshot);
+  for (unsigned long i = 0; i < replacedCount; i++) {
+    retireEpochObject(segment->epochs, replaced[i], &freeSnapshotPredicate);
+  }
+  for (unsigned long i = 0; i < replacedBaseCount; i++) {
+    retireEpochObject(segment->epochs, replacedBases[i], &freeRetiredPredicateEntry);
+  }
+  free(replaced);
+  free(replacedBases);
+  reclaimEpochObjects(segment->epochs);
+  return snapshot->version;
+}
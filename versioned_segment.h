@@ -0,0 +1,84 @@
+#ifndef VERSIONED_SEGMENT_H_INCLUDED
+#define VERSIONED_SEGMENT_H_INCLUDED
+
+#include "triple.h"
+#include "iterator.h"
+#include "predicate_entry.h"
+#include "epoch.h"
+
+/*
+  Snapshot reads alongside one writer. Readers see the graph as a SegmentSnapshot, an immutable
+  set of predicates that is published whole, so a reader never sees half a batch and never waits for
+  the writer. The writer queues additions and removals and publishes them as a new snapshot: each
+  predicate the batch touches gets a new version, and every other one is shared with the previous
+  snapshot. The replaced snapshot and versions are retired through an EpochDomain and freed once the
+  last reader that could hold them has ended its snapshot. Published entries are prepared for
+  reading, so iterating them never writes to them.
+
+  A predicate's versions share one sorted base. A version holds a view of the base with its own
+  removals from it, and a delta entry with the pairs added since the base was built, so publishing a
+  small batch copies the delta and the removals but never the base. Once the delta outgrows
+  1/PREDICATE_ENTRY_DELTA_MERGE_RATIO of the base, or the removals call for compaction, the batch
+  merges everything into a new base, which the replaced one is retired for.
+*/
+
+typedef struct {
+  // the sorted pairs, shared by the versions since it was built and never changed once published
+  PredicateEntry *base;
+  // this version's removals from base, over base's borrowed pairs
+  PredicateEntry *view;
+  // the pairs added since base was built, with this version's removals from them; NULL when there are none
+  PredicateEntry *delta;
+} SnapshotPredicate;
+
+typedef struct {
+  unsigned long version;
+  // ascending, entries[i] holding the triples of predicates[i]
+  PredicateId *predicates;
+  SnapshotPredicate **entries;
+  unsigned long predicateCount;
+  unsigned long tripleCount;
+} SegmentSnapshot;
+
+typedef struct {
+  Triple triple;
+  BOOL removal;
+  // position in the batch, so a predicate's changes are applied in the order they were made
+  unsigned long sequence;
+} SegmentChange;
+
+typedef struct {
+  // the snapshot readers begin on
+  SegmentSnapshot *current;
+  EpochDomain *epochs;
+  // the writer's changes since the last publish
+  SegmentChange *changes;
+  unsigned long changeCount;
+  unsigned long currentChangesLength;
+} VersionedSegment;
+
+VersionedSegment *createVersionedSegment();
+// no reader may be inside a snapshot
+void freeVersionedSegment(VersionedSegment *segment);
+
+// one registration per reader thread, see registerEpochReader; -1 when every slot is taken
+int registerSnapshotReader(VersionedSegment *segment);
+void unregisterSnapshotReader(VersionedSegment *segment, int reader);
+// the snapshot and its entries stay valid and unchanged until endSnapshot; free its iterators before that
+SegmentSnapshot *beginSnapshot(VersionedSegment *segment, int reader);
+void endSnapshot(VersionedSegment *segment, int reader);
+
+// returns NULL when the predicate has no triples in the snapshot
+SnapshotPredicate *getSnapshotPredicate(SegmentSnapshot *snapshot, PredicateId predicate);
+// the view, or the view merged with the delta when there is one, in subject order
+Iterator *createSnapshotPredicateIterator(SegmentSnapshot *snapshot, PredicateId predicate);
+BOOL hasSnapshotTriple(SegmentSnapshot *snapshot, SubjectId subject, PredicateId predicate, ObjectId object);
+
+// the writer: one thread at a time, whose changes readers see once they are published
+void addTripleToVersionedSegment(VersionedSegment *segment, Triple triple);
+// removing a triple that is not there is a no-op, as for removeTripleFromSegment
+void removeTripleFromVersionedSegment(VersionedSegment *segment, Triple triple);
+// publishes the changes as the next snapshot, frees what no reader can hold any more and returns the new version
+unsigned long publishVersionedSegment(VersionedSegment *segment);
+
+#endif